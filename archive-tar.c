@@ -15,6 +15,7 @@
 #include "strbuf.h"
 #include "streaming.h"
 #include "run-command.h"
+#include "thread-utils.h"
 #include "write-or-die.h"
 
 #define RECORDSIZE	(512)
@@ -24,6 +25,7 @@ static char block[BLOCKSIZE];
 static unsigned long offset;
 
 static int tar_umask = 002;
+static int tgz_threads = 1;
 
 static int write_tar_filter_archive(const struct archiver *ar,
 				    struct archiver_args *args);
@@ -427,6 +429,14 @@ static int git_tar_config(const char *var, const char *value,
 		return 0;
 	}
 
+	if (!strcmp(var, "tar.gzipthreads")) {
+		tgz_threads = git_config_int(var, value, ctx->kvi);
+		if (tgz_threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    tgz_threads, var);
+		return 0;
+	}
+
 	return tar_filter_config(var, value, cb);
 }
 
@@ -470,6 +480,272 @@ static void tgz_write_block(const void *data)
 
 static const char internal_gzip_command[] = "git archive gzip";
 
+/*
+ * Block-parallel gzip, used by the internal gzip implementation unless
+ * tar.gzipThreads is 1.  The tar stream is cut into chunks of
+ * TGZ_CHUNK_SIZE bytes that are compressed independently into raw
+ * deflate data, each primed with the last TGZ_DICT_SIZE bytes of the
+ * preceding chunk so that little compression is lost at the seams.
+ * Every chunk but the last ends with a sync flush, which leaves it on a
+ * byte boundary, and the compressed chunks are written out in order
+ * between a gzip header and trailer of our own.  The chunk boundaries
+ * do not depend on the number of threads, so neither does the output.
+ */
+#define TGZ_CHUNK_SIZE (128 * 1024)
+#define TGZ_DICT_SIZE (32 * 1024)
+
+struct tgz_chunk {
+	/* dictionary followed by the data to compress */
+	unsigned char *buf;
+	size_t dict_len;
+	size_t len;
+	struct strbuf out;
+	uint32_t crc;
+	int last;
+	int done;
+};
+
+static struct tgz_pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	pthread_t *threads;
+	int nr_threads;
+	int level;
+	int finished;
+
+	/* ring of chunks, indexed by sequence number modulo nr */
+	struct tgz_chunk *chunks;
+	size_t nr;
+	size_t submitted, started, written;
+	struct tgz_chunk *filling;
+
+	uint32_t crc;
+	uint32_t isize;
+} tgz_pool;
+
+static struct tgz_chunk *tgz_chunk_at(size_t seq)
+{
+	return &tgz_pool.chunks[seq % tgz_pool.nr];
+}
+
+static void tgz_compress_chunk(struct tgz_chunk *c)
+{
+	git_zstream stream;
+	int flush = c->last ? Z_FINISH : Z_SYNC_FLUSH;
+	int status;
+
+	memset(&stream, 0, sizeof(stream));
+	git_deflate_init_raw(&stream, tgz_pool.level);
+	if (c->dict_len &&
+	    deflateSetDictionary(&stream.z, c->buf, c->dict_len) != Z_OK)
+		BUG("deflateSetDictionary() failed");
+
+	stream.next_in = c->buf + c->dict_len;
+	stream.avail_in = c->len;
+	strbuf_reset(&c->out);
+	for (;;) {
+		strbuf_grow(&c->out, git_deflate_bound(&stream, stream.avail_in) + 16);
+		stream.next_out = (unsigned char *)c->out.buf + c->out.len;
+		stream.avail_out = strbuf_avail(&c->out);
+		status = git_deflate(&stream, flush);
+		strbuf_setlen(&c->out, (char *)stream.next_out - c->out.buf);
+		if (status != Z_OK && status != Z_BUF_ERROR &&
+		    status != Z_STREAM_END)
+			die(_("deflate error (%d)"), status);
+		if (c->last ? status == Z_STREAM_END :
+		    !stream.avail_in && stream.avail_out)
+			break;
+	}
+	/* all but the last stream are left unfinished on purpose */
+	git_deflate_abort(&stream);
+
+	c->crc = crc32(crc32(0, NULL, 0), c->buf + c->dict_len, c->len);
+}
+
+static void *tgz_worker(void *data UNUSED)
+{
+	pthread_mutex_lock(&tgz_pool.mutex);
+	for (;;) {
+		struct tgz_chunk *c;
+
+		while (tgz_pool.started == tgz_pool.submitted &&
+		       !tgz_pool.finished)
+			pthread_cond_wait(&tgz_pool.work_cond, &tgz_pool.mutex);
+		if (tgz_pool.started == tgz_pool.submitted)
+			break;
+
+		c = tgz_chunk_at(tgz_pool.started++);
+		pthread_mutex_unlock(&tgz_pool.mutex);
+		tgz_compress_chunk(c);
+		pthread_mutex_lock(&tgz_pool.mutex);
+		c->done = 1;
+		pthread_cond_broadcast(&tgz_pool.done_cond);
+	}
+	pthread_mutex_unlock(&tgz_pool.mutex);
+	return NULL;
+}
+
+/* waits for the oldest chunk in flight and writes it out */
+static void tgz_write_chunk(void)
+{
+	struct tgz_chunk *c = tgz_chunk_at(tgz_pool.written);
+
+	pthread_mutex_lock(&tgz_pool.mutex);
+	while (!c->done)
+		pthread_cond_wait(&tgz_pool.done_cond, &tgz_pool.mutex);
+	pthread_mutex_unlock(&tgz_pool.mutex);
+
+	write_or_die(1, c->out.buf, c->out.len);
+	tgz_pool.crc = crc32_combine(tgz_pool.crc, c->crc, c->len);
+	tgz_pool.isize += c->len;
+	tgz_pool.written++;
+}
+
+static struct tgz_chunk *tgz_start_chunk(void)
+{
+	struct tgz_chunk *c;
+
+	if (tgz_pool.submitted == tgz_pool.written + tgz_pool.nr)
+		tgz_write_chunk();
+
+	c = tgz_chunk_at(tgz_pool.submitted);
+	c->dict_len = 0;
+	if (tgz_pool.submitted) {
+		struct tgz_chunk *prev = tgz_chunk_at(tgz_pool.submitted - 1);
+		c->dict_len = prev->len < TGZ_DICT_SIZE ? prev->len : TGZ_DICT_SIZE;
+		memcpy(c->buf, prev->buf + prev->dict_len + prev->len - c->dict_len,
+		       c->dict_len);
+	}
+	c->len = 0;
+	c->last = 0;
+	c->done = 0;
+	return tgz_pool.filling = c;
+}
+
+static void tgz_submit_chunk(struct tgz_chunk *c)
+{
+	tgz_pool.filling = NULL;
+	if (!tgz_pool.nr_threads) {
+		tgz_compress_chunk(c);
+		c->done = 1;
+		tgz_pool.submitted++;
+		return;
+	}
+
+	pthread_mutex_lock(&tgz_pool.mutex);
+	tgz_pool.submitted++;
+	pthread_cond_signal(&tgz_pool.work_cond);
+	pthread_mutex_unlock(&tgz_pool.mutex);
+}
+
+static void tgz_parallel_write_block(const void *data)
+{
+	const unsigned char *buf = data;
+	size_t size = BLOCKSIZE;
+
+	while (size) {
+		struct tgz_chunk *c = tgz_pool.filling;
+		size_t chunk;
+
+		if (!c)
+			c = tgz_start_chunk();
+		chunk = TGZ_CHUNK_SIZE - c->len;
+		if (size < chunk)
+			chunk = size;
+		memcpy(c->buf + c->dict_len + c->len, buf, chunk);
+		c->len += chunk;
+		buf += chunk;
+		size -= chunk;
+		if (c->len == TGZ_CHUNK_SIZE)
+			tgz_submit_chunk(c);
+	}
+}
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static int write_parallel_tgz_archive(const struct archiver *ar,
+				      struct archiver_args *args)
+{
+	/* no name, no mtime, OS is Unix, for reproducibility */
+	unsigned char header[10] = { 0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 3 };
+	unsigned char trailer[8];
+	struct tgz_chunk *c;
+	int nr_threads = tgz_threads ? tgz_threads : online_cpus();
+	int r;
+
+	if (!HAVE_THREADS)
+		nr_threads = 0;
+
+	memset(&tgz_pool, 0, sizeof(tgz_pool));
+	tgz_pool.level = args->compression_level;
+	tgz_pool.nr_threads = nr_threads;
+	tgz_pool.nr = nr_threads > 1 ? 2 * nr_threads : 2;
+	tgz_pool.crc = crc32(0, NULL, 0);
+	CALLOC_ARRAY(tgz_pool.chunks, tgz_pool.nr);
+	for (size_t i = 0; i < tgz_pool.nr; i++) {
+		tgz_pool.chunks[i].buf = xmalloc(TGZ_DICT_SIZE + TGZ_CHUNK_SIZE);
+		strbuf_init(&tgz_pool.chunks[i].out, 0);
+	}
+
+	if (nr_threads) {
+		pthread_mutex_init(&tgz_pool.mutex, NULL);
+		pthread_cond_init(&tgz_pool.work_cond, NULL);
+		pthread_cond_init(&tgz_pool.done_cond, NULL);
+		CALLOC_ARRAY(tgz_pool.threads, nr_threads);
+		for (int i = 0; i < nr_threads; i++)
+			if (pthread_create(&tgz_pool.threads[i], NULL,
+					   tgz_worker, NULL))
+				die(_("unable to create thread"));
+	}
+
+	/* the same extra flags as zlib would set in its header */
+	if (tgz_pool.level == Z_BEST_COMPRESSION)
+		header[8] = 2;
+	else if (tgz_pool.level == Z_NO_COMPRESSION ||
+		 tgz_pool.level == Z_BEST_SPEED)
+		header[8] = 4;
+	write_or_die(1, header, sizeof(header));
+
+	write_block = tgz_parallel_write_block;
+	r = write_tar_archive(ar, args);
+
+	c = tgz_pool.filling ? tgz_pool.filling : tgz_start_chunk();
+	c->last = 1;
+	tgz_submit_chunk(c);
+	while (tgz_pool.written < tgz_pool.submitted)
+		tgz_write_chunk();
+
+	put_le32(trailer, tgz_pool.crc);
+	put_le32(trailer + 4, tgz_pool.isize);
+	write_or_die(1, trailer, sizeof(trailer));
+
+	if (nr_threads) {
+		pthread_mutex_lock(&tgz_pool.mutex);
+		tgz_pool.finished = 1;
+		pthread_cond_broadcast(&tgz_pool.work_cond);
+		pthread_mutex_unlock(&tgz_pool.mutex);
+		for (int i = 0; i < nr_threads; i++)
+			pthread_join(tgz_pool.threads[i], NULL);
+		free(tgz_pool.threads);
+		pthread_cond_destroy(&tgz_pool.done_cond);
+		pthread_cond_destroy(&tgz_pool.work_cond);
+		pthread_mutex_destroy(&tgz_pool.mutex);
+	}
+	for (size_t i = 0; i < tgz_pool.nr; i++) {
+		free(tgz_pool.chunks[i].buf);
+		strbuf_release(&tgz_pool.chunks[i].out);
+	}
+	free(tgz_pool.chunks);
+	return r;
+}
+
 static int write_tar_filter_archive(const struct archiver *ar,
 				    struct archiver_args *args)
 {
@@ -481,6 +757,10 @@ static int write_tar_filter_archive(const struct archiver *ar,
 	if (!ar->filter_command)
 		BUG("tar-filter archiver called with no filter defined");
 
+	if (!strcmp(ar->filter_command, internal_gzip_command) &&
+	    tgz_threads != 1)
+		return write_parallel_tgz_archive(ar, args);
+
 	if (!strcmp(ar->filter_command, internal_gzip_command)) {
 		write_block = tgz_write_block;
 		git_deflate_init_gzip(&gzstream, args->compression_level);
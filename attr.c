@@ -434,12 +434,200 @@ struct attr_stack {
 	unsigned num_matches;
 	unsigned alloc;
 	struct match_attr **attrs;
+
+	/*
+	 * Set up by compile_attr_stack() when the frame is pushed, after
+	 * which its rules do not change: the macro definitions among the
+	 * rules, and for long frames an index of the patterns.
+	 */
+	unsigned num_macros;
+	struct match_attr **macros;
+	struct attr_index *index;
+};
+
+/*
+ * Frames shorter than this are scanned as they are; generated
+ * .gitattributes files, e.g. listing the files kept in LFS one by
+ * one, can be thousands of lines long, though.
+ */
+#define ATTR_INDEX_MIN 32
+
+/*
+ * Like the index of long exclude lists in dir.c: a pattern that is a
+ * literal name, a "*suffix", or a literal path can only match a path
+ * whose basename, basename suffix or whole path is that string. Such
+ * patterns are put in hash tables keyed by that string, and the
+ * positions of the rules with the same key are kept in increasing
+ * order, as are those of the other (non-macro) rules.
+ */
+struct attr_index_entry {
+	struct hashmap_entry ent;
+	unsigned *pos;
+	unsigned nr, alloc;
+	size_t keylen;
+	char key[FLEX_ARRAY];
+};
+
+struct attr_index {
+	int ignore_case;
+
+	struct hashmap basenames;
+	struct hashmap suffixes;
+	struct hashmap paths;
+
+	/* distinct lengths of the "*suffix" patterns */
+	size_t *suffix_len;
+	size_t suffix_len_nr, suffix_len_alloc;
+
+	unsigned *other;
+	unsigned other_nr, other_alloc;
 };
 
+struct attr_index_key {
+	const char *key;
+	size_t keylen;
+};
+
+static int attr_index_entry_cmp(const void *cmp_data UNUSED,
+				const struct hashmap_entry *eptr,
+				const struct hashmap_entry *entry_or_key UNUSED,
+				const void *keydata)
+{
+	const struct attr_index_entry *e =
+		container_of(eptr, const struct attr_index_entry, ent);
+	const struct attr_index_key *k = keydata;
+
+	return e->keylen != k->keylen || fspathncmp(e->key, k->key, k->keylen);
+}
+
+static unsigned int attr_index_hash(const char *key, size_t keylen)
+{
+	return ignore_case ? memihash(key, keylen) : memhash(key, keylen);
+}
+
+static struct attr_index_entry *attr_index_get(const struct hashmap *map,
+					       const char *key, size_t keylen)
+{
+	struct attr_index_key k = { key, keylen };
+
+	return hashmap_get_entry_from_hash(map, attr_index_hash(key, keylen),
+					   &k, struct attr_index_entry, ent);
+}
+
+static void attr_index_add(struct hashmap *map, const char *key, size_t keylen,
+			   unsigned pos)
+{
+	struct attr_index_entry *e = attr_index_get(map, key, keylen);
+
+	if (!e) {
+		FLEX_ALLOC_MEM(e, key, key, keylen);
+		e->keylen = keylen;
+		hashmap_entry_init(&e->ent, attr_index_hash(key, keylen));
+		hashmap_add(map, &e->ent);
+	}
+	ALLOC_GROW(e->pos, e->nr + 1, e->alloc);
+	e->pos[e->nr++] = pos;
+}
+
+static void clear_attr_index_map(struct hashmap *map)
+{
+	struct hashmap_iter iter;
+	struct attr_index_entry *e;
+
+	hashmap_for_each_entry(map, &iter, e, ent)
+		free(e->pos);
+	hashmap_clear_and_free(map, struct attr_index_entry, ent);
+}
+
+static void attr_index_free(struct attr_index *index)
+{
+	if (!index)
+		return;
+	clear_attr_index_map(&index->basenames);
+	clear_attr_index_map(&index->suffixes);
+	clear_attr_index_map(&index->paths);
+	free(index->suffix_len);
+	free(index->other);
+	free(index);
+}
+
+static void index_attr_pattern(struct attr_index *index,
+			       const struct attr_stack *e, unsigned pos)
+{
+	const struct pattern *pat = &e->attrs[pos]->u.pat;
+	const char *p = pat->pattern;
+	size_t len = pat->patternlen;
+
+	if (pat->flags & PATTERN_FLAG_NODIR) {
+		if (pat->nowildcardlen == len) {
+			attr_index_add(&index->basenames, p, len, pos);
+			return;
+		}
+		if (pat->flags & PATTERN_FLAG_ENDSWITH) {
+			size_t i;
+
+			attr_index_add(&index->suffixes, p + 1, len - 1, pos);
+			for (i = 0; i < index->suffix_len_nr; i++)
+				if (index->suffix_len[i] == len - 1)
+					return;
+			ALLOC_GROW(index->suffix_len, index->suffix_len_nr + 1,
+				   index->suffix_len_alloc);
+			index->suffix_len[index->suffix_len_nr++] = len - 1;
+			return;
+		}
+	} else if (pat->nowildcardlen == len) {
+		/* see match_pathname() */
+		struct strbuf path = STRBUF_INIT;
+
+		if (*p == '/') {
+			p++;
+			len--;
+		}
+		if (e->originlen) {
+			strbuf_add(&path, e->origin, e->originlen);
+			strbuf_addch(&path, '/');
+		}
+		strbuf_add(&path, p, len);
+		attr_index_add(&index->paths, path.buf, path.len, pos);
+		strbuf_release(&path);
+		return;
+	}
+
+	ALLOC_GROW(index->other, index->other_nr + 1, index->other_alloc);
+	index->other[index->other_nr++] = pos;
+}
+
+static void compile_attr_stack(struct attr_stack *e)
+{
+	struct attr_index *index;
+	unsigned i, macros_alloc = 0;
+
+	for (i = 0; i < e->num_matches; i++) {
+		if (!e->attrs[i]->is_macro)
+			continue;
+		ALLOC_GROW_BY(e->macros, e->num_macros, 1, macros_alloc);
+		e->macros[e->num_macros - 1] = e->attrs[i];
+	}
+
+	if (e->num_matches < ATTR_INDEX_MIN)
+		return;
+	CALLOC_ARRAY(index, 1);
+	index->ignore_case = ignore_case;
+	hashmap_init(&index->basenames, attr_index_entry_cmp, NULL, 0);
+	hashmap_init(&index->suffixes, attr_index_entry_cmp, NULL, 0);
+	hashmap_init(&index->paths, attr_index_entry_cmp, NULL, 0);
+	for (i = 0; i < e->num_matches; i++)
+		if (!e->attrs[i]->is_macro)
+			index_attr_pattern(index, e, i);
+	e->index = index;
+}
+
 static void attr_stack_free(struct attr_stack *e)
 {
 	unsigned i;
 	free(e->origin);
+	free(e->macros);
+	attr_index_free(e->index);
 	for (i = 0; i < e->num_matches; i++) {
 		struct match_attr *a = e->attrs[i];
 		size_t j;
@@ -901,6 +1089,7 @@ static void push_stack(struct attr_stack **attr_stack_p,
 		elem->origin = origin;
 		if (origin)
 			elem->originlen = originlen;
+		compile_attr_stack(elem);
 		elem->prev = *attr_stack_p;
 		*attr_stack_p = elem;
 	}
@@ -1085,21 +1274,126 @@ static int fill_one(struct all_attrs_item *all_attrs,
 	return rem;
 }
 
+/*
+ * With a check for specific attributes, the rules that are further
+ * down the stack cannot change the value of an attribute that is known
+ * already.
+ */
+static int wanted_attrs_known(const struct attr_check *check)
+{
+	int i;
+
+	if (!check->nr)
+		return 0;
+	for (i = 0; i < check->nr; i++) {
+		unsigned int n = check->items[i].attr->attr_nr;
+
+		if (check->all_attrs[n].value == ATTR__UNKNOWN)
+			return 0;
+	}
+	return 1;
+}
+
+static int fill_rule(const char *path, int pathlen, int basename_offset,
+		     const struct attr_stack *stack, const struct match_attr *a,
+		     struct attr_check *check, int rem)
+{
+	const char *base = stack->origin ? stack->origin : "";
+
+	if (!path_matches(path, pathlen, basename_offset,
+			  &a->u.pat, base, stack->originlen))
+		return rem;
+	rem = fill_one(check->all_attrs, a, rem);
+	return wanted_attrs_known(check) ? 0 : rem;
+}
+
+struct attr_pos_list {
+	const unsigned *pos;
+	unsigned nr;
+};
+
+static void add_pos_list(struct attr_pos_list *lists, size_t *nr,
+			 const struct attr_index_entry *e)
+{
+	if (!e)
+		return;
+	lists[*nr].pos = e->pos;
+	lists[*nr].nr = e->nr;
+	(*nr)++;
+}
+
+/*
+ * Try the rules the index of the frame points at for "path", and the
+ * ones it does not cover, from the last one to the first.
+ */
+static int fill_indexed(const char *path, int pathlen, int basename_offset,
+			const struct attr_stack *stack,
+			struct attr_check *check, int rem)
+{
+	const struct attr_index *index = stack->index;
+	int isdir = pathlen && path[pathlen - 1] == '/';
+	const char *basename = path + basename_offset;
+	size_t basenamelen = pathlen - basename_offset - isdir;
+	struct attr_pos_list lists_buf[8], *lists = lists_buf;
+	size_t nr = 0, i;
+
+	if (3 + index->suffix_len_nr > ARRAY_SIZE(lists_buf))
+		ALLOC_ARRAY(lists, 3 + index->suffix_len_nr);
+
+	add_pos_list(lists, &nr, attr_index_get(&index->basenames,
+						basename, basenamelen));
+	for (i = 0; i < index->suffix_len_nr; i++) {
+		size_t len = index->suffix_len[i];
+
+		if (len <= basenamelen)
+			add_pos_list(lists, &nr,
+				     attr_index_get(&index->suffixes,
+						    basename + basenamelen - len,
+						    len));
+	}
+	add_pos_list(lists, &nr, attr_index_get(&index->paths,
+						path, pathlen - isdir));
+	lists[nr].pos = index->other;
+	lists[nr].nr = index->other_nr;
+	nr++;
+
+	while (rem > 0) {
+		struct attr_pos_list *best = NULL;
+
+		for (i = 0; i < nr; i++)
+			if (lists[i].nr &&
+			    (!best || lists[i].pos[lists[i].nr - 1] >
+				      best->pos[best->nr - 1]))
+				best = &lists[i];
+		if (!best)
+			break;
+		rem = fill_rule(path, pathlen, basename_offset, stack,
+				stack->attrs[best->pos[--best->nr]], check, rem);
+	}
+
+	if (lists != lists_buf)
+		free(lists);
+	return rem;
+}
+
 static int fill(const char *path, int pathlen, int basename_offset,
 		const struct attr_stack *stack,
-		struct all_attrs_item *all_attrs, int rem)
+		struct attr_check *check, int rem)
 {
 	for (; rem > 0 && stack; stack = stack->prev) {
 		unsigned i;
-		const char *base = stack->origin ? stack->origin : "";
 
+		if (stack->index && stack->index->ignore_case == ignore_case) {
+			rem = fill_indexed(path, pathlen, basename_offset,
+					   stack, check, rem);
+			continue;
+		}
 		for (i = stack->num_matches; 0 < rem && 0 < i; i--) {
 			const struct match_attr *a = stack->attrs[i - 1];
 			if (a->is_macro)
 				continue;
-			if (path_matches(path, pathlen, basename_offset,
-					 &a->u.pat, base, stack->originlen))
-				rem = fill_one(all_attrs, a, rem);
+			rem = fill_rule(path, pathlen, basename_offset,
+					stack, a, check, rem);
 		}
 	}
 
@@ -1126,13 +1420,11 @@ static void determine_macros(struct all_attrs_item *all_attrs,
 {
 	for (; stack; stack = stack->prev) {
 		unsigned i;
-		for (i = stack->num_matches; i > 0; i--) {
-			const struct match_attr *ma = stack->attrs[i - 1];
-			if (ma->is_macro) {
-				unsigned int n = ma->u.attr->attr_nr;
-				if (!all_attrs[n].macro) {
-					all_attrs[n].macro = ma;
-				}
+		for (i = stack->num_macros; i > 0; i--) {
+			const struct match_attr *ma = stack->macros[i - 1];
+			unsigned int n = ma->u.attr->attr_nr;
+			if (!all_attrs[n].macro) {
+				all_attrs[n].macro = ma;
 			}
 		}
 	}
@@ -1169,7 +1461,7 @@ static void collect_some_attrs(struct index_state *istate,
 	determine_macros(check->all_attrs, check->stack);
 
 	rem = check->all_attrs_nr;
-	fill(path, pathlen, basename_offset, check->stack, check->all_attrs, rem);
+	fill(path, pathlen, basename_offset, check->stack, check, rem);
 }
 
 static const char *default_attr_source_tree_object_name;
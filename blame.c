@@ -10,13 +10,17 @@
 #include "convert.h"
 #include "diff.h"
 #include "diffcore.h"
+#include "dir.h"
 #include "gettext.h"
 #include "hex.h"
+#include "lockfile.h"
 #include "path.h"
+#include "quote.h"
 #include "read-cache.h"
 #include "revision.h"
 #include "setup.h"
 #include "tag.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "blame.h"
 #include "alloc.h"
@@ -2031,6 +2035,18 @@ static void copy_split_if_better(struct blame_scoreboard *sb,
 	memcpy(best_so_far, potential, sizeof(struct blame_entry[3]));
 }
 
+/*
+ * The best piece of a blame_entry found so far that could be blamed on
+ * another file: what split_overlap(split, ent, tlno, plno, same, ...)
+ * would hand to the file with index "file" in the files searched.
+ * "file" is -1 if nothing was found.
+ */
+struct copy_match {
+	int file;
+	int tlno, plno, same;
+	unsigned score;
+};
+
 /*
  * We are looking at a part of the final image represented by
  * ent (tlno and same are offset by ent->s_lno).
@@ -2045,30 +2061,52 @@ static void copy_split_if_better(struct blame_scoreboard *sb,
  *         ^plno
  *
  * All line numbers are 0-based.
+ *
+ * Like copy_split_if_better(), a later piece replaces an earlier one
+ * with the same score. This must not touch the refcounts of origins, as
+ * it is run from several threads at once.
  */
 static void handle_split(struct blame_scoreboard *sb,
 			 struct blame_entry *ent,
 			 int tlno, int plno, int same,
-			 struct blame_origin *parent,
-			 struct blame_entry *split)
+			 int file, struct copy_match *best)
 {
-	if (ent->num_lines <= tlno)
+	struct blame_entry potential = { 0 };
+	int chunk_end_lno;
+	unsigned score;
+
+	if (ent->num_lines <= tlno || same <= tlno)
 		return;
-	if (tlno < same) {
-		struct blame_entry potential[3];
-		tlno += ent->s_lno;
-		same += ent->s_lno;
-		split_overlap(potential, ent, tlno, plno, same, parent);
-		copy_split_if_better(sb, split, potential);
-		decref_split(potential);
-	}
+	tlno += ent->s_lno;
+	same += ent->s_lno;
+
+	/* the middle part of what split_overlap() would make */
+	potential.lno = ent->lno;
+	if (ent->s_lno < tlno)
+		potential.lno += tlno - ent->s_lno;
+	if (same < ent->s_lno + ent->num_lines)
+		chunk_end_lno = ent->lno + (same - ent->s_lno);
+	else
+		chunk_end_lno = ent->lno + ent->num_lines;
+	potential.num_lines = chunk_end_lno - potential.lno;
+	if (potential.num_lines < 1)
+		return;
+
+	score = blame_entry_score(sb, &potential);
+	if (best->file >= 0 && score < best->score)
+		return;
+	best->file = file;
+	best->tlno = tlno;
+	best->plno = plno;
+	best->same = same;
+	best->score = score;
 }
 
 struct handle_split_cb_data {
 	struct blame_scoreboard *sb;
 	struct blame_entry *ent;
-	struct blame_origin *parent;
-	struct blame_entry *split;
+	int file;
+	struct copy_match *best;
 	long plno;
 	long tlno;
 };
@@ -2077,30 +2115,29 @@ static int handle_split_cb(long start_a, long count_a,
 			   long start_b, long count_b, void *data)
 {
 	struct handle_split_cb_data *d = data;
-	handle_split(d->sb, d->ent, d->tlno, d->plno, start_b, d->parent,
-		     d->split);
+	handle_split(d->sb, d->ent, d->tlno, d->plno, start_b, d->file,
+		     d->best);
 	d->plno = start_a + count_a;
 	d->tlno = start_b + count_b;
 	return 0;
 }
 
 /*
- * Find the lines from parent that are the same as ent so that
- * we can pass blames to it.  file_p has the blob contents for
- * the parent.
+ * Find the lines from file_p that are the same as ent, and update
+ * "best" if they make a better piece of ent to pass blame for.
  */
 static void find_copy_in_blob(struct blame_scoreboard *sb,
 			      struct blame_entry *ent,
-			      struct blame_origin *parent,
-			      struct blame_entry *split,
-			      mmfile_t *file_p)
+			      struct commit *parent,
+			      int file, mmfile_t *file_p,
+			      struct copy_match *best)
 {
 	const char *cp;
 	mmfile_t file_o;
 	struct handle_split_cb_data d;
 
 	memset(&d, 0, sizeof(d));
-	d.sb = sb; d.ent = ent; d.parent = parent; d.split = split;
+	d.sb = sb; d.ent = ent; d.file = file; d.best = best;
 	/*
 	 * Prepare mmfile that contains only the lines in ent.
 	 */
@@ -2112,12 +2149,129 @@ static void find_copy_in_blob(struct blame_scoreboard *sb,
 	 * file_o is a part of final image we are annotating.
 	 * file_p partially may match that image.
 	 */
-	memset(split, 0, sizeof(struct blame_entry [3]));
 	if (diff_hunks(file_p, &file_o, handle_split_cb, &d, sb->xdl_opts))
 		die("unable to generate diff (%s)",
-		    oid_to_hex(&parent->commit->object.oid));
+		    oid_to_hex(&parent->object.oid));
 	/* remainder, if any, all match the preimage */
-	handle_split(sb, ent, d.tlno, d.plno, ent->num_lines, parent, split);
+	handle_split(sb, ent, d.tlno, d.plno, ent->num_lines, file, best);
+}
+
+/*
+ * Searching for copies compares each of a number of blame entries with
+ * each of a number of files, looking at the files in order. The entries
+ * are independent, and so are ranges of files, so this is cut into
+ * tasks of one entry and a range of files that threads can take on.
+ */
+struct copy_search {
+	struct blame_scoreboard *sb;
+	struct blame_entry **ents;
+	int nr_ents;
+	struct commit *parent; /* the files are in */
+	mmfile_t *files;
+	int nr_files;
+	int nr_ranges;
+	struct copy_match *matches; /* nr_ents * nr_ranges */
+
+	pthread_mutex_t mutex;
+	int next_task;
+};
+
+static void run_copy_search_task(struct copy_search *cs, int task)
+{
+	int ent = task / cs->nr_ranges, range = task % cs->nr_ranges;
+	int per_range = DIV_ROUND_UP(cs->nr_files, cs->nr_ranges);
+	int end = per_range * (range + 1);
+	struct copy_match *m = &cs->matches[task];
+
+	m->file = -1;
+	if (end > cs->nr_files)
+		end = cs->nr_files;
+	for (int i = per_range * range; i < end; i++)
+		find_copy_in_blob(cs->sb, cs->ents[ent], cs->parent, i,
+				  &cs->files[i], m);
+}
+
+static void *copy_search_thread(void *data)
+{
+	struct copy_search *cs = data;
+
+	for (;;) {
+		int task;
+
+		pthread_mutex_lock(&cs->mutex);
+		task = cs->next_task++;
+		pthread_mutex_unlock(&cs->mutex);
+		if (task >= cs->nr_ents * cs->nr_ranges)
+			break;
+		run_copy_search_task(cs, task);
+	}
+	return NULL;
+}
+
+/* How many files find_copy_in_parent() reads before searching them. */
+#define COPY_SEARCH_BATCH 64
+
+/* Below this many entry and file pairs, threads are not worth starting. */
+#define COPY_SEARCH_MIN_PAIRS_PER_THREAD 16
+
+/*
+ * Find the best piece of each of "ents" to blame on one of "files" of
+ * "parent", storing it in "best".
+ */
+static void find_best_copies(struct blame_scoreboard *sb,
+			     struct blame_entry **ents, int nr_ents,
+			     struct commit *parent,
+			     mmfile_t *files, int nr_files,
+			     struct copy_match *best)
+{
+	struct copy_search cs = {
+		.sb = sb,
+		.ents = ents,
+		.nr_ents = nr_ents,
+		.parent = parent,
+		.files = files,
+		.nr_files = nr_files,
+		.nr_ranges = 1,
+	};
+	int nr_threads = sb->num_threads;
+
+	if (nr_threads > nr_ents * nr_files / COPY_SEARCH_MIN_PAIRS_PER_THREAD)
+		nr_threads = nr_ents * nr_files / COPY_SEARCH_MIN_PAIRS_PER_THREAD;
+	/* with few entries, let each thread look at some of the files */
+	if (nr_threads > 1 && nr_ents < 4 * nr_threads)
+		cs.nr_ranges = nr_files < nr_threads ? nr_files : nr_threads;
+	CALLOC_ARRAY(cs.matches, st_mult(nr_ents, cs.nr_ranges));
+
+	if (nr_threads > 1) {
+		pthread_t *threads;
+
+		ALLOC_ARRAY(threads, nr_threads);
+		pthread_mutex_init(&cs.mutex, NULL);
+		for (int i = 0; i < nr_threads; i++)
+			if (pthread_create(&threads[i], NULL,
+					   copy_search_thread, &cs))
+				die(_("unable to create thread"));
+		for (int i = 0; i < nr_threads; i++)
+			pthread_join(threads[i], NULL);
+		pthread_mutex_destroy(&cs.mutex);
+		free(threads);
+	} else {
+		for (int i = 0; i < nr_ents * cs.nr_ranges; i++)
+			run_copy_search_task(&cs, i);
+	}
+
+	/* later ranges win ties, as later files do within a range */
+	for (int i = 0; i < nr_ents; i++) {
+		best[i].file = -1;
+		for (int r = 0; r < cs.nr_ranges; r++) {
+			struct copy_match *m = &cs.matches[i * cs.nr_ranges + r];
+
+			if (m->file >= 0 &&
+			    (best[i].file < 0 || m->score >= best[i].score))
+				best[i] = *m;
+		}
+	}
+	free(cs.matches);
 }
 
 /* Move all blame entries from list *source that have a score smaller
@@ -2161,6 +2315,9 @@ static void find_move_in_parent(struct blame_scoreboard *sb,
 	struct blame_entry *e, split[3];
 	struct blame_entry *unblamed = target->suspects;
 	struct blame_entry *leftover = NULL;
+	struct blame_entry **ents = NULL;
+	struct copy_match *best = NULL;
+	int nr, alloc = 0;
 	mmfile_t file_p;
 
 	if (!unblamed)
@@ -2178,10 +2335,21 @@ static void find_move_in_parent(struct blame_scoreboard *sb,
 	 */
 	do {
 		struct blame_entry **unblamedtail = &unblamed;
-		struct blame_entry *next;
-		for (e = unblamed; e; e = next) {
-			next = e->next;
-			find_copy_in_blob(sb, e, parent, split, &file_p);
+
+		for (e = unblamed, nr = 0; e; e = e->next) {
+			ALLOC_GROW(ents, nr + 1, alloc);
+			ents[nr++] = e;
+		}
+		REALLOC_ARRAY(best, alloc);
+		find_best_copies(sb, ents, nr, parent->commit, &file_p, 1, best);
+
+		for (int i = 0; i < nr; i++) {
+			e = ents[i];
+			memset(split, 0, sizeof(split));
+			if (best[i].file >= 0)
+				split_overlap(split, e, best[i].tlno,
+					      best[i].plno, best[i].same,
+					      parent);
 			if (split[1].suspect &&
 			    sb->move_score < blame_entry_score(sb, &split[1])) {
 				split_blame(blamed, &unblamedtail, split, e);
@@ -2195,6 +2363,8 @@ static void find_move_in_parent(struct blame_scoreboard *sb,
 		toosmall = filter_small(sb, toosmall, &unblamed, sb->move_score);
 	} while (unblamed);
 	target->suspects = reverse_blame(leftover, NULL);
+	free(ents);
+	free(best);
 }
 
 struct blame_list {
@@ -2243,6 +2413,8 @@ static void find_copy_in_parent(struct blame_scoreboard *sb,
 	int num_ents;
 	struct blame_entry *unblamed = target->suspects;
 	struct blame_entry *leftover = NULL;
+	struct blame_entry **ents;
+	struct copy_match *best;
 
 	if (!unblamed)
 		return; /* nothing remains for this target */
@@ -2278,38 +2450,66 @@ static void find_copy_in_parent(struct blame_scoreboard *sb,
 	do {
 		struct blame_entry **unblamedtail = &unblamed;
 		blame_list = setup_blame_list(unblamed, &num_ents);
+		ALLOC_ARRAY(ents, num_ents);
+		ALLOC_ARRAY(best, num_ents);
+		for (j = 0; j < num_ents; j++)
+			ents[j] = blame_list[j].ent;
 
-		for (i = 0; i < diff_queued_diff.nr; i++) {
-			struct diff_filepair *p = diff_queued_diff.queue[i];
-			struct blame_origin *norigin;
-			mmfile_t file_p;
-			struct blame_entry potential[3];
-
-			if (!DIFF_FILE_VALID(p->one))
-				continue; /* does not exist in parent */
-			if (S_ISGITLINK(p->one->mode))
-				continue; /* ignore git links */
-			if (porigin && !strcmp(p->one->path, porigin->path))
-				/* find_move already dealt with this path */
-				continue;
+		for (i = 0; i < diff_queued_diff.nr; ) {
+			struct blame_origin *norigins[COPY_SEARCH_BATCH];
+			mmfile_t files[COPY_SEARCH_BATCH];
+			int nr_files = 0;
 
-			norigin = get_origin(parent, p->one->path);
-			oidcpy(&norigin->blob_oid, &p->one->oid);
-			norigin->mode = p->one->mode;
-			fill_origin_blob(&sb->revs->diffopt, norigin, &file_p,
-					 &sb->num_read_blob, 0);
-			if (!file_p.ptr)
-				continue;
+			/*
+			 * Read a batch of files to search in, so that their
+			 * blobs need not all be in memory at once.
+			 */
+			for (; i < diff_queued_diff.nr && nr_files < COPY_SEARCH_BATCH; i++) {
+				struct diff_filepair *p = diff_queued_diff.queue[i];
+				struct blame_origin *norigin;
+
+				if (!DIFF_FILE_VALID(p->one))
+					continue; /* does not exist in parent */
+				if (S_ISGITLINK(p->one->mode))
+					continue; /* ignore git links */
+				if (porigin && !strcmp(p->one->path, porigin->path))
+					/* find_move already dealt with this path */
+					continue;
+
+				norigin = get_origin(parent, p->one->path);
+				oidcpy(&norigin->blob_oid, &p->one->oid);
+				norigin->mode = p->one->mode;
+				fill_origin_blob(&sb->revs->diffopt, norigin,
+						 &files[nr_files],
+						 &sb->num_read_blob, 0);
+				if (!files[nr_files].ptr) {
+					blame_origin_decref(norigin);
+					continue;
+				}
+				norigins[nr_files++] = norigin;
+			}
+
+			find_best_copies(sb, ents, num_ents, parent, files,
+					 nr_files, best);
 
 			for (j = 0; j < num_ents; j++) {
-				find_copy_in_blob(sb, blame_list[j].ent,
-						  norigin, potential, &file_p);
+				struct blame_entry potential[3];
+
+				if (best[j].file < 0)
+					continue;
+				split_overlap(potential, blame_list[j].ent,
+					      best[j].tlno, best[j].plno,
+					      best[j].same,
+					      norigins[best[j].file]);
 				copy_split_if_better(sb, blame_list[j].split,
 						     potential);
 				decref_split(potential);
 			}
-			blame_origin_decref(norigin);
+			for (j = 0; j < nr_files; j++)
+				blame_origin_decref(norigins[j]);
 		}
+		free(ents);
+		free(best);
 
 		for (j = 0; j < num_ents; j++) {
 			struct blame_entry *split = blame_list[j].split;
@@ -2577,6 +2777,260 @@ static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin,
 		free(sg_origin);
 }
 
+/*
+ * The blame cache keeps the result of blaming a whole file at a commit,
+ * one line per blame entry:
+ *
+ *   <lno> <num> <s_lno> <flags> <commit> <blob> <mode>[ <commit> <blob> <mode>]\t<path>[\t<path>]
+ *
+ * where "lno" is the first line in the blamed file, the first origin is
+ * the suspect that the lines are blamed on, starting at its line "s_lno",
+ * and the second origin, if any, is the suspect's "previous". "flags" is
+ * "b" for boundary commits, "-" otherwise. Paths are quoted if needed. The
+ * file starts with a line giving the blamed blob and its number of lines.
+ */
+struct blame_cache_entry {
+	int lno, num_lines, s_lno;
+	int boundary;
+	struct blame_origin *suspect;
+};
+
+static char *blame_cache_path(struct blame_scoreboard *sb,
+			      const struct object_id *commit, const char *path)
+{
+	const struct git_hash_algo *algo = sb->repo->hash_algo;
+	struct git_hash_ctx ctx;
+	unsigned char hash[GIT_MAX_RAWSZ];
+
+	algo->init_fn(&ctx);
+	git_hash_update(&ctx, commit->hash, algo->rawsz);
+	git_hash_update(&ctx, path, strlen(path) + 1);
+	git_hash_update(&ctx, sb->cache_options, strlen(sb->cache_options));
+	git_hash_final(hash, &ctx);
+	return repo_git_path(sb->repo, "blame-cache/%s", hash_to_hex_algop(hash, algo));
+}
+
+static const char *parse_cache_origin(struct blame_scoreboard *sb,
+				      const char *p, struct commit **commit,
+				      struct object_id *blob, unsigned *mode)
+{
+	struct object_id oid;
+
+	if (parse_oid_hex_algop(p, &oid, &p, sb->repo->hash_algo) ||
+	    *p++ != ' ' ||
+	    parse_oid_hex_algop(p, blob, &p, sb->repo->hash_algo) ||
+	    *p++ != ' ')
+		return NULL;
+	if (*p < '0' || *p > '7')
+		return NULL;
+	*mode = strtoul(p, (char **)&p, 8);
+	if (!(*commit = lookup_commit(sb->repo, &oid)))
+		return NULL;
+	return p;
+}
+
+static const char *parse_cache_path(struct strbuf *buf, const char *p)
+{
+	strbuf_reset(buf);
+	if (*p == '"')
+		return unquote_c_style(buf, p, &p) ? NULL : p;
+	while (*p && *p != '\t')
+		strbuf_addch(buf, *p++);
+	return buf->len ? p : NULL;
+}
+
+static struct blame_origin *cache_origin(struct commit *commit, const char *path,
+					 const struct object_id *blob, unsigned mode)
+{
+	struct blame_origin *o = get_origin(commit, path);
+
+	if (is_null_oid(&o->blob_oid)) {
+		oidcpy(&o->blob_oid, blob);
+		o->mode = mode;
+	}
+	return o;
+}
+
+/*
+ * Parse a non-negative decimal number followed by a space, returning
+ * what comes after the space, or NULL.
+ */
+static const char *parse_cache_int(const char *p, int *v)
+{
+	char *end;
+	long l;
+
+	if (!isdigit(*p))
+		return NULL;
+	errno = 0;
+	l = strtol(p, &end, 10);
+	if (errno || l > INT_MAX || !skip_prefix(end, " ", &p))
+		return NULL;
+	*v = l;
+	return p;
+}
+
+static int parse_cache_entry(struct blame_scoreboard *sb, const char *p,
+			     struct blame_cache_entry *e)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct commit *commit, *prev_commit = NULL;
+	struct object_id blob, prev_blob;
+	unsigned mode, prev_mode = 0;
+	int ret = -1;
+
+	if (!(p = parse_cache_int(p, &e->lno)) ||
+	    !(p = parse_cache_int(p, &e->num_lines)) ||
+	    !(p = parse_cache_int(p, &e->s_lno)) ||
+	    e->num_lines <= 0)
+		return -1;
+	if (*p != 'b' && *p != '-')
+		return -1;
+	e->boundary = *p++ == 'b';
+	if (*p++ != ' ' ||
+	    !(p = parse_cache_origin(sb, p, &commit, &blob, &mode)))
+		return -1;
+	if (*p == ' ' &&
+	    !(p = parse_cache_origin(sb, p + 1, &prev_commit, &prev_blob, &prev_mode)))
+		return -1;
+	if (*p++ != '\t' || !(p = parse_cache_path(&path, p)))
+		goto out;
+
+	e->suspect = cache_origin(commit, path.buf, &blob, mode);
+	if (prev_commit) {
+		if (*p++ != '\t' || !(p = parse_cache_path(&path, p)) || *p) {
+			blame_origin_decref(e->suspect);
+			goto out;
+		}
+		if (!e->suspect->previous)
+			e->suspect->previous = cache_origin(prev_commit, path.buf,
+							    &prev_blob, prev_mode);
+	}
+	ret = 0;
+out:
+	strbuf_release(&path);
+	return ret;
+}
+
+/*
+ * Read the cached blame of "origin", and check that it covers all of
+ * the lines of its blob. Returns the number of entries, or -1.
+ */
+static int read_blame_cache(struct blame_scoreboard *sb,
+			    struct blame_origin *origin,
+			    struct blame_cache_entry **entries_p)
+{
+	struct blame_cache_entry *entries = NULL;
+	int nr = 0, alloc = 0, num_lines, next_lno = 0;
+	struct strbuf line = STRBUF_INIT;
+	struct object_id blob;
+	const char *p;
+	char *path;
+	FILE *fp;
+
+	path = blame_cache_path(sb, &origin->commit->object.oid, origin->path);
+	fp = fopen(path, "r");
+	if (!fp) {
+		free(path);
+		return -1;
+	}
+
+	if (strbuf_getline(&line, fp) ||
+	    parse_oid_hex_algop(line.buf, &blob, &p, sb->repo->hash_algo) ||
+	    !oideq(&blob, &origin->blob_oid) ||
+	    *p++ != ' ' || strtol_i(p, 10, &num_lines))
+		goto fail;
+
+	while (!strbuf_getline(&line, fp)) {
+		ALLOC_GROW(entries, nr + 1, alloc);
+		if (parse_cache_entry(sb, line.buf, &entries[nr]))
+			goto fail;
+		if (entries[nr++].lno != next_lno)
+			goto fail;
+		next_lno += entries[nr - 1].num_lines;
+	}
+	if (next_lno != num_lines)
+		goto fail;
+
+	/* let blame_cache_expire() know that it is still in use */
+	utime(path, NULL);
+
+	fclose(fp);
+	free(path);
+	strbuf_release(&line);
+	*entries_p = entries;
+	return nr;
+
+fail:
+	for (int i = 0; i < nr; i++)
+		blame_origin_decref(entries[i].suspect);
+	free(entries);
+	fclose(fp);
+	free(path);
+	strbuf_release(&line);
+	return -1;
+}
+
+/*
+ * If the blame of the whole of "origin" is in the cache, blame its
+ * suspects on the commits found there instead of passing them on.
+ */
+static int apply_blame_cache(struct blame_scoreboard *sb,
+			     struct blame_origin *origin)
+{
+	struct blame_cache_entry *entries;
+	struct blame_entry *e, *next;
+	int nr, i;
+
+	if (!sb->cache_options ||
+	    (nr = read_blame_cache(sb, origin, &entries)) < 0)
+		return 0;
+
+	/* suspects are sorted by line in the final image, not in origin */
+	for (e = origin->suspects; e; e = next) {
+		int start = e->s_lno, end = e->s_lno + e->num_lines;
+
+		int lo = 0, hi = nr;
+
+		next = e->next;
+		while (lo < hi) {
+			int mid = lo + (hi - lo) / 2;
+
+			if (entries[mid].lno + entries[mid].num_lines <= start)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for (i = lo; i < nr && entries[i].lno < end; i++) {
+			struct blame_cache_entry *c = &entries[i];
+			int from = start > c->lno ? start : c->lno;
+			int to = end < c->lno + c->num_lines ? end : c->lno + c->num_lines;
+			struct blame_entry *n = xcalloc(1, sizeof(*n));
+
+			n->lno = e->lno + from - start;
+			n->num_lines = to - from;
+			n->s_lno = c->s_lno + from - c->lno;
+			n->suspect = blame_origin_incref(c->suspect);
+			n->suspect->guilty = 1;
+			if (c->boundary)
+				n->suspect->commit->object.flags |= UNINTERESTING;
+			if (sb->found_guilty_entry)
+				sb->found_guilty_entry(n, sb->found_guilty_entry_data);
+			n->next = sb->ent;
+			sb->ent = n;
+		}
+		blame_origin_decref(e->suspect);
+		free(e);
+	}
+	origin->suspects = NULL;
+
+	for (i = 0; i < nr; i++)
+		blame_origin_decref(entries[i].suspect);
+	free(entries);
+	sb->num_cache_hits++;
+	return 1;
+}
+
 /*
  * The main loop -- while we have blobs with lines whose true origin
  * is still unknown, pick one blob, and allow its lines to pass blames
@@ -2607,7 +3061,9 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 		 */
 		blame_origin_incref(suspect);
 		repo_parse_commit(the_repository, commit);
-		if (sb->reverse ||
+		if (apply_blame_cache(sb, suspect))
+			; /* all of its lines were found in the cache */
+		else if (sb->reverse ||
 		    (!(commit->object.flags & UNINTERESTING) &&
 		     !(revs->max_age != -1 && commit->date < revs->max_age)))
 			pass_blame(sb, suspect, opt);
@@ -2890,6 +3346,129 @@ void setup_scoreboard(struct blame_scoreboard *sb,
 
 
 
+void setup_blame_cache(struct blame_scoreboard *sb, int opt)
+{
+	struct rev_info *revs = sb->revs;
+
+	/*
+	 * Moves, copies and the guesses made for ignored commits depend
+	 * on how the lines that reach a commit are grouped, so their
+	 * results cannot be reused for a subset of the lines. Cached
+	 * results also do not stop at the bottom of a range.
+	 */
+	if (sb->reverse || (opt & (PICKAXE_BLAME_MOVE | PICKAXE_BLAME_COPY)) ||
+	    oidset_size(&sb->ignore_list) || revs->max_age != -1)
+		return;
+	for (size_t i = 0; i < revs->cmdline.nr; i++)
+		if (revs->cmdline.rev[i].flags & UNINTERESTING)
+			return;
+
+	sb->cache_options = xstrfmt("xdl=%d root=%d first-parent=%d "
+				    "renames=%d textconv=%d",
+				    sb->xdl_opts, sb->show_root,
+				    revs->first_parent_only,
+				    !sb->no_whole_file_rename,
+				    revs->diffopt.flags.allow_textconv);
+}
+
+static void write_cache_origin(struct strbuf *buf, struct blame_origin *o)
+{
+	strbuf_addf(buf, "%s %s %06o", oid_to_hex(&o->commit->object.oid),
+		    oid_to_hex(&o->blob_oid), o->mode);
+}
+
+void blame_cache_store(struct blame_scoreboard *sb)
+{
+	struct lock_file lock = LOCK_INIT;
+	struct blame_origin *final;
+	struct strbuf buf = STRBUF_INIT;
+	struct blame_entry *e;
+	int next_lno = 0;
+	char *path;
+
+	if (!sb->cache_options)
+		return;
+	trace2_data_intmax("blame", sb->repo, "cache/hits", sb->num_cache_hits);
+	if (is_null_oid(&sb->final->object.oid))
+		return;
+
+	blame_sort_final(sb);
+	blame_coalesce(sb);
+
+	final = get_origin(sb->final, sb->path);
+	if (fill_blob_sha1_and_mode(sb->repo, final))
+		goto out;
+	strbuf_addf(&buf, "%s %d\n", oid_to_hex(&final->blob_oid), sb->num_lines);
+	for (e = sb->ent; e; e = e->next) {
+		struct blame_origin *suspect = e->suspect;
+
+		/* only the blame of whole files is kept */
+		if (e->lno != next_lno || is_null_oid(&suspect->blob_oid))
+			goto out;
+		next_lno += e->num_lines;
+
+		strbuf_addf(&buf, "%d %d %d %c ", e->lno, e->num_lines, e->s_lno,
+			    suspect->commit->object.flags & UNINTERESTING ? 'b' : '-');
+		write_cache_origin(&buf, suspect);
+		if (suspect->previous) {
+			strbuf_addch(&buf, ' ');
+			write_cache_origin(&buf, suspect->previous);
+		}
+		strbuf_addch(&buf, '\t');
+		quote_c_style(suspect->path, &buf, NULL, 0);
+		if (suspect->previous) {
+			strbuf_addch(&buf, '\t');
+			quote_c_style(suspect->previous->path, &buf, NULL, 0);
+		}
+		strbuf_addch(&buf, '\n');
+	}
+	if (next_lno != sb->num_lines)
+		goto out;
+
+	path = blame_cache_path(sb, &sb->final->object.oid, sb->path);
+	if (!access(path, F_OK) ||
+	    safe_create_leading_directories(sb->repo, path) ||
+	    hold_lock_file_for_update(&lock, path, 0) < 0) {
+		free(path);
+		goto out;
+	}
+	if (write_in_full(get_lock_file_fd(&lock), buf.buf, buf.len) < 0 ||
+	    commit_lock_file(&lock))
+		rollback_lock_file(&lock);
+	free(path);
+
+out:
+	blame_origin_decref(final);
+	strbuf_release(&buf);
+}
+
+void blame_cache_expire(struct repository *r, timestamp_t expire)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct dirent *de;
+	size_t baselen;
+	DIR *dir;
+
+	repo_git_path_replace(r, &path, "blame-cache/");
+	baselen = path.len;
+	dir = opendir(path.buf);
+	if (!dir)
+		goto out;
+	while ((de = readdir_skip_dot_and_dotdot(dir))) {
+		struct stat st;
+
+		strbuf_setlen(&path, baselen);
+		strbuf_addstr(&path, de->d_name);
+		if (!stat(path.buf, &st) && st.st_mtime <= expire)
+			unlink_or_warn(path.buf);
+	}
+	closedir(dir);
+	strbuf_setlen(&path, baselen);
+	rmdir(path.buf);
+out:
+	strbuf_release(&path);
+}
+
 struct blame_entry *blame_entry_prepend(struct blame_entry *head,
 					long start, long end,
 					struct blame_origin *o)
@@ -2935,6 +3514,7 @@ void cleanup_scoreboard(struct blame_scoreboard *sb)
 	free(sb->final_buf);
 	clear_prio_queue(&sb->commits);
 	oidset_clear(&sb->ignore_list);
+	free(sb->cache_options);
 
 	if (sb->bloom_data) {
 		int i;
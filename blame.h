@@ -132,6 +132,7 @@ struct blame_scoreboard {
 	int num_read_blob;
 	int num_get_patch;
 	int num_commits;
+	int num_cache_hits;
 
 	/*
 	 * blame for a blame_entry with score lower than these thresholds
@@ -143,6 +144,12 @@ struct blame_scoreboard {
 	/* use this file's contents as the final image */
 	const char *contents_from;
 
+	/*
+	 * the options that the blame cache entries must have been made
+	 * with, or NULL when the cache is not used
+	 */
+	char *cache_options;
+
 	/* flags */
 	int reverse;
 	int show_root;
@@ -150,6 +157,9 @@ struct blame_scoreboard {
 	int no_whole_file_rename;
 	int debug;
 
+	/* threads to search for moved and copied lines with */
+	int num_threads;
+
 	/* callbacks */
 	void(*on_sanity_fail)(struct blame_scoreboard *, int);
 	void(*found_guilty_entry)(struct blame_entry *, void *);
@@ -180,6 +190,26 @@ void init_scoreboard(struct blame_scoreboard *sb);
 void setup_scoreboard(struct blame_scoreboard *sb,
 		      struct blame_origin **orig);
 void setup_blame_bloom_data(struct blame_scoreboard *sb);
+
+/*
+ * Use the results kept in $GIT_DIR/blame-cache for the commits that
+ * assign_blame() reaches, if the options in "sb" and "opt" allow it.
+ * Call once the options in "sb" are set.
+ */
+void setup_blame_cache(struct blame_scoreboard *sb, int opt);
+
+/*
+ * Keep the result of assign_blame() in the cache, if it was set up and
+ * the whole file has been blamed.
+ */
+void blame_cache_store(struct blame_scoreboard *sb);
+
+/*
+ * Remove the entries of the blame cache of "r" that have not been
+ * written or used since "expire".
+ */
+void blame_cache_expire(struct repository *r, timestamp_t expire);
+
 void cleanup_scoreboard(struct blame_scoreboard *sb);
 
 struct blame_entry *blame_entry_prepend(struct blame_entry *head,
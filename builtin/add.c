@@ -7,6 +7,7 @@
 #include "builtin.h"
 #include "advice.h"
 #include "config.h"
+#include "convert.h"
 #include "lockfile.h"
 #include "editor.h"
 #include "dir.h"
@@ -331,10 +332,29 @@ static void check_embedded_repo(const char *path)
 	strbuf_release(&name);
 }
 
+/*
+ * Hand the next files to pipelining clean filters, so that they are
+ * cleaned by the time we get to them. Returns where to call us again.
+ */
+static int queue_clean_filters(struct index_state *istate,
+			       struct dir_struct *dir, int pos)
+{
+	int queued = 0;
+
+	if (!convert_has_process_filters())
+		return dir->nr;
+	for (; pos < dir->nr && queued < CONVERT_QUEUE_MAX &&
+	       convert_has_process_filters(); pos++)
+		queued += convert_queue_to_git(istate, dir->entries[pos]->name);
+	convert_run_queue();
+	return pos;
+}
+
 static int add_files(struct repository *repo, struct dir_struct *dir, int flags)
 {
-	int i, exit_status = 0;
+	int i, exit_status = 0, queued_up_to = 0, prepared_up_to = 0;
 	struct string_list matched_sparse_paths = STRING_LIST_INIT_NODUP;
+	const char **paths;
 
 	if (dir->ignored_nr) {
 		fprintf(stderr, _(ignore_error));
@@ -345,7 +365,17 @@ static int add_files(struct repository *repo, struct dir_struct *dir, int flags)
 		exit_status = 1;
 	}
 
+	ALLOC_ARRAY(paths, dir->nr);
+	for (i = 0; i < dir->nr; i++)
+		paths[i] = dir->entries[i]->name;
+
 	for (i = 0; i < dir->nr; i++) {
+		if (i >= queued_up_to)
+			queued_up_to = queue_clean_filters(repo->index, dir, i);
+		if (i >= prepared_up_to)
+			prepared_up_to = i + prepare_blobs_bulk_checkin(repo->index,
+									paths + i,
+									dir->nr - i);
 		if (!include_sparse &&
 		    !path_in_sparse_checkout(dir->entries[i]->name, repo->index)) {
 			string_list_append(&matched_sparse_paths,
@@ -367,6 +397,7 @@ static int add_files(struct repository *repo, struct dir_struct *dir, int flags)
 	}
 
 	string_list_clear(&matched_sparse_paths, 0);
+	free(paths);
 
 	return exit_status;
 }
@@ -34,6 +34,7 @@
 #include "refs.h"
 #include "setup.h"
 #include "tag.h"
+#include "thread-utils.h"
 #include "write-or-die.h"
 
 static const char blame_usage[] = N_("git blame [<options>] [<rev-opts>] [<rev>] [--] <file>");
@@ -60,6 +61,8 @@ static int max_digits;
 static int max_score_digits;
 static int show_root;
 static int reverse;
+static int use_blame_cache;
+static int num_threads;
 static int blank_boundary;
 static int incremental;
 static int xdl_opts;
@@ -750,6 +753,17 @@ static int git_blame_config(const char *var, const char *value,
 		free(str);
 		return 0;
 	}
+	if (!strcmp(var, "blame.threads")) {
+		num_threads = git_config_int(var, value, ctx->kvi);
+		if (num_threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    num_threads, var);
+		return 0;
+	}
+	if (!strcmp(var, "blame.cache")) {
+		use_blame_cache = git_config_bool(var, value);
+		return 0;
+	}
 	if (!strcmp(var, "blame.markunblamablelines")) {
 		mark_unblamable_lines = git_config_bool(var, value);
 		return 0;
@@ -1203,6 +1217,13 @@ int cmd_blame(int argc,
 	sb.show_root = show_root;
 	sb.xdl_opts = xdl_opts;
 	sb.no_whole_file_rename = no_whole_file_rename;
+	if (!HAVE_THREADS)
+		sb.num_threads = 1;
+	else
+		sb.num_threads = num_threads ? num_threads : online_cpus();
+
+	if (use_blame_cache)
+		setup_blame_cache(&sb, opt);
 
 	read_mailmap(&mailmap);
 
@@ -1217,6 +1238,8 @@ int cmd_blame(int argc,
 
 	stop_progress(&pi.progress);
 
+	blame_cache_store(&sb);
+
 	if (!incremental)
 		setup_pager(the_repository);
 	else
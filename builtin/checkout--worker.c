@@ -81,10 +81,17 @@ static void release_pc_item_data(struct parallel_checkout_item *pc_item)
 	discard_cache_entry(pc_item->ce);
 }
 
+static void item_written(struct parallel_checkout_item *pc_item,
+			 void *data UNUSED)
+{
+	report_result(pc_item);
+	release_pc_item_data(pc_item);
+}
+
 static void worker_loop(struct checkout *state)
 {
 	struct parallel_checkout_item *items = NULL;
-	size_t i, nr = 0, alloc = 0;
+	size_t nr = 0, alloc = 0;
 
 	while (1) {
 		int len = packet_read(0, packet_buffer, sizeof(packet_buffer),
@@ -99,12 +106,7 @@ static void worker_loop(struct checkout *state)
 		packet_to_pc_item(packet_buffer, len, &items[nr++]);
 	}
 
-	for (i = 0; i < nr; i++) {
-		struct parallel_checkout_item *pc_item = &items[i];
-		write_pc_item(pc_item, state);
-		report_result(pc_item);
-		release_pc_item_data(pc_item);
-	}
+	write_pc_items(items, nr, state, item_written, NULL);
 
 	packet_flush(1);
 
@@ -383,13 +383,18 @@ static void mark_ce_for_checkout_no_overlay(struct cache_entry *ce,
 	}
 }
 
+static int ce_matched(const struct cache_entry *ce)
+{
+	return ce->ce_flags & CE_MATCHED;
+}
+
 static int checkout_worktree(const struct checkout_opts *opts,
 			     const struct branch_info *info)
 {
 	struct checkout state = CHECKOUT_INIT;
 	int nr_checkouts = 0, nr_unmerged = 0;
 	int errs = 0;
-	int pos;
+	int pos, queued_up_to = 0;
 	int pc_workers, pc_threshold;
 	struct mem_pool ce_mem_pool;
 
@@ -410,6 +415,10 @@ static int checkout_worktree(const struct checkout_opts *opts,
 
 	for (pos = 0; pos < the_repository->index->cache_nr; pos++) {
 		struct cache_entry *ce = the_repository->index->cache[pos];
+
+		if (pos >= queued_up_to)
+			queued_up_to = queue_checkout_filters(&state, pos,
+							      ce_matched);
 		if (ce->ce_flags & CE_MATCHED) {
 			if (!ce_stage(ce)) {
 				errs |= checkout_entry(ce, &state,
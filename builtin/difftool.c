@@ -25,7 +25,6 @@
 #include "path.h"
 #include "read-cache-ll.h"
 #include "repository.h"
-#include "sparse-index.h"
 #include "strvec.h"
 #include "strbuf.h"
 #include "lockfile.h"
@@ -606,9 +605,6 @@ static int run_dir_diff(struct repository *repo,
 	strvec_pushl(&cmd.args, ldir.buf, rdir.buf, NULL);
 	ret = run_command(&cmd);
 
-	/* TODO: audit for interaction with sparse-index. */
-	ensure_full_index(&wtindex);
-
 	/*
 	 * If the diff includes working copy files and those
 	 * files were modified during the diff, then the changes
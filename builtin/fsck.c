@@ -1,6 +1,7 @@
 #define USE_THE_REPOSITORY_VARIABLE
 #include "builtin.h"
 #include "gettext.h"
+#include "hash-batch.h"
 #include "hex.h"
 #include "config.h"
 #include "commit.h"
@@ -23,10 +24,10 @@
 #include "replace-object.h"
 #include "resolve-undo.h"
 #include "run-command.h"
-#include "sparse-index.h"
 #include "worktree.h"
 #include "pack-revindex.h"
 #include "pack-bitmap.h"
+#include "thread-utils.h"
 
 #define REACHABLE 0x0001
 #define SEEN      0x0002
@@ -611,62 +612,113 @@ static void get_default_heads(void)
 	}
 }
 
+/*
+ * A loose object read by fsck_loose(). The objects are hashed by a
+ * hash batch and checked in the order they were read once it is
+ * flushed.
+ */
+struct loose_object {
+	struct object_id oid;
+	struct object_id real_oid;
+	char *path;
+	enum object_type type;
+	unsigned long size;
+	void *contents;
+};
+
 struct for_each_loose_cb
 {
 	struct progress *progress;
+	struct hash_batch *batch;
+	struct loose_object **objects;
+	size_t nr, alloc;
 };
 
-static int fsck_loose(const struct object_id *oid, const char *path,
-		      void *data UNUSED)
+static void fsck_loose_object(struct loose_object *lo)
 {
 	struct object *obj;
-	enum object_type type = OBJ_NONE;
-	unsigned long size;
-	void *contents = NULL;
 	int eaten;
-	struct object_info oi = OBJECT_INFO_INIT;
-	struct object_id real_oid = *null_oid(the_hash_algo);
-	int err = 0;
-
-	oi.sizep = &size;
-	oi.typep = &type;
 
-	if (read_loose_object(path, oid, &real_oid, &contents, &oi) < 0) {
-		if (contents && !oideq(&real_oid, oid))
-			err = error(_("%s: hash-path mismatch, found at: %s"),
-				    oid_to_hex(&real_oid), path);
-		else
-			err = error(_("%s: object corrupt or missing: %s"),
-				    oid_to_hex(oid), path);
-	}
-	if (err < 0) {
+	if (lo->contents && !oideq(&lo->real_oid, &lo->oid)) {
 		errors_found |= ERROR_OBJECT;
-		free(contents);
-		return 0; /* keep checking other objects */
+		error(_("%s: hash-path mismatch, found at: %s"),
+		      oid_to_hex(&lo->real_oid), lo->path);
+		free(lo->contents);
+		return; /* keep checking other objects */
 	}
 
-	if (!contents && type != OBJ_BLOB)
-		BUG("read_loose_object streamed a non-blob");
-
-	obj = parse_object_buffer(the_repository, oid, type, size,
-				  contents, &eaten);
+	obj = parse_object_buffer(the_repository, &lo->oid, lo->type, lo->size,
+				  lo->contents, &eaten);
 
 	if (!obj) {
 		errors_found |= ERROR_OBJECT;
 		error(_("%s: object could not be parsed: %s"),
-		      oid_to_hex(oid), path);
+		      oid_to_hex(&lo->oid), lo->path);
 		if (!eaten)
-			free(contents);
-		return 0; /* keep checking other objects */
+			free(lo->contents);
+		return; /* keep checking other objects */
 	}
 
 	obj->flags &= ~(REACHABLE | SEEN);
 	obj->flags |= HAS_OBJ;
-	if (fsck_obj(obj, contents, size))
+	if (fsck_obj(obj, lo->contents, lo->size))
 		errors_found |= ERROR_OBJECT;
 
 	if (!eaten)
-		free(contents);
+		free(lo->contents);
+}
+
+static void fsck_loose_flush(struct for_each_loose_cb *cb_data)
+{
+	hash_batch_flush(cb_data->batch);
+	for (size_t i = 0; i < cb_data->nr; i++) {
+		struct loose_object *lo = cb_data->objects[i];
+
+		fsck_loose_object(lo);
+		free(lo->path);
+		free(lo);
+	}
+	cb_data->nr = 0;
+}
+
+static int fsck_loose(const struct object_id *oid, const char *path,
+		      void *data)
+{
+	struct for_each_loose_cb *cb_data = data;
+	struct loose_object *lo;
+	struct object_info oi = OBJECT_INFO_INIT;
+
+	CALLOC_ARRAY(lo, 1);
+	oidcpy(&lo->oid, oid);
+	lo->type = OBJ_NONE;
+	oi.sizep = &lo->size;
+	oi.typep = &lo->type;
+
+	if (read_loose_object(path, oid, NULL, &lo->contents, &oi) < 0) {
+		/* report it after the objects read before it */
+		fsck_loose_flush(cb_data);
+		errors_found |= ERROR_OBJECT;
+		error(_("%s: object corrupt or missing: %s"),
+		      oid_to_hex(oid), path);
+		free(lo->contents);
+		free(lo);
+		return 0; /* keep checking other objects */
+	}
+
+	if (!lo->contents && lo->type != OBJ_BLOB)
+		BUG("read_loose_object streamed a non-blob");
+
+	lo->path = xstrdup(path);
+	ALLOC_GROW(cb_data->objects, cb_data->nr + 1, cb_data->alloc);
+	cb_data->objects[cb_data->nr++] = lo;
+
+	/* a streamed blob has been checked already */
+	if (lo->contents) {
+		hash_batch_add_object(cb_data->batch, lo->contents, lo->size,
+				      lo->type, &lo->real_oid);
+		if (hash_batch_full(cb_data->batch))
+			fsck_loose_flush(cb_data);
+	}
 	return 0; /* keep checking other objects, even if we saw an error */
 }
 
@@ -686,11 +738,12 @@ static int fsck_subdir(unsigned int nr, const char *path UNUSED, void *data)
 	return 0;
 }
 
-static void fsck_object_dir(const char *path)
+static void fsck_object_dir(const char *path, int nr_threads)
 {
 	struct progress *progress = NULL;
 	struct for_each_loose_cb cb_data = {
 		.progress = progress,
+		.batch = hash_batch_new(the_hash_algo, nr_threads),
 	};
 
 	if (verbose)
@@ -702,6 +755,9 @@ static void fsck_object_dir(const char *path)
 
 	for_each_loose_file_in_objdir(path, fsck_loose, fsck_cruft, fsck_subdir,
 				      &cb_data);
+	fsck_loose_flush(&cb_data);
+	hash_batch_free(cb_data.batch);
+	free(cb_data.objects);
 	display_progress(progress, 256);
 	stop_progress(&progress);
 }
@@ -814,26 +870,33 @@ static void fsck_index(struct index_state *istate, const char *index_path,
 {
 	unsigned int i;
 
-	/* TODO: audit for interaction with sparse-index. */
-	ensure_full_index(istate);
 	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
 		unsigned int mode;
-		struct blob *blob;
 		struct object *obj;
+		int namelen = ce_namelen(ce);
 
-		mode = istate->cache[i]->ce_mode;
+		mode = ce->ce_mode;
 		if (S_ISGITLINK(mode))
 			continue;
-		blob = lookup_blob(the_repository,
-				   &istate->cache[i]->oid);
-		if (!blob)
-			continue;
-		obj = &blob->object;
+		if (S_ISSPARSEDIR(mode)) {
+			/* the walk from the tree finds the blobs in it */
+			struct tree *tree = lookup_tree(the_repository, &ce->oid);
+			if (!tree)
+				continue;
+			obj = &tree->object;
+			namelen--;
+		} else {
+			struct blob *blob = lookup_blob(the_repository, &ce->oid);
+			if (!blob)
+				continue;
+			obj = &blob->object;
+		}
 		obj->flags |= USED;
 		fsck_put_object_name(&fsck_walk_options, &obj->oid,
-				     "%s:%s",
+				     "%s:%.*s",
 				     is_current_worktree ? "" : index_path,
-				     istate->cache[i]->name);
+				     namelen, ce->name);
 		mark_object_reachable(obj);
 	}
 	if (istate->cache_tree)
@@ -988,6 +1051,7 @@ int cmd_fsck(int argc,
 
 	git_config(git_fsck_config, &fsck_obj_options);
 	prepare_repo_settings(the_repository);
+	the_repository->settings.command_requires_full_index = 0;
 
 	if (check_references)
 		fsck_refs(the_repository);
@@ -997,9 +1061,15 @@ int cmd_fsck(int argc,
 		for_each_packed_object(the_repository,
 				       mark_packed_for_connectivity, NULL, 0);
 	} else {
+		int nr_threads;
+
+		if (repo_config_get_int(the_repository, "pack.threads",
+					&nr_threads) || nr_threads <= 0)
+			nr_threads = online_cpus();
+
 		prepare_alt_odb(the_repository);
 		for (odb = the_repository->objects->odb; odb; odb = odb->next)
-			fsck_object_dir(odb->path);
+			fsck_object_dir(odb->path, nr_threads);
 
 		if (check_full) {
 			struct packed_git *p;
@@ -1022,7 +1092,7 @@ int cmd_fsck(int argc,
 				/* verify gives error messages itself */
 				if (verify_pack(the_repository,
 						p, fsck_obj_buffer,
-						progress, count))
+						progress, count, nr_threads))
 					errors_found |= ERROR_PACK;
 				count += p->num_objects;
 			}
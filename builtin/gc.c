@@ -15,6 +15,7 @@
 
 #include "builtin.h"
 #include "abspath.h"
+#include "blame.h"
 #include "date.h"
 #include "dir.h"
 #include "environment.h"
@@ -42,6 +43,7 @@
 #include "remote.h"
 #include "exec-cmd.h"
 #include "gettext.h"
+#include "grep-trigram.h"
 #include "hook.h"
 #include "setup.h"
 #include "trace2.h"
@@ -135,6 +137,7 @@ struct gc_config {
 	char *gc_log_expire;
 	char *prune_expire;
 	char *prune_worktrees_expire;
+	char *blame_cache_expire;
 	char *repack_filter;
 	char *repack_filter_to;
 	char *repack_expire_to;
@@ -159,6 +162,7 @@ struct gc_config {
 	.gc_log_expire = xstrdup("1.day.ago"), \
 	.prune_expire = xstrdup("2.weeks.ago"), \
 	.prune_worktrees_expire = xstrdup("3.months.ago"), \
+	.blame_cache_expire = xstrdup("1.month.ago"), \
 	.max_delta_cache_size = DEFAULT_DELTA_CACHE_SIZE, \
 	.delta_base_cache_limit = DEFAULT_DELTA_BASE_CACHE_LIMIT, \
 }
@@ -168,6 +172,7 @@ static void gc_config_release(struct gc_config *cfg)
 	free(cfg->gc_log_expire);
 	free(cfg->prune_expire);
 	free(cfg->prune_worktrees_expire);
+	free(cfg->blame_cache_expire);
 	free(cfg->repack_filter);
 	free(cfg->repack_filter_to);
 }
@@ -207,6 +212,11 @@ static void gc_config(struct gc_config *cfg)
 		cfg->prune_worktrees_expire = owned;
 	}
 
+	if (!repo_config_get_expiry(the_repository, "gc.blamecacheexpire", &owned)) {
+		free(cfg->blame_cache_expire);
+		cfg->blame_cache_expire = owned;
+	}
+
 	if (!repo_config_get_expiry(the_repository, "gc.logexpiry", &owned)) {
 		free(cfg->gc_log_expire);
 		cfg->gc_log_expire = owned;
@@ -424,6 +434,28 @@ static int rerere_gc_condition(struct gc_config *cfg UNUSED)
 	return should_gc;
 }
 
+static int maintenance_task_grep_trigrams(struct maintenance_run_opts *opts,
+					  struct gc_config *cfg UNUSED)
+{
+	const struct string_list *config_revs;
+	struct string_list revs = STRING_LIST_INIT_NODUP;
+	int ret;
+
+	if (!git_config_get_string_multi("maintenance.grep-trigrams.refs",
+					 &config_revs))
+		ret = write_grep_trigram_index(the_repository, config_revs,
+					       !opts->quiet);
+	else {
+		string_list_append(&revs, "HEAD");
+		ret = write_grep_trigram_index(the_repository, &revs,
+					       !opts->quiet);
+		string_list_clear(&revs, 0);
+	}
+	if (ret)
+		return error(_("failed to write grep trigram index"));
+	return 0;
+}
+
 static int too_many_loose_objects(struct gc_config *cfg)
 {
 	/*
@@ -1012,6 +1044,16 @@ int cmd_gc(int argc,
 	if (maintenance_task_rerere_gc(&opts, &cfg))
 		die(FAILED_RUN, "rerere");
 
+	if (cfg.blame_cache_expire) {
+		timestamp_t expire;
+
+		if (parse_expiry_date(cfg.blame_cache_expire, &expire))
+			die(_("failed to parse '%s' value '%s'"),
+			    "gc.blameCacheExpire", cfg.blame_cache_expire);
+		if (expire)
+			blame_cache_expire(the_repository, expire);
+	}
+
 	report_garbage = report_pack_garbage;
 	reprepare_packed_git(the_repository);
 	if (pack_garbage.nr > 0) {
@@ -1545,6 +1587,7 @@ enum maintenance_task_label {
 	TASK_REFLOG_EXPIRE,
 	TASK_WORKTREE_PRUNE,
 	TASK_RERERE_GC,
+	TASK_GREP_TRIGRAMS,
 
 	/* Leave as final value */
 	TASK__COUNT
@@ -1596,6 +1639,10 @@ static struct maintenance_task tasks[] = {
 		maintenance_task_rerere_gc,
 		rerere_gc_condition,
 	},
+	[TASK_GREP_TRIGRAMS] = {
+		"grep-trigrams",
+		maintenance_task_grep_trigrams,
+	},
 };
 
 static int compare_tasks_by_selection(const void *a_, const void *b_)
@@ -18,6 +18,7 @@
 #include "string-list.h"
 #include "run-command.h"
 #include "grep.h"
+#include "grep-trigram.h"
 #include "quote.h"
 #include "dir.h"
 #include "pathspec.h"
@@ -44,6 +45,9 @@ static int recurse_submodules;
 
 static int num_threads;
 
+static int use_trigram_index = 1;
+static struct grep_trigram_filter *trigram_filter;
+
 static pthread_t *threads;
 
 /* We use one producer thread and THREADS consumer
@@ -319,6 +323,9 @@ static int grep_cmd_config(const char *var, const char *value,
 	if (!strcmp(var, "submodule.recurse"))
 		recurse_submodules = git_config_bool(var, value);
 
+	if (!strcmp(var, "grep.usetrigramindex"))
+		use_trigram_index = git_config_bool(var, value);
+
 	return st;
 }
 
@@ -361,6 +368,9 @@ static int grep_oid(struct grep_opt *opt, const struct object_id *oid,
 	struct strbuf pathbuf = STRBUF_INIT;
 	struct grep_source gs;
 
+	if (trigram_filter && grep_trigram_filter_skip(trigram_filter, oid))
+		return 0;
+
 	grep_source_name(opt, filename, tree_name_len, &pathbuf);
 	grep_source_init_oid(&gs, pathbuf.buf, path, oid, opt->repo);
 	strbuf_release(&pathbuf);
@@ -1266,17 +1276,22 @@ int cmd_grep(int argc,
 	} else if (!list.nr) {
 		if (!cached)
 			setup_work_tree();
+		else if (use_trigram_index)
+			trigram_filter = grep_trigram_filter_new(the_repository, &opt);
 
 		hit = grep_cache(&opt, &pathspec, cached);
 	} else {
 		if (cached)
 			die(_("both --cached and trees are given"));
 
+		if (use_trigram_index)
+			trigram_filter = grep_trigram_filter_new(the_repository, &opt);
 		hit = grep_objects(&opt, &pathspec, &list);
 	}
 
 	if (num_threads > 1)
 		hit |= wait_all();
+	grep_trigram_filter_free(trigram_filter);
 	if (hit && show_in_pager)
 		run_pager(&opt, prefix);
 
@@ -6,6 +6,7 @@
 #include "delta.h"
 #include "environment.h"
 #include "gettext.h"
+#include "hash-batch.h"
 #include "hex.h"
 #include "pack.h"
 #include "csum-file.h"
@@ -479,18 +480,20 @@ static void *unpack_entry_data(off_t offset, unsigned long size,
 	char hdr[32];
 	int hdrlen;
 
-	if (!is_delta_type(type)) {
-		hdrlen = format_object_header(hdr, sizeof(hdr), type, size);
-		the_hash_algo->init_fn(&c);
-		git_hash_update(&c, hdr, hdrlen);
-	} else
-		oid = NULL;
 	if (type == OBJ_BLOB &&
 	    size > repo_settings_get_big_file_threshold(the_repository))
 		buf = fixed_buf;
 	else
 		buf = xmallocz(size);
 
+	/* objects we keep in memory are hashed by the caller */
+	if (!is_delta_type(type) && buf == fixed_buf) {
+		hdrlen = format_object_header(hdr, sizeof(hdr), type, size);
+		the_hash_algo->init_fn(&c);
+		git_hash_update(&c, hdr, hdrlen);
+	} else
+		oid = NULL;
+
 	memset(&stream, 0, sizeof(stream));
 	git_inflate_init(&stream);
 	stream.next_out = buf;
@@ -1243,6 +1246,29 @@ static void *threaded_second_pass(void *data)
 	return NULL;
 }
 
+/*
+ * Non-delta objects whose hash is being computed by the hash batch;
+ * they are checked in pack order once it is flushed.
+ */
+struct hashed_object {
+	struct object_entry *obj;
+	void *data;
+};
+
+static void check_hashed_objects(struct hash_batch *batch,
+				 struct hashed_object *hashed, int *nr)
+{
+	hash_batch_flush(batch);
+	for (int i = 0; i < *nr; i++) {
+		struct object_entry *obj = hashed[i].obj;
+
+		sha1_object(hashed[i].data, NULL, obj->size, obj->type,
+			    &obj->idx.oid);
+		free(hashed[i].data);
+	}
+	*nr = 0;
+}
+
 /*
  * First pass:
  * - find locations of all objects;
@@ -1256,6 +1282,9 @@ static void parse_pack_objects(unsigned char *hash)
 	struct object_id ref_delta_oid;
 	struct stat st;
 	struct git_hash_ctx tmp_ctx;
+	struct hash_batch *batch = hash_batch_new(the_hash_algo, nr_threads);
+	struct hashed_object *hashed = NULL;
+	int nr_hashed = 0, hashed_alloc = 0;
 
 	if (verbose)
 		progress = start_progress(
@@ -1282,13 +1311,24 @@ static void parse_pack_objects(unsigned char *hash)
 			/* large blobs, check later */
 			obj->real_type = OBJ_BAD;
 			nr_delays++;
-		} else
-			sha1_object(data, NULL, obj->size, obj->type,
-				    &obj->idx.oid);
+		} else {
+			hash_batch_add_object(batch, data, obj->size, obj->type,
+					      &obj->idx.oid);
+			ALLOC_GROW(hashed, nr_hashed + 1, hashed_alloc);
+			hashed[nr_hashed].obj = obj;
+			hashed[nr_hashed].data = data;
+			nr_hashed++;
+			data = NULL;
+			if (hash_batch_full(batch))
+				check_hashed_objects(batch, hashed, &nr_hashed);
+		}
 		free(data);
 		display_progress(progress, i+1);
 	}
 	objects[i].idx.offset = consumed_bytes;
+	check_hashed_objects(batch, hashed, &nr_hashed);
+	hash_batch_free(batch);
+	free(hashed);
 	stop_progress(&progress);
 
 	/* Check pack integrity */
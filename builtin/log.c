@@ -23,6 +23,7 @@
 #include "diff-merges.h"
 #include "revision.h"
 #include "log-tree.h"
+#include "log-readahead.h"
 #include "builtin.h"
 #include "oid-array.h"
 #include "tag.h"
@@ -43,6 +44,7 @@
 
 #include "commit-reach.h"
 #include "range-diff.h"
+#include "thread-utils.h"
 #include "tmp-objdir.h"
 #include "tree.h"
 #include "write-or-die.h"
@@ -54,6 +56,7 @@
 static unsigned int force_in_body_from;
 static int stdout_mboxrd;
 static int format_no_prefix;
+static int log_threads = -1;
 
 static const char * const builtin_log_usage[] = {
 	N_("git log [<options>] [<revision-range>] [[--] <path>...]"),
@@ -72,6 +75,21 @@ static int session_is_interactive(void)
 	return isatty(1) || pager_in_use();
 }
 
+/* beyond this, more threads only compete with the one showing the output */
+#define LOG_READAHEAD_DEFAULT_THREADS 4
+
+static int log_readahead_threads(void)
+{
+	/* nobody waits for the end of the output of an interactive session */
+	if (log_threads < 0) {
+		if (session_is_interactive())
+			return 1;
+		return online_cpus() < LOG_READAHEAD_DEFAULT_THREADS ?
+			online_cpus() : LOG_READAHEAD_DEFAULT_THREADS;
+	}
+	return log_threads ? log_threads : online_cpus();
+}
+
 static int auto_decoration_style(void)
 {
 	return session_is_interactive() ? DECORATE_SHORT_REFS : 0;
@@ -503,6 +521,7 @@ static void finish_early_output(struct rev_info *rev)
 
 static int cmd_log_walk_no_free(struct rev_info *rev)
 {
+	struct log_readahead *ra;
 	struct commit *commit;
 	int saved_nrl = 0;
 	int saved_dcctc = 0;
@@ -517,12 +536,14 @@ static int cmd_log_walk_no_free(struct rev_info *rev)
 	if (rev->early_output)
 		finish_early_output(rev);
 
+	ra = log_readahead_start(rev, log_readahead_threads());
+
 	/*
 	 * For --check and --exit-code, the exit code is based on CHECK_FAILED
 	 * and HAS_CHANGES being accumulated in rev->diffopt, so be careful to
 	 * retain that state information if replacing rev->diffopt in this loop
 	 */
-	while ((commit = get_revision(rev)) != NULL) {
+	while ((commit = ra ? log_readahead_next(ra) : get_revision(rev))) {
 		if (!log_tree_commit(rev, commit) && rev->max_count >= 0)
 			/*
 			 * We decremented max_count in get_revision,
@@ -548,6 +569,7 @@ static int cmd_log_walk_no_free(struct rev_info *rev)
 		if (rev->diffopt.degraded_cc_to_c)
 			saved_dcctc = 1;
 	}
+	log_readahead_finish(ra);
 	rev->diffopt.degraded_cc_to_c = saved_dcctc;
 	rev->diffopt.needed_rename_limit = saved_nrl;
 
@@ -629,6 +651,13 @@ static int git_log_config(const char *var, const char *value,
 		cfg->default_show_signature = git_config_bool(var, value);
 		return 0;
 	}
+	if (!strcmp(var, "log.threads")) {
+		log_threads = git_config_int(var, value, ctx->kvi);
+		if (log_threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    log_threads, var);
+		return 0;
+	}
 
 	return git_diff_ui_config(var, value, ctx, cb);
 }
@@ -23,7 +23,6 @@
 #include "pathspec.h"
 #include "read-cache.h"
 #include "setup.h"
-#include "sparse-index.h"
 #include "submodule.h"
 #include "object-store.h"
 #include "hex.h"
@@ -414,7 +413,7 @@ static void show_files(struct repository *repo, struct dir_struct *dir)
 		return;
 
 	if (!show_sparse_dirs)
-		ensure_full_index(repo->index);
+		expand_index_for_pathspec_files(repo->index, &pathspec);
 
 	for (i = 0; i < repo->index->cache_nr; i++) {
 		const struct cache_entry *ce = repo->index->cache[i];
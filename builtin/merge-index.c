@@ -2,10 +2,11 @@
 #define DISABLE_SIGN_COMPARE_WARNINGS
 
 #include "builtin.h"
+#include "config.h"
 #include "hex.h"
 #include "read-cache-ll.h"
+#include "repository.h"
 #include "run-command.h"
-#include "sparse-index.h"
 
 static const char *pgm;
 static int one_shot, quiet;
@@ -65,8 +66,8 @@ static void merge_one_path(const char *path)
 static void merge_all(void)
 {
 	int i;
-	/* TODO: audit for interaction with sparse-index. */
-	ensure_full_index(the_repository->index);
+
+	/* sparse directories have no unmerged entries in them */
 	for (i = 0; i < the_repository->index->cache_nr; i++) {
 		const struct cache_entry *ce = the_repository->index->cache[i];
 		if (!ce_stage(ce))
@@ -95,10 +96,11 @@ int cmd_merge_index(int argc,
 	if (argc < 3)
 		usage(usage_string);
 
-	repo_read_index(the_repository);
+	git_config(git_default_config, NULL);
 
-	/* TODO: audit for interaction with sparse-index. */
-	ensure_full_index(the_repository->index);
+	prepare_repo_settings(the_repository);
+	the_repository->settings.command_requires_full_index = 0;
+	repo_read_index(the_repository);
 
 	i = 1;
 	if (!strcmp(argv[i], "-o")) {
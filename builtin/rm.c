@@ -20,7 +20,6 @@
 
 #include "string-list.h"
 #include "setup.h"
-#include "sparse-index.h"
 #include "submodule.h"
 #include "pathspec.h"
 
@@ -308,8 +307,7 @@ int cmd_rm(int argc,
 
 	seen = xcalloc(pathspec.nr, 1);
 
-	if (pathspec_needs_expanded_index(the_repository->index, &pathspec))
-		ensure_full_index(the_repository->index);
+	expand_index_for_pathspec(the_repository->index, &pathspec);
 
 	for (unsigned int i = 0; i < the_repository->index->cache_nr; i++) {
 		const struct cache_entry *ce = the_repository->index->cache[i];
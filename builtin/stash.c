@@ -1558,12 +1558,24 @@ static int do_push_stash(const struct pathspec *ps, const char *stash_msg, int q
 	if (!include_untracked && ps->nr) {
 		char *ps_matched = xcalloc(ps->nr, 1);
 
-		/* TODO: audit for interaction with sparse-index. */
-		ensure_full_index(the_repository->index);
 		for (size_t i = 0; i < the_repository->index->cache_nr; i++)
 			ce_path_match(the_repository->index, the_repository->index->cache[i], ps,
 				      ps_matched);
 
+		/*
+		 * A path inside a sparse directory is only matched once
+		 * the directory has been expanded.
+		 */
+		if (the_repository->index->sparse_index &&
+		    memchr(ps_matched, 0, ps->nr)) {
+			expand_index_for_pathspec_files(the_repository->index, ps);
+			memset(ps_matched, 0, ps->nr);
+			for (size_t i = 0; i < the_repository->index->cache_nr; i++)
+				ce_path_match(the_repository->index,
+					      the_repository->index->cache[i], ps,
+					      ps_matched);
+		}
+
 		if (report_path_error(ps_matched, ps)) {
 			fprintf_ln(stderr, _("Did you forget to 'git add'?"));
 			ret = -1;
@@ -12,13 +12,57 @@
 #include "serve.h"
 #include "commit.h"
 #include "environment.h"
+#include "config.h"
+#include "abspath.h"
 
 static const char * const upload_pack_usage[] = {
 	N_("git-upload-pack [--[no-]strict] [--timeout=<n>] [--stateless-rpc]\n"
 	   "                [--advertise-refs] <directory>"),
+	N_("git-upload-pack [--[no-]strict] --listen=<socket> <directory>"),
 	NULL
 };
 
+static int serve_socket_config(const char *var, const char *value,
+			       const struct config_context *ctx UNUSED,
+			       void *cb_data)
+{
+	char **path = cb_data;
+
+	if (!strcmp(var, "uploadpack.servesocket")) {
+		FREE_AND_NULL(*path);
+		return git_config_pathname(path, var, value);
+	}
+	return 0;
+}
+
+/*
+ * Hand the request over to a server started with "--listen", if one is
+ * configured and running. Returns -1 if the request was not forwarded.
+ */
+static int forward_to_serve_socket(int stateless_rpc)
+{
+	char *path = NULL;
+	int ret;
+
+	/*
+	 * Only trust protected config: we are about to give our
+	 * connection to whoever listens on that socket.
+	 */
+	git_protected_config(serve_socket_config, &path);
+	if (!path)
+		return -1;
+	if (!is_absolute_path(path)) {
+		char *abs = xstrfmt("%s/%s",
+				    repo_get_git_dir(the_repository), path);
+		free(path);
+		path = abs;
+	}
+
+	ret = protocol_v2_forward_to_socket(the_repository, path, stateless_rpc);
+	free(path);
+	return ret;
+}
+
 int cmd_upload_pack(int argc,
 		    const char **argv,
 		    const char *prefix,
@@ -29,6 +73,8 @@ int cmd_upload_pack(int argc,
 	int advertise_refs = 0;
 	int stateless_rpc = 0;
 	int timeout = 0;
+	const char *listen = NULL;
+	int ret;
 	struct option options[] = {
 		OPT_BOOL(0, "stateless-rpc", &stateless_rpc,
 			 N_("quit after a single request/response exchange")),
@@ -39,6 +85,8 @@ int cmd_upload_pack(int argc,
 			 N_("do not try <directory>/.git/ if <directory> is no Git directory")),
 		OPT_INTEGER(0, "timeout", &timeout,
 			    N_("interrupt transfer after <n> seconds of inactivity")),
+		OPT_STRING(0, "listen", &listen, N_("socket"),
+			   N_("keep serving protocol v2 requests forwarded to <socket>")),
 		OPT_END()
 	};
 	unsigned enter_repo_flags = ENTER_REPO_ANY_OWNER_OK;
@@ -52,6 +100,9 @@ int cmd_upload_pack(int argc,
 
 	if (argc != 1)
 		usage_with_options(upload_pack_usage, options);
+	die_for_incompatible_opt3(!!listen, "--listen",
+				  stateless_rpc, "--stateless-rpc",
+				  advertise_refs, "--advertise-refs");
 
 	setup_path();
 
@@ -62,10 +113,15 @@ int cmd_upload_pack(int argc,
 	if (!enter_repo(dir, enter_repo_flags))
 		die("'%s' does not appear to be a git repository", dir);
 
+	if (listen)
+		return !!protocol_v2_serve_socket(the_repository, listen);
+
 	switch (determine_protocol_version_server()) {
 	case protocol_v2:
 		if (advertise_refs)
 			protocol_v2_advertise_capabilities(the_repository);
+		else if ((ret = forward_to_serve_socket(stateless_rpc)) >= 0)
+			return ret ? 128 : 0;
 		else
 			protocol_v2_serve_loop(the_repository, stateless_rpc);
 		break;
@@ -6,15 +6,24 @@
 
 #include "git-compat-util.h"
 #include "bulk-checkin.h"
+#include "config.h"
+#include "convert.h"
 #include "environment.h"
 #include "gettext.h"
 #include "hex.h"
 #include "lockfile.h"
+#include "name-hash.h"
+#include "oidset.h"
+#include "read-cache-ll.h"
 #include "repository.h"
 #include "csum-file.h"
 #include "pack.h"
+#include "statinfo.h"
 #include "strbuf.h"
+#include "strmap.h"
+#include "thread-utils.h"
 #include "tmp-objdir.h"
+#include "trace2.h"
 #include "packfile.h"
 #include "object-file.h"
 #include "object-store.h"
@@ -32,6 +41,7 @@ static struct bulk_checkin_packfile {
 	struct pack_idx_entry **written;
 	uint32_t alloc_written;
 	uint32_t nr_written;
+	struct oidset written_oids;
 } bulk_checkin_packfile;
 
 static void finish_tmp_packfile(struct strbuf *basename,
@@ -86,6 +96,7 @@ static void flush_bulk_checkin_packfile(struct bulk_checkin_packfile *state)
 clear_exit:
 	free(state->pack_tmp_name);
 	free(state->written);
+	oidset_clear(&state->written_oids);
 	memset(state, 0, sizeof(*state));
 
 	strbuf_release(&packname);
@@ -134,15 +145,22 @@ static int already_written(struct bulk_checkin_packfile *state, struct object_id
 		       HAS_OBJECT_RECHECK_PACKED | HAS_OBJECT_FETCH_PROMISOR))
 		return 1;
 
-	/* Might want to keep the list sorted */
-	for (uint32_t i = 0; i < state->nr_written; i++)
-		if (oideq(&state->written[i]->oid, oid))
-			return 1;
+	/* Or we may have written it to the current pack already */
+	if (oidset_contains(&state->written_oids, oid))
+		return 1;
 
 	/* This is a new object we need to keep */
 	return 0;
 }
 
+static void add_written(struct bulk_checkin_packfile *state,
+			struct pack_idx_entry *idx)
+{
+	ALLOC_GROW(state->written, state->nr_written + 1, state->alloc_written);
+	state->written[state->nr_written++] = idx;
+	oidset_insert(&state->written_oids, &idx->oid);
+}
+
 /*
  * Read the contents from fd for size bytes, streaming it to the
  * packfile in state while updating the hash in ctx. Signal a failure
@@ -315,11 +333,272 @@ static int deflate_blob_to_pack(struct bulk_checkin_packfile *state,
 		free(idx);
 	} else {
 		oidcpy(&idx->oid, result_oid);
-		ALLOC_GROW(state->written,
-			   state->nr_written + 1,
-			   state->alloc_written);
-		state->written[state->nr_written++] = idx;
+		add_written(state, idx);
+	}
+	return 0;
+}
+
+/*
+ * A blob that a thread of prepare_blobs_bulk_checkin() read, hashed and
+ * deflated. "data" holds the object as it goes into the pack, i.e. the
+ * in-pack header followed by the deflated contents.
+ */
+struct prepared_blob {
+	const char *path;
+	int ok;
+	struct stat_data sd;
+	struct object_id oid;
+	unsigned char *data;
+	size_t len;
+};
+
+static struct strmap prepared_blobs = STRMAP_INIT;
+
+/* How much prepare_blobs_bulk_checkin() holds in memory at a time */
+#define PREPARE_BLOBS_MAX 4096
+#define PREPARE_BLOBS_MAX_BYTES (64 * 1024 * 1024)
+
+struct prepare_blobs_data {
+	struct prepared_blob *blobs;
+	size_t nr, next;
+	pthread_mutex_t mutex;
+};
+
+static void prepare_blob(struct prepared_blob *blob)
+{
+	unsigned char hdr[MAX_PACK_OBJECT_HEADER];
+	unsigned hdrlen;
+	unsigned long bound;
+	git_zstream s;
+	struct stat st;
+	size_t size;
+	char *buf;
+	int fd;
+
+	fd = open(blob->path, O_RDONLY);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return;
+	}
+	size = xsize_t(st.st_size);
+	buf = xmalloc(size + 1);
+	if (read_in_full(fd, buf, size) != (ssize_t)size) {
+		close(fd);
+		free(buf);
+		return;
 	}
+	close(fd);
+
+	hash_object_file(the_hash_algo, buf, size, OBJ_BLOB, &blob->oid);
+
+	hdrlen = encode_in_pack_object_header(hdr, sizeof(hdr), OBJ_BLOB, size);
+	git_deflate_init(&s, pack_compression_level);
+	bound = git_deflate_bound(&s, size);
+	blob->data = xmalloc(st_add(hdrlen, bound));
+	memcpy(blob->data, hdr, hdrlen);
+	s.next_in = (unsigned char *)buf;
+	s.avail_in = size;
+	s.next_out = blob->data + hdrlen;
+	s.avail_out = bound;
+	while (git_deflate(&s, Z_FINISH) == Z_OK)
+		; /* nothing */
+	git_deflate_end(&s);
+	blob->len = hdrlen + s.total_out;
+	free(buf);
+
+	fill_stat_data(&blob->sd, &st);
+	blob->ok = 1;
+}
+
+static void *prepare_blobs_thread(void *data_)
+{
+	struct prepare_blobs_data *data = data_;
+
+	for (;;) {
+		size_t i;
+
+		pthread_mutex_lock(&data->mutex);
+		i = data->next++;
+		pthread_mutex_unlock(&data->mutex);
+		if (i >= data->nr)
+			break;
+		prepare_blob(&data->blobs[i]);
+	}
+	return NULL;
+}
+
+static int prepare_blobs_threads(void)
+{
+	static int threads = -1;
+
+	if (threads < 0) {
+		if (repo_config_get_int(the_repository, "add.threads", &threads))
+			threads = 1;
+		if (!threads)
+			threads = online_cpus();
+		if (!HAVE_THREADS || threads < 1)
+			threads = 1;
+	}
+	return threads;
+}
+
+static void discard_prepared_blobs(void)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	strmap_for_each_entry(&prepared_blobs, &iter, e) {
+		struct prepared_blob *blob = e->value;
+		free(blob->data);
+		free(blob);
+	}
+	strmap_clear(&prepared_blobs, 0);
+}
+
+/*
+ * Whether the caller would write "path" as a blob that we can prepare:
+ * a regular file that index_core() would read as it is, and that does
+ * not match its index entry already.
+ */
+static int want_prepared_blob(struct index_state *istate, const char *path,
+			      size_t *size)
+{
+	unsigned ce_option = CE_MATCH_IGNORE_VALID |
+			     CE_MATCH_IGNORE_SKIP_WORKTREE |
+			     CE_MATCH_RACY_IS_DIRTY;
+	struct cache_entry *ce;
+	struct stat st;
+
+	if (lstat(path, &st) || !S_ISREG(st.st_mode) ||
+	    (uintmax_t)st.st_size >
+	    repo_settings_get_big_file_threshold(the_repository) ||
+	    would_convert_to_git(istate, path))
+		return 0;
+	ce = index_file_exists(istate, path, strlen(path), ignore_case);
+	if (ce && !ce_stage(ce) && !ie_match_stat(istate, ce, &st, ce_option))
+		return 0;
+	*size = xsize_t(st.st_size);
+	return 1;
+}
+
+size_t prepare_blobs_bulk_checkin(struct index_state *istate,
+				  const char **paths, size_t nr)
+{
+	struct prepare_blobs_data data = { 0 };
+	pthread_t *threads;
+	size_t i, bytes = 0, consumed = 0, prepared = 0;
+	int nr_threads = prepare_blobs_threads();
+
+	discard_prepared_blobs();
+	/*
+	 * Objects written to a pack get no mapping to the compatibility
+	 * hash; write_object_file() takes care of that for loose ones.
+	 */
+	if (nr_threads < 2 || !odb_transaction_nesting ||
+	    the_repository->compat_hash_algo)
+		return nr;
+
+	CALLOC_ARRAY(data.blobs, nr < PREPARE_BLOBS_MAX ? nr : PREPARE_BLOBS_MAX);
+	while (consumed < nr && data.nr < PREPARE_BLOBS_MAX &&
+	       bytes < PREPARE_BLOBS_MAX_BYTES) {
+		const char *path = paths[consumed++];
+		size_t size;
+
+		if (!want_prepared_blob(istate, path, &size) ||
+		    strmap_contains(&prepared_blobs, path))
+			continue;
+		data.blobs[data.nr].path = path;
+		strmap_put(&prepared_blobs, path, &data.blobs[data.nr]);
+		data.nr++;
+		bytes += size;
+	}
+	strmap_clear(&prepared_blobs, 0);
+	if (!data.nr) {
+		free(data.blobs);
+		return consumed;
+	}
+
+	trace2_region_enter("bulk-checkin", "prepare-blobs", the_repository);
+	pthread_mutex_init(&data.mutex, NULL);
+	if ((size_t)nr_threads > data.nr)
+		nr_threads = data.nr;
+	CALLOC_ARRAY(threads, nr_threads);
+	for (int t = 0; t < nr_threads; t++) {
+		int err = pthread_create(&threads[t], NULL,
+					 prepare_blobs_thread, &data);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	for (int t = 0; t < nr_threads; t++)
+		if (pthread_join(threads[t], NULL))
+			die("unable to join thread");
+	pthread_mutex_destroy(&data.mutex);
+	free(threads);
+
+	for (i = 0; i < data.nr; i++) {
+		struct prepared_blob *blob;
+
+		if (!data.blobs[i].ok)
+			continue;
+		blob = xmalloc(sizeof(*blob));
+		*blob = data.blobs[i];
+		strmap_put(&prepared_blobs, blob->path, blob);
+		prepared++;
+	}
+	trace2_data_intmax("bulk-checkin", the_repository,
+			   "prepare-blobs/prepared", prepared);
+	trace2_region_leave("bulk-checkin", "prepare-blobs", the_repository);
+	free(data.blobs);
+	return consumed;
+}
+
+static void write_prepared_blob(struct bulk_checkin_packfile *state,
+				struct prepared_blob *blob)
+{
+	struct pack_idx_entry *idx;
+
+	if (already_written(state, &blob->oid))
+		return;
+
+	prepare_to_stream(state, INDEX_WRITE_OBJECT);
+	if (state->nr_written && pack_size_limit_cfg &&
+	    pack_size_limit_cfg < state->offset + blob->len) {
+		flush_bulk_checkin_packfile(state);
+		prepare_to_stream(state, INDEX_WRITE_OBJECT);
+	}
+
+	CALLOC_ARRAY(idx, 1);
+	idx->offset = state->offset;
+	crc32_begin(state->f);
+	hashwrite(state->f, blob->data, blob->len);
+	state->offset += blob->len;
+	idx->crc32 = crc32_end(state->f);
+	oidcpy(&idx->oid, &blob->oid);
+	add_written(state, idx);
+}
+
+int index_prepared_blob_bulk_checkin(struct object_id *oid, const char *path,
+				     struct stat *st, unsigned flags)
+{
+	struct prepared_blob *blob = strmap_get(&prepared_blobs, path);
+
+	if (!blob)
+		return -1;
+	strmap_remove(&prepared_blobs, path, 0);
+
+	if (match_stat_data(&blob->sd, st)) {
+		free(blob->data);
+		free(blob);
+		return -1;
+	}
+
+	oidcpy(oid, &blob->oid);
+	if (flags & INDEX_WRITE_OBJECT)
+		write_prepared_blob(&bulk_checkin_packfile, blob);
+	free(blob->data);
+	free(blob);
 	return 0;
 }
 
@@ -374,6 +653,7 @@ void begin_odb_transaction(void)
 
 void flush_odb_transaction(void)
 {
+	discard_prepared_blobs();
 	flush_batch_fsync();
 	flush_bulk_checkin_packfile(&bulk_checkin_packfile);
 }
@@ -6,6 +6,8 @@
 
 #include "object.h"
 
+struct index_state;
+
 void prepare_loose_object_bulk_checkin(void);
 void fsync_loose_object_bulk_checkin(int fd, const char *filename);
 
@@ -28,6 +30,30 @@ int index_blob_bulk_checkin(struct object_id *oid,
 			    int fd, size_t size,
 			    const char *path, unsigned flags);
 
+/*
+ * Read, hash and deflate some of the files "paths" with several threads
+ * (see "add.threads"), so that index_path() can later write them to the
+ * bulk-checkin pack without reading them again. Only regular files that
+ * need no conversion are prepared, and only within an ODB transaction.
+ * The blobs prepared by an earlier call are discarded.
+ *
+ * To bound the memory used, this may stop before the end of "paths";
+ * it returns how many of them it looked at, and the caller calls it
+ * again with the rest once it has added those.
+ */
+size_t prepare_blobs_bulk_checkin(struct index_state *istate,
+				  const char **paths, size_t nr);
+
+/*
+ * If "path" was prepared by prepare_blobs_bulk_checkin() and its stat
+ * data still matches "st", store its object name in "oid", write it to
+ * the bulk-checkin pack if INDEX_WRITE_OBJECT is set in "flags" and
+ * the object does not exist yet, and return 0. Otherwise return -1, and
+ * the caller has to index the file itself.
+ */
+int index_prepared_blob_bulk_checkin(struct object_id *oid, const char *path,
+				     struct stat *st, unsigned flags);
+
 /*
  * Tell the object database to optimize for adding
  * multiple objects. end_odb_transaction must be called
@@ -9,12 +9,14 @@
 #include "tree-walk.h"
 #include "cache-tree.h"
 #include "bulk-checkin.h"
+#include "config.h"
 #include "object-file.h"
 #include "object-store.h"
 #include "read-cache-ll.h"
 #include "replace-object.h"
 #include "repository.h"
 #include "promisor-remote.h"
+#include "thread-utils.h"
 #include "trace.h"
 #include "trace2.h"
 
@@ -254,13 +256,44 @@ static int must_check_existence(const struct cache_entry *ce)
 	return !(repo_has_promisor_remote(the_repository) && ce_skip_worktree(ce));
 }
 
+/*
+ * Tree objects computed by a thread, which the main thread writes out
+ * afterwards in the order they were computed.
+ */
+struct deferred_trees {
+	struct deferred_tree {
+		struct object_id oid;
+		struct strbuf buf;
+	} *items;
+	size_t nr, alloc;
+};
+
+static void defer_tree(struct deferred_trees *deferred,
+		       const struct object_id *oid, struct strbuf *buf)
+{
+	struct deferred_tree *item;
+
+	ALLOC_GROW(deferred->items, deferred->nr + 1, deferred->alloc);
+	item = &deferred->items[deferred->nr++];
+	oidcpy(&item->oid, oid);
+	strbuf_init(&item->buf, 0);
+	strbuf_swap(&item->buf, buf);
+}
+
+/*
+ * With "deferred", the tree objects are only hashed and queued there,
+ * and errors are not reported: the caller runs the serial update
+ * afterwards, which writes nothing new for the trees computed here and
+ * reports any problem itself.
+ */
 static int update_one(struct cache_tree *it,
 		      struct cache_entry **cache,
 		      int entries,
 		      const char *base,
 		      int baselen,
 		      int *skip_count,
-		      int flags)
+		      int flags,
+		      struct deferred_trees *deferred)
 {
 	struct strbuf buffer;
 	int missing_ok = flags & WRITE_TREE_MISSING_OK;
@@ -338,7 +371,7 @@ static int update_one(struct cache_tree *it,
 				    path,
 				    baselen + sublen + 1,
 				    &subskip,
-				    flags);
+				    flags, deferred);
 		if (subcnt < 0)
 			return subcnt;
 		if (!subcnt)
@@ -398,11 +431,14 @@ static int update_one(struct cache_tree *it,
 
 		ce_missing_ok = mode == S_IFGITLINK || missing_ok ||
 			!must_check_existence(ce);
+		/* deferred subtrees are not written yet */
+		if (sub && deferred)
+			ce_missing_ok = 1;
 		if (is_null_oid(oid) ||
 		    (!ce_missing_ok && !has_object(the_repository, oid,
 						   HAS_OBJECT_RECHECK_PACKED | HAS_OBJECT_FETCH_PROMISOR))) {
 			strbuf_release(&buffer);
-			if (expected_missing)
+			if (expected_missing || deferred)
 				return -1;
 			return error("invalid object %06o %s for '%.*s'",
 				mode, oid_to_hex(oid), entlen+baselen, path);
@@ -455,6 +491,10 @@ static int update_one(struct cache_tree *it,
 	} else if (dryrun) {
 		hash_object_file(the_hash_algo, buffer.buf, buffer.len,
 				 OBJ_TREE, &it->oid);
+	} else if (deferred) {
+		hash_object_file(the_hash_algo, buffer.buf, buffer.len,
+				 OBJ_TREE, &it->oid);
+		defer_tree(deferred, &it->oid, &buffer);
 	} else if (write_object_file_flags(buffer.buf, buffer.len, OBJ_TREE,
 					   &it->oid, NULL, flags & WRITE_TREE_SILENT
 					   ? WRITE_OBJECT_FILE_SILENT : 0)) {
@@ -472,9 +512,220 @@ static int update_one(struct cache_tree *it,
 	return i;
 }
 
+#define CACHE_TREE_MAX_THREADS 20
+#define CACHE_TREE_THREAD_COST 1000
+
+/* a task covers at least this many entries, unless its subtree is smaller */
+#define CACHE_TREE_TASK_MIN 100
+
+struct cache_tree_task {
+	struct cache_tree *it;
+	struct cache_entry **cache;
+	int entries;
+	const char *base;
+	int baselen;
+	struct deferred_trees deferred;
+};
+
+struct cache_tree_tasks {
+	struct cache_tree_task *items;
+	size_t nr, alloc;
+	int split; /* subtrees with more entries are split up further */
+	int flags;
+
+	pthread_mutex_t mutex;
+	size_t next;
+};
+
+static int cache_tree_threads(struct index_state *istate, int flags)
+{
+	int nr = 0;
+
+	/*
+	 * Objects that are missing may have to be fetched from a promisor
+	 * remote, and repairing or dry runs want to look at what the
+	 * object store has after each tree.
+	 */
+	if (!HAVE_THREADS ||
+	    (flags & (WRITE_TREE_DRY_RUN | WRITE_TREE_REPAIR)) ||
+	    repo_has_promisor_remote(the_repository))
+		return 1;
+
+	repo_config_get_int(the_repository, "core.cachetreethreads", &nr);
+	if (nr > 0)
+		return nr;
+
+	nr = online_cpus();
+	if (nr > CACHE_TREE_MAX_THREADS)
+		nr = CACHE_TREE_MAX_THREADS;
+	if (nr > istate->cache_nr / CACHE_TREE_THREAD_COST)
+		nr = istate->cache_nr / CACHE_TREE_THREAD_COST;
+	return nr < 1 ? 1 : nr;
+}
+
+/*
+ * Walk down the invalid part of the cache tree, creating the nodes
+ * update_one() would create, and hand out the subtrees below it as
+ * tasks, splitting up the big ones.
+ */
+static void collect_tasks(struct cache_tree_tasks *tasks,
+			  struct cache_tree *it,
+			  struct cache_entry **cache,
+			  int entries,
+			  const char *base,
+			  int baselen)
+{
+	int i = 0;
+
+	while (i < entries) {
+		const struct cache_entry *ce = cache[i];
+		struct cache_tree_sub *sub;
+		const char *path, *slash;
+		int pathlen, prefixlen, end, removed = 0;
+
+		path = ce->name;
+		pathlen = ce_namelen(ce);
+		if (pathlen <= baselen || memcmp(base, path, baselen))
+			break; /* at the end of this level */
+
+		slash = strchr(path + baselen, '/');
+		if (!slash) {
+			i++;
+			continue;
+		}
+		prefixlen = slash - path + 1;
+		for (end = i; end < entries; end++) {
+			const struct cache_entry *e = cache[end];
+
+			if (ce_namelen(e) < prefixlen ||
+			    memcmp(e->name, path, prefixlen))
+				break;
+			if (e->ce_flags & CE_REMOVE)
+				removed = 1;
+		}
+
+		sub = find_subtree(it, path + baselen, prefixlen - baselen - 1, 1);
+		if (!sub->cache_tree)
+			sub->cache_tree = cache_tree();
+
+		if (0 <= sub->cache_tree->entry_count &&
+		    has_object(the_repository, &sub->cache_tree->oid,
+			       HAS_OBJECT_RECHECK_PACKED))
+			; /* nothing to do */
+		else if (end - i > tasks->split)
+			collect_tasks(tasks, sub->cache_tree, cache + i, end - i,
+				      path, prefixlen);
+		else if (!removed) {
+			/*
+			 * A valid subtree tells the serial update how many
+			 * entries it covers by its entry count, which does
+			 * not include CE_REMOVE entries; leave those to it.
+			 */
+			struct cache_tree_task *task;
+
+			ALLOC_GROW(tasks->items, tasks->nr + 1, tasks->alloc);
+			task = &tasks->items[tasks->nr++];
+			memset(task, 0, sizeof(*task));
+			task->it = sub->cache_tree;
+			task->cache = cache + i;
+			task->entries = end - i;
+			task->base = path;
+			task->baselen = prefixlen;
+		}
+		i = end;
+	}
+}
+
+static void *update_tasks_thread(void *data)
+{
+	struct cache_tree_tasks *tasks = data;
+
+	for (;;) {
+		struct cache_tree_task *task = NULL;
+		int skip;
+
+		pthread_mutex_lock(&tasks->mutex);
+		if (tasks->next < tasks->nr)
+			task = &tasks->items[tasks->next++];
+		pthread_mutex_unlock(&tasks->mutex);
+		if (!task)
+			break;
+
+		update_one(task->it, task->cache, task->entries,
+			   task->base, task->baselen, &skip,
+			   tasks->flags, &task->deferred);
+	}
+	return NULL;
+}
+
+/*
+ * Compute the trees of independent subtrees with several threads, and
+ * write them out in a stable order. The serial update_one() that
+ * follows then finds them valid and only has the levels above them
+ * left to do.
+ */
+static void update_subtrees_parallel(struct index_state *istate, int flags,
+				     int nr_threads)
+{
+	struct cache_tree_tasks tasks = { .flags = flags };
+	pthread_t *threads;
+	int nr_workers;
+
+	tasks.split = istate->cache_nr / (nr_threads * 4);
+	if (tasks.split < CACHE_TREE_TASK_MIN)
+		tasks.split = CACHE_TREE_TASK_MIN;
+	collect_tasks(&tasks, istate->cache_tree, istate->cache,
+		      istate->cache_nr, "", 0);
+	if (tasks.nr < 2)
+		goto out;
+
+	nr_workers = nr_threads - 1;
+	if (nr_workers > tasks.nr - 1)
+		nr_workers = tasks.nr - 1;
+
+	pthread_mutex_init(&tasks.mutex, NULL);
+	enable_obj_read_lock();
+	CALLOC_ARRAY(threads, nr_workers);
+	for (int i = 0; i < nr_workers; i++) {
+		int err = pthread_create(&threads[i], NULL,
+					 update_tasks_thread, &tasks);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	update_tasks_thread(&tasks);
+	for (int i = 0; i < nr_workers; i++)
+		pthread_join(threads[i], NULL);
+	disable_obj_read_lock();
+	pthread_mutex_destroy(&tasks.mutex);
+	free(threads);
+
+	trace2_data_intmax("cache_tree", the_repository, "update/threads",
+			   nr_workers + 1);
+
+out:
+	trace2_data_intmax("cache_tree", the_repository, "update/tasks",
+			   tasks.nr);
+	for (size_t i = 0; i < tasks.nr; i++) {
+		struct deferred_trees *deferred = &tasks.items[i].deferred;
+
+		for (size_t j = 0; j < deferred->nr; j++) {
+			struct deferred_tree *item = &deferred->items[j];
+			struct object_id oid;
+
+			/* a failure here is reported by the serial update */
+			write_object_file_flags(item->buf.buf, item->buf.len,
+						OBJ_TREE, &oid, NULL,
+						WRITE_OBJECT_FILE_SILENT);
+			strbuf_release(&item->buf);
+		}
+		free(deferred->items);
+	}
+	free(tasks.items);
+}
+
 int cache_tree_update(struct index_state *istate, int flags)
 {
-	int skip, i;
+	int skip, i, nr_threads;
 
 	i = verify_cache(istate, flags);
 
@@ -490,8 +741,11 @@ int cache_tree_update(struct index_state *istate, int flags)
 	trace_performance_enter();
 	trace2_region_enter("cache_tree", "update", the_repository);
 	begin_odb_transaction();
+	nr_threads = cache_tree_threads(istate, flags);
+	if (nr_threads > 1)
+		update_subtrees_parallel(istate, flags, nr_threads);
 	i = update_one(istate->cache_tree, istate->cache, istate->cache_nr,
-		       "", 0, &skip, flags);
+		       "", 0, &skip, flags, NULL);
 	end_odb_transaction();
 	trace2_region_leave("cache_tree", "update", the_repository);
 	trace_performance_leave("cache_tree_update");
@@ -52,8 +52,10 @@ void git_test_write_commit_graph_or_die(void)
 #define GRAPH_CHUNKID_BLOOMINDEXES 0x42494458 /* "BIDX" */
 #define GRAPH_CHUNKID_BLOOMDATA 0x42444154 /* "BDAT" */
 #define GRAPH_CHUNKID_BASE 0x42415345 /* "BASE" */
+#define GRAPH_CHUNKID_REACHABILITY 0x5245414c /* "REAL" */
 
 #define GRAPH_DATA_WIDTH (the_hash_algo->rawsz + 16)
+#define GRAPH_REACHABILITY_WIDTH 12
 
 #define GRAPH_VERSION_1 0x1
 #define GRAPH_VERSION GRAPH_VERSION_1
@@ -342,6 +344,18 @@ static int graph_read_bloom_index(const unsigned char *chunk_start,
 	return 0;
 }
 
+static int graph_read_reachability(const unsigned char *chunk_start,
+				   size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+	if (chunk_size / GRAPH_REACHABILITY_WIDTH != g->num_commits) {
+		warning(_("commit-graph reachability labels chunk is too small"));
+		return -1;
+	}
+	g->chunk_reachability = chunk_start;
+	return 0;
+}
+
 static int graph_read_bloom_data(const unsigned char *chunk_start,
 				  size_t chunk_size, void *data)
 {
@@ -456,6 +470,9 @@ struct commit_graph *parse_commit_graph(struct repo_settings *s,
 			graph->read_generation_data = 1;
 	}
 
+	read_chunk(cf, GRAPH_CHUNKID_REACHABILITY,
+		   graph_read_reachability, graph);
+
 	if (s->commit_graph_changed_paths_version) {
 		read_chunk(cf, GRAPH_CHUNKID_BLOOMINDEXES,
 			   graph_read_bloom_index, graph);
@@ -541,6 +558,25 @@ static int validate_mixed_generation_chain(struct commit_graph *g)
 	return 0;
 }
 
+/*
+ * The reachability labels of a layer are numbered on top of those of
+ * its base layers and are only usable if all of them have labels, too.
+ */
+static void validate_mixed_reachability_chain(struct commit_graph *g)
+{
+	struct commit_graph *p;
+
+	for (; g; g = g->base_graph) {
+		if (!g->chunk_reachability)
+			continue;
+		for (p = g->base_graph; p; p = p->base_graph)
+			if (!p->chunk_reachability)
+				break;
+		if (p)
+			g->chunk_reachability = NULL;
+	}
+}
+
 static void validate_mixed_bloom_settings(struct commit_graph *g)
 {
 	struct bloom_filter_settings *settings = NULL;
@@ -691,6 +727,7 @@ struct commit_graph *load_commit_graph_chain_fd_st(struct repository *r,
 
 	validate_mixed_generation_chain(graph_chain);
 	validate_mixed_bloom_settings(graph_chain);
+	validate_mixed_reachability_chain(graph_chain);
 
 	free(oids);
 	fclose(fp);
@@ -829,6 +866,58 @@ struct bloom_filter_settings *get_bloom_filter_settings(struct repository *r)
 	return NULL;
 }
 
+struct reachability_label {
+	/* position of the commit in a post-order traversal of the graph */
+	uint32_t post;
+	/* lowest "post" of any commit reachable from this one */
+	uint32_t low;
+	/* lowest "post" of the commits under this one in the traversal */
+	uint32_t first;
+};
+
+static int load_reachability_label(struct commit_graph *g, uint32_t pos,
+				   struct reachability_label *label)
+{
+	const unsigned char *data;
+
+	while (g && pos < g->num_commits_in_base)
+		g = g->base_graph;
+	if (!g || !g->chunk_reachability ||
+	    pos >= g->num_commits + g->num_commits_in_base)
+		return -1;
+
+	data = g->chunk_reachability +
+		st_mult(GRAPH_REACHABILITY_WIDTH, pos - g->num_commits_in_base);
+	label->post = get_be32(data);
+	label->low = get_be32(data + 4);
+	label->first = get_be32(data + 8);
+	return 0;
+}
+
+int commit_graph_reachable(struct repository *r,
+			   struct commit *from, struct commit *to)
+{
+	struct reachability_label from_label, to_label;
+	uint32_t from_pos, to_pos;
+
+	if (!repo_find_commit_pos_in_graph(r, from, &from_pos) ||
+	    !repo_find_commit_pos_in_graph(r, to, &to_pos) ||
+	    load_reachability_label(r->objects->commit_graph, from_pos, &from_label) ||
+	    load_reachability_label(r->objects->commit_graph, to_pos, &to_label))
+		return -1;
+
+	/*
+	 * Everything reachable from "from" comes before it in the
+	 * traversal, but not before the lowest commit it can reach...
+	 */
+	if (to_label.post > from_label.post || to_label.post < from_label.low)
+		return 0;
+	/* ...and everything the traversal went through under it is reachable. */
+	if (to_label.post >= from_label.first)
+		return 1;
+	return -1;
+}
+
 void close_commit_graph(struct raw_object_store *o)
 {
 	if (!o->commit_graph)
@@ -1135,6 +1224,8 @@ struct packed_commit_list {
 	size_t alloc;
 };
 
+define_commit_slab(reachability_label_slab, struct reachability_label);
+
 struct write_commit_graph_context {
 	struct repository *r;
 	struct object_directory *odb;
@@ -1163,9 +1254,11 @@ struct write_commit_graph_context {
 		 changed_paths:1,
 		 order_by_pack:1,
 		 write_generation_data:1,
-		 trust_generation_numbers:1;
+		 trust_generation_numbers:1,
+		 reachability:1;
 
 	struct topo_level_slab *topo_levels;
+	struct reachability_label_slab *reachability_labels;
 	const struct commit_graph_opts *opts;
 	size_t total_bloom_filter_data_size;
 	const struct bloom_filter_settings *bloom_settings;
@@ -1370,6 +1463,26 @@ static int write_graph_chunk_generation_data_overflow(struct hashfile *f,
 	return 0;
 }
 
+static int write_graph_chunk_reachability(struct hashfile *f,
+					  void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		struct reachability_label *label =
+			reachability_label_slab_at(ctx->reachability_labels,
+						   ctx->commits.list[i]);
+
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+		hashwrite_be32(f, label->post);
+		hashwrite_be32(f, label->low);
+		hashwrite_be32(f, label->first);
+	}
+
+	return 0;
+}
+
 static int write_graph_chunk_extra_edges(struct hashfile *f,
 					 void *data)
 {
@@ -1748,6 +1861,157 @@ static void compute_generation_numbers(struct write_commit_graph_context *ctx)
 	stop_progress(&ctx->progress);
 }
 
+/*
+ * The reachability labels come from a depth-first traversal of the
+ * commits being written, going from children to parents. A commit that
+ * reaches another always finishes after it, so it gets the larger
+ * "post" number, and the commits finished while it was on the stack got
+ * a contiguous range of numbers that starts at "first". "low" is the
+ * smallest number of anything the commit can reach; anything outside
+ * of [low, post] cannot be reached.
+ *
+ * The numbers continue those of the base layers: the commits in a new
+ * layer cannot be reached from the commits below it, so they can all
+ * come after them without invalidating the labels that are there.
+ */
+enum reachability_state {
+	REACHABILITY_OUTSIDE = 0,
+	REACHABILITY_PENDING,
+	REACHABILITY_ACTIVE,
+	REACHABILITY_DONE,
+};
+
+define_commit_slab(reachability_state_slab, enum reachability_state);
+
+struct reachability_frame {
+	struct commit *commit;
+	struct commit_list *parent;
+};
+
+static int compare_commits_by_topo_level_desc(const void *va, const void *vb,
+					      void *data)
+{
+	struct topo_level_slab *topo_levels = data;
+	uint32_t a = *topo_level_slab_at(topo_levels, *(struct commit **)va);
+	uint32_t b = *topo_level_slab_at(topo_levels, *(struct commit **)vb);
+
+	if (a > b)
+		return -1;
+	if (a < b)
+		return 1;
+	return 0;
+}
+
+static int get_parent_reachability_label(struct write_commit_graph_context *ctx,
+					 struct reachability_state_slab *state,
+					 struct commit *parent,
+					 struct reachability_label *label)
+{
+	uint32_t pos;
+
+	if (*reachability_state_slab_at(state, parent) == REACHABILITY_DONE) {
+		*label = *reachability_label_slab_at(ctx->reachability_labels,
+						     parent);
+		return 0;
+	}
+
+	/* the parent must be in one of the layers we build upon */
+	pos = commit_graph_position(parent);
+	if (pos == COMMIT_NOT_FROM_GRAPH || pos >= ctx->new_num_commits_in_base)
+		return -1;
+	return load_reachability_label(ctx->r->objects->commit_graph, pos, label);
+}
+
+static int compute_reachability_labels(struct write_commit_graph_context *ctx)
+{
+	struct reachability_state_slab state;
+	struct reachability_frame *stack = NULL;
+	size_t stack_nr = 0, stack_alloc = 0;
+	struct commit **order;
+	uint32_t next = ctx->new_num_commits_in_base;
+	int ret = 0;
+	size_t i;
+
+	init_reachability_state_slab(&state);
+	for (i = 0; i < ctx->commits.nr; i++)
+		*reachability_state_slab_at(&state, ctx->commits.list[i]) =
+			REACHABILITY_PENDING;
+
+	/* start from the tips, so that the traversal covers long paths */
+	ALLOC_ARRAY(order, ctx->commits.nr);
+	COPY_ARRAY(order, ctx->commits.list, ctx->commits.nr);
+	QSORT_S(order, ctx->commits.nr, compare_commits_by_topo_level_desc,
+		ctx->topo_levels);
+
+	if (ctx->report_progress)
+		ctx->progress = start_delayed_progress(
+					the_repository,
+					_("Computing commit graph reachability labels"),
+					ctx->commits.nr);
+
+	for (i = 0; i < ctx->commits.nr && !ret; i++) {
+		if (*reachability_state_slab_at(&state, order[i]) != REACHABILITY_PENDING)
+			continue;
+
+		ALLOC_GROW(stack, stack_nr + 1, stack_alloc);
+		stack[stack_nr].commit = order[i];
+		stack[stack_nr].parent = order[i]->parents;
+		stack_nr++;
+		*reachability_state_slab_at(&state, order[i]) = REACHABILITY_ACTIVE;
+		reachability_label_slab_at(ctx->reachability_labels, order[i])->first = next;
+
+		while (stack_nr) {
+			struct reachability_frame *frame = &stack[stack_nr - 1];
+			struct commit *c = frame->commit;
+			struct reachability_label *label;
+			struct commit_list *p;
+
+			if (frame->parent) {
+				struct commit *parent = frame->parent->item;
+
+				frame->parent = frame->parent->next;
+				if (*reachability_state_slab_at(&state, parent) != REACHABILITY_PENDING)
+					continue;
+
+				*reachability_state_slab_at(&state, parent) = REACHABILITY_ACTIVE;
+				reachability_label_slab_at(ctx->reachability_labels, parent)->first = next;
+				ALLOC_GROW(stack, stack_nr + 1, stack_alloc);
+				stack[stack_nr].commit = parent;
+				stack[stack_nr].parent = parent->parents;
+				stack_nr++;
+				continue;
+			}
+
+			label = reachability_label_slab_at(ctx->reachability_labels, c);
+			label->post = next++;
+			label->low = label->post;
+			for (p = c->parents; p; p = p->next) {
+				struct reachability_label parent_label;
+
+				if (get_parent_reachability_label(ctx, &state, p->item,
+								  &parent_label)) {
+					ret = -1;
+					break;
+				}
+				if (parent_label.low < label->low)
+					label->low = parent_label.low;
+			}
+			if (ret)
+				break;
+
+			*reachability_state_slab_at(&state, c) = REACHABILITY_DONE;
+			display_progress(ctx->progress, ++ctx->progress_cnt);
+			stack_nr--;
+		}
+	}
+	stop_progress(&ctx->progress);
+
+	free(stack);
+	free(order);
+	clear_reachability_state_slab(&state);
+	return ret;
+}
+
 static void set_generation_in_graph_data(struct commit *c, timestamp_t t,
 					 void *data UNUSED)
 {
@@ -2130,6 +2394,10 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 				 ctx->total_bloom_filter_data_size),
 			  write_graph_chunk_bloom_data);
 	}
+	if (ctx->reachability)
+		add_chunk(cf, GRAPH_CHUNKID_REACHABILITY,
+			  st_mult(GRAPH_REACHABILITY_WIDTH, ctx->commits.nr),
+			  write_graph_chunk_reachability);
 	if (ctx->num_commit_graphs_after > 1)
 		add_chunk(cf, GRAPH_CHUNKID_BASE,
 			  st_mult(hashsz, ctx->num_commit_graphs_after - 1),
@@ -2527,6 +2795,7 @@ int write_commit_graph(struct object_directory *odb,
 	int replace = 0;
 	struct bloom_filter_settings bloom_settings = DEFAULT_BLOOM_FILTER_SETTINGS;
 	struct topo_level_slab topo_levels;
+	struct reachability_label_slab reachability_labels;
 
 	prepare_repo_settings(r);
 	if (!r->settings.core_commit_graph) {
@@ -2554,6 +2823,8 @@ int write_commit_graph(struct object_directory *odb,
 
 	init_topo_level_slab(&topo_levels);
 	ctx.topo_levels = &topo_levels;
+	init_reachability_label_slab(&reachability_labels);
+	ctx.reachability_labels = &reachability_labels;
 
 	prepare_commit_graph(ctx.r);
 	if (ctx.r->objects->commit_graph) {
@@ -2587,6 +2858,16 @@ int write_commit_graph(struct object_directory *odb,
 
 	bloom_settings.hash_version = bloom_settings.hash_version == 2 ? 2 : 1;
 
+	if (flags & COMMIT_GRAPH_WRITE_REACHABILITY)
+		ctx.reachability = 1;
+	if (!(flags & COMMIT_GRAPH_NO_WRITE_REACHABILITY)) {
+		struct commit_graph *g = ctx.r->objects->commit_graph;
+
+		/* We have reachability labels already. Keep them in the next graph */
+		if (g && g->chunk_reachability)
+			ctx.reachability = 1;
+	}
+
 	if (ctx.split) {
 		struct commit_graph *g = ctx.r->objects->commit_graph;
 
@@ -2665,6 +2946,19 @@ int write_commit_graph(struct object_directory *odb,
 	if (ctx.write_generation_data)
 		compute_generation_numbers(&ctx);
 
+	if (ctx.reachability && ctx.new_base_graph &&
+	    !ctx.new_base_graph->chunk_reachability) {
+		if (flags & COMMIT_GRAPH_WRITE_REACHABILITY)
+			warning(_("not writing reachability labels, as the base "
+				  "commit-graph layers have none; use "
+				  "'--split=replace' to add them"));
+		ctx.reachability = 0;
+	}
+	if (ctx.reachability && compute_reachability_labels(&ctx)) {
+		warning(_("unable to compute reachability labels for the commit-graph"));
+		ctx.reachability = 0;
+	}
+
 	if (ctx.changed_paths)
 		compute_bloom_filters(&ctx);
 
@@ -2684,6 +2978,7 @@ int write_commit_graph(struct object_directory *odb,
 	free(ctx.commits.list);
 	oid_array_clear(&ctx.oids);
 	clear_topo_level_slab(&topo_levels);
+	clear_reachability_label_slab(&reachability_labels);
 
 	if (ctx.r->objects->commit_graph) {
 		struct commit_graph *g = ctx.r->objects->commit_graph;
@@ -2833,6 +3128,20 @@ static int verify_one_commit_graph(struct repository *r,
 			if (generation > max_generation)
 				max_generation = generation;
 
+			if (g->chunk_reachability) {
+				struct reachability_label label, parent_label;
+
+				if (load_reachability_label(g, commit_graph_position(graph_commit), &label) ||
+				    load_reachability_label(g, commit_graph_position(graph_parents->item),
+							    &parent_label) ||
+				    parent_label.post >= label.post ||
+				    parent_label.low < label.low)
+					graph_report(_("commit-graph reachability label for commit %s "
+						       "does not match its parent %s"),
+						     oid_to_hex(&cur_oid),
+						     oid_to_hex(&graph_parents->item->object.oid));
+			}
+
 			graph_parents = graph_parents->next;
 			odb_parents = odb_parents->next;
 		}
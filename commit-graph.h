@@ -105,6 +105,7 @@ struct commit_graph {
 	size_t chunk_extra_edges_size;
 	const unsigned char *chunk_base_graphs;
 	size_t chunk_base_graphs_size;
+	const unsigned char *chunk_reachability;
 	const unsigned char *chunk_bloom_indexes;
 	const unsigned char *chunk_bloom_data;
 	size_t chunk_bloom_data_size;
@@ -145,12 +146,24 @@ int corrected_commit_dates_enabled(struct repository *r);
 
 struct bloom_filter_settings *get_bloom_filter_settings(struct repository *r);
 
+/*
+ * Use the reachability labels of the commit-graph to tell whether "to"
+ * can be reached from "from" without walking any commits. Returns 1 if
+ * it can, 0 if it cannot, and -1 if the labels cannot tell, e.g. because
+ * either commit is not in a commit-graph layer that has them, in which
+ * case the caller has to walk.
+ */
+int commit_graph_reachable(struct repository *r,
+			   struct commit *from, struct commit *to);
+
 enum commit_graph_write_flags {
 	COMMIT_GRAPH_WRITE_APPEND     = (1 << 0),
 	COMMIT_GRAPH_WRITE_PROGRESS   = (1 << 1),
 	COMMIT_GRAPH_WRITE_SPLIT      = (1 << 2),
 	COMMIT_GRAPH_WRITE_BLOOM_FILTERS = (1 << 3),
 	COMMIT_GRAPH_NO_WRITE_BLOOM_FILTERS = (1 << 4),
+	COMMIT_GRAPH_WRITE_REACHABILITY = (1 << 5),
+	COMMIT_GRAPH_NO_WRITE_REACHABILITY = (1 << 6),
 };
 
 enum commit_graph_split_flags {
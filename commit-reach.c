@@ -5,6 +5,7 @@
 #include "commit-graph.h"
 #include "decorate.h"
 #include "hex.h"
+#include "pack-bitmap.h"
 #include "prio-queue.h"
 #include "ref-filter.h"
 #include "revision.h"
@@ -131,6 +132,44 @@ static int paint_down_to_common(struct repository *r,
 	return 0;
 }
 
+/*
+ * Ask the reachability labels of the commit-graph whether "commit" can
+ * reach any of "list". Returns 1 or 0 if they could tell, and -1 if we
+ * need to walk.
+ */
+static int graph_reaches_any(struct repository *r, struct commit *commit,
+			     const struct commit_list *list)
+{
+	int ret = 0;
+
+	for (; list; list = list->next) {
+		int reachable = commit_graph_reachable(r, commit, list->item);
+
+		if (reachable > 0)
+			return 1;
+		if (reachable < 0)
+			ret = -1;
+	}
+	return ret;
+}
+
+/* Likewise, whether any of "from" can reach "commit". */
+static int graph_any_reaches(struct repository *r, struct commit **from,
+			     size_t nr, struct commit *commit)
+{
+	int ret = 0;
+
+	for (size_t i = 0; i < nr; i++) {
+		int reachable = commit_graph_reachable(r, from[i], commit);
+
+		if (reachable > 0)
+			return 1;
+		if (reachable < 0)
+			ret = -1;
+	}
+	return ret;
+}
+
 static int merge_bases_many(struct repository *r,
 			    struct commit *one, int n,
 			    struct commit **twos,
@@ -163,6 +202,18 @@ static int merge_bases_many(struct repository *r,
 				     oid_to_hex(&twos[i]->object.oid));
 	}
 
+	/* If one is an ancestor of the other, it is the merge base. */
+	if (n == 1) {
+		if (commit_graph_reachable(r, one, twos[0]) == 1) {
+			commit_list_insert(twos[0], result);
+			return 0;
+		}
+		if (commit_graph_reachable(r, twos[0], one) == 1) {
+			commit_list_insert(one, result);
+			return 0;
+		}
+	}
+
 	if (paint_down_to_common(r, one, n, twos, 0, 0, &list)) {
 		free_commit_list(list);
 		return -1;
@@ -499,9 +550,15 @@ int repo_is_descendant_of(struct repository *r,
 			  struct commit *commit,
 			  struct commit_list *with_commit)
 {
+	int ret;
+
 	if (!with_commit)
 		return 1;
 
+	ret = graph_reaches_any(r, commit, with_commit);
+	if (ret >= 0)
+		return ret;
+
 	if (generation_numbers_enabled(r)) {
 		struct commit_list *from_list = NULL;
 		int result;
@@ -512,7 +569,6 @@ int repo_is_descendant_of(struct repository *r,
 	} else {
 		while (with_commit) {
 			struct commit *other;
-			int ret;
 
 			other = with_commit->item;
 			with_commit = with_commit->next;
@@ -546,6 +602,11 @@ int repo_in_merge_bases_many(struct repository *r, struct commit *commit,
 			max_generation = generation;
 	}
 
+	ret = graph_any_reaches(r, reference, nr_reference, commit);
+	if (ret >= 0)
+		return ret;
+	ret = 0;
+
 	generation = commit_graph_generation(commit);
 	if (generation > max_generation)
 		return ret;
@@ -706,6 +767,16 @@ static enum contains_result contains_test(struct commit *candidate,
 		return CONTAINS_YES;
 	}
 
+	/* or can the commit-graph tell? */
+	switch (graph_reaches_any(the_repository, candidate, want)) {
+	case 1:
+		*cached = CONTAINS_YES;
+		return CONTAINS_YES;
+	case 0:
+		*cached = CONTAINS_NO;
+		return CONTAINS_NO;
+	}
+
 	/* Otherwise, we don't know; prepare to recurse */
 	parse_commit_or_die(candidate);
 
@@ -1044,16 +1115,13 @@ static void free_bit_array(struct commit *c)
 	*bitmap = NULL;
 }
 
-void ahead_behind(struct repository *r,
-		  struct commit **commits, size_t commits_nr,
-		  struct ahead_behind_count *counts, size_t counts_nr)
+static void ahead_behind_walk(struct repository *r,
+			      struct commit **commits, size_t commits_nr,
+			      struct ahead_behind_count *counts, size_t counts_nr)
 {
 	struct prio_queue queue = { .compare = compare_commits_by_gen_then_commit_date };
 	size_t width = DIV_ROUND_UP(commits_nr, BITS_IN_EWORD);
 
-	if (!commits_nr || !counts_nr)
-		return;
-
 	for (size_t i = 0; i < counts_nr; i++) {
 		counts[i].ahead = 0;
 		counts[i].behind = 0;
@@ -1122,6 +1190,68 @@ void ahead_behind(struct repository *r,
 	clear_prio_queue(&queue);
 }
 
+void ahead_behind(struct repository *r,
+		  struct commit **commits, size_t commits_nr,
+		  struct ahead_behind_count *counts, size_t counts_nr)
+{
+	struct ahead_behind_count **left, *walk_counts;
+	struct commit **walk_commits;
+	size_t *walk_index;
+	size_t walk_commits_nr = 0;
+	int left_nr;
+
+	if (!commits_nr || !counts_nr)
+		return;
+
+	ALLOC_ARRAY(left, counts_nr);
+	left_nr = bitmap_ahead_behind(r, commits, commits_nr,
+				      counts, counts_nr, left);
+	if (left_nr < 0) {
+		ahead_behind_walk(r, commits, commits_nr, counts, counts_nr);
+		free(left);
+		return;
+	}
+	if (!left_nr) {
+		free(left);
+		return;
+	}
+
+	/*
+	 * Walk for the pairs the bitmaps could not answer, starting from
+	 * only the commits they mention.
+	 */
+	ALLOC_ARRAY(walk_counts, left_nr);
+	ALLOC_ARRAY(walk_commits, commits_nr);
+	ALLOC_ARRAY(walk_index, commits_nr);
+	for (size_t i = 0; i < commits_nr; i++)
+		walk_index[i] = SIZE_MAX;
+	for (int i = 0; i < left_nr; i++) {
+		size_t tip = left[i]->tip_index, base = left[i]->base_index;
+
+		if (walk_index[tip] == SIZE_MAX) {
+			walk_index[tip] = walk_commits_nr;
+			walk_commits[walk_commits_nr++] = commits[tip];
+		}
+		if (walk_index[base] == SIZE_MAX) {
+			walk_index[base] = walk_commits_nr;
+			walk_commits[walk_commits_nr++] = commits[base];
+		}
+		walk_counts[i].tip_index = walk_index[tip];
+		walk_counts[i].base_index = walk_index[base];
+	}
+
+	ahead_behind_walk(r, walk_commits, walk_commits_nr, walk_counts, left_nr);
+
+	for (int i = 0; i < left_nr; i++) {
+		left[i]->ahead = walk_counts[i].ahead;
+		left[i]->behind = walk_counts[i].behind;
+	}
+	free(walk_index);
+	free(walk_commits);
+	free(walk_counts);
+	free(left);
+}
+
 struct commit_and_index {
 	struct commit *commit;
 	unsigned int index;
@@ -1146,7 +1276,7 @@ void tips_reachable_from_bases(struct repository *r,
 			       int mark)
 {
 	struct commit_and_index *commits;
-	size_t min_generation_index = 0;
+	size_t commits_nr = 0, min_generation_index = 0;
 	timestamp_t min_generation;
 	struct commit_list *stack = NULL;
 
@@ -1163,13 +1293,34 @@ void tips_reachable_from_bases(struct repository *r,
 	CALLOC_ARRAY(commits, tips_nr);
 
 	for (size_t i = 0; i < tips_nr; i++) {
-		commits[i].commit = tips[i];
-		commits[i].index = i;
-		commits[i].generation = commit_graph_generation(tips[i]);
+		int reachable = 0;
+
+		/* Take what the commit-graph can tell us without a walk. */
+		for (struct commit_list *b = bases; b; b = b->next) {
+			int res = commit_graph_reachable(r, b->item, tips[i]);
+
+			if (res > 0) {
+				reachable = 1;
+				break;
+			}
+			if (res < 0)
+				reachable = -1;
+		}
+		if (reachable > 0)
+			tips[i]->object.flags |= mark;
+		if (reachable >= 0)
+			continue;
+
+		commits[commits_nr].commit = tips[i];
+		commits[commits_nr].index = i;
+		commits[commits_nr].generation = commit_graph_generation(tips[i]);
+		commits_nr++;
 	}
+	if (!commits_nr)
+		goto done;
 
 	/* Sort with generation number ascending. */
-	QSORT(commits, tips_nr, compare_commit_and_index_by_generation);
+	QSORT(commits, commits_nr, compare_commit_and_index_by_generation);
 	min_generation = commits[0].generation;
 
 	while (bases) {
@@ -1185,7 +1336,7 @@ void tips_reachable_from_bases(struct repository *r,
 		timestamp_t c_gen = commit_graph_generation(c);
 
 		/* Does it match any of our tips? */
-		for (size_t j = min_generation_index; j < tips_nr; j++) {
+		for (size_t j = min_generation_index; j < commits_nr; j++) {
 			if (c_gen < commits[j].generation)
 				break;
 
@@ -1194,12 +1345,12 @@ void tips_reachable_from_bases(struct repository *r,
 
 				if (j == min_generation_index) {
 					unsigned int k = j + 1;
-					while (k < tips_nr &&
+					while (k < commits_nr &&
 					       (tips[commits[k].index]->object.flags & mark))
 						k++;
 
 					/* Terminate early if all found. */
-					if (k >= tips_nr)
+					if (k >= commits_nr)
 						goto done;
 
 					min_generation_index = k;
@@ -125,6 +125,10 @@ struct ahead_behind_count {
 /*
  * Given an array of commits and an array of ahead_behind_count pairs,
  * compute the ahead/behind counts for each pair.
+ *
+ * With a reachability bitmap index, pairs whose commits are close to
+ * bitmapped commits are counted from the bitmaps; the others are counted
+ * by walking the commit history.
  */
 void ahead_behind(struct repository *r,
 		  struct commit **commits, size_t commits_nr,
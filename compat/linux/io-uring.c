@@ -0,0 +1,212 @@
+#include "git-compat-util.h"
+#include "compat/linux/io-uring.h"
+
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+			  unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg,
+			     unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int uring_probe(struct uring *ring, const unsigned char *ops, size_t nr)
+{
+	struct io_uring_probe *probe;
+	size_t len = st_add(sizeof(*probe),
+			    st_mult(256, sizeof(struct io_uring_probe_op)));
+	int ret = 0;
+
+	probe = xcalloc(1, len);
+	if (io_uring_register(ring->fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+		ret = -1;
+		goto out;
+	}
+	for (size_t i = 0; i < nr; i++) {
+		if (ops[i] > probe->last_op ||
+		    !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+			ret = -1;
+			goto out;
+		}
+	}
+out:
+	free(probe);
+	return ret;
+}
+
+int uring_init(struct uring *ring, unsigned entries,
+	       const unsigned char *ops, size_t nr)
+{
+	struct io_uring_params p = { 0 };
+	void *sqes;
+
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = io_uring_setup(entries, &p);
+	if (ring->fd < 0)
+		return -1;
+
+	ring->entries = p.sq_entries;
+	ring->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_ring_len = p.cq_off.cqes +
+			    p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_len > ring->sq_ring_len)
+			ring->sq_ring_len = ring->cq_ring_len;
+		ring->cq_ring_len = ring->sq_ring_len;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, ring->fd,
+			     IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED)
+		goto fail_sq;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_len,
+				     PROT_READ | PROT_WRITE,
+				     MAP_SHARED | MAP_POPULATE, ring->fd,
+				     IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED)
+			goto fail_cq;
+	}
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+		goto fail_sqes;
+	ring->sqes = sqes;
+
+	ring->sq_head = (unsigned *)((char *)ring->sq_ring + p.sq_off.head);
+	ring->sq_tail = (unsigned *)((char *)ring->sq_ring + p.sq_off.tail);
+	ring->sq_mask = (unsigned *)((char *)ring->sq_ring + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)((char *)ring->sq_ring + p.sq_off.array);
+	ring->cq_head = (unsigned *)((char *)ring->cq_ring + p.cq_off.head);
+	ring->cq_tail = (unsigned *)((char *)ring->cq_ring + p.cq_off.tail);
+	ring->cq_mask = (unsigned *)((char *)ring->cq_ring + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ring + p.cq_off.cqes);
+
+	if (uring_probe(ring, ops, nr)) {
+		uring_release(ring);
+		return -1;
+	}
+	return 0;
+
+fail_sqes:
+	if (ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_len);
+fail_cq:
+	munmap(ring->sq_ring, ring->sq_ring_len);
+fail_sq:
+	close(ring->fd);
+	return -1;
+}
+
+void uring_release(struct uring *ring)
+{
+	munmap(ring->sqes, ring->sqes_len);
+	if (ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_len);
+	munmap(ring->sq_ring, ring->sq_ring_len);
+	close(ring->fd);
+	memset(ring, 0, sizeof(*ring));
+}
+
+unsigned uring_space(const struct uring *ring)
+{
+	unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+	return ring->entries - (*ring->sq_tail - head);
+}
+
+struct io_uring_sqe *uring_get_sqe(struct uring *ring)
+{
+	unsigned tail = *ring->sq_tail;
+	unsigned idx = tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+	if (!uring_space(ring))
+		BUG("io_uring submission queue is full");
+
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[idx] = idx;
+	ring->nr_queued++;
+
+	/*
+	 * The kernel only looks at entries before the tail when we call
+	 * io_uring_enter(), by which time the caller has filled it in.
+	 */
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return sqe;
+}
+
+int uring_submit(struct uring *ring, unsigned wait_nr)
+{
+	for (;;) {
+		int n = io_uring_enter(ring->fd, ring->nr_queued, wait_nr,
+				       wait_nr ? IORING_ENTER_GETEVENTS : 0);
+
+		if (n >= 0) {
+			ring->nr_queued -= n;
+			return 0;
+		}
+		if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			return -1;
+	}
+}
+
+int uring_wait(struct uring *ring, unsigned wait_nr)
+{
+	while (io_uring_enter(ring->fd, 0, wait_nr,
+			      IORING_ENTER_GETEVENTS) < 0)
+		if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			return -1;
+	return 0;
+}
+
+struct io_uring_cqe *uring_peek_cqe(struct uring *ring)
+{
+	unsigned head = *ring->cq_head;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_cqe_seen(struct uring *ring)
+{
+	__atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+void statx_to_stat(const struct statx *stx, struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st->st_size = stx->stx_size;
+	st->st_blksize = stx->stx_blksize;
+	st->st_blocks = stx->stx_blocks;
+	st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
@@ -0,0 +1,71 @@
+#ifndef COMPAT_LINUX_IO_URING_H
+#define COMPAT_LINUX_IO_URING_H
+
+#include <linux/io_uring.h>
+
+/*
+ * A minimal io_uring wrapper for the batched system calls in compat/,
+ * talking to the kernel through the raw system calls so that we do not
+ * need liburing.
+ */
+struct uring {
+	int fd;
+	unsigned entries;
+
+	/* submission queue */
+	void *sq_ring;
+	size_t sq_ring_len;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	unsigned nr_queued;
+
+	/* completion queue, which may share the mapping of sq_ring */
+	void *cq_ring;
+	size_t cq_ring_len;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+/*
+ * Set up a ring of (at least) "entries" submission queue entries, and
+ * make sure the kernel knows all the "nr" opcodes in "ops". Returns 0 on
+ * success, or -1 if io_uring cannot be used.
+ */
+int uring_init(struct uring *ring, unsigned entries,
+	       const unsigned char *ops, size_t nr);
+
+void uring_release(struct uring *ring);
+
+/* The number of submission queue entries that can still be queued. */
+unsigned uring_space(const struct uring *ring);
+
+/*
+ * Return a cleared submission queue entry. The caller must have checked
+ * uring_space() first.
+ */
+struct io_uring_sqe *uring_get_sqe(struct uring *ring);
+
+/*
+ * Submit the queued entries and wait for at least "wait_nr" completions.
+ * Returns 0 on success, or -1 with errno set if the kernel refused; the
+ * requests submitted earlier may then still be in flight.
+ */
+int uring_submit(struct uring *ring, unsigned wait_nr);
+
+/*
+ * Wait for at least "wait_nr" completions without submitting anything.
+ * Returns 0 on success, or -1 with errno set.
+ */
+int uring_wait(struct uring *ring, unsigned wait_nr);
+
+/* Return the next completion, or NULL if there is none (yet). */
+struct io_uring_cqe *uring_peek_cqe(struct uring *ring);
+
+/* Release the completion returned by uring_peek_cqe(). */
+void uring_cqe_seen(struct uring *ring);
+
+/* Convert the result of an IORING_OP_STATX request. */
+void statx_to_stat(const struct statx *stx, struct stat *st);
+
+#endif /* COMPAT_LINUX_IO_URING_H */
@@ -0,0 +1,142 @@
+#include "git-compat-util.h"
+#include "compat/lstat-batch.h"
+#include "compat/linux/io-uring.h"
+
+/*
+ * Each batch sets up its own ring, and queues one IORING_OP_STATX
+ * request per path; the kernel runs them in parallel and we collect
+ * the results as they complete. Should the kernel stop taking requests
+ * from the ring, we wait for those it already took, as they write into
+ * "stx", and lstat() the paths whose results we have not seen one by
+ * one. So is everything the batch is asked for afterwards.
+ */
+#define LSTAT_BATCH_RING_SIZE 256
+
+struct lstat_batch {
+	struct uring ring;
+
+	/* the kernel fills these in */
+	struct statx *stx;
+	size_t stx_alloc;
+	unsigned in_flight;
+
+	struct lstat_batch_stats stats;
+
+	unsigned failed : 1;
+};
+
+struct lstat_batch *lstat_batch_new(void)
+{
+	static const unsigned char ops[] = { IORING_OP_STATX };
+	struct lstat_batch *b;
+
+	CALLOC_ARRAY(b, 1);
+	if (uring_init(&b->ring, LSTAT_BATCH_RING_SIZE, ops, ARRAY_SIZE(ops))) {
+		free(b);
+		return NULL;
+	}
+	return b;
+}
+
+static void queue_statx(struct lstat_batch *b, const char *path, size_t i)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(&b->ring);
+
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uintptr_t)path;
+	sqe->len = STATX_BASIC_STATS;
+	sqe->off = (uintptr_t)&b->stx[i];
+	sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+	sqe->user_data = i;
+}
+
+/* Collect the results that are in, and return how many there were. */
+static size_t reap_statx(struct lstat_batch *b, struct stat *st, int *ret)
+{
+	struct io_uring_cqe *cqe;
+	size_t nr = 0;
+
+	while ((cqe = uring_peek_cqe(&b->ring))) {
+		size_t i = cqe->user_data;
+
+		if (!cqe->res) {
+			statx_to_stat(&b->stx[i], &st[i]);
+			ret[i] = 0;
+		} else {
+			errno = -cqe->res;
+			ret[i] = -1;
+		}
+		uring_cqe_seen(&b->ring);
+		nr++;
+	}
+	b->in_flight -= nr;
+	return nr;
+}
+
+void lstat_batch_run(struct lstat_batch *b, const char **paths,
+		     size_t nr, struct stat *st, int *ret)
+{
+	size_t queued = 0, done = 0;
+
+	if (!b || b->failed) {
+		for (size_t i = 0; i < nr; i++)
+			ret[i] = lstat(paths[i], &st[i]);
+		return;
+	}
+
+	/* lstat() only ever returns 0 or -1, so 1 marks what is pending */
+	for (size_t i = 0; i < nr; i++)
+		ret[i] = 1;
+
+	ALLOC_GROW(b->stx, nr, b->stx_alloc);
+	while (done < nr) {
+		while (queued < nr && b->in_flight < b->ring.entries) {
+			queue_statx(b, paths[queued], queued);
+			queued++;
+			b->in_flight++;
+			b->stats.nr_batched++;
+		}
+		if (b->in_flight > b->stats.max_in_flight)
+			b->stats.max_in_flight = b->in_flight;
+
+		if (uring_submit(&b->ring, 1)) {
+			b->failed = 1;
+			break;
+		}
+		done += reap_statx(b, st, ret);
+	}
+
+	if (!b->failed)
+		return;
+
+	/*
+	 * The kernel never saw what is still queued, but may still be
+	 * writing the results of what it took into b->stx, which must
+	 * not be reused or freed before they are in.
+	 */
+	b->in_flight -= b->ring.nr_queued;
+	while (b->in_flight) {
+		if (!reap_statx(b, st, ret) && uring_wait(&b->ring, 1))
+			break;
+	}
+	for (size_t i = 0; i < nr; i++)
+		if (ret[i] > 0)
+			ret[i] = lstat(paths[i], &st[i]);
+}
+
+void lstat_batch_free(struct lstat_batch *b, struct lstat_batch_stats *stats)
+{
+	if (!b)
+		return;
+	if (stats) {
+		stats->nr_batched += b->stats.nr_batched;
+		if (b->stats.max_in_flight > stats->max_in_flight)
+			stats->max_in_flight = b->stats.max_in_flight;
+	}
+	uring_release(&b->ring);
+	/* with results we could not wait for, the kernel may still write */
+	if (!b->in_flight)
+		free(b->stx);
+	free(b);
+}
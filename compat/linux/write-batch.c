@@ -0,0 +1,262 @@
+#include "git-compat-util.h"
+#include "compat/write-batch.h"
+#include "compat/linux/io-uring.h"
+#include "gettext.h"
+
+/*
+ * The files are written in two rounds: first all of them are opened,
+ * then each open file gets a linked chain of write, statx and close
+ * requests. A failure in the chain cancels the rest of it, and we then
+ * finish that file with plain system calls.
+ */
+#define WRITE_BATCH_RING_SIZE 256
+
+/* IORING_OP_WRITE takes a 32-bit length */
+#define WRITE_BATCH_MAX_WRITE (1U << 30)
+
+enum write_batch_op {
+	WB_OPEN,
+	WB_WRITE,
+	WB_STATX,
+	WB_CLOSE,
+};
+
+#define WB_USER_DATA(i, op) (((uint64_t)(i) << 2) | (op))
+
+struct write_batch_state {
+	int fd;
+	int write_res, statx_res, close_res;
+	struct statx stx;
+};
+
+struct write_batch {
+	struct uring ring;
+	struct write_batch_state *state;
+	size_t state_alloc;
+	unsigned in_flight;
+};
+
+struct write_batch *write_batch_new(void)
+{
+	static const unsigned char ops[] = {
+		IORING_OP_OPENAT, IORING_OP_WRITE,
+		IORING_OP_STATX, IORING_OP_CLOSE,
+	};
+	struct write_batch *b;
+
+	CALLOC_ARRAY(b, 1);
+	if (uring_init(&b->ring, WRITE_BATCH_RING_SIZE, ops, ARRAY_SIZE(ops))) {
+		free(b);
+		return NULL;
+	}
+	return b;
+}
+
+static void reap_completions(struct write_batch *b,
+			     struct write_batch_file *files)
+{
+	struct io_uring_cqe *cqe;
+
+	/*
+	 * Unlike a stat, an open or write the kernel may or may not have
+	 * done cannot simply be redone, so there is nothing to fall back
+	 * to here.
+	 */
+	if (uring_submit(&b->ring, 1))
+		die_errno(_("io_uring_enter failed"));
+	while ((cqe = uring_peek_cqe(&b->ring))) {
+		size_t i = cqe->user_data >> 2;
+		struct write_batch_state *s = &b->state[i];
+
+		switch ((enum write_batch_op)(cqe->user_data & 3)) {
+		case WB_OPEN:
+			if (cqe->res < 0) {
+				files[i].result = WRITE_BATCH_OPEN_FAILED;
+				files[i].err = -cqe->res;
+			} else {
+				s->fd = cqe->res;
+			}
+			break;
+		case WB_WRITE:
+			s->write_res = cqe->res;
+			break;
+		case WB_STATX:
+			s->statx_res = cqe->res;
+			break;
+		case WB_CLOSE:
+			s->close_res = cqe->res;
+			break;
+		}
+		uring_cqe_seen(&b->ring);
+		b->in_flight--;
+	}
+}
+
+/* Make room for "nr" more requests, waiting for completions if needed. */
+static void reserve_requests(struct write_batch *b,
+			     struct write_batch_file *files, unsigned nr)
+{
+	while (b->in_flight + nr > b->ring.entries || uring_space(&b->ring) < nr)
+		reap_completions(b, files);
+	b->in_flight += nr;
+}
+
+static void queue_open(struct write_batch *b, struct write_batch_file *file,
+		       size_t i)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(&b->ring);
+
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uintptr_t)file->path;
+	sqe->open_flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+	sqe->len = file->mode;
+	sqe->user_data = WB_USER_DATA(i, WB_OPEN);
+}
+
+static void queue_write_chain(struct write_batch *b,
+			      struct write_batch_file *file, size_t i)
+{
+	struct write_batch_state *s = &b->state[i];
+	struct io_uring_sqe *sqe;
+
+	sqe = uring_get_sqe(&b->ring);
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->flags = IOSQE_IO_LINK;
+	sqe->fd = s->fd;
+	sqe->addr = (uintptr_t)file->buf;
+	sqe->len = file->len < WRITE_BATCH_MAX_WRITE ?
+		   file->len : WRITE_BATCH_MAX_WRITE;
+	sqe->off = 0;
+	sqe->user_data = WB_USER_DATA(i, WB_WRITE);
+
+	if (file->want_stat) {
+		sqe = uring_get_sqe(&b->ring);
+		sqe->opcode = IORING_OP_STATX;
+		sqe->flags = IOSQE_IO_LINK;
+		sqe->fd = s->fd;
+		sqe->addr = (uintptr_t)"";
+		sqe->len = STATX_BASIC_STATS;
+		sqe->off = (uintptr_t)&s->stx;
+		sqe->statx_flags = AT_EMPTY_PATH;
+		sqe->user_data = WB_USER_DATA(i, WB_STATX);
+	}
+
+	sqe = uring_get_sqe(&b->ring);
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = s->fd;
+	sqe->user_data = WB_USER_DATA(i, WB_CLOSE);
+}
+
+/*
+ * Finish a file whose chain was cut short, e.g. by a short write, with
+ * plain system calls.
+ */
+static void finish_file(struct write_batch_file *file,
+			struct write_batch_state *s)
+{
+	size_t written = s->write_res > 0 ? s->write_res : 0;
+	int fd = s->fd;
+
+	if (s->close_res != -ECANCELED) {
+		/* the chain went on and closed the file already */
+		fd = open(file->path, O_WRONLY | O_CLOEXEC);
+		if (fd < 0)
+			goto write_failed;
+	}
+	if (lseek(fd, written, SEEK_SET) < 0 ||
+	    write_in_full(fd, (const char *)file->buf + written,
+			  file->len - written) < 0) {
+		close(fd);
+		goto write_failed;
+	}
+	if (file->want_stat && !fstat(fd, &file->st))
+		file->have_stat = 1;
+	if (close(fd)) {
+		file->result = WRITE_BATCH_CLOSE_FAILED;
+		file->err = errno;
+	}
+	return;
+
+write_failed:
+	file->result = WRITE_BATCH_WRITE_FAILED;
+	file->err = errno;
+}
+
+static void check_chain(struct write_batch_file *file,
+			struct write_batch_state *s)
+{
+	if (s->write_res < 0 && s->write_res != -ECANCELED) {
+		file->result = WRITE_BATCH_WRITE_FAILED;
+		file->err = -s->write_res;
+		if (s->close_res == -ECANCELED)
+			close(s->fd);
+		return;
+	}
+	if (s->write_res < 0 || (size_t)s->write_res < file->len) {
+		finish_file(file, s);
+		return;
+	}
+
+	if (file->want_stat && !s->statx_res) {
+		statx_to_stat(&s->stx, &file->st);
+		file->have_stat = 1;
+	}
+	if (s->close_res == -ECANCELED) {
+		/* statx failed, so we have to close the file ourselves */
+		if (close(s->fd)) {
+			file->result = WRITE_BATCH_CLOSE_FAILED;
+			file->err = errno;
+		}
+	} else if (s->close_res < 0) {
+		file->result = WRITE_BATCH_CLOSE_FAILED;
+		file->err = -s->close_res;
+	}
+}
+
+void write_batch_run(struct write_batch *b,
+		     struct write_batch_file *files, size_t nr)
+{
+	if (!b)
+		BUG("write_batch_run() called without a batch");
+
+	ALLOC_GROW(b->state, nr, b->state_alloc);
+	for (size_t i = 0; i < nr; i++) {
+		files[i].result = WRITE_BATCH_OK;
+		files[i].err = 0;
+		files[i].have_stat = 0;
+		b->state[i].fd = -1;
+		b->state[i].write_res = -ECANCELED;
+		b->state[i].statx_res = -ECANCELED;
+		b->state[i].close_res = -ECANCELED;
+	}
+
+	for (size_t i = 0; i < nr; i++) {
+		reserve_requests(b, files, 1);
+		queue_open(b, &files[i], i);
+	}
+	while (b->in_flight)
+		reap_completions(b, files);
+
+	for (size_t i = 0; i < nr; i++) {
+		if (b->state[i].fd < 0)
+			continue;
+		reserve_requests(b, files, files[i].want_stat ? 3 : 2);
+		queue_write_chain(b, &files[i], i);
+	}
+	while (b->in_flight)
+		reap_completions(b, files);
+
+	for (size_t i = 0; i < nr; i++)
+		if (b->state[i].fd >= 0)
+			check_chain(&files[i], &b->state[i]);
+}
+
+void write_batch_free(struct write_batch *b)
+{
+	if (!b)
+		return;
+	uring_release(&b->ring);
+	free(b->state);
+	free(b);
+}
@@ -0,0 +1,38 @@
+#ifndef COMPAT_LSTAT_BATCH_H
+#define COMPAT_LSTAT_BATCH_H
+
+/*
+ * Call lstat() on many paths at once. Where the platform allows it
+ * (io_uring on Linux), the calls are handed to the kernel in batches
+ * rather than made one after another, which helps on filesystems where
+ * each call has a high latency, e.g. network and overlay filesystems.
+ *
+ * A batch is not thread-safe; each thread needs its own.
+ */
+struct lstat_batch;
+
+struct lstat_batch_stats {
+	/* number of calls handed to the kernel in batches */
+	uintmax_t nr_batched;
+	/* the most calls that were in flight at once */
+	unsigned max_in_flight;
+};
+
+/*
+ * Returns NULL if the platform cannot batch calls. lstat_batch_run()
+ * then simply calls lstat() on each path.
+ */
+struct lstat_batch *lstat_batch_new(void);
+
+/*
+ * Stat the "nr" paths, setting "ret[i]" to what lstat() on "paths[i]"
+ * would return, and filling in "st[i]" if it succeeded.
+ */
+void lstat_batch_run(struct lstat_batch *batch, const char **paths,
+		     size_t nr, struct stat *st, int *ret);
+
+/* Add the statistics of "batch" to "stats" if not NULL, and free it. */
+void lstat_batch_free(struct lstat_batch *batch,
+		      struct lstat_batch_stats *stats);
+
+#endif /* COMPAT_LSTAT_BATCH_H */
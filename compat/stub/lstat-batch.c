@@ -0,0 +1,22 @@
+#include "git-compat-util.h"
+#include "compat/lstat-batch.h"
+
+/*
+ * Stub. See the io_uring implementation in compat/linux/lstat-batch.c.
+ */
+struct lstat_batch *lstat_batch_new(void)
+{
+	return NULL;
+}
+
+void lstat_batch_run(struct lstat_batch *batch UNUSED, const char **paths,
+		     size_t nr, struct stat *st, int *ret)
+{
+	for (size_t i = 0; i < nr; i++)
+		ret[i] = lstat(paths[i], &st[i]);
+}
+
+void lstat_batch_free(struct lstat_batch *batch UNUSED,
+		      struct lstat_batch_stats *stats UNUSED)
+{
+}
@@ -0,0 +1,20 @@
+#include "git-compat-util.h"
+#include "compat/write-batch.h"
+
+/*
+ * Stub. See the io_uring implementation in compat/linux/write-batch.c.
+ */
+struct write_batch *write_batch_new(void)
+{
+	return NULL;
+}
+
+void write_batch_run(struct write_batch *batch UNUSED,
+		     struct write_batch_file *files UNUSED, size_t nr UNUSED)
+{
+	BUG("write_batch_run() called without a batch");
+}
+
+void write_batch_free(struct write_batch *batch UNUSED)
+{
+}
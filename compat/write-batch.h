@@ -0,0 +1,54 @@
+#ifndef COMPAT_WRITE_BATCH_H
+#define COMPAT_WRITE_BATCH_H
+
+/*
+ * Create and write many small files at once. Where the platform allows
+ * it (io_uring on Linux), the open(), write(), fstat() and close() calls
+ * of all files are handed to the kernel in batches rather than made one
+ * after another.
+ *
+ * A batch is not thread-safe; each thread needs its own.
+ */
+struct write_batch;
+
+enum write_batch_result {
+	WRITE_BATCH_OK = 0,
+	WRITE_BATCH_OPEN_FAILED,
+	WRITE_BATCH_WRITE_FAILED,
+	WRITE_BATCH_CLOSE_FAILED,
+};
+
+struct write_batch_file {
+	/* input */
+	const char *path;
+	mode_t mode;
+	const void *buf;
+	size_t len;
+	unsigned want_stat : 1;
+
+	/* output */
+	enum write_batch_result result;
+	int err; /* errno of the call that failed */
+	unsigned have_stat : 1; /* "st" was filled in by fstat() */
+	struct stat st;
+};
+
+/*
+ * Returns NULL if the platform cannot batch calls, in which case the
+ * caller has to write the files itself.
+ */
+struct write_batch *write_batch_new(void);
+
+/*
+ * Create each of the "nr" files with open(path, O_WRONLY|O_CREAT|O_EXCL,
+ * mode), write its contents, fstat() it if "want_stat" is set, and close
+ * it. The results are reported in the "output" fields. A file whose
+ * write or close failed is left behind; the caller decides whether to
+ * unlink() it.
+ */
+void write_batch_run(struct write_batch *batch,
+		     struct write_batch_file *files, size_t nr);
+
+void write_batch_free(struct write_batch *batch);
+
+#endif /* COMPAT_WRITE_BATCH_H */
@@ -8,6 +8,7 @@
 # define gz_header_s zng_gz_header_s
 
 # define crc32(crc, buf, len) zng_crc32(crc, buf, len)
+# define crc32_combine(crc1, crc2, len2) zng_crc32_combine(crc1, crc2, len2)
 
 # define inflate(strm, bits) zng_inflate(strm, bits)
 # define inflateEnd(strm) zng_inflateEnd(strm)
@@ -22,6 +23,7 @@
 # define deflateInit2(stream, level, method, window_bits, mem_level, strategy) zng_deflateInit2(stream, level, method, window_bits, mem_level, strategy)
 # define deflateReset(strm) zng_deflateReset(strm)
 # define deflateSetHeader(strm, head) zng_deflateSetHeader(strm, head)
+# define deflateSetDictionary(strm, dict, len) zng_deflateSetDictionary(strm, dict, len)
 
 #else
 # include <zlib.h>
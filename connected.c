@@ -10,6 +10,249 @@
 #include "transport.h"
 #include "packfile.h"
 #include "promisor-remote.h"
+#include "config.h"
+#include "commit.h"
+#include "tree.h"
+#include "tree-walk.h"
+#include "tag.h"
+#include "oid-array.h"
+#include "oidset.h"
+#include "prio-queue.h"
+#include "pack-bitmap.h"
+#include "ewah/ewok.h"
+#include "trace2.h"
+#include "shallow.h"
+
+/*
+ * Upper bound on the number of objects the in-process check is willing
+ * to look at before giving up and handing the tips to rev-list, which
+ * can stop at existing refs instead of at bitmapped commits.
+ */
+#define CONNECTIVITY_BITMAP_MAX_OBJECTS 100000
+
+struct bitmap_connectivity {
+	struct repository *repo;
+	struct bitmap_index *bitmap_git;
+	/* objects known to exist together with everything they reach */
+	struct bitmap *closed;
+	struct oidset seen;
+	struct prio_queue commits;
+	struct object_array trees;
+	unsigned long nr_objects;
+};
+
+static int bitmap_connectivity_closed(struct bitmap_connectivity *bc,
+				      const struct object_id *oid)
+{
+	return bitmap_walk_contains(bc->bitmap_git, bc->closed, oid);
+}
+
+/*
+ * Returns 1 if the object was not visited before and is not already
+ * known to be connected, in which case the caller must inspect it.
+ */
+static int bitmap_connectivity_visit(struct bitmap_connectivity *bc,
+				     const struct object_id *oid)
+{
+	if (oidset_insert(&bc->seen, oid))
+		return 0;
+	if (bitmap_connectivity_closed(bc, oid))
+		return 0;
+	bc->nr_objects++;
+	return 1;
+}
+
+static int bitmap_connectivity_add_tip(struct bitmap_connectivity *bc,
+				       const struct object_id *oid)
+{
+	while (1) {
+		enum object_type type = oid_object_info(bc->repo, oid, NULL);
+
+		switch (type) {
+		case OBJ_COMMIT: {
+			struct commit *commit = lookup_commit(bc->repo, oid);
+			if (!commit)
+				return -1;
+			prio_queue_put(&bc->commits, commit);
+			return 0;
+		}
+		case OBJ_TREE: {
+			struct tree *tree = lookup_tree(bc->repo, oid);
+			if (!tree)
+				return -1;
+			add_object_array(&tree->object, NULL, &bc->trees);
+			return 0;
+		}
+		case OBJ_BLOB:
+			return 0;
+		case OBJ_TAG: {
+			struct tag *tag = lookup_tag(bc->repo, oid);
+			if (!tag || parse_tag(tag) || !tag->tagged)
+				return -1;
+			oid = &tag->tagged->oid;
+			break;
+		}
+		default:
+			return -1;
+		}
+	}
+}
+
+static int bitmap_connectivity_walk_commits(struct bitmap_connectivity *bc)
+{
+	struct commit *commit;
+
+	while ((commit = prio_queue_get(&bc->commits))) {
+		struct ewah_bitmap *reachable;
+		struct commit_list *parent;
+		struct tree *tree;
+
+		if (!bitmap_connectivity_visit(bc, &commit->object.oid))
+			continue;
+		if (bc->nr_objects > CONNECTIVITY_BITMAP_MAX_OBJECTS)
+			return -1;
+		if (repo_parse_commit_gently(bc->repo, commit, 1))
+			return -1;
+
+		reachable = bitmap_for_commit(bc->bitmap_git, commit);
+		if (reachable) {
+			bitmap_or_ewah(bc->closed, reachable);
+			continue;
+		}
+
+		tree = repo_get_commit_tree(bc->repo, commit);
+		if (!tree)
+			return -1;
+		add_object_array(&tree->object, NULL, &bc->trees);
+		for (parent = commit->parents; parent; parent = parent->next)
+			prio_queue_put(&bc->commits, parent->item);
+	}
+
+	return 0;
+}
+
+static int bitmap_connectivity_walk_trees(struct bitmap_connectivity *bc)
+{
+	while (bc->trees.nr) {
+		struct tree *tree = (struct tree *)object_array_pop(&bc->trees);
+		struct tree_desc desc;
+		struct name_entry entry;
+		int ret = 0;
+
+		if (!bitmap_connectivity_visit(bc, &tree->object.oid))
+			continue;
+		if (parse_tree_gently(tree, 1))
+			return -1;
+
+		init_tree_desc(&desc, &tree->object.oid,
+			       tree->buffer, tree->size);
+		while (tree_entry(&desc, &entry)) {
+			if (S_ISGITLINK(entry.mode))
+				continue;
+			if (S_ISDIR(entry.mode)) {
+				struct tree *subtree = lookup_tree(bc->repo,
+								   &entry.oid);
+				if (!subtree) {
+					ret = -1;
+					break;
+				}
+				add_object_array(&subtree->object, NULL,
+						 &bc->trees);
+				continue;
+			}
+			if (!bitmap_connectivity_visit(bc, &entry.oid))
+				continue;
+			if (!has_object(bc->repo, &entry.oid,
+					HAS_OBJECT_RECHECK_PACKED)) {
+				ret = -1;
+				break;
+			}
+		}
+		free_tree_buffer(tree);
+
+		if (ret < 0 || bc->nr_objects > CONNECTIVITY_BITMAP_MAX_OBJECTS)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Try to prove that everything reachable from "tips" exists without
+ * spawning rev-list. The walk stops at objects covered by the
+ * reachability bitmap of a commit we have reached, as such objects are
+ * known to be present together with everything they reach.
+ *
+ * Returns 0 if the tips are connected, and -1 if we could not tell, in
+ * which case the caller should fall back to the rev-list check. A
+ * missing object is not reported here, so that rev-list can produce
+ * the authoritative answer and error message for it.
+ */
+static int check_connected_bitmap(struct repository *r,
+				  const struct oid_array *tips)
+{
+	struct bitmap_connectivity bc = {
+		.repo = r,
+		.seen = OIDSET_INIT,
+		.commits = { compare_commits_by_gen_then_commit_date },
+		.trees = OBJECT_ARRAY_INIT,
+	};
+	int ret = -1;
+	size_t i;
+
+	bc.bitmap_git = prepare_bitmap_git(r);
+	if (!bc.bitmap_git)
+		return -1;
+	bc.closed = bitmap_new();
+
+	trace2_region_enter("connectivity", "bitmap", r);
+
+	for (i = 0; i < tips->nr; i++)
+		if (bitmap_connectivity_add_tip(&bc, &tips->oid[i]) < 0)
+			goto out;
+
+	if (!bitmap_connectivity_walk_commits(&bc) &&
+	    !bitmap_connectivity_walk_trees(&bc))
+		ret = 0;
+
+out:
+	trace2_data_intmax("connectivity", r, "bitmap/objects",
+			   bc.nr_objects);
+	trace2_data_string("connectivity", r, "bitmap/result",
+			   ret ? "fallback" : "connected");
+	trace2_region_leave("connectivity", "bitmap", r);
+
+	clear_prio_queue(&bc.commits);
+	object_array_clear(&bc.trees);
+	oidset_clear(&bc.seen);
+	bitmap_free(bc.closed);
+	free_bitmap_index(bc.bitmap_git);
+	return ret;
+}
+
+static int use_bitmap_connectivity_check(struct repository *r,
+					 struct check_connected_options *opt)
+{
+	int enabled = 1;
+
+	/*
+	 * Shallow boundaries and deepening fetches need the exact
+	 * semantics of rev-list's "--not --all" walk.
+	 */
+	if (opt->shallow_file || opt->is_deepening_fetch ||
+	    is_repository_shallow(r))
+		return 0;
+
+	/*
+	 * In a partial clone, looking at an object we do not have
+	 * would fetch it from the promisor remote.
+	 */
+	if (repo_has_promisor_remote(r))
+		return 0;
+
+	repo_config_get_bool(r, "transfer.bitmapconnectivity", &enabled);
+	return enabled;
+}
 
 /*
  * If we feed all the commits we want to verify to this command
@@ -20,6 +263,10 @@
  * these commits locally exists and is connected to our existing refs.
  * Note that this does _not_ validate the individual objects.
  *
+ * When the repository has a reachability bitmap, we first try to prove
+ * the same thing in-process (see check_connected_bitmap() above) and
+ * only spawn rev-list if that does not succeed.
+ *
  * Returns 0 if everything is connected, non-zero otherwise.
  */
 int check_connected(oid_iterate_fn fn, void *cb_data,
@@ -32,7 +279,8 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 	int err = 0;
 	struct packed_git *new_pack = NULL;
 	struct transport *transport;
-	size_t base_len;
+	struct oid_array tips = OID_ARRAY_INIT;
+	size_t base_len, i;
 
 	if (!opt)
 		opt = &defaults;
@@ -95,6 +343,31 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 	}
 
 no_promisor_pack_found:
+	do {
+		/*
+		 * If index-pack already checked that:
+		 * - there are no dangling pointers in the new pack
+		 * - the pack is self contained
+		 * Then if the updated ref is in the new pack, then we
+		 * are sure the ref is good and not sending it to
+		 * rev-list for verification.
+		 */
+		if (new_pack && find_pack_entry_one(oid, new_pack))
+			continue;
+
+		oid_array_append(&tips, oid);
+	} while ((oid = fn(cb_data)) != NULL);
+
+	if (!tips.nr ||
+	    (use_bitmap_connectivity_check(the_repository, opt) &&
+	     !check_connected_bitmap(the_repository, &tips))) {
+		if (opt->err_fd)
+			close(opt->err_fd);
+		oid_array_clear(&tips);
+		free(new_pack);
+		return 0;
+	}
+
 	if (opt->shallow_file) {
 		strvec_push(&rev_list.args, "--shallow-file");
 		strvec_push(&rev_list.args, opt->shallow_file);
@@ -128,6 +401,7 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 		rev_list.no_stderr = opt->quiet;
 
 	if (start_command(&rev_list)) {
+		oid_array_clear(&tips);
 		free(new_pack);
 		return error(_("Could not run 'git rev-list'"));
 	}
@@ -136,21 +410,9 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 
 	rev_list_in = xfdopen(rev_list.in, "w");
 
-	do {
-		/*
-		 * If index-pack already checked that:
-		 * - there are no dangling pointers in the new pack
-		 * - the pack is self contained
-		 * Then if the updated ref is in the new pack, then we
-		 * are sure the ref is good and not sending it to
-		 * rev-list for verification.
-		 */
-		if (new_pack && find_pack_entry_one(oid, new_pack))
-			continue;
-
-		if (fprintf(rev_list_in, "%s\n", oid_to_hex(oid)) < 0)
+	for (i = 0; i < tips.nr; i++)
+		if (fprintf(rev_list_in, "%s\n", oid_to_hex(&tips.oid[i])) < 0)
 			break;
-	} while ((oid = fn(cb_data)) != NULL);
 
 	if (ferror(rev_list_in) || fflush(rev_list_in)) {
 		if (errno != EPIPE && errno != EINVAL)
@@ -162,6 +424,7 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 		err = error_errno(_("failed to close rev-list's stdin"));
 
 	sigchain_pop(SIGPIPE);
+	oid_array_clear(&tips);
 	free(new_pack);
 	return finish_command(&rev_list) || err;
 }
@@ -745,15 +745,139 @@ static int apply_single_file_filter(const char *path, const char *src, size_t le
 #define CAP_CLEAN    (1u<<0)
 #define CAP_SMUDGE   (1u<<1)
 #define CAP_DELAY    (1u<<2)
+#define CAP_PIPELINE (1u<<3)
+
+/*
+ * A request queued with the "pipeline" capability. Once answered, the
+ * answer is used by the next conversion of the same path, provided the
+ * contents are the same as those that were sent.
+ */
+struct filter_request {
+	struct hashmap_entry ent;
+	struct hashmap_entry id_ent; /* in "pending" until answered */
+	uintmax_t id;
+	unsigned int capability;
+	struct object_id input;
+	int answered;
+	struct strbuf output;
+	char path[FLEX_ARRAY];
+};
 
 struct cmd2process {
 	struct subprocess_entry subprocess; /* must be the first member! */
 	unsigned int supported_capabilities;
+
+	/* requests queued with the "pipeline" capability */
+	struct hashmap requests;
+	struct hashmap pending; /* those not answered yet, by id */
+	size_t nr_queued; /* how many of them are not answered yet */
+	uintmax_t next_request_id;
 };
 
 static int subprocess_map_initialized;
 static struct hashmap subprocess_map;
 
+static unsigned int filter_request_hash(const char *path,
+					unsigned int capability)
+{
+	return strhash(path) ^ capability;
+}
+
+struct filter_request_key {
+	const char *path;
+	unsigned int capability;
+};
+
+static int filter_request_cmp(const void *cmp_data UNUSED,
+			      const struct hashmap_entry *eptr,
+			      const struct hashmap_entry *entry_or_key,
+			      const void *keydata)
+{
+	const struct filter_request *a, *b;
+	const struct filter_request_key *key = keydata;
+
+	a = container_of(eptr, const struct filter_request, ent);
+	if (key)
+		return a->capability != key->capability ||
+		       strcmp(a->path, key->path);
+	b = container_of(entry_or_key, const struct filter_request, ent);
+	return a->capability != b->capability || strcmp(a->path, b->path);
+}
+
+static unsigned int filter_request_id_hash(uintmax_t id)
+{
+	return memhash(&id, sizeof(id));
+}
+
+static int filter_request_id_cmp(const void *cmp_data UNUSED,
+				 const struct hashmap_entry *eptr,
+				 const struct hashmap_entry *entry_or_key,
+				 const void *keydata)
+{
+	const struct filter_request *a, *b;
+	const uintmax_t *id = keydata;
+
+	a = container_of(eptr, const struct filter_request, id_ent);
+	if (id)
+		return a->id != *id;
+	b = container_of(entry_or_key, const struct filter_request, id_ent);
+	return a->id != b->id;
+}
+
+static struct filter_request *find_filter_request(struct cmd2process *entry,
+						  const char *path,
+						  unsigned int capability)
+{
+	struct filter_request_key key = { path, capability };
+
+	return hashmap_get_entry_from_hash(&entry->requests,
+					   filter_request_hash(path, capability),
+					   &key, struct filter_request, ent);
+}
+
+static void remove_filter_request(struct cmd2process *entry,
+				  struct filter_request *req)
+{
+	hashmap_remove(&entry->requests, &req->ent, NULL);
+	if (!req->answered) {
+		hashmap_remove(&entry->pending, &req->id_ent, &req->id);
+		entry->nr_queued--;
+	}
+	strbuf_release(&req->output);
+	free(req);
+}
+
+/* Drop the answers that no conversion asked for. */
+static void drop_filter_answers(struct cmd2process *entry)
+{
+	struct hashmap_iter iter;
+	struct filter_request *req;
+	struct filter_request **answered = NULL;
+	size_t i, nr = 0, alloc = 0;
+
+	hashmap_for_each_entry(&entry->requests, &iter, req, ent) {
+		if (!req->answered)
+			continue;
+		ALLOC_GROW(answered, nr + 1, alloc);
+		answered[nr++] = req;
+	}
+	for (i = 0; i < nr; i++)
+		remove_filter_request(entry, answered[i]);
+	free(answered);
+}
+
+static void clear_filter_requests(struct cmd2process *entry)
+{
+	struct hashmap_iter iter;
+	struct filter_request *req;
+
+	hashmap_for_each_entry(&entry->requests, &iter, req, ent)
+		strbuf_release(&req->output);
+	hashmap_clear(&entry->pending);
+	hashmap_clear_and_free(&entry->requests, struct filter_request, ent);
+	entry->nr_queued = 0;
+}
+
 static int start_multi_file_filter_fn(struct subprocess_entry *subprocess)
 {
 	static int versions[] = {2, 0};
@@ -761,6 +885,7 @@ static int start_multi_file_filter_fn(struct subprocess_entry *subprocess)
 		{ "clean",  CAP_CLEAN  },
 		{ "smudge", CAP_SMUDGE },
 		{ "delay",  CAP_DELAY  },
+		{ "pipeline", CAP_PIPELINE },
 		{ NULL, 0 }
 	};
 	struct cmd2process *entry = (struct cmd2process *)subprocess;
@@ -789,23 +914,14 @@ static void handle_filter_error(const struct strbuf *filter_status,
 		 */
 		error(_("external filter '%s' failed"), entry->subprocess.cmd);
 		subprocess_stop(&subprocess_map, &entry->subprocess);
+		clear_filter_requests(entry);
 		free(entry);
 	}
 }
 
-static int apply_multi_file_filter(const char *path, const char *src, size_t len,
-				   int fd, struct strbuf *dst, const char *cmd,
-				   const unsigned int wanted_capability,
-				   const struct checkout_metadata *meta,
-				   struct delayed_checkout *dco)
+static struct cmd2process *find_multi_file_filter(const char *cmd)
 {
-	int err;
-	int can_delay = 0;
 	struct cmd2process *entry;
-	struct child_process *process;
-	struct strbuf nbuf = STRBUF_INIT;
-	struct strbuf filter_status = STRBUF_INIT;
-	const char *filter_type;
 
 	if (!subprocess_map_initialized) {
 		subprocess_map_initialized = 1;
@@ -818,61 +934,221 @@ static int apply_multi_file_filter(const char *path, const char *src, size_t len
 	fflush(NULL);
 
 	if (!entry) {
-		entry = xmalloc(sizeof(*entry));
-		entry->supported_capabilities = 0;
+		CALLOC_ARRAY(entry, 1);
 
 		if (subprocess_start(&subprocess_map, &entry->subprocess, cmd, start_multi_file_filter_fn)) {
 			free(entry);
-			return 0;
+			return NULL;
 		}
+		hashmap_init(&entry->requests, filter_request_cmp, NULL, 0);
+		hashmap_init(&entry->pending, filter_request_id_cmp, NULL, 0);
 	}
-	process = &entry->subprocess.process;
-
-	if (!(entry->supported_capabilities & wanted_capability))
-		return 0;
-
-	if (wanted_capability & CAP_CLEAN)
-		filter_type = "clean";
-	else if (wanted_capability & CAP_SMUDGE)
-		filter_type = "smudge";
-	else
-		die(_("unexpected filter type"));
+	return entry;
+}
 
-	sigchain_push(SIGPIPE, SIG_IGN);
+static int write_filter_request(struct child_process *process,
+				const char *filter_type, const char *path,
+				const struct checkout_metadata *meta)
+{
+	int err;
 
 	assert(strlen(filter_type) < LARGE_PACKET_DATA_MAX - strlen("command=\n"));
 	err = packet_write_fmt_gently(process->in, "command=%s\n", filter_type);
 	if (err)
-		goto done;
+		return err;
 
 	err = strlen(path) > LARGE_PACKET_DATA_MAX - strlen("pathname=\n");
 	if (err) {
 		error(_("path name too long for external filter"));
-		goto done;
+		return err;
 	}
 
 	err = packet_write_fmt_gently(process->in, "pathname=%s\n", path);
 	if (err)
-		goto done;
+		return err;
 
 	if (meta && meta->refname) {
 		err = packet_write_fmt_gently(process->in, "ref=%s\n", meta->refname);
 		if (err)
-			goto done;
+			return err;
 	}
 
 	if (meta && !is_null_oid(&meta->treeish)) {
 		err = packet_write_fmt_gently(process->in, "treeish=%s\n", oid_to_hex(&meta->treeish));
 		if (err)
-			goto done;
+			return err;
 	}
 
 	if (meta && !is_null_oid(&meta->blob)) {
 		err = packet_write_fmt_gently(process->in, "blob=%s\n", oid_to_hex(&meta->blob));
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static int read_filter_answer(struct cmd2process *entry)
+{
+	struct child_process *process = &entry->subprocess.process;
+	struct filter_request *req = NULL;
+	struct strbuf status = STRBUF_INIT;
+	int err = 0;
+	char *line;
+
+	for (;;) {
+		const char *value;
+
+		if (packet_read_line_gently(process->out, NULL, &line) < 0) {
+			err = -1;
+			goto done;
+		}
+		if (!line)
+			break;
+		if (skip_prefix(line, "request-id=", &value)) {
+			uintmax_t id = strtoumax(value, NULL, 10);
+
+			req = hashmap_get_entry_from_hash(&entry->pending,
+							  filter_request_id_hash(id),
+							  &id, struct filter_request,
+							  id_ent);
+		} else if (skip_prefix(line, "status=", &value)) {
+			strbuf_reset(&status);
+			strbuf_addstr(&status, value);
+		}
+	}
+
+	if (!req) {
+		err = error(_("external filter '%s' answered an unknown request"),
+			    entry->subprocess.cmd);
+		goto done;
+	}
+
+	if (!strcmp(status.buf, "success")) {
+		err = read_packetized_to_strbuf(process->out, &req->output,
+						PACKET_READ_GENTLE_ON_EOF) < 0;
 		if (err)
 			goto done;
+		err = subprocess_read_status(process->out, &status);
+		if (err)
+			goto done;
+	}
+
+	if (!strcmp(status.buf, "success")) {
+		hashmap_remove(&entry->pending, &req->id_ent, &req->id);
+		req->answered = 1;
+		entry->nr_queued--;
+	} else {
+		/*
+		 * Drop the request; the conversion asks the filter again,
+		 * and handles whatever it says then.
+		 */
+		remove_filter_request(entry, req);
 	}
 
+done:
+	strbuf_release(&status);
+	return err;
+}
+
+/*
+ * Tell the filter to answer all queued requests, and collect the
+ * answers. On error the filter is stopped and -1 is returned; "entry"
+ * must not be used anymore then.
+ */
+static int run_filter_queue(struct cmd2process *entry)
+{
+	struct child_process *process = &entry->subprocess.process;
+	struct strbuf filter_status = STRBUF_INIT;
+	int err;
+
+	sigchain_push(SIGPIPE, SIG_IGN);
+
+	err = packet_write_fmt_gently(process->in, "command=flush_requests\n");
+	if (!err)
+		err = packet_flush_gently(process->in);
+	while (!err && entry->nr_queued)
+		err = read_filter_answer(entry);
+
+	sigchain_pop(SIGPIPE);
+
+	if (err) {
+		handle_filter_error(&filter_status, entry, 0);
+		strbuf_release(&filter_status);
+		return -1;
+	}
+	return 0;
+}
+
+static int apply_multi_file_filter(const char *path, const char *src, size_t len,
+				   int fd, struct strbuf *dst, const char *cmd,
+				   const unsigned int wanted_capability,
+				   const struct checkout_metadata *meta,
+				   struct delayed_checkout *dco)
+{
+	int err;
+	int can_delay = 0;
+	struct cmd2process *entry;
+	struct child_process *process;
+	struct filter_request *req;
+	struct strbuf nbuf = STRBUF_INIT;
+	struct strbuf filter_status = STRBUF_INIT;
+	struct strbuf fd_input = STRBUF_INIT;
+	const char *filter_type;
+
+	entry = find_multi_file_filter(cmd);
+	if (!entry)
+		return 0;
+	process = &entry->subprocess.process;
+
+	if (!(entry->supported_capabilities & wanted_capability))
+		return 0;
+
+	if (wanted_capability & CAP_CLEAN)
+		filter_type = "clean";
+	else if (wanted_capability & CAP_SMUDGE)
+		filter_type = "smudge";
+	else
+		die(_("unexpected filter type"));
+
+	/*
+	 * The filter does not expect other requests while it has
+	 * queued requests to answer.
+	 */
+	if (entry->nr_queued && run_filter_queue(entry))
+		return 0;
+
+	req = find_filter_request(entry, path, wanted_capability);
+	if (req) {
+		struct object_id oid;
+
+		if (fd >= 0) {
+			if (strbuf_read(&fd_input, fd, 0) < 0) {
+				remove_filter_request(entry, req);
+				strbuf_release(&fd_input);
+				return error_errno(_("read error while filtering '%s'"),
+						   path);
+			}
+			src = fd_input.buf;
+			len = fd_input.len;
+			fd = -1;
+		}
+		hash_object_file(the_hash_algo, src, len, OBJ_BLOB, &oid);
+		if (oideq(&oid, &req->input)) {
+			strbuf_swap(dst, &req->output);
+			remove_filter_request(entry, req);
+			strbuf_release(&fd_input);
+			return 1;
+		}
+		remove_filter_request(entry, req);
+	}
+
+	sigchain_push(SIGPIPE, SIG_IGN);
+
+	err = write_filter_request(process, filter_type, path, meta);
+	if (err)
+		goto done;
+
 	if ((entry->supported_capabilities & CAP_DELAY) &&
 	    dco && dco->state == CE_CAN_DELAY) {
 		can_delay = 1;
@@ -930,9 +1206,111 @@ static int apply_multi_file_filter(const char *path, const char *src, size_t len
 		strbuf_swap(dst, &nbuf);
 	strbuf_release(&nbuf);
 	strbuf_release(&filter_status);
+	strbuf_release(&fd_input);
 	return !err;
 }
 
+/*
+ * Send a request with the "pipeline" capability, without waiting for
+ * the answer. Returns 1 if the request was queued.
+ */
+static int queue_filter_request(const char *path, const char *src, size_t len,
+				const char *cmd, unsigned int capability,
+				const struct checkout_metadata *meta)
+{
+	struct cmd2process *entry = find_multi_file_filter(cmd);
+	struct child_process *process;
+	struct filter_request *req;
+	int err;
+
+	if (!entry ||
+	    !(entry->supported_capabilities & CAP_PIPELINE) ||
+	    !(entry->supported_capabilities & capability))
+		return 0;
+
+	req = find_filter_request(entry, path, capability);
+	if (req) {
+		if (!req->answered)
+			return 0; /* it is already on its way */
+		remove_filter_request(entry, req);
+	}
+	if (entry->nr_queued >= CONVERT_QUEUE_MAX && run_filter_queue(entry))
+		return 0;
+	process = &entry->subprocess.process;
+
+	FLEX_ALLOC_STR(req, path, path);
+	hashmap_entry_init(&req->ent, filter_request_hash(path, capability));
+	req->id = entry->next_request_id++;
+	hashmap_entry_init(&req->id_ent, filter_request_id_hash(req->id));
+	req->capability = capability;
+	strbuf_init(&req->output, 0);
+	hash_object_file(the_hash_algo, src, len, OBJ_BLOB, &req->input);
+
+	sigchain_push(SIGPIPE, SIG_IGN);
+
+	err = write_filter_request(process,
+				   capability == CAP_CLEAN ? "clean" : "smudge",
+				   path, meta);
+	if (!err)
+		err = packet_write_fmt_gently(process->in,
+					      "request-id=%"PRIuMAX"\n", req->id);
+	if (!err)
+		err = packet_flush_gently(process->in);
+	if (!err)
+		err = write_packetized_from_buf_no_flush(src, len, process->in);
+	if (!err)
+		err = packet_flush_gently(process->in);
+
+	sigchain_pop(SIGPIPE);
+
+	if (err) {
+		struct strbuf filter_status = STRBUF_INIT;
+
+		free(req);
+		handle_filter_error(&filter_status, entry, 0);
+		strbuf_release(&filter_status);
+		return 0;
+	}
+
+	hashmap_add(&entry->requests, &req->ent);
+	hashmap_add(&entry->pending, &req->id_ent);
+	entry->nr_queued++;
+	return 1;
+}
+
+/* Whether "cmd" has been started, or can be started, with "capability" */
+static int can_queue_filter_request(const char *cmd, unsigned int capability)
+{
+	struct cmd2process *entry = find_multi_file_filter(cmd);
+
+	return entry &&
+	       (entry->supported_capabilities & CAP_PIPELINE) &&
+	       (entry->supported_capabilities & capability);
+}
+
+void convert_run_queue(void)
+{
+	struct hashmap_iter iter;
+	struct cmd2process *entry;
+	struct cmd2process **queued = NULL;
+	size_t i, nr = 0, alloc = 0;
+
+	if (!subprocess_map_initialized)
+		return;
+
+	hashmap_for_each_entry(&subprocess_map, &iter, entry, subprocess.ent) {
+		drop_filter_answers(entry);
+		if (entry->nr_queued) {
+			ALLOC_GROW(queued, nr + 1, alloc);
+			queued[nr++] = entry;
+		}
+	}
+
+	/* run_filter_queue() may stop the filter, so iterate over a copy */
+	for (i = 0; i < nr; i++)
+		run_filter_queue(queued[i]);
+	free(queued);
+}
 
 int async_query_available_blobs(const char *cmd, struct string_list *available_paths)
 {
@@ -991,6 +1369,8 @@ static struct convert_driver {
 	char *clean;
 	char *process;
 	int required;
+	/* capabilities that "process" turned out not to queue */
+	unsigned int unqueueable;
 } *user_convert, **user_convert_tail;
 
 static int apply_filter(const char *path, const char *src, size_t len,
@@ -1316,11 +1696,8 @@ static int git_path_check_ident(struct attr_check_item *check)
 
 static struct attr_check *check;
 
-void convert_attrs(struct index_state *istate,
-		   struct conv_attrs *ca, const char *path)
+static void init_convert_attrs(void)
 {
-	struct attr_check_item *ccheck = NULL;
-
 	if (!check) {
 		check = attr_check_initl("crlf", "ident", "filter",
 					 "eol", "text", "working-tree-encoding",
@@ -1328,7 +1705,14 @@ void convert_attrs(struct index_state *istate,
 		user_convert_tail = &user_convert;
 		git_config(read_convert_config, NULL);
 	}
+}
 
+void convert_attrs(struct index_state *istate,
+		   struct conv_attrs *ca, const char *path)
+{
+	struct attr_check_item *ccheck = NULL;
+
+	init_convert_attrs();
 	git_check_attr(istate, path, check);
 	ccheck = check->items;
 	ca->crlf_action = git_path_check_crlf(ccheck + 4);
@@ -1477,19 +1861,23 @@ void convert_to_git_filter_fd(struct index_state *istate,
 	ident_to_git(dst->buf, dst->len, dst, ca.ident);
 }
 
-static int convert_to_working_tree_ca_internal(const struct conv_attrs *ca,
-					       const char *path, const char *src,
-					       size_t len, struct strbuf *dst,
-					       int normalizing,
-					       const struct checkout_metadata *meta,
-					       struct delayed_checkout *dco)
+/*
+ * The conversions that come before the smudge filter. Returns 1 if they
+ * changed the contents, which are then in "dst", and points "src" and
+ * "len" to them.
+ */
+static int convert_to_working_tree_before_filter(const struct conv_attrs *ca,
+						 const char *path,
+						 const char **src, size_t *len,
+						 struct strbuf *dst,
+						 int normalizing)
 {
-	int ret = 0, ret_filter = 0;
+	int ret = 0;
 
-	ret |= ident_to_worktree(src, len, dst, ca->ident);
+	ret |= ident_to_worktree(*src, *len, dst, ca->ident);
 	if (ret) {
-		src = dst->buf;
-		len = dst->len;
+		*src = dst->buf;
+		*len = dst->len;
 	}
 	/*
 	 * CRLF conversion can be skipped if normalizing, unless there
@@ -1497,18 +1885,32 @@ static int convert_to_working_tree_ca_internal(const struct conv_attrs *ca,
 	 * support smudge).  The filters might expect CRLFs.
 	 */
 	if ((ca->drv && (ca->drv->smudge || ca->drv->process)) || !normalizing) {
-		ret |= crlf_to_worktree(src, len, dst, ca->crlf_action);
+		ret |= crlf_to_worktree(*src, *len, dst, ca->crlf_action);
 		if (ret) {
-			src = dst->buf;
-			len = dst->len;
+			*src = dst->buf;
+			*len = dst->len;
 		}
 	}
 
-	ret |= encode_to_worktree(path, src, len, dst, ca->working_tree_encoding);
+	ret |= encode_to_worktree(path, *src, *len, dst, ca->working_tree_encoding);
 	if (ret) {
-		src = dst->buf;
-		len = dst->len;
+		*src = dst->buf;
+		*len = dst->len;
 	}
+	return ret;
+}
+
+static int convert_to_working_tree_ca_internal(const struct conv_attrs *ca,
+					       const char *path, const char *src,
+					       size_t len, struct strbuf *dst,
+					       int normalizing,
+					       const struct checkout_metadata *meta,
+					       struct delayed_checkout *dco)
+{
+	int ret = 0, ret_filter = 0;
+
+	ret = convert_to_working_tree_before_filter(ca, path, &src, &len, dst,
+						    normalizing);
 
 	ret_filter = apply_filter(
 		path, src, len, -1, dst, ca->drv, CAP_SMUDGE, meta, dco);
@@ -1537,6 +1939,81 @@ int convert_to_working_tree_ca(const struct conv_attrs *ca,
 						   meta, NULL);
 }
 
+int convert_has_process_filters(void)
+{
+	struct convert_driver *drv;
+
+	init_convert_attrs();
+	for (drv = user_convert; drv; drv = drv->next)
+		if (drv->process && *drv->process &&
+		    drv->unqueueable != (CAP_CLEAN | CAP_SMUDGE))
+			return 1;
+	return 0;
+}
+
+/*
+ * Whether requests for "capability" can be queued to the process of
+ * "drv". The answer does not change once the process has told what it
+ * supports, so remember a negative one to spare the callers looking at
+ * more paths for nothing.
+ */
+static int driver_can_queue(struct convert_driver *drv,
+			    unsigned int capability)
+{
+	if (!drv || !drv->process || !*drv->process ||
+	    (drv->unqueueable & capability))
+		return 0;
+	if (can_queue_filter_request(drv->process, capability))
+		return 1;
+	drv->unqueueable |= capability;
+	return 0;
+}
+
+int convert_queue_to_git(struct index_state *istate, const char *path)
+{
+	struct conv_attrs ca;
+	struct strbuf buf = STRBUF_INIT;
+	struct stat st;
+	int ret;
+
+	convert_attrs(istate, &ca, path);
+	if (!driver_can_queue(ca.drv, CAP_CLEAN))
+		return 0;
+	if (lstat(path, &st) || !S_ISREG(st.st_mode) ||
+	    strbuf_read_file(&buf, path, st.st_size) < 0) {
+		strbuf_release(&buf);
+		return 0;
+	}
+
+	ret = queue_filter_request(path, buf.buf, buf.len, ca.drv->process,
+				   CAP_CLEAN, NULL);
+	strbuf_release(&buf);
+	return ret;
+}
+
+int convert_can_queue_to_working_tree(const struct conv_attrs *ca)
+{
+	return driver_can_queue(ca->drv, CAP_SMUDGE);
+}
+
+int convert_queue_to_working_tree_ca(const struct conv_attrs *ca,
+				     const char *path, const char *src,
+				     size_t len,
+				     const struct checkout_metadata *meta)
+{
+	struct strbuf buf = STRBUF_INIT;
+	int ret;
+
+	if (!convert_can_queue_to_working_tree(ca))
+		return 0;
+
+	convert_to_working_tree_before_filter(ca, path, &src, &len, &buf, 0);
+	ret = queue_filter_request(path, src, len, ca->drv->process,
+				   CAP_SMUDGE, meta);
+	strbuf_release(&buf);
+	return ret;
+}
+
 int renormalize_buffer(struct index_state *istate, const char *path,
 		       const char *src, size_t len, struct strbuf *dst)
 {
@@ -112,6 +112,45 @@ int async_convert_to_working_tree_ca(const struct conv_attrs *ca,
 				     size_t len, struct strbuf *dst,
 				     const struct checkout_metadata *meta,
 				     void *dco);
+
+/*
+ * Long-running filter processes (see "filter.<driver>.process") that
+ * have the "pipeline" capability accept several requests before they
+ * answer any of them, so that a filter can work on them concurrently.
+ *
+ * A caller that is about to convert many files can queue up to
+ * CONVERT_QUEUE_MAX of them with convert_queue_to_git() or
+ * convert_queue_to_working_tree_ca(), and then call convert_run_queue()
+ * to collect the answers. The next conversion of a queued path with the
+ * same contents uses the answer instead of asking the filter; answers
+ * that nobody asks for are dropped by the next convert_run_queue().
+ *
+ * The queue functions return 1 if the path was queued. Paths that are
+ * not filtered by such a process are not queued.
+ */
+#define CONVERT_QUEUE_MAX 64
+
+/*
+ * Whether any filter.<driver>.process may still queue requests: it is
+ * configured, and has not turned out to lack the "pipeline" capability.
+ */
+int convert_has_process_filters(void);
+
+/* Queue the clean filter of the file "path" in the working tree. */
+int convert_queue_to_git(struct index_state *istate, const char *path);
+
+/*
+ * Whether convert_queue_to_working_tree_ca() would queue a path with
+ * the attributes "ca", to check before reading its contents.
+ */
+int convert_can_queue_to_working_tree(const struct conv_attrs *ca);
+int convert_queue_to_working_tree_ca(const struct conv_attrs *ca,
+				     const char *path, const char *src,
+				     size_t len,
+				     const struct checkout_metadata *meta);
+
+void convert_run_queue(void);
+
 static inline int convert_to_working_tree(struct index_state *istate,
 					  const char *path, const char *src,
 					  size_t len, struct strbuf *dst,
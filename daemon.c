@@ -12,6 +12,8 @@
 #include "setup.h"
 #include "strbuf.h"
 #include "string-list.h"
+#include "trace.h"
+#include "trace2.h"
 
 #ifdef NO_INITGROUPS
 #define initgroups(x, y) (0) /* nothing */
@@ -30,6 +32,7 @@ static int informative_errors;
 static const char daemon_usage[] =
 "git daemon [--verbose] [--syslog] [--export-all]\n"
 "           [--timeout=<n>] [--init-timeout=<n>] [--max-connections=<n>]\n"
+"           [--max-queued-connections=<n>]\n"
 "           [--strict-paths] [--base-path=<path>] [--base-path-relaxed]\n"
 "           [--user-path | --user-path=<path>]\n"
 "           [--interpolated-path=<path>]\n"
@@ -809,6 +812,7 @@ static struct child {
 	struct child *next;
 	struct child_process cld;
 	struct sockaddr_storage address;
+	uint64_t start_ns;
 } *firstborn;
 
 static void add_child(struct child_process *cld, struct sockaddr *addr, socklen_t addrlen)
@@ -819,6 +823,7 @@ static void add_child(struct child_process *cld, struct sockaddr *addr, socklen_
 	live_children++;
 	memcpy(&newborn->cld, cld, sizeof(*cld));
 	memcpy(&newborn->address, addr, addrlen);
+	newborn->start_ns = getnanotime();
 	for (cradle = &firstborn; *cradle; cradle = &(*cradle)->next)
 		if (!addrcmp(&(*cradle)->address, &newborn->address))
 			break;
@@ -858,6 +863,8 @@ static void check_dead_children(void)
 			if (status)
 				dead = " (with error)";
 			loginfo("[%"PRIuMAX"] Disconnected%s", (uintmax_t)pid, dead);
+			trace2_data_intmax("daemon", NULL, "service_time_ms",
+					   (getnanotime() - blanket->start_ns) / 1000000);
 
 			/* remove the child */
 			*cradle = blanket->next;
@@ -868,22 +875,51 @@ static void check_dead_children(void)
 			cradle = &blanket->next;
 }
 
+/*
+ * Connections accepted while "max_connections" children are running,
+ * waiting in arrival order for one of them to finish. Once
+ * "max_queued_connections" are waiting we stop accepting, and leave
+ * further clients in the listen backlog of the kernel.
+ */
+static unsigned int max_queued_connections;
+static unsigned int nr_queued;
+
+static struct queued_connection {
+	struct queued_connection *next;
+	int fd;
+	struct sockaddr_storage address;
+	socklen_t addrlen;
+	uint64_t queued_ns;
+} *queue_head, **queue_tail = &queue_head;
+
+static int queue_is_full(void)
+{
+	return max_queued_connections && nr_queued >= max_queued_connections;
+}
+
+static void queue_connection(int incoming, struct sockaddr *addr, socklen_t addrlen)
+{
+	struct queued_connection *q;
+
+	CALLOC_ARRAY(q, 1);
+	q->fd = incoming;
+	memcpy(&q->address, addr, addrlen);
+	q->addrlen = addrlen;
+	q->queued_ns = getnanotime();
+	*queue_tail = q;
+	queue_tail = &q->next;
+	nr_queued++;
+
+	loginfo("Too many children, queueing connection (%u waiting)",
+		nr_queued);
+	trace2_data_intmax("daemon", NULL, "queue_depth", nr_queued);
+}
+
 static struct strvec cld_argv = STRVEC_INIT;
-static void handle(int incoming, struct sockaddr *addr, socklen_t addrlen)
+static void start_child(int incoming, struct sockaddr *addr, socklen_t addrlen)
 {
 	struct child_process cld = CHILD_PROCESS_INIT;
 
-	if (max_connections && live_children >= max_connections) {
-		kill_some_child();
-		sleep(1);  /* give it some time to die */
-		check_dead_children();
-		if (live_children >= max_connections) {
-			close(incoming);
-			logerror("Too many children, dropping connection");
-			return;
-		}
-	}
-
 	if (addr->sa_family == AF_INET) {
 		char buf[128] = "";
 		struct sockaddr_in *sin_addr = (void *) addr;
@@ -912,6 +948,45 @@ static void handle(int incoming, struct sockaddr *addr, socklen_t addrlen)
 		add_child(&cld, addr, addrlen);
 }
 
+static void start_queued_connections(void)
+{
+	while (queue_head &&
+	       (!max_connections || live_children < max_connections)) {
+		struct queued_connection *q = queue_head;
+
+		queue_head = q->next;
+		if (!queue_head)
+			queue_tail = &queue_head;
+		nr_queued--;
+
+		trace2_data_intmax("daemon", NULL, "queue_wait_ms",
+				   (getnanotime() - q->queued_ns) / 1000000);
+		start_child(q->fd, (struct sockaddr *)&q->address, q->addrlen);
+		free(q);
+	}
+}
+
+static void handle(int incoming, struct sockaddr *addr, socklen_t addrlen)
+{
+	if (max_connections && live_children >= max_connections) {
+		if (max_queued_connections && !queue_is_full()) {
+			queue_connection(incoming, addr, addrlen);
+			return;
+		}
+
+		kill_some_child();
+		sleep(1);  /* give it some time to die */
+		check_dead_children();
+		if (live_children >= max_connections) {
+			close(incoming);
+			logerror("Too many children, dropping connection");
+			return;
+		}
+	}
+
+	start_child(incoming, addr, addrlen);
+}
+
 static void child_handler(int signo UNUSED)
 {
 	/*
@@ -1132,9 +1207,20 @@ static int service_loop(struct socketlist *socklist)
 	signal(SIGCHLD, child_handler);
 
 	for (;;) {
+		size_t nr_pfd = socklist->nr;
+
 		check_dead_children();
+		start_queued_connections();
 
-		if (poll(pfd, socklist->nr, -1) < 0) {
+		/*
+		 * Stop accepting while the queue is full. We may miss
+		 * the SIGCHLD of a child that died before we got to
+		 * poll(), so do not wait forever while connections are
+		 * queued.
+		 */
+		if (queue_is_full())
+			nr_pfd = 0;
+		if (poll(pfd, nr_pfd, nr_queued ? 1000 : -1) < 0) {
 			if (errno != EINTR) {
 				logerror("Poll failed, resuming: %s",
 				      strerror(errno));
@@ -1143,7 +1229,7 @@ static int service_loop(struct socketlist *socklist)
 			continue;
 		}
 
-		for (size_t i = 0; i < socklist->nr; i++) {
+		for (size_t i = 0; i < nr_pfd; i++) {
 			if (pfd[i].revents & POLLIN) {
 				union {
 					struct sockaddr sa;
@@ -1322,6 +1408,11 @@ int cmd_main(int argc, const char **argv)
 			max_connections = parsed_value < 0 ? 0 : parsed_value;
 			continue;
 		}
+		if (skip_prefix(arg, "--max-queued-connections=", &v)) {
+			if (strtoul_ui(v, 10, &max_queued_connections))
+				die(_("invalid max-queued-connections '%s', expecting a non-negative integer"), v);
+			continue;
+		}
 		if (!strcmp(arg, "--strict-paths")) {
 			strict_paths = 1;
 			continue;
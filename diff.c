@@ -4117,6 +4117,13 @@ static int diff_populate_gitlink(struct diff_filespec *s, int size_only)
  * grab the data for the blob (or file) for our own in-core comparison.
  * diff_filespec has data and size fields for this purpose.
  */
+static struct oidmap *readahead_blobs;
+
+void diff_set_readahead_blobs(struct oidmap *blobs)
+{
+	readahead_blobs = blobs;
+}
+
 int diff_populate_filespec(struct repository *r,
 			   struct diff_filespec *s,
 			   const struct diff_populate_filespec_options *options)
@@ -4221,6 +4228,17 @@ int diff_populate_filespec(struct repository *r,
 		struct object_info info = {
 			.sizep = &s->size
 		};
+		struct diff_readahead_blob *blob = NULL;
+
+		if (readahead_blobs)
+			blob = oidmap_remove(readahead_blobs, &s->oid);
+		if (blob) {
+			s->data = blob->data;
+			s->size = blob->size;
+			s->should_free = 1;
+			free(blob);
+			return 0;
+		}
 
 		if (!(size_only || check_binary))
 			/*
@@ -5,6 +5,7 @@
 #define DIFFCORE_H
 
 #include "hash.h"
+#include "oidmap.h"
 
 struct diff_options;
 struct mem_pool;
@@ -75,6 +76,19 @@ void fill_filespec(struct diff_filespec *, const struct object_id *,
  */
 void diff_queued_diff_prefetch(void *repository);
 
+/*
+ * Blob contents that have been read ahead of time, e.g. by another
+ * thread. diff_populate_filespec() takes a blob out of the map set with
+ * diff_set_readahead_blobs() and uses its buffer instead of reading the
+ * object again. Pass NULL to stop using the map.
+ */
+struct diff_readahead_blob {
+	struct oidmap_entry entry;
+	void *data;
+	unsigned long size;
+};
+void diff_set_readahead_blobs(struct oidmap *blobs);
+
 struct diff_populate_filespec_options {
 	unsigned check_size_only : 1;
 	unsigned check_binary : 1;
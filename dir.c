@@ -18,6 +18,7 @@
 #include "gettext.h"
 #include "name-hash.h"
 #include "object-file.h"
+#include "object-store.h"
 #include "path.h"
 #include "refs.h"
 #include "repository.h"
@@ -32,6 +33,7 @@
 #include "sparse-index.h"
 #include "submodule-config.h"
 #include "symlinks.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "tree.h"
 #include "hex.h"
@@ -577,6 +579,19 @@ int match_pathspec(struct index_state *istate,
 					 prefix, seen, flags);
 }
 
+int match_leading_pathspec(struct index_state *istate,
+			   const struct pathspec *ps,
+			   const char *name, int namelen,
+			   int prefix, char *seen, int is_dir)
+{
+	unsigned flags = DO_MATCH_LEADING_PATHSPEC;
+
+	if (is_dir)
+		flags |= DO_MATCH_DIRECTORY;
+	return match_pathspec_with_flags(istate, ps, name, namelen,
+					 prefix, seen, flags);
+}
+
 /**
  * Check if a submodule is a superset of the pathspec
  */
@@ -968,6 +983,185 @@ static int read_skip_worktree_file_from_index(struct index_state *istate,
 	return do_read_blob(&istate->cache[pos]->oid, oid_stat, size_out, data_out);
 }
 
+/*
+ * Lists shorter than this are scanned as they are; generated ignore
+ * files can be thousands of lines long, though, and every path of the
+ * working tree is checked against them.
+ */
+#define PATTERN_INDEX_MIN 32
+
+/*
+ * A pattern that is a literal name, a "*suffix", or a literal path
+ * can only match a path whose basename, basename suffix or whole path
+ * is that string. Such patterns are put in hash tables keyed by that
+ * string, and the positions of the patterns with the same key are kept
+ * in increasing order. All other patterns are tried in turn, but only
+ * those after the last one found in the tables.
+ */
+struct pattern_index_entry {
+	struct hashmap_entry ent;
+	int *pos;
+	int nr, alloc;
+	int keylen;
+	char key[FLEX_ARRAY];
+};
+
+struct pattern_list_index {
+	/* the number of patterns of the list that have been indexed */
+	int nr;
+	int ignore_case;
+
+	struct hashmap basenames;
+	struct hashmap suffixes;
+	struct hashmap paths;
+
+	/* lengths of the "*suffix" patterns, longest first */
+	int *suffix_len;
+	int suffix_len_nr, suffix_len_alloc;
+
+	/* positions of the patterns in none of the tables */
+	int *other;
+	int other_nr, other_alloc;
+};
+
+struct pattern_index_key {
+	const char *key;
+	int keylen;
+};
+
+static int pattern_index_entry_cmp(const void *cmp_data UNUSED,
+				   const struct hashmap_entry *eptr,
+				   const struct hashmap_entry *entry_or_key UNUSED,
+				   const void *keydata)
+{
+	const struct pattern_index_entry *e =
+		container_of(eptr, const struct pattern_index_entry, ent);
+	const struct pattern_index_key *k = keydata;
+
+	return e->keylen != k->keylen || fspathncmp(e->key, k->key, k->keylen);
+}
+
+static unsigned int pattern_index_hash(const char *key, int keylen)
+{
+	return ignore_case ? memihash(key, keylen) : memhash(key, keylen);
+}
+
+static void pattern_index_add(struct hashmap *map, const char *key, int keylen,
+			      int pos)
+{
+	struct pattern_index_key k = { key, keylen };
+	unsigned int hash = pattern_index_hash(key, keylen);
+	struct pattern_index_entry *e;
+
+	e = hashmap_get_entry_from_hash(map, hash, &k,
+					struct pattern_index_entry, ent);
+	if (!e) {
+		FLEX_ALLOC_MEM(e, key, key, keylen);
+		e->keylen = keylen;
+		hashmap_entry_init(&e->ent, hash);
+		hashmap_add(map, &e->ent);
+	}
+	ALLOC_GROW(e->pos, e->nr + 1, e->alloc);
+	e->pos[e->nr++] = pos;
+}
+
+static void clear_pattern_index_map(struct hashmap *map)
+{
+	struct hashmap_iter iter;
+	struct pattern_index_entry *e;
+
+	hashmap_for_each_entry(map, &iter, e, ent)
+		free(e->pos);
+	hashmap_clear_and_free(map, struct pattern_index_entry, ent);
+}
+
+static void free_pattern_list_index(struct pattern_list *pl)
+{
+	struct pattern_list_index *index = pl->index;
+
+	if (!index)
+		return;
+	clear_pattern_index_map(&index->basenames);
+	clear_pattern_index_map(&index->suffixes);
+	clear_pattern_index_map(&index->paths);
+	free(index->suffix_len);
+	free(index->other);
+	FREE_AND_NULL(pl->index);
+}
+
+static void index_pattern(struct pattern_list_index *index,
+			  struct path_pattern *pattern, int pos)
+{
+	const char *p = pattern->pattern;
+	int len = pattern->patternlen;
+
+	if (pattern->flags & PATTERN_FLAG_NODIR) {
+		if (pattern->nowildcardlen == len) {
+			pattern_index_add(&index->basenames, p, len, pos);
+			return;
+		}
+		if (pattern->flags & PATTERN_FLAG_ENDSWITH) {
+			int i;
+
+			pattern_index_add(&index->suffixes, p + 1, len - 1, pos);
+			for (i = 0; i < index->suffix_len_nr; i++)
+				if (index->suffix_len[i] <= len - 1)
+					break;
+			if (i < index->suffix_len_nr &&
+			    index->suffix_len[i] == len - 1)
+				return;
+			ALLOC_GROW(index->suffix_len, index->suffix_len_nr + 1,
+				   index->suffix_len_alloc);
+			MOVE_ARRAY(index->suffix_len + i + 1,
+				   index->suffix_len + i,
+				   index->suffix_len_nr - i);
+			index->suffix_len[i] = len - 1;
+			index->suffix_len_nr++;
+			return;
+		}
+	} else if (pattern->nowildcardlen == len) {
+		/* see match_pathname() */
+		struct strbuf path = STRBUF_INIT;
+
+		if (*p == '/') {
+			p++;
+			len--;
+		}
+		if (pattern->baselen) {
+			strbuf_add(&path, pattern->base, pattern->baselen - 1);
+			strbuf_addch(&path, '/');
+		}
+		strbuf_add(&path, p, len);
+		pattern_index_add(&index->paths, path.buf, path.len, pos);
+		strbuf_release(&path);
+		return;
+	}
+
+	ALLOC_GROW(index->other, index->other_nr + 1, index->other_alloc);
+	index->other[index->other_nr++] = pos;
+}
+
+static void prepare_pattern_list_index(struct pattern_list *pl)
+{
+	struct pattern_list_index *index = pl->index;
+
+	if (pl->nr < PATTERN_INDEX_MIN)
+		return;
+	if (index && index->ignore_case != ignore_case)
+		free_pattern_list_index(pl);
+	if (!pl->index) {
+		CALLOC_ARRAY(pl->index, 1);
+		index = pl->index;
+		index->ignore_case = ignore_case;
+		hashmap_init(&index->basenames, pattern_index_entry_cmp, NULL, 0);
+		hashmap_init(&index->suffixes, pattern_index_entry_cmp, NULL, 0);
+		hashmap_init(&index->paths, pattern_index_entry_cmp, NULL, 0);
+	}
+	/* patterns are only ever appended to a list */
+	for (; index->nr < pl->nr; index->nr++)
+		index_pattern(index, pl->patterns[index->nr], index->nr);
+}
+
 /*
  * Frees memory within pl which was allocated for exclude patterns and
  * the file buffer.  Does not free pl itself.
@@ -981,6 +1175,7 @@ void clear_pattern_list(struct pattern_list *pl)
 	free(pl->patterns);
 	clear_pattern_entry_hashmap(&pl->recursive_hashmap);
 	clear_pattern_entry_hashmap(&pl->parent_hashmap);
+	free_pattern_list_index(pl);
 
 	memset(pl, 0, sizeof(*pl));
 }
@@ -1093,6 +1288,73 @@ static void invalidate_directory(struct untracked_cache *uc,
 		dir->dirs[i]->recurse = 0;
 }
 
+/*
+ * With several threads, the directories that read_directory_recursive()
+ * would recurse into at the top level of the traversal are put on a
+ * queue instead, and read by whichever thread is free. The result of
+ * such a read only ever matters to treat_directory(), so the reads it
+ * does itself are still made right away.
+ *
+ * The untracked cache is filled as the serial walk would: each node of
+ * it is only ever written by the thread reading its directory, which
+ * creates the nodes of the subdirectories before queueing them. The
+ * lookups of the nodes of parent directories, and the counters of the
+ * cache, are serialized by "untracked_mutex".
+ */
+struct read_directory_walk {
+	struct index_state *istate;
+	const struct pathspec *pathspec;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	/*
+	 * directories to read, each with a trailing slash, and its node
+	 * of the untracked cache as "util"
+	 */
+	struct string_list todo;
+	/* number of threads reading a directory from "todo" */
+	int busy;
+
+	pthread_mutex_t gitfile_mutex;
+	pthread_mutex_t untracked_mutex;
+};
+
+static void queue_directory(struct read_directory_walk *walk,
+			    const char *path, int len,
+			    struct untracked_cache_dir *untracked)
+{
+	pthread_mutex_lock(&walk->mutex);
+	string_list_append_nodup(&walk->todo, xmemdupz(path, len))->util =
+		untracked;
+	pthread_cond_signal(&walk->cond);
+	pthread_mutex_unlock(&walk->mutex);
+}
+
+static void lock_untracked(struct dir_struct *dir)
+{
+	if (dir->internal.walk && dir->untracked)
+		pthread_mutex_lock(&dir->internal.walk->untracked_mutex);
+}
+
+static void unlock_untracked(struct dir_struct *dir)
+{
+	if (dir->internal.walk && dir->untracked)
+		pthread_mutex_unlock(&dir->internal.walk->untracked_mutex);
+}
+
+/* lookup_untracked(), for the traversal of read_directory() */
+static struct untracked_cache_dir *lookup_untracked_dir(struct dir_struct *dir,
+							struct untracked_cache_dir *parent,
+							const char *name, int len)
+{
+	struct untracked_cache_dir *d;
+
+	lock_untracked(dir);
+	d = lookup_untracked(dir->untracked, parent, name, len);
+	unlock_untracked(dir);
+	return d;
+}
+
 /* Flags for add_patterns() */
 #define PATTERN_NOFOLLOW (1<<0)
 
@@ -1366,6 +1628,96 @@ int match_pathname(const char *pathname, int pathlen,
 				 WM_PATHNAME) == 0;
 }
 
+static int pattern_matches(struct path_pattern *pattern,
+			   const char *pathname, int pathlen,
+			   const char *basename, int *dtype,
+			   struct index_state *istate)
+{
+	const char *exclude = pattern->pattern;
+	int prefix = pattern->nowildcardlen;
+
+	if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
+		*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
+		if (*dtype != DT_DIR)
+			return 0;
+	}
+
+	if (pattern->flags & PATTERN_FLAG_NODIR)
+		return match_basename(basename,
+				      pathlen - (basename - pathname),
+				      exclude, prefix, pattern->patternlen,
+				      pattern->flags);
+
+	assert(pattern->baselen == 0 ||
+	       pattern->base[pattern->baselen - 1] == '/');
+	return match_pathname(pathname, pathlen,
+			      pattern->base,
+			      pattern->baselen ? pattern->baselen - 1 : 0,
+			      exclude, prefix, pattern->patternlen);
+}
+
+/*
+ * Update "best" to the last pattern of the entry for "key" that is
+ * after "best" and matches.
+ */
+static void match_pattern_index(struct hashmap *map,
+				const char *key, int keylen, int *best,
+				struct pattern_list *pl,
+				const char *pathname, int pathlen,
+				const char *basename, int *dtype,
+				struct index_state *istate)
+{
+	struct pattern_index_key k = { key, keylen };
+	struct pattern_index_entry *e;
+
+	e = hashmap_get_entry_from_hash(map, pattern_index_hash(key, keylen),
+					&k, struct pattern_index_entry, ent);
+	if (!e)
+		return;
+	for (int i = e->nr - 1; i >= 0 && e->pos[i] > *best; i--) {
+		if (pattern_matches(pl->patterns[e->pos[i]], pathname, pathlen,
+				    basename, dtype, istate)) {
+			*best = e->pos[i];
+			return;
+		}
+	}
+}
+
+static struct path_pattern *last_matching_pattern_from_index(const char *pathname,
+							     int pathlen,
+							     const char *basename,
+							     int *dtype,
+							     struct pattern_list *pl,
+							     struct index_state *istate)
+{
+	struct pattern_list_index *index = pl->index;
+	int basenamelen = pathlen - (basename - pathname);
+	int best = -1;
+
+	match_pattern_index(&index->basenames, basename, basenamelen, &best,
+			    pl, pathname, pathlen, basename, dtype, istate);
+	for (int i = 0; i < index->suffix_len_nr; i++) {
+		int len = index->suffix_len[i];
+
+		if (len > basenamelen)
+			continue;
+		match_pattern_index(&index->suffixes,
+				    basename + basenamelen - len, len, &best,
+				    pl, pathname, pathlen, basename, dtype, istate);
+	}
+	match_pattern_index(&index->paths, pathname, pathlen, &best,
+			    pl, pathname, pathlen, basename, dtype, istate);
+
+	for (int i = index->other_nr - 1; i >= 0 && index->other[i] > best; i--) {
+		if (pattern_matches(pl->patterns[index->other[i]], pathname,
+				    pathlen, basename, dtype, istate)) {
+			best = index->other[i];
+			break;
+		}
+	}
+	return best < 0 ? NULL : pl->patterns[best];
+}
+
 /*
  * Scan the given exclude list in reverse to see whether pathname
  * should be ignored.  The first match (i.e. the last on the list), if
@@ -1379,45 +1731,25 @@ static struct path_pattern *last_matching_pattern_from_list(const char *pathname
 						       struct pattern_list *pl,
 						       struct index_state *istate)
 {
-	struct path_pattern *res = NULL; /* undecided */
 	int i;
 
 	if (!pl->nr)
 		return NULL;	/* undefined */
 
+	prepare_pattern_list_index(pl);
+	if (pl->index)
+		return last_matching_pattern_from_index(pathname, pathlen,
+							basename, dtype,
+							pl, istate);
+
 	for (i = pl->nr - 1; 0 <= i; i--) {
 		struct path_pattern *pattern = pl->patterns[i];
-		const char *exclude = pattern->pattern;
-		int prefix = pattern->nowildcardlen;
-
-		if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
-			*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
-			if (*dtype != DT_DIR)
-				continue;
-		}
 
-		if (pattern->flags & PATTERN_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
-					   exclude, prefix, pattern->patternlen,
-					   pattern->flags)) {
-				res = pattern;
-				break;
-			}
-			continue;
-		}
-
-		assert(pattern->baselen == 0 ||
-		       pattern->base[pattern->baselen - 1] == '/');
-		if (match_pathname(pathname, pathlen,
-				   pattern->base,
-				   pattern->baselen ? pattern->baselen - 1 : 0,
-				   exclude, prefix, pattern->patternlen)) {
-			res = pattern;
-			break;
-		}
+		if (pattern_matches(pattern, pathname, pathlen, basename,
+				    dtype, istate))
+			return pattern;
 	}
-	return res;
+	return NULL;
 }
 
 /*
@@ -1604,7 +1936,7 @@ static void prep_exclude(struct dir_struct *dir,
 	struct pattern_list *pl;
 	struct exclude_stack *stk = NULL;
 	struct untracked_cache_dir *untracked;
-	int current;
+	int current, load_gitignore;
 
 	group = &dir->internal.exclude_list_group[EXC_DIRS];
 
@@ -1660,10 +1992,9 @@ static void prep_exclude(struct dir_struct *dir,
 				die("oops in prep_exclude");
 			cp++;
 			untracked =
-				lookup_untracked(dir->untracked,
-						 untracked,
-						 base + current,
-						 cp - base - current);
+				lookup_untracked_dir(dir, untracked,
+						     base + current,
+						     cp - base - current);
 		}
 		stk->prev = dir->internal.exclude_stack;
 		stk->baselen = cp - base;
@@ -1694,7 +2025,8 @@ static void prep_exclude(struct dir_struct *dir,
 		/* Try to read per-directory file */
 		oidclr(&oid_stat.oid, the_repository->hash_algo);
 		oid_stat.valid = 0;
-		if (dir->exclude_per_dir &&
+		lock_untracked(dir);
+		load_gitignore =
 		    /*
 		     * If we know that no files have been added in
 		     * this directory (i.e. valid_cached_dir() has
@@ -1707,7 +2039,9 @@ static void prep_exclude(struct dir_struct *dir,
 		      * loading .gitignore, which would result in
 		      * ENOENT anyway.
 		      */
-		     !is_null_oid(&untracked->exclude_oid))) {
+		     !is_null_oid(&untracked->exclude_oid));
+		unlock_untracked(dir);
+		if (dir->exclude_per_dir && load_gitignore) {
 			/*
 			 * dir->internal.basebuf gets reused by the traversal,
 			 * but we need fname to remain unchanged to ensure the
@@ -1738,11 +2072,13 @@ static void prep_exclude(struct dir_struct *dir,
 		 * last_matching_pattern(). Be careful about ignore rule
 		 * order, though, if you do that.
 		 */
+		lock_untracked(dir);
 		if (untracked &&
 		    !oideq(&oid_stat.oid, &untracked->exclude_oid)) {
 			invalidate_gitignore(dir->untracked, untracked);
 			oidcpy(&untracked->exclude_oid, &oid_stat.oid);
 		}
+		unlock_untracked(dir);
 		dir->internal.exclude_stack = stk;
 		current = stk->baselen;
 	}
@@ -1968,6 +2304,10 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 		 */
 		int nested_repo;
 		struct strbuf sb = STRBUF_INIT;
+
+		/* read_gitfile_gently() returns a static buffer */
+		if (dir->internal.walk)
+			pthread_mutex_lock(&dir->internal.walk->gitfile_mutex);
 		strbuf_addstr(&sb, dirname);
 		nested_repo = is_nonbare_repository_dir(&sb);
 
@@ -1982,6 +2322,8 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 			free(real_dirname);
 		}
 		strbuf_release(&sb);
+		if (dir->internal.walk)
+			pthread_mutex_unlock(&dir->internal.walk->gitfile_mutex);
 
 		if (nested_repo) {
 			if ((dir->flags & DIR_SKIP_NESTED_GIT) ||
@@ -2109,10 +2451,12 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 	old_untracked_nr = dir->nr;
 
 	/* Actually recurse into dirname now, we'll fixup the state later. */
-	untracked = lookup_untracked(dir->untracked, untracked,
-				     dirname + baselen, len - baselen);
+	untracked = lookup_untracked_dir(dir, untracked,
+					 dirname + baselen, len - baselen);
+	dir->internal.nested_reads++;
 	state = read_directory_recursive(dir, istate, dirname, len, untracked,
 					 check_only, stop_early, pathspec);
+	dir->internal.nested_reads--;
 
 	/* There are a variety of reasons we may need to fixup the state... */
 	if (state == path_excluded) {
@@ -2536,8 +2880,10 @@ static int open_cached_dir(struct cached_dir *cdir,
 	if (!cdir->fdir)
 		warning_errno(_("could not open directory '%s'"), c_path);
 	if (dir->untracked) {
+		lock_untracked(dir);
 		invalidate_directory(dir->untracked, untracked);
 		dir->untracked->dir_opened++;
+		unlock_untracked(dir);
 	}
 	if (!cdir->fdir)
 		return -1;
@@ -2578,7 +2924,7 @@ static int read_cached_dir(struct cached_dir *cdir)
 	return -1;
 }
 
-static void close_cached_dir(struct cached_dir *cdir)
+static void close_cached_dir(struct dir_struct *dir, struct cached_dir *cdir)
 {
 	if (cdir->fdir)
 		closedir(cdir->fdir);
@@ -2587,8 +2933,10 @@ static void close_cached_dir(struct cached_dir *cdir)
 	 * entries. Mark it valid.
 	 */
 	if (cdir->untracked) {
+		lock_untracked(dir);
 		cdir->untracked->valid = 1;
 		cdir->untracked->recurse = 1;
+		unlock_untracked(dir);
 	}
 }
 
@@ -2678,12 +3026,17 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 			dir_state = state;
 
 		/* recurse into subdir if instructed by treat_path */
-		if (state == path_recurse) {
+		if (state == path_recurse && dir->internal.walk &&
+		    !dir->internal.nested_reads && !check_only) {
+			queue_directory(dir->internal.walk, path.buf, path.len,
+					lookup_untracked_dir(dir, untracked,
+							     path.buf + baselen,
+							     path.len - baselen));
+		} else if (state == path_recurse) {
 			struct untracked_cache_dir *ud;
-			ud = lookup_untracked(dir->untracked,
-					      untracked,
-					      path.buf + baselen,
-					      path.len - baselen);
+			ud = lookup_untracked_dir(dir, untracked,
+						  path.buf + baselen,
+						  path.len - baselen);
 			subdir_state =
 				read_directory_recursive(dir, istate, path.buf,
 							 path.len, ud,
@@ -2735,7 +3088,7 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 						    istate, &path, baselen,
 						    pathspec, state);
 	}
-	close_cached_dir(&cdir);
+	close_cached_dir(dir, &cdir);
  out:
 	strbuf_release(&path);
 
@@ -2829,6 +3182,211 @@ static int treat_leading_path(struct dir_struct *dir,
 	return state == path_recurse;
 }
 
+/*
+ * Mostly arbitrary, as in preload-index.c: at most 20 threads, and one
+ * for every 1000 entries of the index, which is the best guess we have
+ * of the size of the working tree before reading it.
+ */
+#define READ_DIRECTORY_MAX_THREADS 20
+#define READ_DIRECTORY_THREAD_COST 1000
+
+static int read_directory_threads(struct index_state *istate,
+				  const struct pathspec *pathspec)
+{
+	int nr = 0;
+
+	/*
+	 * Looking up a name in a sparse index may expand it, and
+	 * attributes cannot be looked up from several threads.
+	 */
+	if (!HAVE_THREADS || istate->sparse_index ||
+	    (pathspec && (pathspec->magic & PATHSPEC_ATTR)))
+		return 1;
+
+	if (istate->repo)
+		repo_config_get_int(istate->repo, "core.untrackedthreads", &nr);
+	if (nr > 0)
+		return nr;
+
+	nr = online_cpus();
+	if (nr > READ_DIRECTORY_MAX_THREADS)
+		nr = READ_DIRECTORY_MAX_THREADS;
+	if (nr > istate->cache_nr / READ_DIRECTORY_THREAD_COST)
+		nr = istate->cache_nr / READ_DIRECTORY_THREAD_COST;
+	return nr < 1 ? 1 : nr;
+}
+
+struct read_directory_worker {
+	pthread_t thread;
+	struct dir_struct dir;
+};
+
+static char *next_directory(struct read_directory_walk *walk,
+			    struct untracked_cache_dir **untracked)
+{
+	char *path = NULL;
+
+	pthread_mutex_lock(&walk->mutex);
+	while (!walk->todo.nr && walk->busy)
+		pthread_cond_wait(&walk->cond, &walk->mutex);
+	if (walk->todo.nr) {
+		struct string_list_item *item = &walk->todo.items[--walk->todo.nr];
+
+		path = item->string;
+		*untracked = item->util;
+		walk->busy++;
+	}
+	pthread_mutex_unlock(&walk->mutex);
+	return path;
+}
+
+static void finish_directory(struct read_directory_walk *walk)
+{
+	pthread_mutex_lock(&walk->mutex);
+	if (!--walk->busy && !walk->todo.nr)
+		pthread_cond_broadcast(&walk->cond);
+	pthread_mutex_unlock(&walk->mutex);
+}
+
+static void read_queued_directories(struct dir_struct *dir)
+{
+	struct read_directory_walk *walk = dir->internal.walk;
+	struct untracked_cache_dir *untracked;
+	char *path;
+
+	while ((path = next_directory(walk, &untracked))) {
+		read_directory_recursive(dir, walk->istate, path, strlen(path),
+					 untracked, 0, 0, walk->pathspec);
+		free(path);
+		finish_directory(walk);
+	}
+}
+
+static void *read_directory_thread(void *data)
+{
+	struct read_directory_worker *w = data;
+
+	read_queued_directories(&w->dir);
+	return NULL;
+}
+
+/*
+ * Each thread keeps its own stack of per-directory exclude lists and
+ * its own results, and shares the exclude lists that do not change
+ * during the traversal.
+ */
+static void copy_dir_for_thread(struct dir_struct *to,
+				const struct dir_struct *from)
+{
+	struct dir_struct blank = DIR_INIT;
+
+	memcpy(to, &blank, sizeof(*to));
+	to->flags = from->flags;
+	to->exclude_per_dir = from->exclude_per_dir;
+	to->untracked = from->untracked;
+	to->internal.exclude_list_group[EXC_CMDL] =
+		from->internal.exclude_list_group[EXC_CMDL];
+	to->internal.exclude_list_group[EXC_FILE] =
+		from->internal.exclude_list_group[EXC_FILE];
+	to->internal.walk = from->internal.walk;
+}
+
+static void merge_dir_from_thread(struct dir_struct *to,
+				  struct dir_struct *from)
+{
+	struct exclude_list_group *group =
+		&from->internal.exclude_list_group[EXC_DIRS];
+	struct exclude_stack *stk = from->internal.exclude_stack;
+
+	ALLOC_GROW(to->entries, to->nr + from->nr, to->internal.alloc);
+	COPY_ARRAY(to->entries + to->nr, from->entries, from->nr);
+	to->nr += from->nr;
+	ALLOC_GROW(to->ignored, to->ignored_nr + from->ignored_nr,
+		   to->internal.ignored_alloc);
+	COPY_ARRAY(to->ignored + to->ignored_nr, from->ignored,
+		   from->ignored_nr);
+	to->ignored_nr += from->ignored_nr;
+	to->internal.visited_paths += from->internal.visited_paths;
+	to->internal.visited_directories += from->internal.visited_directories;
+	free(from->entries);
+	free(from->ignored);
+
+	for (int i = 0; i < group->nr; i++) {
+		free((char *)group->pl[i].src);
+		clear_pattern_list(&group->pl[i]);
+	}
+	free(group->pl);
+	while (stk) {
+		struct exclude_stack *prev = stk->prev;
+		free(stk);
+		stk = prev;
+	}
+	strbuf_release(&from->internal.basebuf);
+}
+
+/* Index the shared lists now, as the threads must only read them. */
+static void prepare_group_index(struct exclude_list_group *group)
+{
+	for (int i = 0; i < group->nr; i++)
+		prepare_pattern_list_index(&group->pl[i]);
+}
+
+static void read_directory_parallel(struct dir_struct *dir,
+				    struct index_state *istate,
+				    const char *path, int len,
+				    struct untracked_cache_dir *untracked,
+				    const struct pathspec *pathspec,
+				    int nr_threads)
+{
+	struct read_directory_walk walk = {
+		.istate = istate,
+		.pathspec = pathspec,
+		.todo = STRING_LIST_INIT_DUP,
+	};
+	struct read_directory_worker *workers;
+
+	pthread_mutex_init(&walk.mutex, NULL);
+	pthread_cond_init(&walk.cond, NULL);
+	pthread_mutex_init(&walk.gitfile_mutex, NULL);
+	pthread_mutex_init(&walk.untracked_mutex, NULL);
+	/* .gitignore files may be read from the object store */
+	enable_obj_read_lock();
+	/* the threads must only ever look names up */
+	lazy_init_name_hash(istate);
+	prepare_group_index(&dir->internal.exclude_list_group[EXC_CMDL]);
+	prepare_group_index(&dir->internal.exclude_list_group[EXC_FILE]);
+	/* valid_cached_dir() does this first thing */
+	if (untracked)
+		refresh_fsmonitor(istate);
+
+	dir->internal.walk = &walk;
+	queue_directory(&walk, path, len, untracked);
+
+	CALLOC_ARRAY(workers, nr_threads - 1);
+	for (int i = 0; i < nr_threads - 1; i++) {
+		copy_dir_for_thread(&workers[i].dir, dir);
+		if (pthread_create(&workers[i].thread, NULL,
+				   read_directory_thread, &workers[i]))
+			die(_("unable to create thread"));
+	}
+	read_queued_directories(dir);
+	for (int i = 0; i < nr_threads - 1; i++) {
+		pthread_join(workers[i].thread, NULL);
+		merge_dir_from_thread(dir, &workers[i].dir);
+	}
+	dir->internal.walk = NULL;
+
+	trace2_data_intmax("read_directory", istate->repo, "threads", nr_threads);
+
+	disable_obj_read_lock();
+	string_list_clear(&walk.todo, 0);
+	pthread_mutex_destroy(&walk.gitfile_mutex);
+	pthread_mutex_destroy(&walk.untracked_mutex);
+	pthread_cond_destroy(&walk.cond);
+	pthread_mutex_destroy(&walk.mutex);
+	free(workers);
+}
+
 static const char *get_ident_string(void)
 {
 	static struct strbuf sb = STRBUF_INIT;
@@ -3103,8 +3661,16 @@ int read_directory(struct dir_struct *dir, struct index_state *istate,
 		 * e.g. prep_exclude()
 		 */
 		dir->untracked = NULL;
-	if (!len || treat_leading_path(dir, istate, path, len, pathspec))
-		read_directory_recursive(dir, istate, path, len, untracked, 0, 0, pathspec);
+	if (!len || treat_leading_path(dir, istate, path, len, pathspec)) {
+		int nr_threads = read_directory_threads(istate, pathspec);
+
+		if (nr_threads > 1)
+			read_directory_parallel(dir, istate, path, len,
+						untracked, pathspec, nr_threads);
+		else
+			read_directory_recursive(dir, istate, path, len,
+						 untracked, 0, 0, pathspec);
+	}
 	QSORT(dir->entries, dir->nr, cmp_dir_entry);
 	QSORT(dir->ignored, dir->ignored_nr, cmp_dir_entry);
 
@@ -54,6 +54,8 @@ struct dir_entry {
 #define PATTERN_FLAG_MUSTBEDIR 8
 #define PATTERN_FLAG_NEGATIVE 16
 
+struct pattern_list_index;
+
 struct path_pattern {
 	/*
 	 * This allows callers of last_matching_pattern() etc.
@@ -118,6 +120,13 @@ struct pattern_list {
 	 * Used to check single-level parents of blobs.
 	 */
 	struct hashmap parent_hashmap;
+
+	/*
+	 * Long lists are indexed by their literal names and "*suffix"
+	 * patterns the first time they are matched against, so that
+	 * only the other patterns have to be tried one by one.
+	 */
+	struct pattern_list_index *index;
 };
 
 /*
@@ -208,6 +217,8 @@ struct untracked_cache {
 	unsigned int use_fsmonitor : 1;
 };
 
+struct read_directory_walk;
+
 /**
  * structure is used to pass directory traversal options to the library and to
  * record the paths discovered. A single `struct dir_struct` is used regardless
@@ -353,6 +364,15 @@ struct dir_struct {
 		/* Stats about the traversal */
 		unsigned visited_paths;
 		unsigned visited_directories;
+
+		/*
+		 * Set while several threads read the working tree, each
+		 * with its own copy of this struct; the subdirectories
+		 * found are then queued for any of them to read.
+		 */
+		struct read_directory_walk *walk;
+		/* reads of treat_directory() in progress, which never queue */
+		unsigned nested_reads;
 	} internal;
 };
 
@@ -117,13 +117,17 @@ static int open_output_fd(char *path, const struct cache_entry *ce, int to_tempf
 	}
 }
 
-int fstat_checkout_output(int fd, const struct checkout *state, struct stat *st)
+int checkout_output_wants_fstat(const struct checkout *state)
 {
 	/* use fstat() only when path == ce->name */
-	if (fstat_is_reliable() &&
-	    state->refresh_cache && !state->base_dir_len) {
+	return fstat_is_reliable() &&
+	       state->refresh_cache && !state->base_dir_len;
+}
+
+int fstat_checkout_output(int fd, const struct checkout *state, struct stat *st)
+{
+	if (checkout_output_wants_fstat(state))
 		return !fstat(fd, st);
-	}
 	return 0;
 }
 
@@ -148,6 +152,51 @@ static int streaming_write_entry(const struct cache_entry *ce, char *path,
 	return result;
 }
 
+unsigned int queue_checkout_filters(const struct checkout *state,
+				    unsigned int pos,
+				    int (*wanted)(const struct cache_entry *ce))
+{
+	struct index_state *istate = state->istate;
+	int queued = 0;
+
+	if (!convert_has_process_filters())
+		return istate->cache_nr;
+
+	/* until the filters turn out not to pipeline */
+	for (; pos < istate->cache_nr && queued < CONVERT_QUEUE_MAX &&
+	       convert_has_process_filters(); pos++) {
+		struct cache_entry *ce = istate->cache[pos];
+		struct checkout_metadata meta;
+		struct conv_attrs ca;
+		struct stat st;
+		size_t size;
+		char *blob;
+
+		if (!wanted(ce) || ce_stage(ce) || !S_ISREG(ce->ce_mode) ||
+		    ce_uptodate(ce))
+			continue;
+		/* checkout_entry() leaves files that match the index alone */
+		if (!state->base_dir_len && !lstat(ce->name, &st) &&
+		    !ie_match_stat(istate, ce, &st,
+				   CE_MATCH_IGNORE_VALID |
+				   CE_MATCH_IGNORE_SKIP_WORKTREE |
+				   CE_MATCH_RACY_IS_DIRTY))
+			continue;
+		convert_attrs(istate, &ca, ce->name);
+		if (!convert_can_queue_to_working_tree(&ca))
+			continue;
+		blob = read_blob_entry(ce, &size);
+		if (!blob)
+			continue;
+		clone_checkout_metadata(&meta, &state->meta, &ce->oid);
+		queued += convert_queue_to_working_tree_ca(&ca, ce->name,
+							   blob, size, &meta);
+		free(blob);
+	}
+	convert_run_queue();
+	return pos;
+}
+
 void enable_delayed_checkout(struct checkout *state)
 {
 	if (!state->delayed_checkout) {
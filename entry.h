@@ -45,6 +45,16 @@ static inline int checkout_entry(struct cache_entry *ce,
 	return checkout_entry_ca(ce, NULL, state, topath, nr_checkouts);
 }
 
+/*
+ * Queue the requests to pipelining smudge filters (see convert.h) for
+ * the entries that "wanted" selects, starting at "pos" in the index
+ * of "state". Returns the position of the first entry that was not
+ * looked at; callers call this again once they get there.
+ */
+unsigned int queue_checkout_filters(const struct checkout *state,
+				    unsigned int pos,
+				    int (*wanted)(const struct cache_entry *ce));
+
 void enable_delayed_checkout(struct checkout *state);
 int finish_delayed_checkout(struct checkout *state, int show_progress);
 
@@ -58,6 +68,7 @@ int finish_delayed_checkout(struct checkout *state, int show_progress);
 void unlink_entry(const struct cache_entry *ce, const char *super_prefix);
 
 void *read_blob_entry(const struct cache_entry *ce, size_t *size);
+int checkout_output_wants_fstat(const struct checkout *state);
 int fstat_checkout_output(int fd, const struct checkout *state, struct stat *st);
 void update_ce_after_write(const struct checkout *state, struct cache_entry *ce,
 			   struct stat *st);
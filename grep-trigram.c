@@ -0,0 +1,483 @@
+#include "git-compat-util.h"
+#include "grep-trigram.h"
+#include "chunk-format.h"
+#include "csum-file.h"
+#include "gettext.h"
+#include "grep.h"
+#include "hash.h"
+#include "hex.h"
+#include "lockfile.h"
+#include "object-name.h"
+#include "object-store.h"
+#include "oid-array.h"
+#include "oidset.h"
+#include "path.h"
+#include "progress.h"
+#include "refs.h"
+#include "repository.h"
+#include "string-list.h"
+#include "trace2.h"
+#include "tree.h"
+#include "tree-walk.h"
+#include "varint.h"
+#include "write-or-die.h"
+#include "xdiff-interface.h"
+
+/*
+ * The file starts with a header of
+ *
+ *   4 bytes: signature "GTRI"
+ *   1 byte:  version, 1
+ *   1 byte:  hash version, as in the commit-graph
+ *   2 bytes: zero
+ *   4 bytes: number of blobs
+ *   4 bytes: number of trigrams
+ *
+ * followed by the names of the indexed blobs in sorted order, the
+ * trigrams that occur in them in increasing order (4 bytes each, the
+ * three bytes of the trigram in the lower 24 bits), and for each
+ * trigram the 8-byte offset of its list of blobs into the data that
+ * follows, plus one more offset for the end of that data. The list of
+ * each trigram is a sequence of varints: the position of its first
+ * blob plus one, and then the differences to the positions of the
+ * following ones. A checksum of all of this ends the file.
+ */
+#define TRIGRAM_SIGNATURE 0x47545249 /* "GTRI" */
+#define TRIGRAM_VERSION 1
+#define TRIGRAM_HEADER_SIZE 16
+#define TRIGRAM_COUNT (1 << 24)
+
+static char *grep_trigram_path(struct repository *r)
+{
+	return xstrfmt("%s/info/grep-trigrams", r->objects->odb->path);
+}
+
+struct trigram_postings {
+	unsigned char *buf;
+	size_t len, alloc;
+	/* position of the last blob in "buf", plus one */
+	uint32_t last;
+};
+
+struct trigram_writer {
+	struct repository *repo;
+	struct oidset trees;
+	struct oid_array blobs;
+
+	/* index of the postings of each trigram, plus one */
+	uint32_t *slot;
+	struct trigram_postings *postings;
+	size_t postings_nr, postings_alloc;
+};
+
+static void collect_blobs(struct trigram_writer *w, struct tree *tree)
+{
+	struct tree_desc desc;
+	struct name_entry entry;
+
+	if (parse_tree(tree))
+		die(_("unable to read tree (%s)"), oid_to_hex(&tree->object.oid));
+
+	init_tree_desc(&desc, &tree->object.oid, tree->buffer, tree->size);
+	while (tree_entry(&desc, &entry)) {
+		if (S_ISREG(entry.mode))
+			oid_array_append(&w->blobs, &entry.oid);
+		else if (S_ISDIR(entry.mode) &&
+			 !oidset_insert(&w->trees, &entry.oid))
+			collect_blobs(w, lookup_tree(w->repo, &entry.oid));
+	}
+	free_tree_buffer(tree);
+}
+
+static void collect_rev(struct trigram_writer *w, const char *name,
+			const struct object_id *oid)
+{
+	struct object *obj = parse_object(w->repo, oid);
+	struct tree *tree;
+
+	obj = obj ? repo_peel_to_type(w->repo, name, 0, obj, OBJ_TREE) : NULL;
+	if (!obj) {
+		warning(_("cannot index '%s': not a tree-ish"), name);
+		return;
+	}
+	tree = (struct tree *)obj;
+	if (!oidset_insert(&w->trees, &tree->object.oid))
+		collect_blobs(w, tree);
+}
+
+static int collect_ref(const char *refname, const char *referent UNUSED,
+		       const struct object_id *oid, int flags UNUSED,
+		       void *data)
+{
+	collect_rev(data, refname, oid);
+	return 0;
+}
+
+static void add_blob(struct trigram_writer *w, uint32_t pos,
+		     const unsigned char *buf, unsigned long size)
+{
+	uint32_t t;
+	unsigned long i;
+
+	if (size < 3)
+		return;
+
+	t = (buf[0] << 8) | buf[1];
+	for (i = 2; i < size; i++) {
+		struct trigram_postings *p;
+		unsigned char varint[16];
+		int len;
+
+		t = ((t << 8) | buf[i]) & (TRIGRAM_COUNT - 1);
+		if (!w->slot[t]) {
+			ALLOC_GROW(w->postings, w->postings_nr + 1,
+				   w->postings_alloc);
+			memset(&w->postings[w->postings_nr], 0,
+			       sizeof(*w->postings));
+			w->slot[t] = ++w->postings_nr;
+		}
+		p = &w->postings[w->slot[t] - 1];
+		if (p->last == pos + 1)
+			continue;
+
+		len = encode_varint(pos + 1 - p->last, varint);
+		ALLOC_GROW(p->buf, p->len + len, p->alloc);
+		memcpy(p->buf + p->len, varint, len);
+		p->len += len;
+		p->last = pos + 1;
+	}
+}
+
+static int write_index_file(struct trigram_writer *w,
+			    const struct oid_array *indexed)
+{
+	struct lock_file lk = LOCK_INIT;
+	struct hashfile *f;
+	char *path = grep_trigram_path(w->repo);
+	uint64_t offset = 0;
+	uint32_t t;
+	size_t i;
+	int fd;
+
+	if (safe_create_leading_directories(w->repo, path)) {
+		error_errno(_("unable to create leading directories of %s"),
+			    path);
+		free(path);
+		return -1;
+	}
+	fd = hold_lock_file_for_update(&lk, path, LOCK_REPORT_ON_ERROR);
+	free(path);
+	if (fd < 0)
+		return -1;
+
+	f = hashfd(w->repo->hash_algo, fd, get_lock_file_path(&lk));
+	hashwrite_be32(f, TRIGRAM_SIGNATURE);
+	hashwrite_u8(f, TRIGRAM_VERSION);
+	hashwrite_u8(f, oid_version(w->repo->hash_algo));
+	hashwrite_u8(f, 0);
+	hashwrite_u8(f, 0);
+	hashwrite_be32(f, indexed->nr);
+	hashwrite_be32(f, w->postings_nr);
+
+	for (i = 0; i < indexed->nr; i++)
+		hashwrite(f, indexed->oid[i].hash, w->repo->hash_algo->rawsz);
+
+	for (t = 0; t < TRIGRAM_COUNT; t++)
+		if (w->slot[t])
+			hashwrite_be32(f, t);
+
+	for (t = 0; t < TRIGRAM_COUNT; t++) {
+		if (!w->slot[t])
+			continue;
+		hashwrite_be64(f, offset);
+		offset += w->postings[w->slot[t] - 1].len;
+	}
+	hashwrite_be64(f, offset);
+
+	for (t = 0; t < TRIGRAM_COUNT; t++) {
+		struct trigram_postings *p;
+
+		if (!w->slot[t])
+			continue;
+		p = &w->postings[w->slot[t] - 1];
+		hashwrite(f, p->buf, p->len);
+	}
+
+	finalize_hashfile(f, NULL, FSYNC_COMPONENT_PACK_METADATA,
+			  CSUM_HASH_IN_STREAM | CSUM_FSYNC);
+	return commit_lock_file(&lk);
+}
+
+int write_grep_trigram_index(struct repository *r,
+			     const struct string_list *revs,
+			     int show_progress)
+{
+	struct trigram_writer w = { .repo = r };
+	struct oid_array indexed = OID_ARRAY_INIT;
+	struct progress *progress = NULL;
+	unsigned long big_file_threshold =
+		repo_settings_get_big_file_threshold(r);
+	const struct string_list_item *item;
+	size_t i;
+	int ret;
+
+	oidset_init(&w.trees, 0);
+	for_each_string_list_item(item, revs) {
+		struct object_id oid;
+
+		if (has_glob_specials(item->string))
+			refs_for_each_glob_ref(get_main_ref_store(r), collect_ref,
+					       item->string, &w);
+		else if (!repo_get_oid(r, item->string, &oid))
+			collect_rev(&w, item->string, &oid);
+		else
+			warning(_("cannot index '%s': unknown revision"),
+				item->string);
+	}
+	oidset_clear(&w.trees);
+	oid_array_sort(&w.blobs);
+
+	CALLOC_ARRAY(w.slot, TRIGRAM_COUNT);
+	if (show_progress)
+		progress = start_delayed_progress(r, _("Indexing blob trigrams"),
+						  w.blobs.nr);
+	for (i = 0; i < w.blobs.nr; i++) {
+		const struct object_id *oid = &w.blobs.oid[i];
+		enum object_type type;
+		unsigned long size;
+		void *buf;
+
+		display_progress(progress, i + 1);
+		if (i && oideq(oid, &w.blobs.oid[i - 1]))
+			continue;
+		if (oid_object_info(r, oid, &size) != OBJ_BLOB ||
+		    size > big_file_threshold)
+			continue;
+		buf = repo_read_object_file(r, oid, &type, &size);
+		if (!buf)
+			continue;
+		if (!buffer_is_binary(buf, size)) {
+			add_blob(&w, indexed.nr, buf, size);
+			oid_array_append(&indexed, oid);
+		}
+		free(buf);
+	}
+	stop_progress(&progress);
+
+	ret = write_index_file(&w, &indexed);
+
+	trace2_data_intmax("grep", r, "trigram/blobs", indexed.nr);
+	trace2_data_intmax("grep", r, "trigram/trigrams", w.postings_nr);
+
+	for (i = 0; i < w.postings_nr; i++)
+		free(w.postings[i].buf);
+	free(w.postings);
+	free(w.slot);
+	oid_array_clear(&w.blobs);
+	oid_array_clear(&indexed);
+	return ret;
+}
+
+struct grep_trigram_filter {
+	const unsigned char *data;
+	size_t data_len;
+	size_t hashsz;
+
+	uint32_t nr_blobs, nr_trigrams;
+	const unsigned char *oids, *trigrams, *offsets, *postings;
+	uint64_t postings_len;
+
+	/* one bit for each blob that may match */
+	unsigned char *candidates;
+	uintmax_t nr_skipped;
+};
+
+static int load_index(struct repository *r, struct grep_trigram_filter *f)
+{
+	char *path = grep_trigram_path(r);
+	struct stat st;
+	size_t tables;
+	int fd;
+
+	fd = git_open(path);
+	free(path);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	if (st.st_size < TRIGRAM_HEADER_SIZE) {
+		close(fd);
+		warning(_("ignoring invalid grep trigram index"));
+		return -1;
+	}
+	f->data_len = xsize_t(st.st_size);
+	f->data = xmmap(NULL, f->data_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	f->hashsz = r->hash_algo->rawsz;
+	if (get_be32(f->data) != TRIGRAM_SIGNATURE ||
+	    f->data[4] != TRIGRAM_VERSION ||
+	    f->data[5] != oid_version(r->hash_algo))
+		goto invalid;
+
+	f->nr_blobs = get_be32(f->data + 8);
+	f->nr_trigrams = get_be32(f->data + 12);
+	tables = st_add3(st_mult(f->nr_blobs, f->hashsz),
+			 st_mult(f->nr_trigrams, 4),
+			 st_mult(st_add(f->nr_trigrams, 1), 8));
+	if (f->data_len < st_add3(TRIGRAM_HEADER_SIZE, tables, f->hashsz))
+		goto invalid;
+
+	f->oids = f->data + TRIGRAM_HEADER_SIZE;
+	f->trigrams = f->oids + st_mult(f->nr_blobs, f->hashsz);
+	f->offsets = f->trigrams + st_mult(f->nr_trigrams, 4);
+	f->postings = f->offsets + st_mult(st_add(f->nr_trigrams, 1), 8);
+	f->postings_len = f->data_len - f->hashsz - (f->postings - f->data);
+	if (get_be64(f->offsets + st_mult(f->nr_trigrams, 8)) != f->postings_len)
+		goto invalid;
+
+	/* a flipped bit in the postings could hide matches */
+	if (!hashfile_checksum_valid(r->hash_algo, f->data, f->data_len))
+		goto invalid;
+	return 0;
+
+invalid:
+	warning(_("ignoring invalid grep trigram index"));
+	munmap((void *)f->data, f->data_len);
+	return -1;
+}
+
+static int find_trigram(struct grep_trigram_filter *f, uint32_t t)
+{
+	uint32_t lo = 0, hi = f->nr_trigrams;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		uint32_t cur = get_be32(f->trigrams + st_mult(mi, 4));
+
+		if (cur == t)
+			return mi;
+		if (cur < t)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return -1;
+}
+
+/* Set the bits of the blobs that contain the trigram "t" in "bits". */
+static void read_postings(struct grep_trigram_filter *f, uint32_t t,
+			  unsigned char *bits)
+{
+	const unsigned char *p, *end;
+	uint64_t pos = 0;
+	int i = find_trigram(f, t);
+
+	if (i < 0)
+		return;
+
+	p = f->postings + get_be64(f->offsets + st_mult(i, 8));
+	end = f->postings + get_be64(f->offsets + st_mult(i + 1, 8));
+	if (p > end || end > f->postings + f->postings_len)
+		return;
+	while (p < end) {
+		pos += decode_varint(&p);
+		if (!pos || pos > f->nr_blobs || p > end)
+			break;
+		bits[(pos - 1) / 8] |= 1 << ((pos - 1) % 8);
+	}
+}
+
+/* Mark the blobs that contain every trigram of the given string. */
+static void add_candidates(struct grep_trigram_filter *f,
+			   const unsigned char *s, size_t len)
+{
+	size_t bytes = DIV_ROUND_UP(f->nr_blobs, 8);
+	unsigned char *all = NULL, *one;
+	size_t i, j;
+
+	CALLOC_ARRAY(one, bytes);
+	for (i = 2; i < len; i++) {
+		uint32_t t = (s[i - 2] << 16) | (s[i - 1] << 8) | s[i];
+
+		memset(one, 0, bytes);
+		read_postings(f, t, one);
+		if (!all) {
+			all = one;
+			CALLOC_ARRAY(one, bytes);
+			continue;
+		}
+		for (j = 0; j < bytes; j++)
+			all[j] &= one[j];
+	}
+	for (j = 0; j < bytes; j++)
+		f->candidates[j] |= all[j];
+	free(all);
+	free(one);
+}
+
+struct grep_trigram_filter *grep_trigram_filter_new(struct repository *r,
+						    const struct grep_opt *opt)
+{
+	struct grep_trigram_filter *f;
+	struct grep_pat *p;
+
+	/*
+	 * The index knows nothing about the text that --textconv would
+	 * grep instead, and -L wants the very blobs we would skip.
+	 */
+	if (opt->allow_textconv || opt->unmatch_name_only ||
+	    !grep_patterns_are_fixed(opt))
+		return NULL;
+	for (p = opt->pattern_list; p; p = p->next)
+		if (p->patternlen < 3)
+			return NULL;
+
+	CALLOC_ARRAY(f, 1);
+	if (load_index(r, f) < 0) {
+		free(f);
+		return NULL;
+	}
+
+	CALLOC_ARRAY(f->candidates, DIV_ROUND_UP(f->nr_blobs, 8));
+	for (p = opt->pattern_list; p; p = p->next)
+		add_candidates(f, (const unsigned char *)p->pattern,
+			       p->patternlen);
+	return f;
+}
+
+int grep_trigram_filter_skip(struct grep_trigram_filter *f,
+			     const struct object_id *oid)
+{
+	uint32_t lo = 0, hi = f->nr_blobs;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		int cmp = memcmp(oid->hash, f->oids + st_mult(mi, f->hashsz),
+				 f->hashsz);
+
+		if (!cmp) {
+			if (f->candidates[mi / 8] & (1 << (mi % 8)))
+				return 0;
+			f->nr_skipped++;
+			return 1;
+		}
+		if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return 0;
+}
+
+void grep_trigram_filter_free(struct grep_trigram_filter *f)
+{
+	if (!f)
+		return;
+	trace2_data_intmax("grep", NULL, "trigram/skipped", f->nr_skipped);
+	munmap((void *)f->data, f->data_len);
+	free(f->candidates);
+	free(f);
+}
@@ -0,0 +1,39 @@
+#ifndef GREP_TRIGRAM_H
+#define GREP_TRIGRAM_H
+
+struct grep_opt;
+struct grep_trigram_filter;
+struct object_id;
+struct repository;
+struct string_list;
+
+/*
+ * Write "$GIT_DIR/objects/info/grep-trigrams", an index of the
+ * trigrams found in the regular files of the trees of "revs", keyed
+ * by blob. Each entry of "revs" is a revision or a ref glob. Binary
+ * blobs and blobs above core.bigFileThreshold are left out.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int write_grep_trigram_index(struct repository *r,
+			     const struct string_list *revs,
+			     int show_progress);
+
+/*
+ * Prepare to skip the blobs that the trigram index shows cannot match
+ * "opt". Returns NULL if there is no index, or if "opt" does not only
+ * look for literal strings of at least three bytes.
+ */
+struct grep_trigram_filter *grep_trigram_filter_new(struct repository *r,
+						    const struct grep_opt *opt);
+
+/*
+ * Returns 1 if grepping the blob "oid" cannot find anything. Blobs
+ * that are not in the index are never skipped.
+ */
+int grep_trigram_filter_skip(struct grep_trigram_filter *filter,
+			     const struct object_id *oid);
+
+void grep_trigram_filter_free(struct grep_trigram_filter *filter);
+
+#endif /* GREP_TRIGRAM_H */
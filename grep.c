@@ -13,6 +13,7 @@
 #include "diffcore.h"
 #include "quote.h"
 #include "help.h"
+#include "kwset.h"
 
 static int grep_source_load(struct grep_source *gs);
 static int grep_source_is_binary(struct grep_source *gs,
@@ -767,6 +768,48 @@ static struct grep_expr *grep_splice_or(struct grep_expr *x, struct grep_expr *y
 	return z;
 }
 
+int grep_patterns_are_fixed(const struct grep_opt *opt)
+{
+	struct grep_pat *p;
+
+	/* a case-insensitive regex may fold more than ASCII */
+	if (opt->ignore_case || opt->invert || opt->all_match ||
+	    opt->no_body_match || opt->header_list || !opt->pattern_list)
+		return 0;
+	for (p = opt->pattern_list; p; p = p->next)
+		if (p->token != GREP_PATTERN ||
+		    !(opt->pattern_type_option == GREP_PATTERN_TYPE_FIXED ||
+		      is_fixed(p->pattern, p->patternlen)))
+			return 0;
+	return 1;
+}
+
+/*
+ * look_ahead() searches the rest of the buffer for the earliest match
+ * of any pattern. When they are all fixed strings, one pass with a
+ * keyword set of them finds it, instead of one pass for each pattern.
+ */
+static void compile_lookahead_kwset(struct grep_opt *opt)
+{
+	struct grep_pat *p;
+	kwset_t kws;
+
+	if (!grep_patterns_are_fixed(opt))
+		return;
+
+	kws = kwsalloc(NULL);
+	for (p = opt->pattern_list; p; p = p->next)
+		if (kwsincr(kws, p->pattern, p->patternlen))
+			goto fail;
+	if (kwsprep(kws))
+		goto fail;
+	opt->lookahead_kws = kws;
+	return;
+
+fail:
+	kwsfree(kws);
+}
+
 void compile_grep_patterns(struct grep_opt *opt)
 {
 	struct grep_pat *p;
@@ -788,8 +831,10 @@ void compile_grep_patterns(struct grep_opt *opt)
 
 	if (opt->all_match || opt->no_body_match || header_expr)
 		extended = 1;
-	else if (!extended)
+	else if (!extended) {
+		compile_lookahead_kwset(opt);
 		return;
+	}
 
 	p = opt->pattern_list;
 	if (p)
@@ -862,6 +907,8 @@ void free_grep_patterns(struct grep_opt *opt)
 
 	if (opt->pattern_expression)
 		free_pattern_expr(opt->pattern_expression);
+	if (opt->lookahead_kws)
+		kwsfree(opt->lookahead_kws);
 }
 
 static const char *end_of_line(const char *cp, unsigned long *left)
@@ -1463,17 +1510,25 @@ static int look_ahead(struct grep_opt *opt,
 	const char *sp, *last_bol;
 	regoff_t earliest = -1;
 
-	for (p = opt->pattern_list; p; p = p->next) {
-		int hit;
-		regmatch_t m;
+	if (opt->lookahead_kws) {
+		struct kwsmatch kwsm;
+		size_t offset = kwsexec(opt->lookahead_kws, bol, *left_p, &kwsm);
 
-		hit = patmatch(p, bol, bol + *left_p, &m, 0);
-		if (hit < 0)
-			return -1;
-		if (!hit || m.rm_so < 0 || m.rm_eo < 0)
-			continue;
-		if (earliest < 0 || m.rm_so < earliest)
-			earliest = m.rm_so;
+		if (offset != (size_t)-1)
+			earliest = offset;
+	} else {
+		for (p = opt->pattern_list; p; p = p->next) {
+			int hit;
+			regmatch_t m;
+
+			hit = patmatch(p, bol, bol + *left_p, &m, 0);
+			if (hit < 0)
+				return -1;
+			if (!hit || m.rm_so < 0 || m.rm_eo < 0)
+				continue;
+			if (earliest < 0 || m.rm_so < earliest)
+				earliest = m.rm_so;
+		}
 	}
 
 	if (earliest < 0) {
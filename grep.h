@@ -124,6 +124,12 @@ struct grep_opt {
 	struct grep_pat **header_tail;
 	struct grep_expr *pattern_expression;
 
+	/*
+	 * When the patterns are all fixed strings, a keyword set of them
+	 * to find the next line that may match.
+	 */
+	struct kwset_t *lookahead_kws;
+
 	/*
 	 * NEEDSWORK: See if we can remove this field, because the repository
 	 * should probably be per-source. That is, grep.c functions using this
@@ -256,6 +262,13 @@ int grep_source(struct grep_opt *opt, struct grep_source *gs);
 
 struct grep_opt *grep_opt_dup(const struct grep_opt *opt);
 
+/*
+ * Returns 1 if a line matches "opt" exactly when it contains one of
+ * its patterns as a literal string, i.e. there is no case folding,
+ * negation or combination of patterns involved.
+ */
+int grep_patterns_are_fixed(const struct grep_opt *opt);
+
 /*
  * Mutex used around access to the attributes machinery if
  * opt->use_threads.  Must be initialized/destroyed by callers!
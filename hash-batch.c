@@ -0,0 +1,269 @@
+#include "git-compat-util.h"
+#include "gettext.h"
+#include "hash.h"
+#include "hash-batch.h"
+#include "object-file.h"
+#include "thread-utils.h"
+
+/*
+ * The caller's thread produces the buffers and the others hash them;
+ * the callers hold on to every queued buffer until the next flush, so
+ * keep that to a bounded number of buffers and bytes.
+ */
+#define HASH_BATCH_MAX_THREADS 16
+#define HASH_BATCH_PER_THREAD 16
+#define HASH_BATCH_MAX_BYTES (16 * 1024 * 1024)
+
+/*
+ * Small buffers are hashed faster than a thread can be woken up, so
+ * the threads take them in chunks, and are only woken up once there
+ * is a chunk for them (or on flush).
+ */
+#define HASH_BATCH_CHUNK 8
+
+struct hash_batch_item {
+	const void *buf;
+	size_t len;
+	enum object_type type; /* OBJ_NONE for a raw buffer */
+	unsigned char *hash;
+	struct object_id *oid;
+};
+
+struct hash_batch {
+	const struct git_hash_algo *algo;
+
+	struct hash_batch_item *items;
+	size_t nr, alloc;
+	size_t bytes;
+
+	/* the items before "next" are taken, those before "done" hashed */
+	size_t next, done;
+
+	int nr_threads;
+	pthread_t *threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	unsigned stopping : 1;
+};
+
+static void batch_lock(struct hash_batch *b)
+{
+	if (b->threads)
+		pthread_mutex_lock(&b->mutex);
+}
+
+static void batch_unlock(struct hash_batch *b)
+{
+	if (b->threads)
+		pthread_mutex_unlock(&b->mutex);
+}
+
+static void hash_item(const struct git_hash_algo *algo,
+		      const struct hash_batch_item *item)
+{
+	struct git_hash_ctx ctx;
+
+	if (item->oid) {
+		hash_object_file(algo, item->buf, item->len, item->type,
+				 item->oid);
+		return;
+	}
+	algo->init_fn(&ctx);
+	git_hash_update(&ctx, item->buf, item->len);
+	git_hash_final(item->hash, &ctx);
+}
+
+/*
+ * Hash "nr" items, with the multi-buffer kernel of the block SHA-256
+ * implementation for SHA-256. There is none for SHA-1, whose collision
+ * detection works on one message at a time.
+ */
+static void hash_items(const struct git_hash_algo *algo,
+		       const struct hash_batch_item *items, size_t nr)
+{
+#ifdef SHA256_BLK
+	if (hash_algo_by_ptr(algo) == GIT_HASH_SHA256) {
+		struct blk_SHA256_msg msgs[HASH_BATCH_CHUNK];
+		char hdrs[HASH_BATCH_CHUNK][32]; /* as MAX_HEADER_LEN */
+		unsigned char hashes[HASH_BATCH_CHUNK][GIT_SHA256_RAWSZ];
+
+		for (size_t i = 0; i < nr; i++) {
+			msgs[i].data = items[i].buf;
+			msgs[i].len = items[i].len;
+			if (items[i].oid) {
+				msgs[i].head = hdrs[i];
+				msgs[i].head_len = format_object_header(hdrs[i], sizeof(hdrs[i]),
+									items[i].type,
+									items[i].len);
+				msgs[i].digest = hashes[i];
+			} else {
+				msgs[i].head = NULL;
+				msgs[i].head_len = 0;
+				msgs[i].digest = items[i].hash;
+			}
+		}
+		blk_SHA256_Multi(msgs, nr);
+		for (size_t i = 0; i < nr; i++)
+			if (items[i].oid)
+				oidread(items[i].oid, hashes[i], algo);
+		return;
+	}
+#endif
+	for (size_t i = 0; i < nr; i++)
+		hash_item(algo, &items[i]);
+}
+
+/*
+ * Hash the next chunk of queued items, if there are any. Called with
+ * the mutex held, which is released while hashing.
+ */
+static int hash_next_items(struct hash_batch *b)
+{
+	struct hash_batch_item items[HASH_BATCH_CHUNK];
+	size_t nr = b->nr - b->next;
+
+	if (!nr)
+		return 0;
+	if (nr > HASH_BATCH_CHUNK)
+		nr = HASH_BATCH_CHUNK;
+	/* "items" may be reallocated while we hash */
+	COPY_ARRAY(items, b->items + b->next, nr);
+	b->next += nr;
+
+	batch_unlock(b);
+	hash_items(b->algo, items, nr);
+	batch_lock(b);
+
+	b->done += nr;
+	if (b->done == b->nr && b->threads)
+		pthread_cond_broadcast(&b->done_cond);
+	return 1;
+}
+
+static void *hash_batch_thread(void *data)
+{
+	struct hash_batch *b = data;
+
+	pthread_mutex_lock(&b->mutex);
+	for (;;) {
+		if (hash_next_items(b))
+			continue;
+		if (b->stopping)
+			break;
+		pthread_cond_wait(&b->work_cond, &b->mutex);
+	}
+	pthread_mutex_unlock(&b->mutex);
+	return NULL;
+}
+
+struct hash_batch *hash_batch_new(const struct git_hash_algo *algo,
+				  int nr_threads)
+{
+	struct hash_batch *b;
+
+	CALLOC_ARRAY(b, 1);
+	b->algo = algo;
+
+	if (nr_threads <= 0)
+		nr_threads = online_cpus();
+	if (nr_threads > HASH_BATCH_MAX_THREADS)
+		nr_threads = HASH_BATCH_MAX_THREADS;
+	if (!HAVE_THREADS)
+		nr_threads = 1;
+	b->nr_threads = nr_threads;
+
+	if (nr_threads > 1) {
+		pthread_mutex_init(&b->mutex, NULL);
+		pthread_cond_init(&b->work_cond, NULL);
+		pthread_cond_init(&b->done_cond, NULL);
+		CALLOC_ARRAY(b->threads, nr_threads - 1);
+		for (int i = 0; i < nr_threads - 1; i++) {
+			int ret = pthread_create(&b->threads[i], NULL,
+						 hash_batch_thread, b);
+			if (ret)
+				die(_("unable to create thread: %s"),
+				    strerror(ret));
+		}
+	}
+	return b;
+}
+
+static void add_item(struct hash_batch *b, const struct hash_batch_item *item)
+{
+	batch_lock(b);
+	ALLOC_GROW(b->items, b->nr + 1, b->alloc);
+	b->items[b->nr++] = *item;
+	b->bytes += item->len;
+	if (b->threads && b->nr - b->next >= HASH_BATCH_CHUNK)
+		pthread_cond_signal(&b->work_cond);
+	batch_unlock(b);
+}
+
+void hash_batch_add(struct hash_batch *b, const void *buf, size_t len,
+		    unsigned char *hash)
+{
+	struct hash_batch_item item = {
+		.buf = buf,
+		.len = len,
+		.type = OBJ_NONE,
+		.hash = hash,
+	};
+
+	add_item(b, &item);
+}
+
+void hash_batch_add_object(struct hash_batch *b, const void *buf,
+			   size_t len, enum object_type type,
+			   struct object_id *oid)
+{
+	struct hash_batch_item item = {
+		.buf = buf,
+		.len = len,
+		.type = type,
+		.oid = oid,
+	};
+
+	add_item(b, &item);
+}
+
+int hash_batch_full(const struct hash_batch *b)
+{
+	return b->nr >= (size_t)b->nr_threads * HASH_BATCH_PER_THREAD ||
+	       b->bytes >= HASH_BATCH_MAX_BYTES;
+}
+
+void hash_batch_flush(struct hash_batch *b)
+{
+	batch_lock(b);
+	if (b->threads)
+		pthread_cond_broadcast(&b->work_cond);
+	while (hash_next_items(b))
+		; /* help the threads with what is left */
+	while (b->done < b->nr)
+		pthread_cond_wait(&b->done_cond, &b->mutex);
+	b->nr = b->next = b->done = 0;
+	b->bytes = 0;
+	batch_unlock(b);
+}
+
+void hash_batch_free(struct hash_batch *b)
+{
+	if (!b)
+		return;
+	hash_batch_flush(b);
+	if (b->threads) {
+		pthread_mutex_lock(&b->mutex);
+		b->stopping = 1;
+		pthread_cond_broadcast(&b->work_cond);
+		pthread_mutex_unlock(&b->mutex);
+		for (int i = 0; i < b->nr_threads - 1; i++)
+			pthread_join(b->threads[i], NULL);
+		pthread_cond_destroy(&b->work_cond);
+		pthread_cond_destroy(&b->done_cond);
+		pthread_mutex_destroy(&b->mutex);
+		free(b->threads);
+	}
+	free(b->items);
+	free(b);
+}
@@ -0,0 +1,51 @@
+#ifndef HASH_BATCH_H
+#define HASH_BATCH_H
+
+#include "object.h"
+
+struct git_hash_algo;
+
+/*
+ * Hash many independent buffers at once. The buffers are queued with
+ * hash_batch_add() or hash_batch_add_object(), and a pool of threads
+ * hashes them while the caller goes on producing the next ones; the
+ * results are only valid after hash_batch_flush(). The buffers must
+ * not be modified or freed before then. With the block SHA-256
+ * implementation, each thread hashes several SHA-256 buffers at once
+ * with blk_SHA256_Multi().
+ *
+ * A batch is not thread-safe; only one thread may queue and flush.
+ */
+struct hash_batch;
+
+/*
+ * Create a batch hashing with "algo", using "nr_threads" threads in
+ * total, the caller's one included (0 means one per CPU). With a single
+ * thread, or without thread support, the buffers are hashed by
+ * hash_batch_flush().
+ */
+struct hash_batch *hash_batch_new(const struct git_hash_algo *algo,
+				  int nr_threads);
+
+/* Queue "buf" to be hashed into "hash". */
+void hash_batch_add(struct hash_batch *batch, const void *buf, size_t len,
+		    unsigned char *hash);
+
+/* Queue "buf" to be hashed into "oid" like hash_object_file() does. */
+void hash_batch_add_object(struct hash_batch *batch, const void *buf,
+			   size_t len, enum object_type type,
+			   struct object_id *oid);
+
+/*
+ * Whether the caller should flush before queueing more, so that the
+ * buffers it holds on to stay bounded.
+ */
+int hash_batch_full(const struct hash_batch *batch);
+
+/* Wait until all the queued buffers have been hashed. */
+void hash_batch_flush(struct hash_batch *batch);
+
+/* Flush the batch and stop its threads. */
+void hash_batch_free(struct hash_batch *batch);
+
+#endif /* HASH_BATCH_H */
@@ -0,0 +1,367 @@
+#include "git-compat-util.h"
+#include "log-readahead.h"
+#include "commit.h"
+#include "diff.h"
+#include "diffcore.h"
+#include "gettext.h"
+#include "object-store.h"
+#include "oid-array.h"
+#include "oidmap.h"
+#include "pathspec.h"
+#include "repository.h"
+#include "revision.h"
+#include "thread-utils.h"
+#include "trace2.h"
+
+/*
+ * Generating the diff of a commit is mostly spent inflating blobs and
+ * resolving their deltas, and that is the part that other threads can
+ * do for us: the diff machinery itself keeps its queue in a global and
+ * is not thread-safe. So while the main thread shows one commit, each
+ * thread takes one of the next commits of the walk, diffs its trees to
+ * find the blobs that changed, and reads them into a map that is handed
+ * to diff_populate_filespec() when that commit's turn comes.
+ *
+ * Blobs larger than this, or beyond this many bytes for one commit, are
+ * left for the diff to read itself.
+ */
+#define READAHEAD_MAX_BYTES (4 * 1024 * 1024)
+
+struct readahead_job {
+	struct commit *commit;
+	struct object_id old_tree;
+	struct object_id new_tree;
+	int skip;
+	int done;
+	unsigned nr_read;
+	struct oid_array wanted;
+	struct oidmap blobs;
+};
+
+struct readahead_worker {
+	pthread_t thread;
+	struct log_readahead *ra;
+	struct diff_options opt;
+};
+
+struct log_readahead {
+	struct rev_info *rev;
+	struct readahead_worker *workers;
+	int nr_threads;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	int finished;
+
+	/* ring of jobs, indexed by sequence number modulo nr_jobs */
+	struct readahead_job *jobs;
+	size_t nr_jobs;
+	size_t shown, started, queued;
+	struct readahead_job *current;
+	int exhausted;
+
+	/* statistics for trace2 */
+	uintmax_t nr_read, nr_unused;
+};
+
+static struct readahead_job *job_at(struct log_readahead *ra, size_t seq)
+{
+	return &ra->jobs[seq % ra->nr_jobs];
+}
+
+static void want_blob(struct readahead_job *job, unsigned mode,
+		      const struct object_id *oid)
+{
+	if (S_ISREG(mode) || S_ISLNK(mode))
+		oid_array_append(&job->wanted, oid);
+}
+
+static void readahead_change(struct diff_options *opt,
+			     unsigned old_mode, unsigned new_mode,
+			     const struct object_id *old_oid,
+			     const struct object_id *new_oid,
+			     int old_oid_valid UNUSED, int new_oid_valid UNUSED,
+			     const char *fullpath UNUSED,
+			     unsigned old_dirty_submodule UNUSED,
+			     unsigned new_dirty_submodule UNUSED)
+{
+	want_blob(opt->change_fn_data, old_mode, old_oid);
+	want_blob(opt->change_fn_data, new_mode, new_oid);
+}
+
+static void readahead_add_remove(struct diff_options *opt,
+				 int addremove UNUSED, unsigned mode,
+				 const struct object_id *oid,
+				 int oid_valid UNUSED,
+				 const char *fullpath UNUSED,
+				 unsigned dirty_submodule UNUSED)
+{
+	want_blob(opt->change_fn_data, mode, oid);
+}
+
+static void read_ahead(struct readahead_worker *w, struct readahead_job *job)
+{
+	unsigned flags = OBJECT_INFO_LOOKUP_REPLACE | OBJECT_INFO_SKIP_FETCH_OBJECT;
+	unsigned long budget = READAHEAD_MAX_BYTES;
+
+	if (job->skip)
+		return;
+
+	w->opt.change_fn_data = job;
+	if (is_null_oid(&job->old_tree))
+		diff_root_tree_oid(&job->new_tree, "", &w->opt);
+	else
+		diff_tree_oid(&job->old_tree, &job->new_tree, "", &w->opt);
+
+	for (size_t i = 0; i < job->wanted.nr; i++) {
+		const struct object_id *oid = &job->wanted.oid[i];
+		struct object_info oi = OBJECT_INFO_INIT;
+		struct diff_readahead_blob *blob;
+		enum object_type type;
+		unsigned long size;
+		void *data;
+
+		if (oidmap_get(&job->blobs, oid))
+			continue;
+
+		oi.typep = &type;
+		oi.sizep = &size;
+		if (oid_object_info_extended(w->opt.repo, oid, &oi, flags) ||
+		    type != OBJ_BLOB || size > budget)
+			continue;
+		oi.contentp = &data;
+		if (oid_object_info_extended(w->opt.repo, oid, &oi, flags))
+			continue;
+		budget -= size;
+
+		CALLOC_ARRAY(blob, 1);
+		oidcpy(&blob->entry.oid, oid);
+		blob->data = data;
+		blob->size = size;
+		oidmap_put(&job->blobs, blob);
+		job->nr_read++;
+	}
+	oid_array_clear(&job->wanted);
+}
+
+static void *readahead_thread(void *data)
+{
+	struct readahead_worker *w = data;
+	struct log_readahead *ra = w->ra;
+
+	trace2_thread_start("log-readahead");
+	pthread_mutex_lock(&ra->mutex);
+	for (;;) {
+		struct readahead_job *job;
+
+		while (ra->started == ra->queued && !ra->finished)
+			pthread_cond_wait(&ra->work_cond, &ra->mutex);
+		if (ra->finished)
+			break;
+
+		job = job_at(ra, ra->started++);
+		pthread_mutex_unlock(&ra->mutex);
+		read_ahead(w, job);
+		pthread_mutex_lock(&ra->mutex);
+		job->done = 1;
+		pthread_cond_broadcast(&ra->done_cond);
+	}
+	pthread_mutex_unlock(&ra->mutex);
+	trace2_thread_exit();
+	return NULL;
+}
+
+static unsigned release_blobs(struct oidmap *blobs)
+{
+	struct oidmap_iter iter;
+	struct diff_readahead_blob *blob;
+	unsigned nr = 0;
+
+	oidmap_iter_init(blobs, &iter);
+	while ((blob = oidmap_iter_next(&iter))) {
+		free(blob->data);
+		nr++;
+	}
+	oidmap_clear(blobs, 1);
+	oidmap_init(blobs, 0);
+	return nr;
+}
+
+static void release_current(struct log_readahead *ra)
+{
+	if (!ra->current)
+		return;
+	diff_set_readahead_blobs(NULL);
+	ra->nr_read += ra->current->nr_read;
+	ra->nr_unused += release_blobs(&ra->current->blobs);
+	ra->current = NULL;
+}
+
+static void queue_commit(struct log_readahead *ra, struct commit *commit)
+{
+	struct readahead_job *job = job_at(ra, ra->queued);
+	/* the same parents log_tree_diff() will diff against */
+	struct commit_list *parents = get_saved_parents(ra->rev, commit);
+
+	job->commit = commit;
+	job->skip = 0;
+	job->done = 0;
+	job->nr_read = 0;
+	if (!parents) {
+		/* compared against the empty tree */
+		oidclr(&job->old_tree, ra->rev->repo->hash_algo);
+		job->skip = !ra->rev->show_root_diff;
+	} else if (parents->next) {
+		/* merges can be diffed in too many ways to guess */
+		job->skip = 1;
+	} else if (repo_parse_commit(ra->rev->repo, parents->item)) {
+		job->skip = 1;
+	} else {
+		oidcpy(&job->old_tree, get_commit_tree_oid(parents->item));
+	}
+	if (!job->skip)
+		oidcpy(&job->new_tree, get_commit_tree_oid(commit));
+
+	pthread_mutex_lock(&ra->mutex);
+	ra->queued++;
+	pthread_cond_signal(&ra->work_cond);
+	pthread_mutex_unlock(&ra->mutex);
+}
+
+static int wants_readahead(struct rev_info *rev)
+{
+	unsigned needs_blobs = DIFF_FORMAT_PATCH | DIFF_FORMAT_DIFFSTAT |
+			       DIFF_FORMAT_NUMSTAT | DIFF_FORMAT_SHORTSTAT |
+			       DIFF_FORMAT_DIRSTAT;
+
+	if (!rev->diff)
+		return 0;
+	if (!(rev->diffopt.output_format & needs_blobs) &&
+	    !(rev->diffopt.pickaxe_opts & DIFF_PICKAXE_KINDS_MASK))
+		return 0;
+
+	/*
+	 * These either produce output as the walk goes, look at state that
+	 * the walk changes behind the commits it has returned, or change
+	 * the pathspec from one commit to the next.
+	 */
+	if (rev->graph || rev->reflog_info || rev->line_level_traverse ||
+	    rev->track_linear || rev->boundary || rev->full_diff ||
+	    rev->remerge_diff || rev->diffopt.flags.follow_renames)
+		return 0;
+
+	/* attribute lookups are not thread-safe */
+	if (rev->diffopt.pathspec.magic & PATHSPEC_ATTR)
+		return 0;
+
+	return 1;
+}
+
+struct log_readahead *log_readahead_start(struct rev_info *rev, int nr_threads)
+{
+	struct log_readahead *ra;
+
+	if (!HAVE_THREADS || nr_threads < 2 || !wants_readahead(rev))
+		return NULL;
+
+	CALLOC_ARRAY(ra, 1);
+	ra->rev = rev;
+	ra->nr_threads = nr_threads;
+	ra->nr_jobs = 4 * nr_threads;
+	CALLOC_ARRAY(ra->jobs, ra->nr_jobs);
+	for (size_t i = 0; i < ra->nr_jobs; i++)
+		oidmap_init(&ra->jobs[i].blobs, 0);
+
+	pthread_mutex_init(&ra->mutex, NULL);
+	pthread_cond_init(&ra->work_cond, NULL);
+	pthread_cond_init(&ra->done_cond, NULL);
+	enable_obj_read_lock();
+
+	CALLOC_ARRAY(ra->workers, nr_threads);
+	for (int i = 0; i < nr_threads; i++) {
+		struct readahead_worker *w = &ra->workers[i];
+
+		w->ra = ra;
+		repo_diff_setup(rev->repo, &w->opt);
+		w->opt.flags.recursive = 1;
+		w->opt.change = readahead_change;
+		w->opt.add_remove = readahead_add_remove;
+		copy_pathspec(&w->opt.pathspec, &rev->diffopt.pathspec);
+		if (pthread_create(&w->thread, NULL, readahead_thread, w))
+			die(_("unable to create thread"));
+	}
+
+	return ra;
+}
+
+struct commit *log_readahead_next(struct log_readahead *ra)
+{
+	struct readahead_job *job;
+
+	release_current(ra);
+
+	while (!ra->exhausted && ra->queued - ra->shown < ra->nr_jobs) {
+		struct commit *commit = get_revision(ra->rev);
+
+		if (!commit) {
+			/*
+			 * With max_count used up we may be asked for more
+			 * once the caller gives back the commits it did
+			 * not show.
+			 */
+			if (ra->rev->max_count)
+				ra->exhausted = 1;
+			break;
+		}
+		queue_commit(ra, commit);
+	}
+
+	if (ra->shown == ra->queued)
+		return NULL;
+
+	job = job_at(ra, ra->shown++);
+	pthread_mutex_lock(&ra->mutex);
+	while (!job->done)
+		pthread_cond_wait(&ra->done_cond, &ra->mutex);
+	pthread_mutex_unlock(&ra->mutex);
+
+	ra->current = job;
+	diff_set_readahead_blobs(&job->blobs);
+	return job->commit;
+}
+
+void log_readahead_finish(struct log_readahead *ra)
+{
+	if (!ra)
+		return;
+
+	release_current(ra);
+
+	pthread_mutex_lock(&ra->mutex);
+	ra->finished = 1;
+	pthread_cond_broadcast(&ra->work_cond);
+	pthread_mutex_unlock(&ra->mutex);
+
+	for (int i = 0; i < ra->nr_threads; i++) {
+		pthread_join(ra->workers[i].thread, NULL);
+		diff_free(&ra->workers[i].opt);
+	}
+	disable_obj_read_lock();
+
+	trace2_data_intmax("log", ra->rev->repo, "readahead/blobs", ra->nr_read);
+	trace2_data_intmax("log", ra->rev->repo, "readahead/unused", ra->nr_unused);
+
+	for (size_t i = 0; i < ra->nr_jobs; i++) {
+		release_blobs(&ra->jobs[i].blobs);
+		oidmap_clear(&ra->jobs[i].blobs, 1);
+		oid_array_clear(&ra->jobs[i].wanted);
+	}
+
+	pthread_cond_destroy(&ra->done_cond);
+	pthread_cond_destroy(&ra->work_cond);
+	pthread_mutex_destroy(&ra->mutex);
+	free(ra->workers);
+	free(ra->jobs);
+	free(ra);
+}
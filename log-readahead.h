@@ -0,0 +1,30 @@
+#ifndef LOG_READAHEAD_H
+#define LOG_READAHEAD_H
+
+struct commit;
+struct log_readahead;
+struct rev_info;
+
+/*
+ * Read ahead the blobs that the diffs of the next few commits of a
+ * revision walk are going to need, using "nr_threads" threads, while
+ * the caller shows the current commit.
+ *
+ * Returns NULL if "rev" asks for output that does not need blob
+ * contents, or that depends on the revision walk not running ahead of
+ * what has been shown (e.g. --graph or --follow). The caller should then
+ * use get_revision() as usual.
+ */
+struct log_readahead *log_readahead_start(struct rev_info *rev, int nr_threads);
+
+/*
+ * Replacement for get_revision() while read-ahead is active. The blobs
+ * read for the returned commit are handed to diff_populate_filespec()
+ * until the next call.
+ */
+struct commit *log_readahead_next(struct log_readahead *ra);
+
+/* Stop the threads and release all blobs that have not been used. */
+void log_readahead_finish(struct log_readahead *ra);
+
+#endif /* LOG_READAHEAD_H */
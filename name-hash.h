@@ -13,6 +13,12 @@ int index_dir_find(struct index_state *istate, const char *name, int namelen,
 void adjust_dirname_case(struct index_state *istate, char *name);
 struct cache_entry *index_file_exists(struct index_state *istate, const char *name, int namelen, int igncase);
 
+/*
+ * Build the name hash of the index now rather than on the first lookup,
+ * so that several threads can then look up names at the same time.
+ */
+void lazy_init_name_hash(struct index_state *istate);
+
 int test_lazy_init_name_hash(struct index_state *istate, int try_threaded);
 void add_name_hash(struct index_state *istate, struct cache_entry *ce);
 void remove_name_hash(struct index_state *istate, struct cache_entry *ce);
@@ -1289,6 +1289,9 @@ int index_path(struct index_state *istate, struct object_id *oid,
 
 	switch (st->st_mode & S_IFMT) {
 	case S_IFREG:
+		if (!(flags & (INDEX_FORMAT_CHECK | INDEX_RENORMALIZE)) &&
+		    !index_prepared_blob_bulk_checkin(oid, path, st, flags))
+			break;
 		fd = open(path, O_RDONLY);
 		if (fd < 0)
 			return error_errno("open(\"%s\")", path);
@@ -1605,11 +1608,13 @@ int read_loose_object(const char *path,
 			error(_("unable to unpack contents of %s"), path);
 			goto out_inflate;
 		}
-		hash_object_file(the_repository->hash_algo,
-				 *contents, *size,
-				 *oi->typep, real_oid);
-		if (!oideq(expected_oid, real_oid))
-			goto out_inflate;
+		if (real_oid) {
+			hash_object_file(the_repository->hash_algo,
+					 *contents, *size,
+					 *oi->typep, real_oid);
+			if (!oideq(expected_oid, real_oid))
+				goto out_inflate;
+		}
 	}
 
 	ret = 0; /* everything checks out */
@@ -235,6 +235,10 @@ int check_and_freshen_file(const char *fn, int freshen);
  * type, and size. If the object is a blob, then "contents" may return NULL,
  * to allow streaming of large blobs.
  *
+ * If "real_oid" is NULL, the contents returned are not hashed, and the
+ * caller has to check them against "expected_oid" itself. Streamed blobs
+ * are always checked.
+ *
  * Returns 0 on success, negative on error (details may be written to stderr).
  */
 int read_loose_object(const char *path,
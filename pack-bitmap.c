@@ -2,6 +2,7 @@
 
 #include "git-compat-util.h"
 #include "commit.h"
+#include "commit-reach.h"
 #include "gettext.h"
 #include "hex.h"
 #include "strbuf.h"
@@ -18,6 +19,7 @@
 #include "repository.h"
 #include "trace2.h"
 #include "object-store.h"
+#include "oidset.h"
 #include "list-objects-filter-options.h"
 #include "midx.h"
 #include "config.h"
@@ -2620,6 +2622,175 @@ static uint32_t count_object_type(struct bitmap_index *bitmap_git,
 	return count;
 }
 
+/*
+ * Count the commits in "a" that are not in "b".
+ */
+static uint32_t count_commits_not_in(struct bitmap_index *bitmap_git,
+				     struct bitmap *a, struct bitmap *b)
+{
+	struct eindex *eindex = &bitmap_git->ext_index;
+	uint32_t i = 0, count = 0;
+	struct ewah_or_iterator it;
+	eword_t filter;
+
+	init_type_iterator(&it, bitmap_git, OBJ_COMMIT);
+
+	for (i = 0; i < a->word_alloc && ewah_or_iterator_next(&filter, &it); i++) {
+		eword_t word = a->words[i] & filter;
+		if (i < b->word_alloc)
+			word &= ~b->words[i];
+		count += ewah_bit_popcount64(word);
+	}
+
+	for (i = 0; i < eindex->count; ++i) {
+		size_t pos = st_add(bitmap_num_objects_total(bitmap_git), i);
+
+		if (eindex->objects[i]->type == OBJ_COMMIT &&
+		    bitmap_get(a, pos) && !bitmap_get(b, pos))
+			count++;
+	}
+
+	ewah_or_iterator_release(&it);
+
+	return count;
+}
+
+/*
+ * How far find_commit_reachable() is willing to walk from a commit to
+ * those with a stored bitmap; ahead_behind() is faster for the rest.
+ */
+#define AHEAD_BEHIND_MAX_WALK 256
+
+/*
+ * Tell whether every line of history from "commit" runs into a commit with
+ * a stored bitmap within "limit" commits, so that find_objects() has only
+ * that much to walk.
+ */
+static int bitmap_is_near(struct bitmap_index *bitmap_git,
+			  struct repository *r,
+			  struct commit *commit, int limit)
+{
+	struct commit_list *queue = NULL;
+	struct oidset seen = OIDSET_INIT;
+	int ret = 1;
+
+	commit_list_insert(commit, &queue);
+	oidset_insert(&seen, &commit->object.oid);
+	while (queue) {
+		struct commit *c = pop_commit(&queue);
+
+		if (bitmap_for_commit(bitmap_git, c))
+			continue;
+		if (!limit-- || repo_parse_commit(r, c)) {
+			ret = 0;
+			break;
+		}
+		for (struct commit_list *p = c->parents; p; p = p->next)
+			if (!oidset_insert(&seen, &p->item->object.oid))
+				commit_list_insert(p->item, &queue);
+	}
+
+	free_commit_list(queue);
+	oidset_clear(&seen);
+	return ret;
+}
+
+/*
+ * Return the set of commits reachable from "commit", or NULL if finding
+ * it would take walking more than a few commits.
+ */
+static struct bitmap *find_commit_reachable(struct bitmap_index *bitmap_git,
+					    struct repository *r,
+					    struct commit *commit)
+{
+	struct rev_info revs;
+	struct object_list *roots = NULL;
+	struct bitmap *result;
+
+	if (!bitmap_is_near(bitmap_git, r, commit, AHEAD_BEHIND_MAX_WALK))
+		return NULL;
+
+	repo_init_revisions(r, &revs, NULL);
+	object_list_insert(&commit->object, &roots);
+	result = find_objects(bitmap_git, &revs, roots, NULL);
+
+	/*
+	 * "revs" asks for commits only, so the walk has marked nothing but
+	 * "commit" and its ancestors; reset them for the next one.
+	 */
+	clear_commit_marks(commit, ALL_REV_FLAGS);
+	object_list_free(&roots);
+	release_revisions(&revs);
+	return result;
+}
+
+int bitmap_ahead_behind(struct repository *r,
+			struct commit **commits, size_t commits_nr,
+			struct ahead_behind_count *counts, size_t counts_nr,
+			struct ahead_behind_count **left)
+{
+	struct bitmap_index *bitmap_git;
+	struct bitmap **bases;
+	signed char *far;
+	struct bitmap *tip = NULL;
+	size_t tip_index = 0;
+	int left_nr = 0;
+
+	if (!(bitmap_git = prepare_bitmap_git(r)))
+		return -1;
+
+	/* keep the bitmap of each base, as it is compared to many tips */
+	CALLOC_ARRAY(bases, commits_nr);
+	CALLOC_ARRAY(far, commits_nr);
+	for (size_t i = 0; i < counts_nr; i++) {
+		size_t b = counts[i].base_index;
+
+		if (bases[b] || far[b])
+			continue;
+		bases[b] = find_commit_reachable(bitmap_git, r, commits[b]);
+		far[b] = !bases[b];
+	}
+
+	for (size_t i = 0; i < counts_nr; i++) {
+		struct ahead_behind_count *c = &counts[i];
+		struct bitmap *base = bases[c->base_index];
+
+		/* the counts for one tip are usually next to each other */
+		if (i && tip_index != c->tip_index) {
+			if (!bases[tip_index])
+				bitmap_free(tip);
+			tip = NULL;
+		}
+		if (!tip && !far[c->tip_index]) {
+			tip_index = c->tip_index;
+			tip = bases[tip_index];
+			if (!tip)
+				tip = find_commit_reachable(bitmap_git, r,
+							    commits[tip_index]);
+			far[tip_index] = !tip;
+		}
+
+		if (!tip || !base) {
+			left[left_nr++] = c;
+			continue;
+		}
+		c->ahead = count_commits_not_in(bitmap_git, tip, base);
+		c->behind = count_commits_not_in(bitmap_git, base, tip);
+	}
+
+	if (tip && !bases[tip_index])
+		bitmap_free(tip);
+	for (size_t i = 0; i < commits_nr; i++)
+		bitmap_free(bases[i]);
+	free(bases);
+	free(far);
+
+	trace2_data_intmax("bitmap", r, "ahead_behind/left", left_nr);
+
+	free_bitmap_index(bitmap_git);
+	return left_nr;
+}
+
 void count_bitmap_commit_list(struct bitmap_index *bitmap_git,
 			      uint32_t *commits, uint32_t *trees,
 			      uint32_t *blobs, uint32_t *tags)
@@ -7,6 +7,7 @@
 #include "pack-objects.h"
 #include "string-list.h"
 
+struct ahead_behind_count;
 struct commit;
 struct repository;
 struct rev_info;
@@ -76,6 +77,24 @@ int bitmap_index_contains_pack(struct bitmap_index *bitmap, struct packed_git *p
 
 void count_bitmap_commit_list(struct bitmap_index *, uint32_t *commits,
 			      uint32_t *trees, uint32_t *blobs, uint32_t *tags);
+
+/*
+ * Fill in the "ahead" and "behind" fields of "counts" like ahead_behind()
+ * does, as the number of commits in the difference between the
+ * reachability bitmaps of each tip and base. The bitmap of each base is
+ * computed only once, so this works best with many tips compared to a few
+ * bases.
+ *
+ * Pairs with a commit that is not within a short walk of a commit with a
+ * stored bitmap are left alone, and stored in "left", which must have room
+ * for "counts_nr" entries. Returns how many there are, or -1 without
+ * touching "counts" if there is no usable bitmap index.
+ */
+int bitmap_ahead_behind(struct repository *r,
+			struct commit **commits, size_t commits_nr,
+			struct ahead_behind_count *counts, size_t counts_nr,
+			struct ahead_behind_count **left);
+
 void traverse_bitmap_commit_list(struct bitmap_index *,
 				 struct rev_info *revs,
 				 show_reachable_fn show_reachable);
@@ -9,6 +9,8 @@
 #include "packfile.h"
 #include "object-file.h"
 #include "object-store.h"
+#include "gettext.h"
+#include "thread-utils.h"
 
 struct idx_entry {
 	off_t                offset;
@@ -48,11 +50,241 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 	return data_crc != ntohl(*index_crc);
 }
 
+/*
+ * The result of checking a single packed object; filled by
+ * verify_entry_check() and consumed, in pack order, by
+ * verify_entry_report().
+ */
+struct verify_entry {
+	struct object_id oid;
+	off_t offset;
+	void *data;
+	enum object_type type;
+	unsigned long size;
+	unsigned crc_mismatch : 1,
+		 unpack_failed : 1,
+		 corrupt : 1,
+		 done : 1;
+};
+
+struct verify_ctx {
+	struct repository *r;
+	struct packed_git *p;
+	struct idx_entry *entries;
+	uint32_t nr_objects;
+	unsigned long big_file_threshold;
+
+	/*
+	 * Threaded verification: workers fill the slots of a ring of
+	 * "window" entries, which the main thread drains in order.
+	 * "bytes" is the size of the inflated objects the ring holds.
+	 */
+	struct verify_entry *slots;
+	uint32_t window;
+	uint32_t next, consumed;
+	size_t bytes;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+/*
+ * Check the CRC, inflate and hash the i-th object in pack order. Pack
+ * access is guarded by obj_read_lock(), which is a no-op unless
+ * verification is threaded; hashing happens outside of it.
+ */
+static void verify_entry_check(struct verify_ctx *ctx,
+			       struct pack_window **w_curs,
+			       uint32_t i, struct verify_entry *e)
+{
+	struct packed_git *p = ctx->p;
+	off_t curpos;
+	int data_valid;
+
+	memset(e, 0, sizeof(*e));
+	e->offset = ctx->entries[i].offset;
+	if (nth_packed_object_id(&e->oid, p, ctx->entries[i].nr) < 0)
+		BUG("unable to get oid of object %lu from %s",
+		    (unsigned long)ctx->entries[i].nr, p->pack_name);
+
+	obj_read_lock();
+	if (p->index_version > 1) {
+		off_t len = ctx->entries[i+1].offset - e->offset;
+		if (check_pack_crc(p, w_curs, e->offset, len,
+				   ctx->entries[i].nr))
+			e->crc_mismatch = 1;
+	}
+
+	curpos = e->offset;
+	e->type = unpack_object_header(p, w_curs, &curpos, &e->size);
+	unuse_pack(w_curs);
+
+	if (e->type == OBJ_BLOB && ctx->big_file_threshold <= e->size) {
+		/*
+		 * Let stream_object_signature() check it with
+		 * the streaming interface; no point slurping
+		 * the data in-core only to discard.
+		 */
+		data_valid = 0;
+	} else {
+		e->data = unpack_entry(ctx->r, p, e->offset,
+				       &e->type, &e->size);
+		data_valid = 1;
+	}
+
+	if (data_valid && !e->data)
+		e->unpack_failed = 1;
+	else if (!e->data && stream_object_signature(ctx->r, &e->oid) < 0)
+		e->corrupt = 1;
+	obj_read_unlock();
+
+	if (e->data && check_object_signature(ctx->r, &e->oid, e->data,
+					      e->size, e->type) < 0)
+		e->corrupt = 1;
+}
+
+static int verify_entry_report(struct verify_ctx *ctx, struct verify_entry *e,
+			       verify_fn fn)
+{
+	struct packed_git *p = ctx->p;
+	int err = 0;
+
+	if (e->crc_mismatch)
+		err = error("index CRC mismatch for object %s "
+			    "from %s at offset %"PRIuMAX"",
+			    oid_to_hex(&e->oid),
+			    p->pack_name, (uintmax_t)e->offset);
+
+	if (e->unpack_failed)
+		err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
+			    oid_to_hex(&e->oid), p->pack_name,
+			    (uintmax_t)e->offset);
+	else if (e->corrupt)
+		err = error("packed %s from %s is corrupt",
+			    oid_to_hex(&e->oid), p->pack_name);
+	else if (fn) {
+		int eaten = 0;
+
+		obj_read_lock();
+		err |= fn(&e->oid, e->type, e->size, e->data, &eaten);
+		obj_read_unlock();
+		if (eaten)
+			e->data = NULL;
+	}
+	FREE_AND_NULL(e->data);
+
+	return err;
+}
+
+/*
+ * The workers stop taking new objects once the ring holds this many
+ * bytes of inflated objects, unless it is empty. Each of them may still
+ * be inflating one more object, of up to core.bigFileThreshold bytes.
+ */
+#define VERIFY_WINDOW_BYTES (64 * 1024 * 1024)
+
+static int verify_window_full(struct verify_ctx *ctx)
+{
+	if (ctx->next == ctx->consumed)
+		return 0;
+	return ctx->next - ctx->consumed >= ctx->window ||
+	       ctx->bytes >= VERIFY_WINDOW_BYTES;
+}
+
+static void *verify_thread(void *data)
+{
+	struct verify_ctx *ctx = data;
+	struct pack_window *w_curs = NULL;
+
+	pthread_mutex_lock(&ctx->mutex);
+	while (ctx->next < ctx->nr_objects) {
+		uint32_t i;
+		struct verify_entry *e;
+
+		if (verify_window_full(ctx)) {
+			pthread_cond_wait(&ctx->cond, &ctx->mutex);
+			continue;
+		}
+		i = ctx->next++;
+		e = &ctx->slots[i % ctx->window];
+		pthread_mutex_unlock(&ctx->mutex);
+
+		verify_entry_check(ctx, &w_curs, i, e);
+
+		pthread_mutex_lock(&ctx->mutex);
+		if (e->data)
+			ctx->bytes += e->size;
+		e->done = 1;
+		pthread_cond_broadcast(&ctx->cond);
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	obj_read_lock();
+	unuse_pack(&w_curs);
+	obj_read_unlock();
+	return NULL;
+}
+
+static int verify_entries_threaded(struct verify_ctx *ctx, verify_fn fn,
+				   struct progress *progress,
+				   uint32_t base_count, int nr_threads)
+{
+	pthread_t *threads;
+	uint32_t i;
+	int err = 0;
+
+	ctx->window = nr_threads * 4;
+	CALLOC_ARRAY(ctx->slots, ctx->window);
+	pthread_mutex_init(&ctx->mutex, NULL);
+	pthread_cond_init(&ctx->cond, NULL);
+
+	enable_obj_read_lock();
+	ALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int ret = pthread_create(&threads[i], NULL, verify_thread, ctx);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+
+	for (i = 0; i < ctx->nr_objects; i++) {
+		struct verify_entry *e = &ctx->slots[i % ctx->window];
+		size_t bytes;
+
+		pthread_mutex_lock(&ctx->mutex);
+		while (!e->done)
+			pthread_cond_wait(&ctx->cond, &ctx->mutex);
+		pthread_mutex_unlock(&ctx->mutex);
+
+		bytes = e->data ? e->size : 0;
+		err |= verify_entry_report(ctx, e, fn);
+
+		pthread_mutex_lock(&ctx->mutex);
+		e->done = 0;
+		ctx->bytes -= bytes;
+		ctx->consumed++;
+		pthread_cond_broadcast(&ctx->cond);
+		pthread_mutex_unlock(&ctx->mutex);
+
+		if (((base_count + i) & 1023) == 0)
+			display_progress(progress, base_count + i);
+	}
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	disable_obj_read_lock();
+
+	pthread_cond_destroy(&ctx->cond);
+	pthread_mutex_destroy(&ctx->mutex);
+	free(ctx->slots);
+	return err;
+}
+
 static int verify_packfile(struct repository *r,
 			   struct packed_git *p,
 			   struct pack_window **w_curs,
 			   verify_fn fn,
-			   struct progress *progress, uint32_t base_count)
+			   struct progress *progress, uint32_t base_count,
+			   int nr_threads)
 
 {
 	off_t index_size = p->index_size;
@@ -63,6 +295,7 @@ static int verify_packfile(struct repository *r,
 	uint32_t nr_objects, i;
 	int err = 0;
 	struct idx_entry *entries;
+	struct verify_ctx verify = { .r = r, .p = p };
 
 	if (!is_pack_valid(p))
 		return error("packfile %s cannot be accessed", p->pack_name);
@@ -103,68 +336,27 @@ static int verify_packfile(struct repository *r,
 	}
 	QSORT(entries, nr_objects, compare_entries);
 
-	for (i = 0; i < nr_objects; i++) {
-		void *data;
-		struct object_id oid;
-		enum object_type type;
-		unsigned long size;
-		off_t curpos;
-		int data_valid;
-
-		if (nth_packed_object_id(&oid, p, entries[i].nr) < 0)
-			BUG("unable to get oid of object %lu from %s",
-			    (unsigned long)entries[i].nr, p->pack_name);
-
-		if (p->index_version > 1) {
-			off_t offset = entries[i].offset;
-			off_t len = entries[i+1].offset - offset;
-			unsigned int nr = entries[i].nr;
-			if (check_pack_crc(p, w_curs, offset, len, nr))
-				err = error("index CRC mismatch for object %s "
-					    "from %s at offset %"PRIuMAX"",
-					    oid_to_hex(&oid),
-					    p->pack_name, (uintmax_t)offset);
-		}
+	verify.entries = entries;
+	verify.nr_objects = nr_objects;
+	verify.big_file_threshold = repo_settings_get_big_file_threshold(r);
 
-		curpos = entries[i].offset;
-		type = unpack_object_header(p, w_curs, &curpos, &size);
-		unuse_pack(w_curs);
-
-		if (type == OBJ_BLOB &&
-		    repo_settings_get_big_file_threshold(r) <= size) {
-			/*
-			 * Let stream_object_signature() check it with
-			 * the streaming interface; no point slurping
-			 * the data in-core only to discard.
-			 */
-			data = NULL;
-			data_valid = 0;
-		} else {
-			data = unpack_entry(r, p, entries[i].offset, &type, &size);
-			data_valid = 1;
-		}
+	if (!HAVE_THREADS)
+		nr_threads = 1;
+	else if (nr_threads > nr_objects)
+		nr_threads = nr_objects;
+	if (nr_threads > 1) {
+		err |= verify_entries_threaded(&verify, fn, progress,
+					       base_count, nr_threads);
+		i = nr_objects;
+	} else {
+		for (i = 0; i < nr_objects; i++) {
+			struct verify_entry e;
 
-		if (data_valid && !data)
-			err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
-				    oid_to_hex(&oid), p->pack_name,
-				    (uintmax_t)entries[i].offset);
-		else if (data && check_object_signature(r, &oid, data, size,
-							type) < 0)
-			err = error("packed %s from %s is corrupt",
-				    oid_to_hex(&oid), p->pack_name);
-		else if (!data && stream_object_signature(r, &oid) < 0)
-			err = error("packed %s from %s is corrupt",
-				    oid_to_hex(&oid), p->pack_name);
-		else if (fn) {
-			int eaten = 0;
-			err |= fn(&oid, type, size, data, &eaten);
-			if (eaten)
-				data = NULL;
+			verify_entry_check(&verify, w_curs, i, &e);
+			err |= verify_entry_report(&verify, &e, fn);
+			if (((base_count + i) & 1023) == 0)
+				display_progress(progress, base_count + i);
 		}
-		if (((base_count + i) & 1023) == 0)
-			display_progress(progress, base_count + i);
-		free(data);
-
 	}
 	display_progress(progress, base_count + i);
 	free(entries);
@@ -187,7 +379,7 @@ int verify_pack_index(struct packed_git *p)
 }
 
 int verify_pack(struct repository *r, struct packed_git *p, verify_fn fn,
-		struct progress *progress, uint32_t base_count)
+		struct progress *progress, uint32_t base_count, int nr_threads)
 {
 	int err = 0;
 	struct pack_window *w_curs = NULL;
@@ -196,7 +388,8 @@ int verify_pack(struct repository *r, struct packed_git *p, verify_fn fn,
 	if (!p->index_data)
 		return -1;
 
-	err |= verify_packfile(r, p, &w_curs, fn, progress, base_count);
+	err |= verify_packfile(r, p, &w_curs, fn, progress, base_count,
+			       nr_threads);
 	unuse_pack(&w_curs);
 
 	return err;
@@ -95,7 +95,13 @@ const char *write_idx_file(struct repository *repo,
 			   const unsigned char *sha1);
 int check_pack_crc(struct packed_git *p, struct pack_window **w_curs, off_t offset, off_t len, unsigned int nr);
 int verify_pack_index(struct packed_git *);
-int verify_pack(struct repository *, struct packed_git *, verify_fn fn, struct progress *, uint32_t);
+/*
+ * Verify the pack and its index, calling "fn" (if not NULL) for each
+ * object in pack order. With "nr_threads" greater than one, objects are
+ * inflated and hashed by that many worker threads; "fn" is still called
+ * from the calling thread, in the same order.
+ */
+int verify_pack(struct repository *, struct packed_git *, verify_fn fn, struct progress *, uint32_t, int nr_threads);
 off_t write_pack_header(struct hashfile *f, uint32_t);
 void fixup_pack_header_footer(const struct git_hash_algo *, int,
 			      unsigned char *, const char *, uint32_t,
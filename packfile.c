@@ -1872,8 +1872,16 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 			      (uintmax_t)curpos, p->pack_name);
 			data = NULL;
 		} else {
+			/*
+			 * Neither buffer is shared: `base` was detached from
+			 * the delta base cache or unpacked by us, and is only
+			 * added to the cache below. So let other threads read
+			 * objects while we apply the delta.
+			 */
+			obj_read_unlock();
 			data = patch_delta(base, base_size, delta_data,
 					   delta_size, &size);
+			obj_read_lock();
 
 			/*
 			 * We could not apply the delta; warn the user, but
@@ -1890,11 +1898,11 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 
 		/*
 		 * We delay adding `base` to the cache until the end of the loop
-		 * because unpack_compressed_entry() momentarily releases the
-		 * obj_read_mutex, giving another thread the chance to access
-		 * the cache. Therefore, if `base` was already there, this other
-		 * thread could free() it (e.g. to make space for another entry)
-		 * before we are done using it.
+		 * because unpack_compressed_entry() and patch_delta() run
+		 * without the obj_read_mutex, giving another thread the chance
+		 * to access the cache. Therefore, if `base` was already there,
+		 * this other thread could free() it (e.g. to make space for
+		 * another entry) before we are done using it.
 		 */
 		if (!external_base)
 			add_delta_base_cache(p, base_obj_offset, base, base_size,
@@ -2,15 +2,19 @@
 #define DISABLE_SIGN_COMPARE_WARNINGS
 
 #include "git-compat-util.h"
+#include "compat/write-batch.h"
 #include "config.h"
 #include "entry.h"
 #include "gettext.h"
 #include "hash.h"
 #include "hex.h"
+#include "object-store.h"
 #include "parallel-checkout.h"
 #include "pkt-line.h"
 #include "progress.h"
 #include "read-cache-ll.h"
+#include "repo-settings.h"
+#include "repository.h"
 #include "run-command.h"
 #include "sigchain.h"
 #include "streaming.h"
@@ -331,50 +335,76 @@ static int close_and_clear(int *fd)
 	return ret;
 }
 
+/*
+ * The leading dirs should have been already created by now. But, in
+ * case of path collisions, one of the dirs could have been replaced by
+ * a symlink (checked out after we enqueued this entry for parallel
+ * checkout). Thus, we must check the leading dirs again.
+ */
+static int check_leading_dirs(struct parallel_checkout_item *pc_item,
+			      const char *path, struct checkout *state)
+{
+	const char *dir_sep = find_last_dir_sep(path);
+
+	if (dir_sep && !has_dirs_only_path(path, dir_sep - path,
+					   state->base_dir_len)) {
+		pc_item->status = PC_ITEM_COLLIDED;
+		trace2_data_string("pcheckout", NULL, "collision/dirname", path);
+		return -1;
+	}
+	return 0;
+}
+
+static void handle_open_error(struct parallel_checkout_item *pc_item,
+			      const char *path)
+{
+	if (errno == EEXIST || errno == EISDIR) {
+		/*
+		 * Errors which probably represent a path collision.
+		 * Suppress the error message and mark the item to be
+		 * retried later, sequentially. ENOTDIR and ENOENT are
+		 * also interesting, but the check_leading_dirs() call
+		 * should have already caught these cases.
+		 */
+		pc_item->status = PC_ITEM_COLLIDED;
+		trace2_data_string("pcheckout", NULL,
+				   "collision/basename", path);
+	} else {
+		error_errno("failed to open file '%s'", path);
+		pc_item->status = PC_ITEM_FAILED;
+	}
+}
+
+static void finish_written_pc_item(struct parallel_checkout_item *pc_item,
+				   struct checkout *state, const char *path,
+				   int fstat_done)
+{
+	if (state->refresh_cache && !fstat_done && lstat(path, &pc_item->st) < 0) {
+		error_errno("unable to stat just-written file '%s'",  path);
+		pc_item->status = PC_ITEM_FAILED;
+		return;
+	}
+
+	pc_item->status = PC_ITEM_WRITTEN;
+}
+
 void write_pc_item(struct parallel_checkout_item *pc_item,
 		   struct checkout *state)
 {
 	unsigned int mode = (pc_item->ce->ce_mode & 0100) ? 0777 : 0666;
 	int fd = -1, fstat_done = 0;
 	struct strbuf path = STRBUF_INIT;
-	const char *dir_sep;
 
 	strbuf_add(&path, state->base_dir, state->base_dir_len);
 	strbuf_add(&path, pc_item->ce->name, pc_item->ce->ce_namelen);
 
-	dir_sep = find_last_dir_sep(path.buf);
-
-	/*
-	 * The leading dirs should have been already created by now. But, in
-	 * case of path collisions, one of the dirs could have been replaced by
-	 * a symlink (checked out after we enqueued this entry for parallel
-	 * checkout). Thus, we must check the leading dirs again.
-	 */
-	if (dir_sep && !has_dirs_only_path(path.buf, dir_sep - path.buf,
-					   state->base_dir_len)) {
-		pc_item->status = PC_ITEM_COLLIDED;
-		trace2_data_string("pcheckout", NULL, "collision/dirname", path.buf);
+	if (check_leading_dirs(pc_item, path.buf, state))
 		goto out;
-	}
 
 	fd = open(path.buf, O_WRONLY | O_CREAT | O_EXCL, mode);
 
 	if (fd < 0) {
-		if (errno == EEXIST || errno == EISDIR) {
-			/*
-			 * Errors which probably represent a path collision.
-			 * Suppress the error message and mark the item to be
-			 * retried later, sequentially. ENOTDIR and ENOENT are
-			 * also interesting, but the above has_dirs_only_path()
-			 * call should have already caught these cases.
-			 */
-			pc_item->status = PC_ITEM_COLLIDED;
-			trace2_data_string("pcheckout", NULL,
-					   "collision/basename", path.buf);
-		} else {
-			error_errno("failed to open file '%s'", path.buf);
-			pc_item->status = PC_ITEM_FAILED;
-		}
+		handle_open_error(pc_item, path.buf);
 		goto out;
 	}
 
@@ -394,18 +424,179 @@ void write_pc_item(struct parallel_checkout_item *pc_item,
 		goto out;
 	}
 
-	if (state->refresh_cache && !fstat_done && lstat(path.buf, &pc_item->st) < 0) {
-		error_errno("unable to stat just-written file '%s'",  path.buf);
-		pc_item->status = PC_ITEM_FAILED;
-		goto out;
-	}
-
-	pc_item->status = PC_ITEM_WRITTEN;
+	finish_written_pc_item(pc_item, state, path.buf, fstat_done);
 
 out:
 	strbuf_release(&path);
 }
 
+/*
+ * Items written through a write_batch are read into memory first. We
+ * queue at most PC_BATCH_ITEMS items, holding at most PC_BATCH_BYTES of
+ * file contents, before handing them to the kernel; larger files are
+ * streamed by write_pc_item() as before.
+ */
+#define PC_BATCH_ITEMS (256)
+#define PC_BATCH_BYTES (32 * 1024 * 1024)
+
+struct pc_batch {
+	struct write_batch *wb;
+	struct write_batch_file *files;
+	struct parallel_checkout_item **items;
+	size_t nr, bytes;
+	uintmax_t nr_written;
+};
+
+static void flush_pc_batch(struct pc_batch *batch, struct checkout *state,
+			   pc_item_written_fn fn, void *data)
+{
+	size_t i;
+
+	write_batch_run(batch->wb, batch->files, batch->nr);
+
+	for (i = 0; i < batch->nr; i++) {
+		struct write_batch_file *file = &batch->files[i];
+		struct parallel_checkout_item *pc_item = batch->items[i];
+
+		errno = file->err;
+		switch (file->result) {
+		case WRITE_BATCH_OK:
+			if (file->have_stat)
+				pc_item->st = file->st;
+			finish_written_pc_item(pc_item, state, file->path,
+					       file->have_stat);
+			break;
+		case WRITE_BATCH_OPEN_FAILED:
+			handle_open_error(pc_item, file->path);
+			break;
+		case WRITE_BATCH_WRITE_FAILED:
+			error_errno("unable to write file '%s'", file->path);
+			pc_item->status = PC_ITEM_FAILED;
+			unlink(file->path);
+			break;
+		case WRITE_BATCH_CLOSE_FAILED:
+			error_errno("unable to close file '%s'", file->path);
+			pc_item->status = PC_ITEM_FAILED;
+			break;
+		}
+
+		free((char *)file->path);
+		free((void *)file->buf);
+		fn(pc_item, data);
+	}
+
+	batch->nr_written += batch->nr;
+	batch->nr = 0;
+	batch->bytes = 0;
+}
+
+/*
+ * Read the contents of "pc_item" into memory and queue it in "batch".
+ * Returns -1 if the item has to be written by write_pc_item() instead.
+ */
+static int queue_pc_item(struct pc_batch *batch,
+			 struct parallel_checkout_item *pc_item,
+			 struct checkout *state)
+{
+	struct write_batch_file *file;
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	unsigned long size;
+	size_t len;
+	char *blob;
+
+	if (oid_object_info(the_repository, &pc_item->ce->oid, &size) != OBJ_BLOB ||
+	    size > repo_settings_get_big_file_threshold(the_repository))
+		return -1;
+
+	blob = read_blob_entry(pc_item->ce, &len);
+	if (!blob)
+		return -1;
+	if (convert_to_working_tree_ca(&pc_item->ca, pc_item->ce->name,
+				       blob, len, &buf, NULL)) {
+		free(blob);
+		blob = strbuf_detach(&buf, &len);
+	}
+
+	strbuf_add(&path, state->base_dir, state->base_dir_len);
+	strbuf_add(&path, pc_item->ce->name, pc_item->ce->ce_namelen);
+
+	file = &batch->files[batch->nr];
+	memset(file, 0, sizeof(*file));
+	file->path = strbuf_detach(&path, NULL);
+	file->mode = (pc_item->ce->ce_mode & 0100) ? 0777 : 0666;
+	file->buf = blob;
+	file->len = len;
+	file->want_stat = checkout_output_wants_fstat(state);
+	batch->items[batch->nr++] = pc_item;
+	batch->bytes += len;
+	return 0;
+}
+
+void write_pc_items(struct parallel_checkout_item *items, size_t nr,
+		    struct checkout *state, pc_item_written_fn fn, void *data)
+{
+	struct pc_batch batch = { 0 };
+	size_t i;
+
+	if (nr > 1)
+		batch.wb = write_batch_new();
+	if (!batch.wb) {
+		for (i = 0; i < nr; i++) {
+			write_pc_item(&items[i], state);
+			fn(&items[i], data);
+		}
+		return;
+	}
+
+	ALLOC_ARRAY(batch.files, PC_BATCH_ITEMS);
+	ALLOC_ARRAY(batch.items, PC_BATCH_ITEMS);
+
+	for (i = 0; i < nr; i++) {
+		struct parallel_checkout_item *pc_item = &items[i];
+		struct strbuf path = STRBUF_INIT;
+		int collided;
+
+		/*
+		 * Items in the queue are all regular files, so writing
+		 * the batch cannot change the result of this check.
+		 */
+		strbuf_add(&path, state->base_dir, state->base_dir_len);
+		strbuf_add(&path, pc_item->ce->name, pc_item->ce->ce_namelen);
+		collided = check_leading_dirs(pc_item, path.buf, state);
+		strbuf_release(&path);
+
+		/*
+		 * An item that does not go through the batch is reported
+		 * right away, so report the items queued before it first:
+		 * "fn" has to be called in the order of the items.
+		 */
+		if (collided) {
+			if (batch.nr)
+				flush_pc_batch(&batch, state, fn, data);
+			fn(pc_item, data);
+			continue;
+		}
+
+		if (queue_pc_item(&batch, pc_item, state)) {
+			if (batch.nr)
+				flush_pc_batch(&batch, state, fn, data);
+			write_pc_item(pc_item, state);
+			fn(pc_item, data);
+			continue;
+		}
+		if (batch.nr == PC_BATCH_ITEMS || batch.bytes >= PC_BATCH_BYTES)
+			flush_pc_batch(&batch, state, fn, data);
+	}
+	if (batch.nr)
+		flush_pc_batch(&batch, state, fn, data);
+
+	trace2_data_intmax("pcheckout", NULL, "io_uring/files", batch.nr_written);
+	write_batch_free(batch.wb);
+	free(batch.files);
+	free(batch.items);
+}
+
 static void send_one_item(int fd, struct parallel_checkout_item *pc_item)
 {
 	size_t len_data;
@@ -635,16 +826,17 @@ static void gather_results_from_workers(struct pc_worker *workers,
 	free(pfds);
 }
 
-static void write_items_sequentially(struct checkout *state)
+static void item_written_sequentially(struct parallel_checkout_item *pc_item,
+				     void *data UNUSED)
 {
-	size_t i;
+	if (pc_item->status != PC_ITEM_COLLIDED)
+		advance_progress_meter();
+}
 
-	for (i = 0; i < parallel_checkout.nr; i++) {
-		struct parallel_checkout_item *pc_item = &parallel_checkout.items[i];
-		write_pc_item(pc_item, state);
-		if (pc_item->status != PC_ITEM_COLLIDED)
-			advance_progress_meter();
-	}
+static void write_items_sequentially(struct checkout *state)
+{
+	write_pc_items(parallel_checkout.items, parallel_checkout.nr, state,
+		       item_written_sequentially, NULL);
 }
 
 int run_parallel_checkout(struct checkout *state, int num_workers, int threshold,
@@ -110,4 +110,16 @@ struct pc_item_result {
 void write_pc_item(struct parallel_checkout_item *pc_item,
 		   struct checkout *state);
 
+typedef void (*pc_item_written_fn)(struct parallel_checkout_item *pc_item,
+				   void *data);
+
+/*
+ * Write the "nr" items like write_pc_item() does, calling "fn" for each
+ * item once it is done. Where the platform allows it, the files are
+ * created in batches (see compat/write-batch.h), and "fn" is only called
+ * once the batch is written, but always in the order of the items.
+ */
+void write_pc_items(struct parallel_checkout_item *items, size_t nr,
+		    struct checkout *state, pc_item_written_fn fn, void *data);
+
 #endif /* PARALLEL_CHECKOUT_H */
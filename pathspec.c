@@ -11,6 +11,7 @@
 #include "read-cache.h"
 #include "repository.h"
 #include "setup.h"
+#include "sparse-index.h"
 #include "strvec.h"
 #include "symlinks.h"
 #include "quote.h"
@@ -890,3 +891,70 @@ int pathspec_needs_expanded_index(struct index_state *istate,
 	free(skip_worktree_seen);
 	return res;
 }
+
+/* Whether the pathspec may match part of the sparse directory "ce". */
+static int pathspec_matches_part_of_dir(const struct cache_entry *ce,
+					void *data)
+{
+	const struct pathspec *pathspec = data;
+	int namelen = ce_namelen(ce);
+
+	for (int i = 0; i < pathspec->nr; i++) {
+		const struct pathspec_item *item = &pathspec->items[i];
+
+		/* see pathspec_needs_expanded_index() */
+		if (item->nowildcard_len < item->len) {
+			if (item->nowildcard_len > namelen &&
+			    !strncmp(item->match, ce->name, namelen))
+				return 1;
+			if (!strncmp(item->match, ce->name, item->nowildcard_len) &&
+			    wildmatch(item->match, ce->name, 0))
+				return 1;
+		} else if (item->len > namelen &&
+			   !strncmp(item->match, ce->name, namelen)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void expand_index_for_pathspec(struct index_state *istate,
+			       const struct pathspec *pathspec)
+{
+	if (!istate->sparse_index)
+		return;
+	if (pathspec->magic)
+		ensure_full_index(istate);
+	else
+		expand_sparse_directories(istate, pathspec_matches_part_of_dir,
+					  (void *)pathspec);
+}
+
+struct pathspec_in_index {
+	struct index_state *istate;
+	const struct pathspec *pathspec;
+};
+
+/* Whether the pathspec may match a path in the sparse directory "ce". */
+static int pathspec_reaches_into_dir(const struct cache_entry *ce, void *data)
+{
+	struct pathspec_in_index *p = data;
+
+	return match_leading_pathspec(p->istate, p->pathspec,
+				      ce->name, ce_namelen(ce) - 1,
+				      0, NULL, 1);
+}
+
+void expand_index_for_pathspec_files(struct index_state *istate,
+				     const struct pathspec *pathspec)
+{
+	struct pathspec_in_index p = { istate, pathspec };
+
+	if (!istate->sparse_index)
+		return;
+	/* attributes are looked up for the directory, not its contents */
+	if (!pathspec->nr || (pathspec->magic & PATHSPEC_ATTR))
+		ensure_full_index(istate);
+	else
+		expand_sparse_directories(istate, pathspec_reaches_into_dir, &p);
+}
@@ -184,6 +184,15 @@ int match_pathspec(struct index_state *istate,
 		   const char *name, int namelen,
 		   int prefix, char *seen, int is_dir);
 
+/*
+ * Like match_pathspec(), but also match a "name" that is a leading
+ * directory of a path the pathspec may match.
+ */
+int match_leading_pathspec(struct index_state *istate,
+			   const struct pathspec *pathspec,
+			   const char *name, int namelen,
+			   int prefix, char *seen, int is_dir);
+
 /*
  * Determine whether a pathspec will match only entire index entries (non-sparse
  * files and/or entire sparse directories). If the pathspec has the potential to
@@ -196,4 +205,23 @@ int match_pathspec(struct index_state *istate,
 int pathspec_needs_expanded_index(struct index_state *istate,
 				  const struct pathspec *pathspec);
 
+/*
+ * Expand only the sparse directories of the index whose contents the
+ * pathspec may match part of, so that each path it matches is either
+ * in the index or in a sparse directory it matches as a whole.
+ *
+ * With a "magic" pathspec, the whole index is expanded.
+ */
+void expand_index_for_pathspec(struct index_state *istate,
+			       const struct pathspec *pathspec);
+
+/*
+ * Expand the sparse directories of the index that the pathspec may match
+ * any path in, so that each path it matches is in the index.
+ *
+ * Without a pathspec, or with "attr" magic, the whole index is expanded.
+ */
+void expand_index_for_pathspec_files(struct index_state *istate,
+				     const struct pathspec *pathspec);
+
 #endif /* PATHSPEC_H */
@@ -6,6 +6,7 @@
 #define DISABLE_SIGN_COMPARE_WARNINGS
 
 #include "git-compat-util.h"
+#include "compat/lstat-batch.h"
 #include "pathspec.h"
 #include "dir.h"
 #include "environment.h"
@@ -29,6 +30,12 @@
 #define MAX_PARALLEL (20)
 #define THREAD_COST (500)
 
+/*
+ * Number of entries each thread collects before handing their lstat's
+ * to lstat_batch_run() in one go.
+ */
+#define PRELOAD_BATCH (256)
+
 struct progress_data {
 	unsigned long n;
 	struct progress *progress;
@@ -42,8 +49,35 @@ struct thread_data {
 	struct progress_data *progress;
 	int offset, nr;
 	int t2_nr_lstat;
+	struct lstat_batch_stats batch_stats;
+};
+
+struct preload_batch {
+	struct lstat_batch *lstat;
+	struct cache_entry **ce;
+	const char **paths;
+	struct stat *st;
+	int *ret;
+	size_t nr;
 };
 
+static void flush_preload_batch(struct index_state *index,
+				struct preload_batch *b)
+{
+	lstat_batch_run(b->lstat, b->paths, b->nr, b->st, b->ret);
+	for (size_t i = 0; i < b->nr; i++) {
+		struct cache_entry *ce = b->ce[i];
+
+		if (b->ret[i])
+			continue;
+		if (ie_match_stat(index, ce, &b->st[i], CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
+			continue;
+		ce_mark_uptodate(ce);
+		mark_fsmonitor_valid(index, ce);
+	}
+	b->nr = 0;
+}
+
 static void *preload_thread(void *_data)
 {
 	int nr, last_nr;
@@ -51,6 +85,13 @@ static void *preload_thread(void *_data)
 	struct index_state *index = p->index;
 	struct cache_entry **cep = index->cache + p->offset;
 	struct cache_def cache = CACHE_DEF_INIT;
+	struct preload_batch batch = { 0 };
+
+	batch.lstat = lstat_batch_new();
+	ALLOC_ARRAY(batch.ce, PRELOAD_BATCH);
+	ALLOC_ARRAY(batch.paths, PRELOAD_BATCH);
+	ALLOC_ARRAY(batch.st, PRELOAD_BATCH);
+	ALLOC_ARRAY(batch.ret, PRELOAD_BATCH);
 
 	nr = p->nr;
 	if (nr + p->offset > index->cache_nr)
@@ -59,7 +100,6 @@ static void *preload_thread(void *_data)
 
 	do {
 		struct cache_entry *ce = *cep++;
-		struct stat st;
 
 		if (ce_stage(ce))
 			continue;
@@ -85,13 +125,12 @@ static void *preload_thread(void *_data)
 		if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
 			continue;
 		p->t2_nr_lstat++;
-		if (lstat(ce->name, &st))
-			continue;
-		if (ie_match_stat(index, ce, &st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
-			continue;
-		ce_mark_uptodate(ce);
-		mark_fsmonitor_valid(index, ce);
+		batch.ce[batch.nr] = ce;
+		batch.paths[batch.nr] = ce->name;
+		if (++batch.nr == PRELOAD_BATCH)
+			flush_preload_batch(index, &batch);
 	} while (--nr > 0);
+	flush_preload_batch(index, &batch);
 	if (p->progress) {
 		struct progress_data *pd = p->progress;
 
@@ -100,6 +139,11 @@ static void *preload_thread(void *_data)
 		pthread_mutex_unlock(&pd->mutex);
 	}
 	cache_def_clear(&cache);
+	lstat_batch_free(batch.lstat, &p->batch_stats);
+	free(batch.ce);
+	free(batch.paths);
+	free(batch.st);
+	free(batch.ret);
 	return NULL;
 }
 
@@ -111,6 +155,7 @@ void preload_index(struct index_state *index,
 	struct thread_data data[MAX_PARALLEL];
 	struct progress_data pd;
 	int t2_sum_lstat = 0;
+	struct lstat_batch_stats batch_stats = { 0 };
 
 	if (!HAVE_THREADS || !core_preload_index)
 		return;
@@ -160,6 +205,9 @@ void preload_index(struct index_state *index,
 		if (pthread_join(p->pthread, NULL))
 			die("unable to join threaded lstat");
 		t2_sum_lstat += p->t2_nr_lstat;
+		batch_stats.nr_batched += p->batch_stats.nr_batched;
+		if (p->batch_stats.max_in_flight > batch_stats.max_in_flight)
+			batch_stats.max_in_flight = p->batch_stats.max_in_flight;
 	}
 	stop_progress(&pd.progress);
 
@@ -172,6 +220,12 @@ void preload_index(struct index_state *index,
 	trace_performance_leave("preload index");
 
 	trace2_data_intmax("index", NULL, "preload/sum_lstat", t2_sum_lstat);
+	if (batch_stats.nr_batched) {
+		trace2_data_intmax("index", NULL, "preload/io_uring_statx",
+				   batch_stats.nr_batched);
+		trace2_data_intmax("index", NULL, "preload/io_uring_max_in_flight",
+				   batch_stats.max_in_flight);
+	}
 	trace2_region_leave("index", "preload", NULL);
 }
 
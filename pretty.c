@@ -31,6 +31,7 @@
 #define FORMATTING_LIMIT (16 * 1024)
 
 static char *user_format;
+static unsigned int user_format_generation;
 static struct cmt_fmt_map {
 	const char *name;
 	enum cmit_fmt format;
@@ -54,6 +55,7 @@ static void save_user_format(struct rev_info *rev, const char *cp, int is_tforma
 {
 	free(user_format);
 	user_format = xstrdup(cp);
+	user_format_generation++;
 	if (is_tformat)
 		rev->use_terminator = 1;
 	rev->commit_format = CMIT_FMT_USERFORMAT;
@@ -1983,10 +1985,202 @@ void userformat_find_requirements(const char *fmt, struct userformat_want *w)
 	}
 }
 
-void repo_format_commit_message(struct repository *r,
-				const struct commit *commit,
-				const char *format, struct strbuf *sb,
-				const struct pretty_print_context *pretty_ctx)
+/*
+ * Some placeholders take arguments that are costly enough to parse that
+ * doing it again for every commit shows when formatting many of them,
+ * like colors and the options of "%(trailers)". These are parsed once
+ * per format string and found again by their offset in the format while
+ * it is expanded; everything else is left to format_commit_item().
+ *
+ * Only the user format is compiled, as it is the one expanded for every
+ * commit of a walk. The result belongs to the rev_info that
+ * pretty_print_commit() is called with, and is compiled again only when
+ * the user format has been replaced since. Other callers, which may
+ * reuse one buffer for different formats, expand them as they are.
+ */
+struct compiled_trailers {
+	struct process_trailer_options opts;
+	struct string_list filter_list;
+	struct strbuf sepbuf;
+	struct strbuf kvsepbuf;
+};
+
+struct compiled_placeholder {
+	size_t offset; /* of the placeholder, just after its '%' */
+	size_t len;
+	enum {
+		COMPILED_COLOR,
+		COMPILED_TRAILERS,
+	} type;
+	int always;
+	char color[COLOR_MAXLEN];
+	struct compiled_trailers *trailers;
+};
+
+struct compiled_format {
+	unsigned int generation; /* of the user_format compiled */
+	struct compiled_placeholder *items;
+	size_t nr, alloc;
+};
+
+static void clear_compiled_trailers(struct compiled_trailers *t)
+{
+	if (!t)
+		return;
+	string_list_clear(&t->filter_list, 0);
+	strbuf_release(&t->sepbuf);
+	strbuf_release(&t->kvsepbuf);
+	free(t);
+}
+
+static void clear_compiled_format(struct compiled_format *cf)
+{
+	for (size_t i = 0; i < cf->nr; i++)
+		clear_compiled_trailers(cf->items[i].trailers);
+	FREE_AND_NULL(cf->items);
+	cf->nr = cf->alloc = 0;
+}
+
+void free_compiled_format(struct compiled_format *cf)
+{
+	if (!cf)
+		return;
+	clear_compiled_format(cf);
+	free(cf);
+}
+
+static int compile_color(const char *placeholder,
+			 struct compiled_placeholder *item)
+{
+	const char *begin, *end;
+
+	if (!skip_prefix(placeholder, "C(", &begin) ||
+	    starts_with(begin, "auto)") ||
+	    !(end = strchr(begin, ')')))
+		return -1;
+
+	if (skip_prefix(begin, "always,", &begin))
+		item->always = 1;
+	else
+		skip_prefix(begin, "auto,", &begin);
+	if (color_parse_mem(begin, end - begin, item->color) < 0)
+		return -1;
+
+	item->type = COMPILED_COLOR;
+	item->len = end - placeholder + 1;
+	return 0;
+}
+
+static int compile_trailers(const char *placeholder,
+			    struct compiled_placeholder *item)
+{
+	struct compiled_trailers *t;
+	const char *arg;
+
+	if (!skip_prefix(placeholder, "(trailers", &arg))
+		return -1;
+
+	CALLOC_ARRAY(t, 1);
+	t->opts = (struct process_trailer_options)PROCESS_TRAILER_OPTIONS_INIT;
+	t->opts.no_divider = 1;
+	string_list_init_nodup(&t->filter_list);
+	strbuf_init(&t->sepbuf, 0);
+	strbuf_init(&t->kvsepbuf, 0);
+
+	if (*arg == ':') {
+		arg++;
+		if (format_set_trailers_options(&t->opts, &t->filter_list,
+						&t->sepbuf, &t->kvsepbuf,
+						&arg, NULL))
+			goto fail;
+	}
+	if (*arg != ')')
+		goto fail;
+
+	item->type = COMPILED_TRAILERS;
+	item->len = arg - placeholder + 1;
+	item->trailers = t;
+	return 0;
+
+fail:
+	clear_compiled_trailers(t);
+	return -1;
+}
+
+static struct compiled_format *compile_user_format(struct rev_info *rev)
+{
+	struct compiled_format *cf = rev->compiled_format;
+	const char *cp;
+
+	if (cf && cf->generation == user_format_generation)
+		return cf;
+	if (cf)
+		clear_compiled_format(cf);
+	else
+		CALLOC_ARRAY(rev->compiled_format, 1);
+	cf = rev->compiled_format;
+	cf->generation = user_format_generation;
+
+	for (cp = user_format; (cp = strchr(cp, '%')); ) {
+		struct compiled_placeholder item = { 0 };
+
+		cp++;
+		item.offset = cp - user_format;
+		if (compile_color(cp, &item) && compile_trailers(cp, &item))
+			continue;
+		ALLOC_GROW(cf->items, cf->nr + 1, cf->alloc);
+		cf->items[cf->nr++] = item;
+	}
+	return cf;
+}
+
+static const struct compiled_placeholder *find_compiled_placeholder(const struct compiled_format *cf,
+								   size_t offset,
+								   size_t *next)
+{
+	if (!cf)
+		return NULL;
+	while (*next < cf->nr && cf->items[*next].offset < offset)
+		(*next)++;
+	if (*next < cf->nr && cf->items[*next].offset == offset)
+		return &cf->items[*next];
+	return NULL;
+}
+
+static size_t format_compiled_placeholder(struct strbuf *sb, /* in UTF-8 */
+					  const struct compiled_placeholder *item,
+					  struct format_commit_context *c)
+{
+	switch (item->type) {
+	case COMPILED_COLOR:
+		if (item->always || want_color(c->pretty_ctx->color))
+			strbuf_addstr(sb, item->color);
+		c->auto_color = 0;
+		break;
+	case COMPILED_TRAILERS:
+		if (!c->commit->object.parsed)
+			parse_object(the_repository, &c->commit->object.oid);
+		if (!c->commit_header_parsed) {
+			c->message = repo_logmsg_reencode(c->repository, c->commit,
+							  &c->commit_encoding,
+							  "UTF-8");
+			parse_commit_header(c);
+		}
+		if (!c->commit_message_parsed)
+			parse_commit_message(c);
+		format_trailers_from_commit(&item->trailers->opts,
+					    c->message + c->subject_off, sb);
+		break;
+	}
+	return item->len;
+}
+
+static void format_commit_message_compiled(struct repository *r,
+					   const struct commit *commit,
+					   const char *format,
+					   const struct compiled_format *cf,
+					   struct strbuf *sb,
+					   const struct pretty_print_context *pretty_ctx)
 {
 	struct format_commit_context context = {
 		.repository = r,
@@ -1996,12 +2190,18 @@ void repo_format_commit_message(struct repository *r,
 	};
 	const char *output_enc = pretty_ctx->output_encoding;
 	const char *utf8 = "UTF-8";
+	const char *start = format;
+	const struct compiled_placeholder *item;
+	size_t next = 0;
 
 	while (strbuf_expand_step(sb, &format)) {
 		size_t len;
 
 		if (skip_prefix(format, "%", &format))
 			strbuf_addch(sb, '%');
+		else if (context.flush_type == no_flush &&
+			 (item = find_compiled_placeholder(cf, format - start, &next)))
+			format += format_compiled_placeholder(sb, item, &context);
 		else if ((len = format_commit_item(sb, format, &context)))
 			format += len;
 		else
@@ -2036,6 +2236,14 @@ void repo_format_commit_message(struct repository *r,
 	signature_check_clear(&context.signature_check);
 }
 
+void repo_format_commit_message(struct repository *r,
+				const struct commit *commit,
+				const char *format, struct strbuf *sb,
+				const struct pretty_print_context *pretty_ctx)
+{
+	format_commit_message_compiled(r, commit, format, NULL, sb, pretty_ctx);
+}
+
 static void pp_header(struct pretty_print_context *pp,
 		      const char *encoding,
 		      const struct commit *commit,
@@ -2293,8 +2501,9 @@ void pretty_print_commit(struct pretty_print_context *pp,
 	int need_8bit_cte = pp->need_8bit_cte;
 
 	if (pp->fmt == CMIT_FMT_USERFORMAT) {
-		repo_format_commit_message(the_repository, commit,
-					   user_format, sb, pp);
+		format_commit_message_compiled(the_repository, commit, user_format,
+					       pp->rev ? compile_user_format(pp->rev) : NULL,
+					       sb, pp);
 		return;
 	}
 
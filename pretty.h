@@ -126,6 +126,13 @@ void repo_format_commit_message(struct repository *r,
  */
 void get_commit_format(const char *arg, struct rev_info *);
 
+/*
+ * Free the user format that pretty_print_commit() compiled for a
+ * rev_info; see release_revisions().
+ */
+struct compiled_format;
+void free_compiled_format(struct compiled_format *cf);
+
 /*
  * Make a commit message with all rules from given "pp"
  * and put it into "sb".
@@ -6,6 +6,7 @@
 #include "gettext.h"
 #include "range-diff.h"
 #include "object-name.h"
+#include "parse.h"
 #include "string-list.h"
 #include "run-command.h"
 #include "strvec.h"
@@ -20,6 +21,8 @@
 #include "userdiff.h"
 #include "apply.h"
 #include "revision.h"
+#include "thread-utils.h"
+#include "trace2.h"
 
 struct patch_util {
 	/* For the search for an exact match */
@@ -324,10 +327,181 @@ static int diffsize(const char *a, const char *b)
 	return COST_MAX;
 }
 
-static void get_correspondences(struct string_list *a, struct string_list *b,
-				int creation_factor)
+/*
+ * The lines of a patch, hashed and sorted, so that the number of lines
+ * two patches do not have in common can be counted without a diff.
+ */
+struct line_fingerprint {
+	unsigned int *hash;
+	int nr;
+};
+
+static int cmp_uint(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a;
+	unsigned int y = *(const unsigned int *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void fingerprint_patch(struct line_fingerprint *fp, const char *diff)
+{
+	int alloc = 0;
+
+	fp->hash = NULL;
+	fp->nr = 0;
+	while (*diff) {
+		const char *eol = strchrnul(diff, '\n');
+
+		if (*eol)
+			eol++;
+		ALLOC_GROW(fp->hash, fp->nr + 1, alloc);
+		fp->hash[fp->nr++] = memhash(diff, eol - diff);
+		diff = eol;
+	}
+	QSORT(fp->hash, fp->nr, cmp_uint);
+}
+
+/*
+ * Every line that is in one patch but not in the other is shown by the
+ * diff between them, so this never exceeds diffsize(). Hash collisions
+ * can only make it smaller.
+ */
+static int fingerprint_distance(const struct line_fingerprint *a,
+				const struct line_fingerprint *b)
+{
+	int i = 0, j = 0, common = 0;
+
+	while (i < a->nr && j < b->nr) {
+		if (a->hash[i] < b->hash[j])
+			i++;
+		else if (a->hash[i] > b->hash[j])
+			j++;
+		else {
+			common++;
+			i++;
+			j++;
+		}
+	}
+	return a->nr + b->nr - 2 * common;
+}
+
+struct correspondence_search {
+	struct string_list *a, *b;
+	struct line_fingerprint *fa, *fb;
+	int *creation_cost_a, *creation_cost_b;
+	/* cost of matching a[i] with b[j], at i * b->nr + j */
+	int *cost;
+	int nr_pruned, nr_diffed;
+	/* diff every pair, and solve one assignment for all patches */
+	int unsplit;
+
+	pthread_mutex_t mutex;
+	int next;
+};
+
+/*
+ * Matching two patches costs more than creating one and deleting the
+ * other when more of their lines differ than that, and the assignment
+ * would then always rather do the latter. Only run the diff for pairs
+ * where that is not already known.
+ */
+static void find_pair_costs(struct correspondence_search *cs, int i,
+			    int *nr_pruned, int *nr_diffed)
+{
+	struct patch_util *a_util = cs->a->items[i].util;
+	int j;
+
+	for (j = 0; j < cs->b->nr; j++) {
+		struct patch_util *b_util = cs->b->items[j].util;
+		int *c = &cs->cost[st_add(st_mult(i, cs->b->nr), j)];
+
+		if (a_util->matching == j)
+			*c = 0;
+		else if (a_util->matching >= 0 || b_util->matching >= 0)
+			*c = COST_MAX;
+		else if (!cs->unsplit &&
+			 fingerprint_distance(&cs->fa[i], &cs->fb[j]) >
+			 cs->creation_cost_a[i] + cs->creation_cost_b[j]) {
+			*c = COST_MAX;
+			(*nr_pruned)++;
+		} else {
+			*c = diffsize(a_util->diff, b_util->diff);
+			(*nr_diffed)++;
+		}
+	}
+}
+
+static void *find_pair_costs_thread(void *data)
+{
+	struct correspondence_search *cs = data;
+	int nr_pruned = 0, nr_diffed = 0;
+
+	for (;;) {
+		int i;
+
+		pthread_mutex_lock(&cs->mutex);
+		i = cs->next++;
+		pthread_mutex_unlock(&cs->mutex);
+		if (i >= cs->a->nr)
+			break;
+		find_pair_costs(cs, i, &nr_pruned, &nr_diffed);
+	}
+
+	pthread_mutex_lock(&cs->mutex);
+	cs->nr_pruned += nr_pruned;
+	cs->nr_diffed += nr_diffed;
+	pthread_mutex_unlock(&cs->mutex);
+	return NULL;
+}
+
+/* Below this many pairs, starting threads is not worth it. */
+#define RANGE_DIFF_MIN_PAIRS_PER_THREAD 64
+
+static void find_all_pair_costs(struct correspondence_search *cs)
+{
+	int nr_threads = git_env_ulong("GIT_TEST_RANGE_DIFF_THREADS", 0);
+	pthread_t *threads;
+	size_t nr_pairs = st_mult(cs->a->nr, cs->b->nr);
+
+	if (!nr_threads) {
+		nr_threads = online_cpus();
+		if (nr_pairs / RANGE_DIFF_MIN_PAIRS_PER_THREAD < nr_threads)
+			nr_threads = nr_pairs / RANGE_DIFF_MIN_PAIRS_PER_THREAD;
+	}
+	if (nr_threads > cs->a->nr)
+		nr_threads = cs->a->nr;
+	if (!HAVE_THREADS || nr_threads < 2) {
+		for (int i = 0; i < cs->a->nr; i++)
+			find_pair_costs(cs, i, &cs->nr_pruned, &cs->nr_diffed);
+		return;
+	}
+
+	pthread_mutex_init(&cs->mutex, NULL);
+	CALLOC_ARRAY(threads, nr_threads);
+	for (int t = 0; t < nr_threads; t++)
+		if (pthread_create(&threads[t], NULL, find_pair_costs_thread, cs))
+			die(_("unable to create thread"));
+	for (int t = 0; t < nr_threads; t++)
+		pthread_join(threads[t], NULL);
+	free(threads);
+	pthread_mutex_destroy(&cs->mutex);
+}
+
+static int find_component(int *parent, int i)
+{
+	while (parent[i] != i)
+		i = parent[i] = parent[parent[i]];
+	return i;
+}
+
+/*
+ * Find the cheapest assignment among the patches a[ia[]] and b[ib[]],
+ * laid out as get_correspondences() always did for the whole series.
+ */
+static void assign_component(struct correspondence_search *cs,
+			     int *ia, int na, int *ib, int nb)
 {
-	int n = a->nr + b->nr;
+	int n = na + nb;
 	int *cost, c, *a2b, *b2a;
 	int i, j;
 
@@ -335,49 +509,35 @@ static void get_correspondences(struct string_list *a, struct string_list *b,
 	ALLOC_ARRAY(a2b, n);
 	ALLOC_ARRAY(b2a, n);
 
-	for (i = 0; i < a->nr; i++) {
-		struct patch_util *a_util = a->items[i].util;
-
-		for (j = 0; j < b->nr; j++) {
-			struct patch_util *b_util = b->items[j].util;
+	for (i = 0; i < na; i++) {
+		for (j = 0; j < nb; j++)
+			cost[i + n * j] =
+				cs->cost[st_add(st_mult(ia[i], cs->b->nr), ib[j])];
 
-			if (a_util->matching == j)
-				c = 0;
-			else if (a_util->matching < 0 && b_util->matching < 0)
-				c = diffsize(a_util->diff, b_util->diff);
-			else
-				c = COST_MAX;
-			cost[i + n * j] = c;
-		}
-
-		c = a_util->matching < 0 ?
-			a_util->diffsize * creation_factor / 100 : COST_MAX;
-		for (j = b->nr; j < n; j++)
+		c = cs->creation_cost_a[ia[i]];
+		for (j = nb; j < n; j++)
 			cost[i + n * j] = c;
 	}
 
-	for (j = 0; j < b->nr; j++) {
-		struct patch_util *util = b->items[j].util;
-
-		c = util->matching < 0 ?
-			util->diffsize * creation_factor / 100 : COST_MAX;
-		for (i = a->nr; i < n; i++)
+	for (j = 0; j < nb; j++) {
+		c = cs->creation_cost_b[ib[j]];
+		for (i = na; i < n; i++)
 			cost[i + n * j] = c;
 	}
 
-	for (i = a->nr; i < n; i++)
-		for (j = b->nr; j < n; j++)
+	for (i = na; i < n; i++)
+		for (j = nb; j < n; j++)
 			cost[i + n * j] = 0;
 
 	compute_assignment(n, n, cost, a2b, b2a);
 
-	for (i = 0; i < a->nr; i++)
-		if (a2b[i] >= 0 && a2b[i] < b->nr) {
-			struct patch_util *a_util = a->items[i].util;
-			struct patch_util *b_util = b->items[a2b[i]].util;
+	for (i = 0; i < na; i++)
+		if (a2b[i] >= 0 && a2b[i] < nb) {
+			struct patch_util *a_util = cs->a->items[ia[i]].util;
+			struct patch_util *b_util = cs->b->items[ib[a2b[i]]].util;
 
-			a_util->matching = a2b[i];
-			b_util->matching = i;
+			a_util->matching = ib[a2b[i]];
+			b_util->matching = ia[i];
 		}
 
 	free(cost);
@@ -385,6 +545,131 @@ static void get_correspondences(struct string_list *a, struct string_list *b,
 	free(b2a);
 }
 
+static void get_correspondences(struct string_list *a, struct string_list *b,
+				int creation_factor)
+{
+	struct correspondence_search cs = {
+		.a = a,
+		.b = b,
+		.unsplit = git_env_bool("GIT_TEST_RANGE_DIFF_UNSPLIT", 0),
+	};
+	int *parent, *next, *last, *ia, *ib, na, nb, nr_components = 0;
+	int i, j, k;
+
+	CALLOC_ARRAY(cs.fa, a->nr);
+	CALLOC_ARRAY(cs.fb, b->nr);
+	ALLOC_ARRAY(cs.creation_cost_a, a->nr);
+	ALLOC_ARRAY(cs.creation_cost_b, b->nr);
+	ALLOC_ARRAY(cs.cost, st_mult(a->nr, b->nr));
+
+	for (i = 0; i < a->nr; i++) {
+		struct patch_util *util = a->items[i].util;
+
+		if (util->matching < 0)
+			fingerprint_patch(&cs.fa[i], util->diff);
+		cs.creation_cost_a[i] = util->matching < 0 ?
+			util->diffsize * creation_factor / 100 : COST_MAX;
+	}
+	for (j = 0; j < b->nr; j++) {
+		struct patch_util *util = b->items[j].util;
+
+		if (util->matching < 0)
+			fingerprint_patch(&cs.fb[j], util->diff);
+		cs.creation_cost_b[j] = util->matching < 0 ?
+			util->diffsize * creation_factor / 100 : COST_MAX;
+	}
+
+	find_all_pair_costs(&cs);
+
+	/*
+	 * A pair that costs more than creating one patch and deleting the
+	 * other is never part of the cheapest assignment, so the patches
+	 * that are not linked by cheaper pairs can be assigned separately.
+	 * Exact matches were taken care of already. With "unsplit", every
+	 * patch is linked, and the one assignment is laid out as it was
+	 * before we split it.
+	 */
+	ALLOC_ARRAY(parent, a->nr + b->nr);
+	for (i = 0; i < a->nr + b->nr; i++)
+		parent[i] = i;
+	for (i = 0; i < a->nr; i++) {
+		if (!cs.unsplit &&
+		    ((struct patch_util *)a->items[i].util)->matching >= 0)
+			continue;
+		for (j = 0; j < b->nr; j++) {
+			int c = cs.cost[st_add(st_mult(i, b->nr), j)];
+
+			int x, y;
+
+			if (!cs.unsplit &&
+			    (c >= COST_MAX ||
+			     c > cs.creation_cost_a[i] + cs.creation_cost_b[j]))
+				continue;
+			/* the root of a component is its first patch */
+			x = find_component(parent, i);
+			y = find_component(parent, a->nr + j);
+			if (x < y)
+				parent[y] = x;
+			else
+				parent[x] = y;
+		}
+	}
+
+	/* chain the members of each component in order, starting at its root */
+	ALLOC_ARRAY(next, a->nr + b->nr);
+	ALLOC_ARRAY(last, a->nr + b->nr);
+	for (k = 0; k < a->nr + b->nr; k++) {
+		int root = find_component(parent, k);
+
+		next[k] = -1;
+		if (root == k)
+			last[k] = k;
+		else
+			last[root] = next[last[root]] = k;
+	}
+
+	ALLOC_ARRAY(ia, a->nr);
+	ALLOC_ARRAY(ib, b->nr);
+	for (k = 0; k < a->nr + b->nr; k++) {
+		if (parent[k] != k)
+			continue;
+
+		na = nb = 0;
+		for (i = k; i >= 0; i = next[i])
+			if (i < a->nr)
+				ia[na++] = i;
+			else
+				ib[nb++] = i - a->nr;
+		if (!na || !nb)
+			continue;
+
+		assign_component(&cs, ia, na, ib, nb);
+		nr_components++;
+	}
+
+	trace2_data_intmax("range-diff", the_repository, "pairs/pruned",
+			   cs.nr_pruned);
+	trace2_data_intmax("range-diff", the_repository, "pairs/diffed",
+			   cs.nr_diffed);
+	trace2_data_intmax("range-diff", the_repository, "components",
+			   nr_components);
+
+	for (i = 0; i < a->nr; i++)
+		free(cs.fa[i].hash);
+	for (j = 0; j < b->nr; j++)
+		free(cs.fb[j].hash);
+	free(cs.fa);
+	free(cs.fb);
+	free(cs.creation_cost_a);
+	free(cs.creation_cost_b);
+	free(cs.cost);
+	free(parent);
+	free(next);
+	free(last);
+	free(ia);
+	free(ib);
+}
+
 static void output_pair_header(struct diff_options *diffopt,
 			       int patch_no_width,
 			       struct strbuf *buf,
@@ -10,6 +10,7 @@
 #include "git-compat-util.h"
 #include "bulk-checkin.h"
 #include "config.h"
+#include "convert.h"
 #include "date.h"
 #include "diff.h"
 #include "diffcore.h"
@@ -1467,11 +1468,58 @@ int repo_refresh_and_write_index(struct repository *repo,
 }
 
 
+/*
+ * The entries that refresh_cache_ent() will compare with the contents
+ * of the file are the racily clean ones and those whose stat data
+ * changed without their size, and for those the file goes through the
+ * clean filter. Hand the next ones to pipelining clean filters. Returns
+ * where to call us again.
+ */
+static int queue_refresh_filters(struct index_state *istate, int pos,
+				 const struct pathspec *pathspec,
+				 unsigned int options)
+{
+	int ignore_valid = options & CE_MATCH_IGNORE_VALID;
+	int queued = 0;
+
+	if (!convert_has_process_filters())
+		return istate->cache_nr;
+
+	/* until the filters turn out not to pipeline */
+	for (; pos < istate->cache_nr && queued < CONVERT_QUEUE_MAX &&
+	       convert_has_process_filters(); pos++) {
+		struct cache_entry *ce = istate->cache[pos];
+		struct stat st;
+		int changed;
+
+		if (ce_uptodate(ce) || ce_stage(ce) || ce_intent_to_add(ce) ||
+		    !S_ISREG(ce->ce_mode) || ce_skip_worktree(ce) ||
+		    (!ignore_valid && (ce->ce_flags & CE_VALID)) ||
+		    (ce->ce_flags & CE_FSMONITOR_VALID))
+			continue;
+		if (pathspec && !ce_path_match(istate, ce, pathspec, NULL))
+			continue;
+		if (lstat(ce->name, &st) || !S_ISREG(st.st_mode))
+			continue;
+
+		changed = ce_match_stat_basic(ce, &st);
+		if (!changed && !is_racy_timestamp(istate, ce))
+			continue;
+		if (changed & (MODE_CHANGED | TYPE_CHANGED))
+			continue;
+		if ((changed & DATA_CHANGED) && ce->ce_stat_data.sd_size)
+			continue;
+		queued += convert_queue_to_git(istate, ce->name);
+	}
+	convert_run_queue();
+	return pos;
+}
+
 int refresh_index(struct index_state *istate, unsigned int flags,
 		  const struct pathspec *pathspec,
 		  char *seen, const char *header_msg)
 {
-	int i;
+	int i, queued_up_to = 0;
 	int has_errors = 0;
 	int really = (flags & REFRESH_REALLY) != 0;
 	int allow_unmerged = (flags & REFRESH_UNMERGED) != 0;
@@ -1553,6 +1601,9 @@ int refresh_index(struct index_state *istate, unsigned int flags,
 		if (filtered)
 			continue;
 
+		if (i >= queued_up_to)
+			queued_up_to = queue_refresh_filters(istate, i,
+							     pathspec, options);
 		new_entry = refresh_cache_ent(istate, ce, options,
 					      &cache_errno, &changed,
 					      &t2_did_lstat, &t2_did_scan);
@@ -3905,16 +3956,48 @@ static int fix_unmerged_status(struct diff_filepair *p,
 		return DIFF_STATUS_MODIFIED;
 }
 
+/*
+ * Hand the next modified files to pipelining clean filters, so that
+ * add_file_to_index() finds them cleaned. Returns where to call us again.
+ */
+static int queue_clean_filters(struct index_state *istate,
+			       struct diff_queue_struct *q, int pos)
+{
+	int queued = 0;
+
+	if (!convert_has_process_filters())
+		return q->nr;
+	for (; pos < q->nr && queued < CONVERT_QUEUE_MAX &&
+	       convert_has_process_filters(); pos++)
+		if (q->queue[pos]->status != DIFF_STATUS_DELETED)
+			queued += convert_queue_to_git(istate,
+						       q->queue[pos]->one->path);
+	convert_run_queue();
+	return pos;
+}
+
 static void update_callback(struct diff_queue_struct *q,
 			    struct diff_options *opt UNUSED, void *cbdata)
 {
-	int i;
+	int i, queued_up_to = 0, prepared_up_to = 0;
 	struct update_callback_data *data = cbdata;
+	const char **paths;
+
+	ALLOC_ARRAY(paths, q->nr);
+	for (i = 0; i < q->nr; i++)
+		paths[i] = q->queue[i]->one->path;
 
 	for (i = 0; i < q->nr; i++) {
 		struct diff_filepair *p = q->queue[i];
 		const char *path = p->one->path;
 
+		if (i >= queued_up_to)
+			queued_up_to = queue_clean_filters(data->index, q, i);
+		if (i >= prepared_up_to)
+			prepared_up_to = i + prepare_blobs_bulk_checkin(data->index,
+									paths + i,
+									q->nr - i);
+
 		if (!data->include_sparse &&
 		    !path_in_sparse_checkout(path, data->index))
 			continue;
@@ -3940,6 +4023,7 @@ static void update_callback(struct diff_queue_struct *q,
 			break;
 		}
 	}
+	free(paths);
 }
 
 int add_files_to_cache(struct repository *repo, const char *prefix,
@@ -1372,6 +1372,111 @@ static const char *find_next(const char *cp)
 	return NULL;
 }
 
+/*
+ * The format string compiled into a list of literal text, with its "%%"
+ * and "%xx" escapes already expanded, and atoms, already resolved to
+ * their index in used_atom[], so that formatting each ref does not have
+ * to scan the format and look its atoms up again.
+ *
+ * Like used_atom[], this is global state, and is forgotten together with
+ * the atoms by ref_array_clear(). It keeps its own copy of the format
+ * string it was compiled from and is only reused for the same string;
+ * atoms are found in used_atom[] by their name alone, so the indices do
+ * not depend on which ref_format asked for them.
+ */
+struct format_op {
+	int atom; /* index into used_atom[], or -1 for literal text */
+	size_t literal_off, literal_len;
+};
+
+static struct {
+	char *format_string;
+	struct format_op *ops;
+	size_t nr, alloc;
+	struct strbuf literals;
+} compiled_format = {
+	.literals = STRBUF_INIT,
+};
+
+static void clear_compiled_format(void)
+{
+	FREE_AND_NULL(compiled_format.format_string);
+	FREE_AND_NULL(compiled_format.ops);
+	compiled_format.nr = compiled_format.alloc = 0;
+	strbuf_release(&compiled_format.literals);
+}
+
+static void add_literal_op(const char *cp, const char *ep)
+{
+	struct strbuf *s = &compiled_format.literals;
+	struct format_op *op;
+	size_t off = s->len;
+
+	while (*cp && (!ep || cp < ep)) {
+		if (*cp == '%') {
+			if (cp[1] == '%')
+				cp++;
+			else {
+				int ch = hex2chr(cp + 1);
+				if (0 <= ch) {
+					strbuf_addch(s, ch);
+					cp += 3;
+					continue;
+				}
+			}
+		}
+		strbuf_addch(s, *cp);
+		cp++;
+	}
+	if (s->len == off)
+		return;
+
+	ALLOC_GROW(compiled_format.ops, compiled_format.nr + 1,
+		   compiled_format.alloc);
+	op = &compiled_format.ops[compiled_format.nr++];
+	op->atom = -1;
+	op->literal_off = off;
+	op->literal_len = s->len - off;
+}
+
+static int compile_ref_format(struct ref_format *format, struct strbuf *err)
+{
+	const char *cp, *sp, *ep;
+
+	if (compiled_format.format_string &&
+	    !strcmp(compiled_format.format_string, format->format))
+		return 0;
+
+	clear_compiled_format();
+	for (cp = format->format; *cp && (sp = find_next(cp)); cp = ep + 1) {
+		struct format_op *op;
+		int pos;
+
+		ep = strchr(sp, ')');
+		if (!ep) {
+			clear_compiled_format();
+			return strbuf_addf_ret(err, -1,
+					       _("malformed format string %s"), sp);
+		}
+		if (cp < sp)
+			add_literal_op(cp, sp);
+		pos = parse_ref_filter_atom(format, sp + 2, ep, err);
+		if (pos < 0) {
+			clear_compiled_format();
+			return -1;
+		}
+		ALLOC_GROW(compiled_format.ops, compiled_format.nr + 1,
+			   compiled_format.alloc);
+		op = &compiled_format.ops[compiled_format.nr++];
+		op->atom = pos;
+	}
+	if (*cp)
+		add_literal_op(cp, NULL);
+
+	compiled_format.format_string = xstrdup(format->format);
+	return 0;
+}
+
 static int reject_atom(enum atom_type atom_type)
 {
 	return atom_type == ATOM_REST;
@@ -1384,10 +1489,10 @@ static int reject_atom(enum atom_type atom_type)
 int verify_ref_format(struct ref_format *format)
 {
 	const char *cp, *sp;
+	struct strbuf err = STRBUF_INIT;
 
 	format->need_color_reset_at_eol = 0;
 	for (cp = format->format; *cp && (sp = find_next(cp)); ) {
-		struct strbuf err = STRBUF_INIT;
 		const char *color, *ep = strchr(sp, ')');
 		int at;
 
@@ -1411,10 +1516,12 @@ int verify_ref_format(struct ref_format *format)
 
 		if (skip_prefix(used_atom[at].name, "color:", &color))
 			format->need_color_reset_at_eol = !!strcmp(color, "reset");
-		strbuf_release(&err);
 	}
 	if (format->need_color_reset_at_eol && !want_color(format->use_color))
 		format->need_color_reset_at_eol = 0;
+	if (compile_ref_format(format, &err))
+		die("%s", err.buf);
+	strbuf_release(&err);
 	return 0;
 }
 
@@ -3025,6 +3132,7 @@ void ref_array_clear(struct ref_array *array)
 	}
 	FREE_AND_NULL(used_atom);
 	used_atom_cnt = 0;
+	clear_compiled_format();
 
 	if (ref_to_worktree_map.worktrees) {
 		hashmap_clear_and_free(&(ref_to_worktree_map.map),
@@ -3448,57 +3556,35 @@ void ref_array_sort(struct ref_sorting *sorting, struct ref_array *array)
 		QSORT_S(array->items, array->nr, compare_refs, sorting);
 }
 
-static void append_literal(const char *cp, const char *ep, struct ref_formatting_state *state)
-{
-	struct strbuf *s = &state->stack->output;
-
-	while (*cp && (!ep || cp < ep)) {
-		if (*cp == '%') {
-			if (cp[1] == '%')
-				cp++;
-			else {
-				int ch = hex2chr(cp + 1);
-				if (0 <= ch) {
-					strbuf_addch(s, ch);
-					cp += 3;
-					continue;
-				}
-			}
-		}
-		strbuf_addch(s, *cp);
-		cp++;
-	}
-}
-
 int format_ref_array_item(struct ref_array_item *info,
 			  struct ref_format *format,
 			  struct strbuf *final_buf,
 			  struct strbuf *error_buf)
 {
-	const char *cp, *sp, *ep;
 	struct ref_formatting_state state = REF_FORMATTING_STATE_INIT;
 
+	if (compile_ref_format(format, error_buf))
+		return -1;
+
 	state.quote_style = format->quote_style;
 	push_stack_element(&state.stack);
 
-	for (cp = format->format; *cp && (sp = find_next(cp)); cp = ep + 1) {
+	for (size_t i = 0; i < compiled_format.nr; i++) {
+		const struct format_op *op = &compiled_format.ops[i];
 		struct atom_value *atomv;
-		int pos;
 
-		ep = strchr(sp, ')');
-		if (cp < sp)
-			append_literal(cp, sp, &state);
-		pos = parse_ref_filter_atom(format, sp + 2, ep, error_buf);
-		if (pos < 0 || get_ref_atom_value(info, pos, &atomv, error_buf) ||
+		if (op->atom < 0) {
+			strbuf_add(&state.stack->output,
+				   compiled_format.literals.buf + op->literal_off,
+				   op->literal_len);
+			continue;
+		}
+		if (get_ref_atom_value(info, op->atom, &atomv, error_buf) ||
 		    atomv->handler(atomv, &state, error_buf)) {
 			pop_stack_element(&state.stack);
 			return -1;
 		}
 	}
-	if (*cp) {
-		sp = cp + strlen(cp);
-		append_literal(cp, sp, &state);
-	}
 	if (format->need_color_reset_at_eol) {
 		struct atom_value resetv = ATOM_VALUE_INIT;
 		resetv.s = GIT_COLOR_RESET;
@@ -3216,6 +3216,8 @@ void release_revisions(struct rev_info *revs)
 	list_objects_filter_release(&revs->filter);
 	clear_pathspec(&revs->prune_data);
 	date_mode_release(&revs->date_mode);
+	free_compiled_format(revs->compiled_format);
+	revs->compiled_format = NULL;
 	release_revisions_mailmap(revs->mailmap);
 	free_grep_patterns(&revs->grep_filter);
 	graph_clear(revs->graph);
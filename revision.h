@@ -281,6 +281,7 @@ struct rev_info {
 
 	unsigned int	abbrev;
 	enum cmit_fmt	commit_format;
+	struct compiled_format *compiled_format;
 	struct log_info *loginfo;
 	int		nr, total;
 	const char	*mime_boundary;
@@ -1,5 +1,7 @@
 #include "git-compat-util.h"
 #include "repository.h"
+#include "abspath.h"
+#include "environment.h"
 #include "config.h"
 #include "hash.h"
 #include "pkt-line.h"
@@ -11,6 +13,15 @@
 #include "bundle-uri.h"
 #include "trace2.h"
 #include "promisor-remote.h"
+#include "gettext.h"
+#include "object-store.h"
+#include "packfile.h"
+#include "commit-graph.h"
+#include "repo-settings.h"
+#include "sigchain.h"
+#include "strvec.h"
+#include "unix-socket.h"
+#include "unix-stream-server.h"
 
 static int advertise_sid = -1;
 static int advertise_object_info = -1;
@@ -370,3 +381,427 @@ void protocol_v2_serve_loop(struct repository *r, int stateless_rpc)
 				break;
 	}
 }
+
+#ifndef NO_UNIX_SOCKETS
+
+/*
+ * A forwarding process sends its stdin, stdout and stderr over the
+ * socket, along with a single byte telling whether it was asked for a
+ * single stateless-rpc exchange. It then describes its request in
+ * pkt-lines, ended by a flush packet:
+ *
+ *   gitdir=<the real path of its repository>
+ *   env=<name>=<value>	for each of serve_socket_env that is set
+ *
+ * The server answers SERVE_SOCKET_ACCEPTED if it serves that repository,
+ * or SERVE_SOCKET_REJECTED without touching the descriptors otherwise.
+ * Once the request has been served, it writes back SERVE_SOCKET_DONE and
+ * closes the connection.
+ */
+#define SERVE_SOCKET_STATEFUL '0'
+#define SERVE_SOCKET_STATELESS_RPC '1'
+#define SERVE_SOCKET_ACCEPTED 'a'
+#define SERVE_SOCKET_REJECTED 'r'
+#define SERVE_SOCKET_DONE '0'
+
+/*
+ * The environment that changes how a request is served: the namespace
+ * and the "-c" settings of the forwarding process. --strict and
+ * --timeout need not be passed on; the former only matters to find the
+ * repository, whose path is compared instead, and the latter only
+ * applies to protocol v0.
+ */
+static const char *serve_socket_env[] = {
+	GIT_NAMESPACE_ENVIRONMENT,
+	CONFIG_DATA_ENVIRONMENT,
+	CONFIG_COUNT_ENVIRONMENT,
+};
+
+static struct unix_ss_socket *serve_socket;
+static pid_t serve_socket_pid;
+static char *serve_socket_gitdir;
+
+static void serve_socket_cleanup(void)
+{
+	/* forked children share our atexit handlers */
+	if (!serve_socket || getpid() != serve_socket_pid)
+		return;
+	unix_ss_free(serve_socket);
+	serve_socket = NULL;
+}
+
+static void serve_socket_cleanup_on_signal(int signo)
+{
+	serve_socket_cleanup();
+	sigchain_pop(signo);
+	raise(signo);
+}
+
+static void add_stat_state(struct strbuf *state, const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) < 0) {
+		strbuf_addstr(state, "-\n");
+		return;
+	}
+	strbuf_addf(state, "%"PRIuMAX":%"PRIuMAX".%u:%"PRIuMAX"\n",
+		    (uintmax_t)st.st_ino, (uintmax_t)st.st_mtime,
+		    ST_MTIME_NSEC(st), (uintmax_t)st.st_size);
+}
+
+/*
+ * Describe the files whose contents the server keeps loaded. The pack
+ * directory changes whenever a pack is added or removed; the other
+ * files are replaced atomically when they are rewritten.
+ */
+static void serve_socket_state(struct repository *r, struct strbuf *state)
+{
+	static const char *object_files[] = {
+		"pack",
+		"pack/multi-pack-index",
+		"info/alternates",
+		"info/commit-graph",
+		"info/commit-graphs/commit-graph-chain",
+	};
+	struct strbuf path = STRBUF_INIT;
+	size_t i;
+
+	strbuf_reset(state);
+	for (i = 0; i < ARRAY_SIZE(object_files); i++) {
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/%s", r->objects->odb->path,
+			    object_files[i]);
+		add_stat_state(state, path.buf);
+	}
+	strbuf_reset(&path);
+	strbuf_addf(&path, "%s/config", r->commondir);
+	add_stat_state(state, path.buf);
+	strbuf_release(&path);
+}
+
+/*
+ * Load what every request needs, so that the children we fork for each
+ * connection inherit it instead of reading it again.
+ */
+static void serve_socket_warm(struct repository *r)
+{
+	int unused;
+
+	repo_config_get_bool(r, "uploadpack.allowfilter", &unused);
+	prepare_repo_settings(r);
+	get_all_packs(r);
+	generation_numbers_enabled(r);
+}
+
+static void serve_socket_reload(struct repository *r)
+{
+	trace2_region_enter("serve", "socket/reload", r);
+	close_object_store(r->objects);
+	repo_config_clear(r);
+	repo_settings_clear(r);
+	reprepare_packed_git(r);
+	serve_socket_warm(r);
+	trace2_region_leave("serve", "socket/reload", r);
+}
+
+/*
+ * Add the variables of serve_socket_env that are set, along with the
+ * GIT_CONFIG_KEY_<n> and GIT_CONFIG_VALUE_<n> that GIT_CONFIG_COUNT
+ * refers to, to "env" as "<name>=<value>".
+ */
+static void serve_socket_getenv(struct strvec *env)
+{
+	const char *count;
+
+	for (size_t i = 0; i < ARRAY_SIZE(serve_socket_env); i++) {
+		const char *value = getenv(serve_socket_env[i]);
+
+		if (value)
+			strvec_pushf(env, "%s=%s", serve_socket_env[i], value);
+	}
+
+	count = getenv(CONFIG_COUNT_ENVIRONMENT);
+	for (int i = 0; count && i < atoi(count); i++) {
+		const char *value;
+		char *name;
+
+		name = xstrfmt("GIT_CONFIG_KEY_%d", i);
+		if ((value = getenv(name)))
+			strvec_pushf(env, "%s=%s", name, value);
+		free(name);
+		name = xstrfmt("GIT_CONFIG_VALUE_%d", i);
+		if ((value = getenv(name)))
+			strvec_pushf(env, "%s=%s", name, value);
+		free(name);
+	}
+}
+
+static int is_serve_socket_env(const char *name, size_t len)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(serve_socket_env); i++)
+		if (strlen(serve_socket_env[i]) == len &&
+		    !strncmp(serve_socket_env[i], name, len))
+			return 1;
+	return (len > 15 && !strncmp(name, "GIT_CONFIG_KEY_", 15)) ||
+	       (len > 17 && !strncmp(name, "GIT_CONFIG_VALUE_", 17));
+}
+
+/* Whether "a" and "b" differ in anything but the namespace. */
+static int serve_socket_config_env_cmp(const struct strvec *a,
+				       const struct strvec *b)
+{
+	size_t i = 0, j = 0;
+
+	for (;;) {
+		while (i < a->nr && starts_with(a->v[i], GIT_NAMESPACE_ENVIRONMENT "="))
+			i++;
+		while (j < b->nr && starts_with(b->v[j], GIT_NAMESPACE_ENVIRONMENT "="))
+			j++;
+		if (i == a->nr || j == b->nr)
+			return i != a->nr || j != b->nr;
+		if (strcmp(a->v[i++], b->v[j++]))
+			return 1;
+	}
+}
+
+/*
+ * Read the description of the request, and check that it is for our
+ * repository. Returns -1 if it is not, after telling the client.
+ */
+static int serve_socket_handshake(struct repository *r, int conn)
+{
+	struct packet_reader reader;
+	struct strvec env = STRVEC_INIT, our_env = STRVEC_INIT;
+	struct strvec no_env = STRVEC_INIT;
+	char *gitdir = NULL;
+	char answer;
+	int config_changed = 0;
+
+	packet_reader_init(&reader, conn, NULL, 0,
+			   PACKET_READ_CHOMP_NEWLINE |
+			   PACKET_READ_GENTLE_ON_EOF);
+	while (packet_reader_read(&reader) == PACKET_READ_NORMAL) {
+		const char *arg;
+
+		if (skip_prefix(reader.line, "gitdir=", &arg)) {
+			free(gitdir);
+			gitdir = xstrdup(arg);
+		} else if (skip_prefix(reader.line, "env=", &arg)) {
+			const char *eq = strchr(arg, '=');
+
+			if (eq && is_serve_socket_env(arg, eq - arg))
+				strvec_push(&env, arg);
+		}
+	}
+	if (reader.status != PACKET_READ_FLUSH)
+		exit(0); /* the client went away */
+
+	/*
+	 * "-c" settings include protected config, e.g. hooks, which we
+	 * only take from a client that could run them itself.
+	 */
+	if (!gitdir || strcmp(gitdir, serve_socket_gitdir) ||
+	    (serve_socket_config_env_cmp(&env, &no_env) &&
+	     !unix_stream_peer_is_same_user(conn))) {
+		trace2_data_string("serve", r, "socket/rejected",
+				   gitdir ? gitdir : "");
+		answer = SERVE_SOCKET_REJECTED;
+		write_in_full(conn, &answer, 1);
+		free(gitdir);
+		strvec_clear(&env);
+		return -1;
+	}
+
+	/* switch to the environment of the client */
+	serve_socket_getenv(&our_env);
+	config_changed = serve_socket_config_env_cmp(&our_env, &env);
+	for (size_t i = 0; i < our_env.nr; i++) {
+		const char *var = our_env.v[i];
+		char *name = xstrndup(var, strchr(var, '=') - var);
+
+		unsetenv(name);
+		free(name);
+	}
+	for (size_t i = 0; i < env.nr; i++)
+		putenv(xstrdup(env.v[i]));
+
+	/*
+	 * The namespace is looked up on first use, which is in the code
+	 * serving the request, but the config we have loaded has to be
+	 * read again with the client's "-c" settings.
+	 */
+	if (config_changed) {
+		repo_config_clear(r);
+		repo_settings_clear(r);
+	}
+
+	answer = SERVE_SOCKET_ACCEPTED;
+	if (write_in_full(conn, &answer, 1) < 0)
+		exit(0);
+
+	free(gitdir);
+	strvec_clear(&env);
+	strvec_clear(&our_env);
+	return 0;
+}
+
+static void NORETURN serve_socket_connection(struct repository *r, int conn)
+{
+	int fds[3];
+	char mode;
+	size_t i;
+
+	if (unix_stream_recv_fds(conn, fds, ARRAY_SIZE(fds), &mode, 1) != 1)
+		die_errno(_("could not receive connection from client"));
+
+	if (serve_socket_handshake(r, conn) < 0)
+		exit(0);
+	trace2_region_enter("serve", "socket/connection", r);
+
+	for (i = 0; i < ARRAY_SIZE(fds); i++) {
+		if (fds[i] == (int)i)
+			continue;
+		if (dup2(fds[i], i) < 0)
+			die_errno(_("could not set up connection"));
+		close(fds[i]);
+	}
+
+	protocol_v2_serve_loop(r, mode == SERVE_SOCKET_STATELESS_RPC);
+	trace2_region_leave("serve", "socket/connection", r);
+
+	mode = SERVE_SOCKET_DONE;
+	write_in_full(conn, &mode, 1);
+	close(conn);
+	exit(0);
+}
+
+int protocol_v2_serve_socket(struct repository *r, const char *path)
+{
+	struct unix_stream_listen_opts opts = UNIX_STREAM_LISTEN_OPTS_INIT;
+	struct strbuf state = STRBUF_INIT, new_state = STRBUF_INIT;
+	int ret;
+
+	ret = unix_ss_create(path, &opts, -1, &serve_socket);
+	if (ret == -2)
+		return error(_("another server is listening on '%s'"), path);
+	if (ret < 0)
+		return error_errno(_("could not listen on '%s'"), path);
+	serve_socket_pid = getpid();
+	serve_socket_gitdir = real_pathdup(repo_get_git_dir(r), 1);
+	atexit(serve_socket_cleanup);
+	sigchain_push_common(serve_socket_cleanup_on_signal);
+
+	serve_socket_state(r, &state);
+	serve_socket_warm(r);
+
+	for (;;) {
+		struct pollfd pfd = {
+			.fd = serve_socket->fd_socket,
+			.events = POLLIN,
+		};
+		pid_t pid;
+		int conn;
+
+		while (waitpid(-1, NULL, WNOHANG) > 0)
+			; /* reap connections that are done */
+
+		if (unix_ss_was_stolen(serve_socket)) {
+			warning(_("socket '%s' was replaced, exiting"), path);
+			break;
+		}
+
+		if (poll(&pfd, 1, 1000) <= 0)
+			continue;
+		conn = accept(serve_socket->fd_socket, NULL, NULL);
+		if (conn < 0)
+			continue;
+
+		serve_socket_state(r, &new_state);
+		if (strbuf_cmp(&state, &new_state)) {
+			serve_socket_reload(r);
+			strbuf_swap(&state, &new_state);
+		}
+
+		pid = fork();
+		if (pid < 0)
+			error_errno(_("could not fork"));
+		else if (!pid) {
+			close(serve_socket->fd_socket);
+			serve_socket_connection(r, conn);
+		}
+		close(conn);
+	}
+
+	strbuf_release(&state);
+	strbuf_release(&new_state);
+	serve_socket_cleanup();
+	return 0;
+}
+
+static int serve_socket_send_request(struct repository *r, int sock)
+{
+	struct strvec env = STRVEC_INIT;
+	char *gitdir = real_pathdup(repo_get_git_dir(r), 1);
+	int ret;
+
+	serve_socket_getenv(&env);
+	ret = packet_write_fmt_gently(sock, "gitdir=%s", gitdir);
+	for (size_t i = 0; !ret && i < env.nr; i++)
+		ret = packet_write_fmt_gently(sock, "env=%s", env.v[i]);
+	if (!ret)
+		ret = packet_flush_gently(sock);
+
+	free(gitdir);
+	strvec_clear(&env);
+	return ret;
+}
+
+int protocol_v2_forward_to_socket(struct repository *r, const char *path,
+				  int stateless_rpc)
+{
+	int fds[] = { 0, 1, 2 };
+	char mode = stateless_rpc ? SERVE_SOCKET_STATELESS_RPC :
+				    SERVE_SOCKET_STATEFUL;
+	int sock, ret;
+
+	sock = unix_stream_connect(path, 0);
+	if (sock < 0)
+		return -1;
+	if (unix_stream_send_fds(sock, fds, ARRAY_SIZE(fds), &mode, 1) < 0 ||
+	    serve_socket_send_request(r, sock) < 0 ||
+	    read_in_full(sock, &mode, 1) != 1 ||
+	    mode != SERVE_SOCKET_ACCEPTED) {
+		/* nothing has been read from stdin yet */
+		close(sock);
+		return -1;
+	}
+
+	/*
+	 * The server owns our end of the connection from now on; all we
+	 * can do is wait for it to tell us how it went.
+	 */
+	if (read_in_full(sock, &mode, 1) == 1 && mode == SERVE_SOCKET_DONE)
+		ret = 0;
+	else
+		ret = 1;
+	close(sock);
+	return ret;
+}
+
+#else
+
+int protocol_v2_serve_socket(struct repository *r UNUSED,
+			     const char *path UNUSED)
+{
+	return error(_("serving over a socket requires unix sockets"));
+}
+
+int protocol_v2_forward_to_socket(struct repository *r UNUSED,
+				  const char *path UNUSED,
+				  int stateless_rpc UNUSED)
+{
+	return -1;
+}
+
+#endif
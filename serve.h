@@ -6,4 +6,26 @@ struct repository;
 void protocol_v2_advertise_capabilities(struct repository *r);
 void protocol_v2_serve_loop(struct repository *r, int stateless_rpc);
 
+/*
+ * Listen on the unix socket at "path" and serve protocol v2 requests for
+ * "r" to the processes that connect to it with
+ * protocol_v2_forward_to_socket(), forking off a child for each of them.
+ * The repository's config, packs, multi-pack-index and commit-graph are
+ * loaded once and reloaded only when they change on disk. Returns when
+ * the socket is removed or replaced, or -1 if it cannot be created.
+ */
+int protocol_v2_serve_socket(struct repository *r, const char *path);
+
+/*
+ * Hand our stdin, stdout and stderr over to the server listening at
+ * "path", and wait until it has served the request for "r". The server
+ * applies our namespace and "-c" settings to the request, and refuses
+ * it if it serves another repository. Returns -1 if no server could be
+ * reached or it refused the request (in which case nothing has been
+ * read from stdin and the caller should serve the request itself), 0 if
+ * the request was served, and 1 if the server failed to serve it.
+ */
+int protocol_v2_forward_to_socket(struct repository *r, const char *path,
+				  int stateless_rpc);
+
 #endif /* SERVE_H */
@@ -194,3 +194,208 @@ void blk_SHA256_Final(unsigned char *digest, blk_SHA256_CTX *ctx)
 	for (i = 0; i < 8; i++, digest += sizeof(uint32_t))
 		put_be32(digest, ctx->state[i]);
 }
+
+/*
+ * The multi-buffer variant runs the compression of several messages in
+ * lockstep, one in each lane of a vector of words, so that every
+ * operation of a round is done for all of them at once. The vector
+ * types are a GCC extension that clang supports too; without them a
+ * "vector" is a single word and the messages are hashed one at a time.
+ */
+#ifdef __GNUC__
+#define MB_LANES 4
+typedef uint32_t mb_word __attribute__((vector_size(MB_LANES * sizeof(uint32_t))));
+#define MB_LANE(v, l) ((v)[l])
+#else
+#define MB_LANES 1
+typedef uint32_t mb_word;
+#define MB_LANE(v, l) (v)
+#endif
+
+static const uint32_t mb_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t mb_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline mb_word mb_ror(mb_word x, unsigned n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+static inline mb_word mb_ch(mb_word x, mb_word y, mb_word z)
+{
+	return z ^ (x & (y ^ z));
+}
+
+static inline mb_word mb_maj(mb_word x, mb_word y, mb_word z)
+{
+	return ((x | y) & z) | (x & y);
+}
+
+static inline mb_word mb_sigma0(mb_word x)
+{
+	return mb_ror(x, 2) ^ mb_ror(x, 13) ^ mb_ror(x, 22);
+}
+
+static inline mb_word mb_sigma1(mb_word x)
+{
+	return mb_ror(x, 6) ^ mb_ror(x, 11) ^ mb_ror(x, 25);
+}
+
+static inline mb_word mb_gamma0(mb_word x)
+{
+	return mb_ror(x, 7) ^ mb_ror(x, 18) ^ (x >> 3);
+}
+
+static inline mb_word mb_gamma1(mb_word x)
+{
+	return mb_ror(x, 17) ^ mb_ror(x, 19) ^ (x >> 10);
+}
+
+static void blk_SHA256_Transform_multi(mb_word state[8],
+				       const unsigned char *buf[MB_LANES])
+{
+	mb_word S[8], W[64], t0, t1;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		S[i] = state[i];
+
+	for (i = 0; i < 16; i++)
+		for (int l = 0; l < MB_LANES; l++)
+			MB_LANE(W[i], l) = get_be32(buf[l] + i * sizeof(uint32_t));
+
+	for (i = 16; i < 64; i++)
+		W[i] = mb_gamma1(W[i - 2]) + W[i - 7] + mb_gamma0(W[i - 15]) + W[i - 16];
+
+	for (i = 0; i < 64; i++) {
+		t0 = S[7] + mb_sigma1(S[4]) + mb_ch(S[4], S[5], S[6]) + mb_k[i] + W[i];
+		t1 = mb_sigma0(S[0]) + mb_maj(S[0], S[1], S[2]);
+		S[7] = S[6];
+		S[6] = S[5];
+		S[5] = S[4];
+		S[4] = S[3] + t0;
+		S[3] = S[2];
+		S[2] = S[1];
+		S[1] = S[0];
+		S[0] = t0 + t1;
+	}
+
+	for (i = 0; i < 8; i++)
+		state[i] += S[i];
+}
+
+struct mb_lane {
+	const struct blk_SHA256_msg *msg;
+	uint64_t total;
+	size_t block, nr_blocks;
+	unsigned char tmp[BLKSIZE];
+};
+
+static void mb_lane_start(struct mb_lane *lane, const struct blk_SHA256_msg *msg,
+			  mb_word state[8], int l)
+{
+	lane->msg = msg;
+	lane->total = (uint64_t)msg->head_len + msg->len;
+	lane->block = 0;
+	/* the message, a 0x80 byte and the 64-bit length, rounded up */
+	lane->nr_blocks = (lane->total + 8) / BLKSIZE + 1;
+	for (int i = 0; i < 8; i++)
+		MB_LANE(state[i], l) = mb_iv[i];
+}
+
+/*
+ * The next block of the padded message of a lane: straight from the
+ * data when it is all in there, otherwise put together in "tmp".
+ */
+static const unsigned char *mb_lane_block(struct mb_lane *lane)
+{
+	const struct blk_SHA256_msg *msg = lane->msg;
+	uint64_t off = (uint64_t)lane->block * BLKSIZE;
+	size_t n = 0;
+
+	if (off >= msg->head_len && off + BLKSIZE <= lane->total)
+		return (const unsigned char *)msg->data + (off - msg->head_len);
+
+	memset(lane->tmp, 0, BLKSIZE);
+	if (off < msg->head_len) {
+		n = msg->head_len - off;
+		if (n > BLKSIZE)
+			n = BLKSIZE;
+		memcpy(lane->tmp, (const unsigned char *)msg->head + off, n);
+	}
+	if (n < BLKSIZE && off + n < lane->total) {
+		size_t from = off + n - msg->head_len;
+		size_t len = msg->len - from;
+
+		if (len > BLKSIZE - n)
+			len = BLKSIZE - n;
+		memcpy(lane->tmp + n, (const unsigned char *)msg->data + from, len);
+	}
+	if (off <= lane->total && lane->total < off + BLKSIZE)
+		lane->tmp[lane->total - off] = 0x80;
+	if (lane->block + 1 == lane->nr_blocks)
+		put_be64(lane->tmp + BLKSIZE - 8, lane->total << 3);
+	return lane->tmp;
+}
+
+void blk_SHA256_Multi(const struct blk_SHA256_msg *msgs, size_t nr)
+{
+	static const unsigned char idle[BLKSIZE];
+	struct mb_lane lanes[MB_LANES];
+	const unsigned char *blocks[MB_LANES];
+	mb_word state[8];
+	size_t next = 0, active = 0;
+
+	memset(state, 0, sizeof(state));
+	for (int l = 0; l < MB_LANES; l++) {
+		lanes[l].msg = NULL;
+		if (next < nr) {
+			mb_lane_start(&lanes[l], &msgs[next++], state, l);
+			active++;
+		}
+	}
+
+	while (active) {
+		for (int l = 0; l < MB_LANES; l++)
+			blocks[l] = lanes[l].msg ? mb_lane_block(&lanes[l]) : idle;
+
+		blk_SHA256_Transform_multi(state, blocks);
+
+		/* hand the lanes whose message is done the next one */
+		for (int l = 0; l < MB_LANES; l++) {
+			struct mb_lane *lane = &lanes[l];
+
+			if (!lane->msg || ++lane->block < lane->nr_blocks)
+				continue;
+			for (int i = 0; i < 8; i++)
+				put_be32(lane->msg->digest + i * sizeof(uint32_t),
+					 MB_LANE(state[i], l));
+			lane->msg = NULL;
+			active--;
+			if (next < nr) {
+				mb_lane_start(lane, &msgs[next++], state, l);
+				active++;
+			}
+		}
+	}
+}
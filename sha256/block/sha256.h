@@ -16,6 +16,21 @@ void blk_SHA256_Init(blk_SHA256_CTX *ctx);
 void blk_SHA256_Update(blk_SHA256_CTX *ctx, const void *data, size_t len);
 void blk_SHA256_Final(unsigned char *digest, blk_SHA256_CTX *ctx);
 
+/* A message for blk_SHA256_Multi(): "head" followed by "data". */
+struct blk_SHA256_msg {
+	const void *head;
+	size_t head_len;
+	const void *data;
+	size_t len;
+	unsigned char *digest;
+};
+
+/*
+ * Hash "nr" independent messages, several at once in the lanes of the
+ * vector registers when the compiler supports vector types.
+ */
+void blk_SHA256_Multi(const struct blk_SHA256_msg *msgs, size_t nr);
+
 #define platform_SHA256_CTX blk_SHA256_CTX
 #define platform_SHA256_Init blk_SHA256_Init
 #define platform_SHA256_Update blk_SHA256_Update
@@ -316,7 +316,13 @@ static int add_path_to_index(const struct object_id *oid,
 	return 0;
 }
 
-void expand_index(struct index_state *istate, struct pattern_list *pl)
+/*
+ * Expand the sparse directories selected by "pl" as described for
+ * expand_index(), or, if "want" is given instead, those for which it
+ * returns true, each to the full list of its files.
+ */
+static void expand_index_1(struct index_state *istate, struct pattern_list *pl,
+			   sparse_dir_fn want, void *want_data)
 {
 	int i;
 	struct index_state *full;
@@ -337,7 +343,9 @@ void expand_index(struct index_state *istate, struct pattern_list *pl)
 	 * continue. A NULL pattern set indicates a full expansion to a
 	 * full index.
 	 */
-	if (pl && !pl->use_cone_patterns) {
+	if (want) {
+		; /* the other sparse directories stay as they are */
+	} else if (pl && !pl->use_cone_patterns) {
 		pl = NULL;
 	} else {
 		/*
@@ -356,7 +364,7 @@ void expand_index(struct index_state *istate, struct pattern_list *pl)
 			pl = NULL;
 	}
 
-	if (!pl && give_advice_on_expansion) {
+	if (!pl && !want && give_advice_on_expansion) {
 		give_advice_on_expansion = 0;
 		advise_if_enabled(ADVICE_SPARSE_INDEX_EXPANDED,
 				  _(ADVICE_MSG));
@@ -368,7 +376,7 @@ void expand_index(struct index_state *istate, struct pattern_list *pl)
 	 * This is used by test cases, but also helps to differentiate the
 	 * two cases.
 	 */
-	tr_region = pl ? "expand_index" : "ensure_full_index";
+	tr_region = pl || want ? "expand_index" : "ensure_full_index";
 	trace2_region_enter("index", tr_region, istate->repo);
 
 	/* initialize basics of new index */
@@ -380,7 +388,7 @@ void expand_index(struct index_state *istate, struct pattern_list *pl)
 	 * are only modifying the list of sparse directories. This hinges
 	 * on whether we have a non-NULL pattern list.
 	 */
-	full->sparse_index = pl ? INDEX_PARTIALLY_SPARSE : INDEX_EXPANDED;
+	full->sparse_index = pl || want ? INDEX_PARTIALLY_SPARSE : INDEX_EXPANDED;
 
 	/* then change the necessary things */
 	full->cache_alloc = (3 * istate->cache_alloc) / 2;
@@ -402,10 +410,11 @@ void expand_index(struct index_state *istate, struct pattern_list *pl)
 		}
 
 		/* We now have a sparse directory entry. Should we expand? */
-		if (pl &&
-		    path_matches_pattern_list(ce->name, ce->ce_namelen,
-					      NULL, &dtype,
-					      pl, istate) == NOT_MATCHED) {
+		if ((pl &&
+		     path_matches_pattern_list(ce->name, ce->ce_namelen,
+					       NULL, &dtype,
+					       pl, istate) == NOT_MATCHED) ||
+		    (want && !want(ce, want_data))) {
 			set_index_entry(full, full->cache_nr++, ce);
 			continue;
 		}
@@ -435,7 +444,7 @@ void expand_index(struct index_state *istate, struct pattern_list *pl)
 	/* Copy back into original index. */
 	memcpy(&istate->name_hash, &full->name_hash, sizeof(full->name_hash));
 	memcpy(&istate->dir_hash, &full->dir_hash, sizeof(full->dir_hash));
-	istate->sparse_index = pl ? INDEX_PARTIALLY_SPARSE : INDEX_EXPANDED;
+	istate->sparse_index = pl || want ? INDEX_PARTIALLY_SPARSE : INDEX_EXPANDED;
 	free(istate->cache);
 	istate->cache = full->cache;
 	istate->cache_nr = full->cache_nr;
@@ -455,6 +464,35 @@ void expand_index(struct index_state *istate, struct pattern_list *pl)
 	trace2_region_leave("index", tr_region, istate->repo);
 }
 
+void expand_index(struct index_state *istate, struct pattern_list *pl)
+{
+	expand_index_1(istate, pl, NULL, NULL);
+}
+
+void expand_sparse_directories(struct index_state *istate,
+			       sparse_dir_fn want, void *want_data)
+{
+	int i, nr = 0, wanted = 0;
+
+	if (!istate->sparse_index || istate->sparse_index == INDEX_EXPANDED)
+		return;
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+
+		if (!S_ISSPARSEDIR(ce->ce_mode))
+			continue;
+		nr++;
+		if (want(ce, want_data))
+			wanted++;
+	}
+	if (!wanted)
+		return;
+	if (wanted == nr)
+		ensure_full_index(istate);
+	else
+		expand_index_1(istate, NULL, want, want_data);
+}
+
 void ensure_full_index(struct index_state *istate)
 {
 	if (!istate)
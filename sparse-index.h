@@ -44,6 +44,18 @@ struct pattern_list;
  */
 void expand_index(struct index_state *istate, struct pattern_list *pl);
 
+struct cache_entry;
+typedef int (*sparse_dir_fn)(const struct cache_entry *ce, void *data);
+
+/**
+ * Expand only the sparse directory entries of the index for which "want"
+ * returns true, each to the full list of the files in it, and leave the
+ * others as they are. If "want" returns true for all of them, this is
+ * the same as ensure_full_index().
+ */
+void expand_sparse_directories(struct index_state *istate,
+			       sparse_dir_fn want, void *want_data);
+
 void ensure_full_index(struct index_state *istate);
 
 #endif
@@ -1,8 +1,13 @@
 #include "test-tool.h"
 #include "hash.h"
+#include "hash-batch.h"
+#include "trace.h"
 
 #define NUM_SECONDS 3
 
+/* how many buffers the batch mode queues before each flush */
+#define BATCH_SIZE 64
+
 static inline void compute_hash(const struct git_hash_algo *algo, struct git_hash_ctx *ctx, uint8_t *final, const void *p, size_t len)
 {
 	algo->init_fn(ctx);
@@ -10,16 +15,66 @@ static inline void compute_hash(const struct git_hash_algo *algo, struct git_has
 	git_hash_final(final, ctx);
 }
 
-int cmd__hash_speed(int ac, const char **av)
+/*
+ * Serial hashing is timed in CPU time. The batch mode hashes on several
+ * threads, whose CPU times would add up, so it is timed on the wall
+ * clock instead.
+ */
+static unsigned long hash_serial(const struct git_hash_algo *algo,
+				 const void *p, size_t len, double *secs)
 {
 	struct git_hash_ctx ctx;
 	unsigned char hash[GIT_MAX_RAWSZ];
 	clock_t initial, start, end;
+	unsigned long j;
+
+	/* Use this as an offset to make overflow less likely. */
+	initial = clock();
+
+	start = end = clock() - initial;
+	for (j = 0; ((end - start) / CLOCKS_PER_SEC) < NUM_SECONDS; j++) {
+		compute_hash(algo, &ctx, hash, p, len);
+
+		/*
+		 * Only check elapsed time every 128 iterations to avoid
+		 * dominating the runtime with system calls.
+		 */
+		if (!(j & 127))
+			end = clock() - initial;
+	}
+	*secs = ((double)end - start) / CLOCKS_PER_SEC;
+	return j;
+}
+
+static unsigned long hash_batched(struct hash_batch *batch,
+				  const void *p, size_t len, double *secs)
+{
+	static unsigned char hashes[BATCH_SIZE][GIT_MAX_RAWSZ];
+	uint64_t start, end;
+	unsigned long j;
+
+	start = end = getnanotime();
+	for (j = 0; end - start < NUM_SECONDS * 1000000000ULL; j += BATCH_SIZE) {
+		for (size_t i = 0; i < BATCH_SIZE; i++)
+			hash_batch_add(batch, p, len, hashes[i]);
+		hash_batch_flush(batch);
+		end = getnanotime();
+	}
+	*secs = (double)(end - start) / 1000000000;
+	return j;
+}
+
+int cmd__hash_speed(int ac, const char **av)
+{
 	unsigned bufsizes[] = { 64, 256, 1024, 8192, 16384 };
 	void *p;
 	const struct git_hash_algo *algo = NULL;
+	struct hash_batch *batch = NULL;
+	int nr_threads = -1;
 
-	if (ac == 2) {
+	if (ac == 3 && skip_prefix(av[2], "--batch=", &av[2]))
+		nr_threads = strtol(av[2], NULL, 10);
+	if (ac == 2 || (ac == 3 && nr_threads >= 0)) {
 		for (size_t i = 1; i < GIT_HASH_NALGOS; i++) {
 			if (!strcmp(av[1], hash_algos[i].name)) {
 				algo = &hash_algos[i];
@@ -28,33 +83,28 @@ int cmd__hash_speed(int ac, const char **av)
 		}
 	}
 	if (!algo)
-		die("usage: test-tool hash-speed algo_name");
-
-	/* Use this as an offset to make overflow less likely. */
-	initial = clock();
+		die("usage: test-tool hash-speed algo_name [--batch=<threads>]");
 
 	printf("algo: %s\n", algo->name);
+	if (nr_threads >= 0) {
+		batch = hash_batch_new(algo, nr_threads);
+		printf("batch: %d buffers\n", BATCH_SIZE);
+	}
 
 	for (size_t i = 0; i < ARRAY_SIZE(bufsizes); i++) {
 		unsigned long j, kb;
-		double kb_per_sec;
+		double kb_per_sec, secs;
 		p = xcalloc(1, bufsizes[i]);
-		start = end = clock() - initial;
-		for (j = 0; ((end - start) / CLOCKS_PER_SEC) < NUM_SECONDS; j++) {
-			compute_hash(algo, &ctx, hash, p, bufsizes[i]);
-
-			/*
-			 * Only check elapsed time every 128 iterations to avoid
-			 * dominating the runtime with system calls.
-			 */
-			if (!(j & 127))
-				end = clock() - initial;
-		}
+		if (batch)
+			j = hash_batched(batch, p, bufsizes[i], &secs);
+		else
+			j = hash_serial(algo, p, bufsizes[i], &secs);
 		kb = j * bufsizes[i];
-		kb_per_sec = kb / (1024 * ((double)end - start) / CLOCKS_PER_SEC);
+		kb_per_sec = kb / (1024 * secs);
 		printf("size %u: %lu iters; %lu KiB; %0.2f KiB/s\n", bufsizes[i], j, kb, kb_per_sec);
 		free(p);
 	}
 
+	hash_batch_free(batch);
 	return 0;
 }
@@ -34,6 +34,10 @@
  * (7) If data with the pathname "invalid-delay.a" is processed that the
  *     filter will add the path "unfiltered" which was not delayed before
  *     to the "list_available_blobs" response.
+ *
+ * With the "pipeline" capability, requests that come with a "request-id"
+ * are not answered right away; the answers are sent in reverse order
+ * when the "flush_requests" command comes.
  */
 
 #include "test-tool.h"
@@ -46,6 +50,15 @@ static FILE *logfile;
 static int always_delay, has_clean_cap, has_smudge_cap;
 static struct strmap delay = STRMAP_INIT;
 
+struct pipelined_answer {
+	char *request_id;
+	const char *status;
+	char *output;
+};
+
+static struct pipelined_answer *pipelined;
+static size_t pipelined_nr, pipelined_alloc;
+
 static inline const char *str_or_null(const char *str)
 {
 	return str ? str : "(null)";
@@ -186,12 +199,50 @@ static void reply_list_available_blobs_cmd(void)
 	packet_flush(1);
 }
 
+static void reply_flush_requests_cmd(void)
+{
+	/* flush */
+	if (packet_read_line(0, NULL))
+		die("bad flush_requests end");
+	fprintf(logfile, " [OK]\n");
+
+	/* Answer in reverse order, to check that Git matches the ids. */
+	while (pipelined_nr) {
+		struct pipelined_answer *answer = &pipelined[--pipelined_nr];
+
+		fprintf(logfile, "OUT: request-id=%s ", answer->request_id);
+		packet_write_fmt(1, "request-id=%s", answer->request_id);
+		packet_write_fmt(1, "status=%s", answer->status);
+		packet_flush(1);
+
+		if (!strcmp(answer->status, "success")) {
+			int i, nr_packets = 0;
+			size_t output_len = strlen(answer->output);
+
+			fprintf(logfile, "%"PRIuMAX" ", (uintmax_t)output_len);
+			if (write_packetized_from_buf_no_flush_count(answer->output,
+				output_len, 1, &nr_packets))
+				die("failed to write buffer to stdout");
+			packet_flush(1);
+			for (i = 0; i < nr_packets; i++)
+				fprintf(logfile, ".");
+			fprintf(logfile, " [OK]\n");
+			packet_flush(1);
+		} else {
+			fprintf(logfile, "[%s]\n", answer->status);
+		}
+		free(answer->request_id);
+		free(answer->output);
+	}
+}
+
 static void command_loop(void)
 {
 	for (;;) {
 		char *buf;
 		const char *output;
 		char *pathname;
+		char *request_id = NULL;
 		struct delay_entry *entry;
 		struct strbuf input = STRBUF_INIT;
 		char *command = packet_key_val_read("command");
@@ -207,6 +258,11 @@ static void command_loop(void)
 			free(command);
 			continue;
 		}
+		if (!strcmp(command, "flush_requests")) {
+			reply_flush_requests_cmd();
+			free(command);
+			continue;
+		}
 
 		pathname = packet_key_val_read("pathname");
 		if (!pathname)
@@ -221,6 +277,9 @@ static void command_loop(void)
 					entry->requested = 1;
 				else if (!entry && always_delay)
 					add_delay_entry(pathname, 1, 1);
+			} else if (starts_with(buf, "request-id=")) {
+				fprintf(logfile, " %s", buf);
+				request_id = xstrdup(get_value(buf, "request-id"));
 			} else if (starts_with(buf, "ref=") ||
 				   starts_with(buf, "treeish=") ||
 				   starts_with(buf, "blob=")) {
@@ -252,7 +311,23 @@ static void command_loop(void)
 			die("bad command '%s'", command);
 		}
 
-		if (!strcmp(pathname, "error.r")) {
+		if (request_id) {
+			struct pipelined_answer *answer;
+
+			ALLOC_GROW(pipelined, pipelined_nr + 1, pipelined_alloc);
+			answer = &pipelined[pipelined_nr++];
+			answer->request_id = request_id;
+			answer->output = NULL;
+			if (!strcmp(pathname, "error.r")) {
+				answer->status = "error";
+			} else if (!strcmp(pathname, "abort.r")) {
+				answer->status = "abort";
+			} else {
+				answer->status = "success";
+				answer->output = xstrdup(output);
+			}
+			fprintf(logfile, "[QUEUED]\n");
+		} else if (!strcmp(pathname, "error.r")) {
 			fprintf(logfile, "[ERROR]\n");
 			packet_write_fmt(1, "status=error");
 			packet_flush(1);
@@ -379,5 +454,6 @@ int cmd__rot13_filter(int argc, const char **argv)
 	if (fclose(logfile))
 		die_errno("error closing logfile");
 	free_delay_entries();
+	free(pipelined);
 	return 0;
 }
@@ -46,4 +46,11 @@ test_perf "read-tree status br_ballast ($nr_files)" '
 	git status
 '
 
+for threads in 1 0
+do
+	test_perf "status -uall, core.untrackedThreads=$threads" "
+		git -c core.untrackedThreads=$threads status -uall
+	"
+done
+
 test_done
@@ -72,4 +72,17 @@ test_perf "switch between aliases ($nr_files)" '
 	git checkout -q br_ballast
 '
 
+# Unlike the tests above, these do measure writing the files: the
+# parallel checkout queue creates them in batches where io_uring is
+# available.
+for workers in 1 4
+do
+	test_perf "checkout-index into empty dir, $workers workers ($nr_files)" \
+		--setup "rm -rf ../p0006-out" "
+		git -c checkout.workers=$workers \
+			-c checkout.thresholdForParallelism=0 \
+			checkout-index -a -f --prefix=../p0006-out/
+	"
+done
+
 test_done
@@ -57,6 +57,13 @@ test_perf_fsync_cfgs "add $total_files files" \
 	"setup_repo" \
 	"add -- files"
 
+for threads in 1 4
+do
+	test_perf "add $total_files files (add.threads=$threads)" \
+		--setup "setup_repo" \
+		"git -c add.threads=$threads add -- files"
+done
+
 test_perf_fsync_cfgs "stash $total_files files" \
 	"setup_repo" \
 	"stash push -u -- files"
@@ -33,4 +33,15 @@ test_cache_tree_update_functions "invalidate 2" "--invalidate 2"
 test_cache_tree_update_functions "invalidate 50" "--invalidate 50"
 test_cache_tree_update_functions "empty" "--empty"
 
+for threads in 1 4
+do
+	test_perf "cache_tree_update, empty, $threads threads" \
+		--setup "git config core.cacheTreeThreads $threads" "
+		for i in \$(test_seq $count)
+		do
+			test-tool cache-tree --empty update
+		done
+	"
+done
+
 test_done
@@ -40,4 +40,33 @@ do
 	'
 done
 
+test_expect_success 'setup large ignore file' '
+	for i in $(test_seq 1 1000)
+	do
+		echo "name$i" &&
+		echo "*.ext$i" &&
+		echo "/dir$i/file" &&
+		echo "dir$i/" &&
+		echo "glob$i*.c" || return 1
+	done >.gitignore &&
+	for i in $(test_seq 1 2000)
+	do
+		echo "dir$((i % 50))/name$i.ext$i" &&
+		echo "dir$i/file" &&
+		echo "other$i.c" || return 1
+	done >paths
+'
+
+test_perf "check-ignore with 5000 patterns" '
+	git check-ignore --stdin <paths
+'
+
+test_expect_success 'setup large attributes file' '
+	sed -e "s/\$/ test/" -e "/\/\$/d" .gitignore >.gitattributes
+'
+
+test_perf "check-attr with 4000 patterns" '
+	git check-attr --stdin test <paths
+'
+
 test_done
@@ -10,4 +10,11 @@ test_perf 'fsck' '
 	git fsck
 '
 
+for threads in 1 2 4 8
+do
+	test_perf "fsck (pack.threads=$threads)" "
+		git -c pack.threads=$threads fsck
+	"
+done
+
 test_done
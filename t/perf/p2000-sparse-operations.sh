@@ -138,5 +138,8 @@ test_perf_on_all git check-attr -a -- $SPARSE_CONE/a
 test_perf_on_all 'echo >>a && test_write_lines y | git add -p'
 test_perf_on_all 'test_write_lines y y y | git checkout --patch -'
 test_perf_on_all 'echo >>a && git add a && test_write_lines y | git reset --patch'
+test_perf_on_all git ls-files -- $SPARSE_CONE/a
+test_perf_on_all "echo >>$SPARSE_CONE/a && git stash push -- $SPARSE_CONE/a && git stash pop"
+test_perf_on_all git merge-index true -a
 
 test_done
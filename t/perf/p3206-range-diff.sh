@@ -0,0 +1,46 @@
+#!/bin/sh
+
+test_description='range-diff performance on long series'
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+# make a series of $2 commits on branch $1, each adding its own file, and
+# change one line in every $3-th of them
+create_series () {
+	perl -le '
+		my ($branch, $n, $every) = @ARGV;
+		print "reset refs/heads/$branch";
+		print "from refs/heads/base";
+		for my $i (1..$n) {
+			my $data = join("", map { "line $_ of patch $i\n" } 1..100);
+			$data =~ s/^line 50 /changed line 50 /m if $every && !($i % $every);
+			print "commit refs/heads/$branch";
+			print "committer nobody <nobody\@example.com> now";
+			print "data <<EOM";
+			print "patch $i";
+			print "EOM";
+			print "M 100644 inline file$i";
+			print "data ", length($data);
+			print $data;
+		}
+	' "$@" |
+	git fast-import --date-format=now
+}
+
+test_expect_success 'setup' '
+	git commit --allow-empty -m base &&
+	git branch -M base &&
+	create_series old 1000 0 &&
+	create_series new 1000 2
+'
+
+test_perf 'range-diff with half of the patches changed' '
+	git range-diff base old new >/dev/null
+'
+
+test_perf 'range-diff --creation-factor=999' '
+	git range-diff --creation-factor=999 base old new >/dev/null
+'
+
+test_done
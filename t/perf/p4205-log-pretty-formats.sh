@@ -13,4 +13,13 @@ do
 	"
 done
 
+test_perf 'log with colors' '
+	git log --color=always \
+		--format="%C(yellow)%h%C(reset) %C(auto,blue)%an%C(reset) %C(bold green)%s%C(reset)" >/dev/null
+'
+
+test_perf 'log with trailers' '
+	git log --format="%h %(trailers:key=Signed-off-by,valueonly,separator=%x2C )" >/dev/null
+'
+
 test_done
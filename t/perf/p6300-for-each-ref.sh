@@ -68,6 +68,7 @@ run_tests () {
 	test_for_each_ref "$1, tags, no sort" --no-sort refs/tags/
 	test_for_each_ref "$1, tags, dereferenced" '--format="%(refname) %(objectname) %(*objectname)"' refs/tags/
 	test_for_each_ref "$1, tags, dereferenced, no sort" --no-sort '--format="%(refname) %(objectname) %(*objectname)"' refs/tags/
+	test_for_each_ref "$1, many atoms, no sort" --no-sort '--format="%(refname:short) %(objectname:short) %(objecttype) %(upstream:short) %(HEAD) %% %(refname:lstrip=1)"'
 
 	test_perf "for-each-ref ($1, tags) + cat-file --batch-check (dereferenced)" "
 		for i in \$(test_seq $test_iteration_count); do
@@ -20,4 +20,20 @@ test_perf 'grep --cached, expensive regex' '
 	git grep --cached "^.* *some_nonexistent_string$" || :
 '
 
+test_expect_success 'pick an old revision' '
+	old=$(git rev-list --first-parent --skip=1000 -1 HEAD) &&
+	if test -z "$old"
+	then
+		old=$(git rev-list --first-parent HEAD | tail -n 1)
+	fi &&
+	echo "$old" >old-rev
+'
+
+for threads in 1 2 4 8 16 32
+do
+	test_perf "grep an old revision, $threads threads" "
+		git -c grep.threads=$threads grep some_nonexistent_string \$(cat old-rev) || :
+	"
+done
+
 test_done
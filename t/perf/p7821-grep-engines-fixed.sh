@@ -71,4 +71,9 @@ do
 	fi
 done
 
+test_perf "fixed grep$GIT_PERF_7821_GREP_OPTS with many patterns" "
+	git grep -F$GIT_PERF_7821_GREP_OPTS -e int -e uncommon -e æ -e char \
+		-e return -e static -e struct -e void >out.many || :
+"
+
 test_done
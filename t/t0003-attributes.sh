@@ -602,6 +602,39 @@ test_expect_success EXPENSIVE 'large attributes blob ignored' '
 	test_cmp expect err
 '
 
+test_expect_success 'long attributes files match like short ones' '
+	mkdir -p long/deep &&
+	for i in $(test_seq 40)
+	do
+		echo "f$i.dat test=filler$i" || return 1
+	done >long/.gitattributes &&
+	cat >>long/.gitattributes <<-\EOF &&
+	*.c test=suffix
+	a.c test=literal
+	*.c other=later
+	b* test=glob
+	/deep/x.c test=path
+	deep/ test=dir
+	f7.dat -test
+	EOF
+	attr_check long/f3.dat filler3 &&
+	attr_check long/f7.dat unset &&
+	attr_check long/z.c suffix &&
+	attr_check long/a.c literal &&
+	attr_check long/bc.c glob &&
+	attr_check long/deep/x.c path &&
+	attr_check long/deep/y.c suffix &&
+	attr_check long/x.c suffix &&
+	attr_check long/deep/ dir &&
+	attr_check long/deep/f3.dat filler3 &&
+	attr_check long/A.C unspecified "-c core.ignorecase=0" &&
+	attr_check long/A.C literal "-c core.ignorecase=1" &&
+	attr_check long/DEEP/X.C path "-c core.ignorecase=1" &&
+	git check-attr other -- long/a.c >actual &&
+	echo "long/a.c: other: later" >expect &&
+	test_cmp expect actual
+'
+
 test_expect_success 'builtin object mode attributes work (dir and regular paths)' '
 	>normal &&
 	attr_check_object_mode normal 100644 &&
@@ -944,6 +944,57 @@ test_expect_success SYMLINKS 'symlinks not respected in-tree' '
 	test_grep "unable to access.*gitignore" err
 '
 
+test_expect_success 'last match wins in a long ignore file' '
+	test_when_finished "rm -rf long" &&
+	git init long &&
+	(
+		cd long &&
+		for i in $(test_seq 1 40)
+		do
+			echo "filler$i" || return 1
+		done >.gitignore &&
+		cat >>.gitignore <<-\EOF &&
+		*.o
+		!keep.o
+		foo*.o
+		build/
+		/top/name
+		name
+		*.tmp.o
+		EOF
+		mkdir build &&
+		cat >paths <<-\EOF &&
+		a.o
+		keep.o
+		foo1.o
+		build
+		sub/build
+		top/name
+		x/y.tmp.o
+		filler7
+		A.O
+		other
+		EOF
+		cat >expect <<-\EOF &&
+		.gitignore:41:*.o	a.o
+		.gitignore:42:!keep.o	keep.o
+		.gitignore:43:foo*.o	foo1.o
+		.gitignore:44:build/	build
+		::	sub/build
+		.gitignore:46:name	top/name
+		.gitignore:47:*.tmp.o	x/y.tmp.o
+		.gitignore:7:filler7	filler7
+		::	A.O
+		::	other
+		EOF
+		git -c core.ignorecase=false check-ignore -v -n --stdin <paths >actual &&
+		test_cmp expect actual &&
+		sed "s/^::	A.O/.gitignore:41:*.o	A.O/" expect >expect.icase &&
+		git -c core.ignorecase=true check-ignore -v -n --stdin <paths >actual &&
+		test_cmp expect.icase actual
+	)
+'
+
 test_expect_success EXPENSIVE 'large exclude file ignored in tree' '
 	test_when_finished "rm .gitignore" &&
 	dd if=/dev/zero of=.gitignore bs=101M count=1 &&
@@ -840,6 +840,183 @@ test_expect_success 'process filter abort stops processing of all further files'
 	)
 '
 
+test_expect_success 'pipelined process filter answers requests in any order' '
+	test_config_global filter.protocol.process "test-tool rot13-filter --log=debug.log clean smudge pipeline" &&
+	test_config_global filter.protocol.required true &&
+	rm -rf repo &&
+	mkdir repo &&
+	(
+		cd repo &&
+		git init &&
+
+		echo "*.r filter=protocol" >.gitattributes &&
+		cp "$TEST_ROOT/test.o" test.r &&
+		cp "$TEST_ROOT/test2.o" test2.r &&
+
+		S=$(test_file_size test.r) &&
+		S2=$(test_file_size test2.r) &&
+		M=$(git hash-object test.r) &&
+		M2=$(git hash-object test2.r) &&
+
+		filter_git add . &&
+		cat >expected.log <<-EOF &&
+			START
+			init handshake complete
+			IN: clean test.r request-id=0 $S [OK] -- [QUEUED]
+			IN: clean test2.r request-id=1 $S2 [OK] -- [QUEUED]
+			IN: flush_requests [OK]
+			OUT: request-id=1 $S2 . [OK]
+			OUT: request-id=0 $S . [OK]
+			STOP
+		EOF
+		test_cmp expected.log debug.log &&
+
+		git commit -m "test commit" &&
+		rm -f test.r test2.r &&
+
+		filter_git checkout --quiet --no-progress . &&
+		cat >expected.log <<-EOF &&
+			START
+			init handshake complete
+			IN: smudge test.r blob=$M request-id=0 $S [OK] -- [QUEUED]
+			IN: smudge test2.r blob=$M2 request-id=1 $S2 [OK] -- [QUEUED]
+			IN: flush_requests [OK]
+			OUT: request-id=1 $S2 . [OK]
+			OUT: request-id=0 $S . [OK]
+			STOP
+		EOF
+		test_cmp_exclude_clean expected.log debug.log &&
+
+		test_cmp_committed_rot13 "$TEST_ROOT/test.o" test.r &&
+		test_cmp_committed_rot13 "$TEST_ROOT/test2.o" test2.r &&
+
+		# Change the stat data, so that status has to clean both files
+		test-tool chmtime =+1 test.r test2.r &&
+		filter_git status --porcelain --untracked-files=no >status &&
+		test_must_be_empty status &&
+		cat >expected.log <<-EOF &&
+			START
+			init handshake complete
+			IN: clean test.r request-id=0 $S [OK] -- [QUEUED]
+			IN: clean test2.r request-id=1 $S2 [OK] -- [QUEUED]
+			IN: flush_requests [OK]
+			OUT: request-id=1 $S2 . [OK]
+			OUT: request-id=0 $S . [OK]
+			STOP
+		EOF
+		test_cmp expected.log debug.log
+	)
+'
+
+test_expect_success 'pipelined process filter falls back on errors' '
+	test_config_global filter.protocol.process "test-tool rot13-filter --log=debug.log clean smudge pipeline" &&
+	rm -rf repo &&
+	mkdir repo &&
+	(
+		cd repo &&
+		git init &&
+
+		echo "*.r filter=protocol" >.gitattributes &&
+		cp "$TEST_ROOT/test.o" test.r &&
+		echo "this will cause an error" >error.o &&
+		cp error.o error.r &&
+
+		S=$(test_file_size test.r) &&
+		SE=$(test_file_size error.r) &&
+		M=$(git hash-object test.r) &&
+		ME=$(git hash-object error.r) &&
+		rm -f debug.log &&
+
+		git add . &&
+		rm -f *.r &&
+
+		filter_git checkout --quiet --no-progress . &&
+		cat >expected.log <<-EOF &&
+			START
+			init handshake complete
+			IN: smudge error.r blob=$ME request-id=0 $SE [OK] -- [QUEUED]
+			IN: smudge test.r blob=$M request-id=1 $S [OK] -- [QUEUED]
+			IN: flush_requests [OK]
+			OUT: request-id=1 $S . [OK]
+			OUT: request-id=0 [error]
+			IN: smudge error.r blob=$ME $SE [OK] -- [ERROR]
+			STOP
+		EOF
+		test_cmp_exclude_clean expected.log debug.log &&
+
+		test_cmp_committed_rot13 "$TEST_ROOT/test.o" test.r &&
+		test_cmp error.o error.r
+	)
+'
+
+test_expect_success 'pipelined process filter with more requests than a queue' '
+	test_config_global filter.protocol.process "test-tool rot13-filter --log=debug.log clean smudge pipeline" &&
+	rm -rf repo &&
+	mkdir repo &&
+	(
+		cd repo &&
+		git init &&
+
+		echo "*.r filter=protocol" >.gitattributes &&
+		for i in $(test_seq 70)
+		do
+			echo "file $i" >$i.r || return 1
+		done &&
+
+		filter_git add . &&
+		grep "IN: clean .* request-id=" debug.log >queued &&
+		test_line_count = 70 queued &&
+		grep "OUT: request-id=" debug.log >answered &&
+		test_line_count = 70 answered &&
+		grep "IN: flush_requests" debug.log >flushes &&
+		test_line_count = 2 flushes &&
+
+		git commit -m "many files" &&
+		rm -f *.r &&
+		filter_git checkout --quiet --no-progress . &&
+		grep "OUT: request-id=" debug.log >answered &&
+		test_line_count = 70 answered &&
+		for i in $(test_seq 70)
+		do
+			echo "file $i" >expect &&
+			test_cmp expect $i.r || return 1
+		done
+	)
+'
+
+test_expect_success 'process filter without the pipeline capability is not queued' '
+	test_config_global filter.protocol.process "test-tool rot13-filter --log=debug.log clean smudge" &&
+	rm -rf repo &&
+	mkdir repo &&
+	(
+		cd repo &&
+		git init &&
+
+		echo "*.r filter=protocol" >.gitattributes &&
+		for i in $(test_seq 70)
+		do
+			echo "file $i" >$i.r || return 1
+		done &&
+
+		filter_git add . &&
+		grep "IN: clean" debug.log >cleaned &&
+		test_line_count = 70 cleaned &&
+		! grep -e request-id -e flush_requests debug.log &&
+
+		git commit -m "many files" &&
+		rm -f *.r &&
+		filter_git checkout --quiet --no-progress . &&
+		grep "IN: smudge" debug.log >smudged &&
+		test_line_count = 70 smudged &&
+		! grep -e request-id -e flush_requests debug.log &&
+		for i in $(test_seq 70)
+		do
+			echo "file $i" >expect &&
+			test_cmp expect $i.r || return 1
+		done
+	)
+'
+
 test_expect_success 'invalid process filter must fail (and not hang!)' '
 	test_config_global filter.protocol.process cat &&
 	test_config_global filter.protocol.required true &&
@@ -278,4 +278,34 @@ test_expect_success 'switching trees does not invalidate shared index' '
 	)
 '
 
+test_expect_success 'cache-tree updated with threads matches serial update' '
+	git init threads &&
+	(
+		cd threads &&
+		for d in a b c/d c/e
+		do
+			mkdir -p $d/sub &&
+			test_seq 1 20 >$d/file &&
+			test_seq 2 20 >$d/sub/file || return 1
+		done &&
+		>top &&
+		git add . &&
+		>c/e/ita &&
+		git add -N c/e/ita &&
+		cp .git/index index.orig &&
+
+		GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+			git -c core.cacheTreeThreads=4 write-tree >actual &&
+		grep "\"key\":\"update/threads\"" trace.event &&
+		test-tool dump-cache-tree >actual.cache-tree &&
+		git fsck &&
+
+		cp index.orig .git/index &&
+		git -c core.cacheTreeThreads=1 write-tree >expect &&
+		test-tool dump-cache-tree >expect.cache-tree &&
+		test_cmp expect actual &&
+		test_cmp expect.cache-tree actual.cache-tree
+	)
+'
+
 test_done
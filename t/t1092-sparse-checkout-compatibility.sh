@@ -2080,8 +2080,9 @@ test_expect_success 'rm pathspec expands index when necessary' '
 	ensure_not_expanded rm "deep/deep*" &&
 	test_must_be_empty sparse-index-err &&
 
-	# out-of-cone pathspec (expand)
-	! ensure_not_expanded rm --sparse "folder1/a*" &&
+	# out-of-cone pathspec (expand only folder1/)
+	ensure_not_expanded rm --sparse "folder1/a*" &&
+	test_region index expand_index trace2.txt &&
 	test_must_be_empty sparse-index-err &&
 
 	# pathspec that should expand index
@@ -2106,6 +2107,38 @@ test_expect_success 'sparse index is not expanded: rm' '
 	ensure_not_expanded rm -r deep
 '
 
+test_expect_success 'untracked files are searched for on one thread with a sparse index' '
+	init_repos &&
+
+	GIT_TRACE2_EVENT="$(pwd)/full.txt" \
+		git -C full-checkout -c core.untrackedThreads=4 status --porcelain &&
+	grep "\"category\":\"read_directory\",\"key\":\"threads\",\"value\":\"4\"" full.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/sparse.txt" \
+		git -C sparse-index -c core.untrackedThreads=4 status --porcelain &&
+	! grep "\"category\":\"read_directory\",\"key\":\"threads\"" sparse.txt
+'
+
+test_expect_success 'pathspecs expand only the sparse directories they need' '
+	init_repos &&
+
+	test_all_match git ls-files -- folder1 deep/a &&
+	test_all_match git ls-files -s -- "folder2/0/*" &&
+	test_all_match git rm --sparse folder1/a folder2/0/1 &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git reset --hard &&
+
+	ensure_not_expanded ls-files -- deep/a &&
+	ensure_not_expanded ls-files -- folder1 &&
+	test_region index expand_index trace2.txt &&
+
+	echo >>sparse-index/deep/a &&
+	ensure_not_expanded stash push -- deep/a &&
+	ensure_not_expanded stash pop &&
+
+	ensure_not_expanded fsck &&
+	ensure_not_expanded merge-index true -a
+'
+
 test_expect_success 'grep with and --cached' '
 	init_repos &&
 
@@ -92,6 +92,34 @@ test_expect_success 'zlib corrupt loose object output ' '
 	)
 '
 
+test_expect_success 'loose objects are checked the same with threads' '
+	git init --bare threaded-loose &&
+	(
+		cd threaded-loose &&
+		for i in $(test_seq 64)
+		do
+			echo "blob $i" >file-$i || return 1
+		done &&
+		git hash-object -w file-* >oids &&
+
+		oid=$(sed -n 10p oids) &&
+		old=$(test_oid_to_path "$oid") &&
+		new=$(dirname $old)/$(test_oid ff_2) &&
+		mv objects/$old objects/$new &&
+		oid=$(sed -n 20p oids) &&
+		oidf=objects/$(test_oid_to_path "$oid") &&
+		chmod +w $oidf &&
+		echo extra garbage >>$oidf &&
+
+		test_must_fail git -c pack.threads=1 fsck >expect 2>expect.err &&
+		test_must_fail git -c pack.threads=4 fsck >actual 2>actual.err &&
+		test_grep "hash-path mismatch" expect.err &&
+		test_grep "object corrupt or missing" expect.err &&
+		test_cmp expect actual &&
+		test_cmp expect.err actual.err
+	)
+'
+
 test_expect_success 'branch pointing to non-commit' '
 	tree_oid=$(git rev-parse --verify HEAD^{tree}) &&
 	test_when_finished "git update-ref -d refs/heads/invalid" &&
@@ -798,6 +826,26 @@ test_expect_success 'fsck errors in packed objects' '
 	! grep corrupt out
 '
 
+test_expect_success 'threaded pack verification reports errors in order' '
+	git cat-file commit HEAD >basis &&
+	sed "s/</one/" basis >one &&
+	sed "s/</foo/" basis >two &&
+	one=$(git hash-object --literally -t commit -w one) &&
+	two=$(git hash-object --literally -t commit -w two) &&
+	pack=$(
+		{
+			echo $one &&
+			echo $two
+		} | git pack-objects .git/objects/pack/pack
+	) &&
+	test_when_finished "rm -f .git/objects/pack/pack-$pack.*" &&
+	remove_object $one &&
+	remove_object $two &&
+	test_must_fail git -c pack.threads=1 fsck --no-dangling >expect 2>&1 &&
+	test_must_fail git -c pack.threads=4 fsck --no-dangling >actual 2>&1 &&
+	test_cmp expect actual
+'
+
 test_expect_success 'fsck fails on corrupt packfile' '
 	hsh=$(git commit-tree -m mycommit HEAD^{tree}) &&
 	pack=$(echo $hsh | git pack-objects .git/objects/pack/pack) &&
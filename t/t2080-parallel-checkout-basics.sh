@@ -229,6 +229,55 @@ test_expect_success SYMLINKS 'parallel checkout checks for symlinks in leading d
 	)
 '
 
+test_expect_success 'parallel checkout of big blobs among small files' '
+	set_checkout_config 2 0 &&
+	git init big-blob &&
+	(
+		cd big-blob &&
+		for i in 1 2 3 4 5 6
+		do
+			echo $i >a$i || return 1
+		done &&
+		test-tool genrandom big 200000 >b_big &&
+		for i in 1 2 3
+		do
+			echo $i >c$i || return 1
+		done &&
+		git add . &&
+		git commit -m files &&
+		rm a* b_big c* &&
+
+		test_checkout_workers 2 \
+			git -c core.bigFileThreshold=100k checkout -- .
+	) &&
+	verify_checkout big-blob
+'
+
+test_expect_success SYMLINKS 'parallel checkout of collisions and big blobs among small files' '
+	set_checkout_config 2 0 &&
+	git init mixed-collisions &&
+	(
+		cd mixed-collisions &&
+		mkdir D untracked &&
+		for i in 1 2 3 4
+		do
+			echo $i >a$i &&
+			echo $i >D/d$i &&
+			echo $i >e$i || return 1
+		done &&
+		test-tool genrandom big 200000 >b_big &&
+		git add . &&
+		git commit -m files &&
+		rm -rf a* b_big D e* &&
+		ln -s untracked D &&
+
+		test_checkout_workers 2 \
+			git -c core.bigFileThreshold=100k checkout --force HEAD &&
+		! test -h D
+	) &&
+	verify_checkout mixed-collisions
+'
+
 # This test is here (and not in e.g. t2022-checkout-paths.sh), because we
 # check the final report including sequential, parallel, and delayed entries
 # all at the same time. So we must have finer control of the parallel checkout
@@ -924,4 +924,45 @@ test_expect_success '--diff-merges' '
 	test_cmp expect actual
 '
 
+test_expect_success 'ties are broken the same way when the search is split' '
+	git init ties &&
+	(
+		cd ties &&
+		for f in 1 2 3 4
+		do
+			echo base >file$f || return 1
+		done &&
+		git add . &&
+		git commit -m base &&
+		git tag base &&
+
+		# Each side adds lines to every file and removes them again,
+		# three times over, with one line that differs between the
+		# sides. The patches that do the same to the same file are
+		# identical, so they tie with the patches of the other side.
+		for side in a b
+		do
+			git checkout -b $side base &&
+			for round in 1 2 3
+			do
+				for f in 1 2 3 4
+				do
+					test_seq 10 >>file$f &&
+					echo "added by $side" >>file$f &&
+					git commit -a -m "add to file$f" &&
+					echo base >file$f &&
+					git commit -a -m "remove from file$f" || return 1
+				done
+			done || return 1
+		done &&
+
+		GIT_TEST_RANGE_DIFF_UNSPLIT=1 GIT_TEST_RANGE_DIFF_THREADS=1 \
+			git range-diff --no-color base..a base..b >expect &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.event" GIT_TEST_RANGE_DIFF_THREADS=4 \
+			git range-diff --no-color base..a base..b >actual &&
+		test_cmp expect actual &&
+		grep "\"key\":\"components\",\"value\":\"[2-9]" trace.event
+	)
+'
+
 test_done
@@ -541,6 +541,41 @@ test_expect_success 'all statuses changed in folder if . is given' '
 	)
 '
 
+test_expect_success 'add with add.threads writes the same index' '
+	test_when_finished "rm -rf threads-1 threads-4" &&
+	git init threads-1 &&
+	(
+		cd threads-1 &&
+		mkdir sub &&
+		for i in $(test_seq 50)
+		do
+			echo "file $i" >sub/file$i || return 1
+		done &&
+		echo same >dup1 &&
+		echo same >dup2 &&
+		printf "crlf\r\n" >crlf.txt &&
+		echo "*.txt text" >.gitattributes
+	) &&
+	cp -R threads-1 threads-4 &&
+	git -C threads-1 add . &&
+	git -C threads-4 -c add.threads=4 add . &&
+	git -C threads-1 ls-files -s >expect &&
+	git -C threads-4 ls-files -s >actual &&
+	test_cmp expect actual &&
+	oid=$(git -C threads-4 rev-parse :sub/file1) &&
+	test_path_is_missing threads-4/.git/objects/$(test_oid_to_path $oid) &&
+	test_path_is_file threads-1/.git/objects/$(test_oid_to_path $oid) &&
+	git -C threads-4 fsck --strict &&
+
+	echo changed >threads-4/sub/file1 &&
+	echo changed >threads-1/sub/file1 &&
+	git -C threads-1 add -u &&
+	git -C threads-4 -c add.threads=4 add -u &&
+	git -C threads-1 ls-files -s >expect &&
+	git -C threads-4 ls-files -s >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success CASE_INSENSITIVE_FS 'path is case-insensitive' '
 	path="$(pwd)/BLUB" &&
 	touch "$path" &&
@@ -2390,4 +2390,64 @@ test_expect_success 'log --invert-grep --grep --author' '
 	test_cmp expect actual
 '
 
+test_expect_success 'log.threads does not change the output' '
+	git -c log.threads=1 log -p --stat --root >expect &&
+	GIT_TRACE2_EVENT="$(pwd)/readahead.event" \
+		git -c log.threads=3 log -p --stat --root >actual &&
+	test_cmp expect actual &&
+	grep "\"readahead/blobs\",\"value\":\"[1-9]" readahead.event &&
+	grep "\"thread_start\".*\"thread\":\"th[0-9]*:log-readahead\"" readahead.event
+'
+
+test_expect_success 'log reads ahead by default when not on a terminal' '
+	cpus=$(test-tool online-cpus) &&
+	if test $cpus -gt 4
+	then
+		cpus=4
+	fi &&
+	GIT_TRACE2_EVENT="$(pwd)/default.event" git log -p --root >actual &&
+	if test $cpus -gt 1
+	then
+		grep "\"thread_start\".*:log-readahead\"" default.event >started &&
+		test_line_count = $cpus started
+	else
+		! grep log-readahead default.event
+	fi
+'
+
+test_expect_success TTY 'log does not read ahead on a terminal' '
+	test_terminal env GIT_TRACE2_EVENT="$(pwd)/tty.event" \
+		git log -p --root >actual &&
+	! grep log-readahead tty.event
+'
+
+test_expect_success 'log reads ahead against the parents that are diffed' '
+	test_commit readahead-a &&
+	test_commit readahead-b &&
+	test_commit readahead-c readahead-a.t changed &&
+	for opts in "--parents" "--parents --full-diff" "--full-history"
+	do
+		git -c log.threads=1 log -p --stat $opts -- readahead-a.t >expect &&
+		GIT_TRACE2_EVENT="$(pwd)/parents.event" \
+			git -c log.threads=3 log -p --stat $opts -- readahead-a.t >actual &&
+		test_cmp expect actual &&
+		if grep "\"readahead/blobs\"" parents.event
+		then
+			grep "\"readahead/unused\",\"value\":\"0\"" parents.event
+		fi &&
+		rm -f parents.event || return 1
+	done
+'
+
+test_expect_success 'log.threads with commits that are not shown' '
+	git -c log.threads=1 log -p -n 2 -S val >expect &&
+	git -c log.threads=3 log -p -n 2 -S val >actual &&
+	test_cmp expect actual &&
+	grep "^commit" expect >commits &&
+	test_line_count = 2 commits &&
+	git -c log.threads=3 log --skip=1 -n 2 --stat >actual &&
+	git -c log.threads=1 log --skip=1 -n 2 --stat >expect &&
+	test_cmp expect actual
+'
+
 test_done
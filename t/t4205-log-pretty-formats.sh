@@ -1194,6 +1194,38 @@ test_expect_success EXPENSIVE,SIZE_T_IS_64BIT 'log --pretty with huge commit mes
 	test_cmp expect error
 '
 
+test_expect_success 'export-subst expands different formats in one buffer' '
+	test_when_finished "rm -rf .git/info/attributes untarred subst.tar" &&
+	cat >subst <<-\EOF &&
+	$Format:%C(always,red)%s%C(always,reset)$
+	$Format:%(trailers:key=Acked-by)$
+	$Format:%C(always,blue)%s%C(always,reset)$
+	EOF
+	blob=$(git hash-object -w subst) &&
+	tree=$(printf "100644 blob %s\tsubst\n" $blob | git mktree) &&
+	commit=$(git commit-tree -p HEAD -m subst \
+		-m "Acked-by: A U Thor <author@example.com>" $tree) &&
+	mkdir -p .git/info untarred &&
+	echo "subst export-subst" >.git/info/attributes &&
+	git archive $commit >subst.tar &&
+	"$TAR" xf subst.tar -C untarred &&
+	git log --no-walk --pretty="tformat:%C(always,red)%s%C(always,reset)%n%(trailers:key=Acked-by)%n%C(always,blue)%s%C(always,reset)" $commit >expect &&
+	test_cmp expect untarred/subst &&
+	grep "Acked-by" untarred/subst
+'
+
+test_expect_success 'user format is kept across expansions of other formats' '
+	merge=$(git commit-tree -p HEAD -p HEAD~1 -m merge HEAD^{tree}) &&
+	git log -3 --pretty="tformat:>%C(always,red)%s%C(always,reset)%(trailers:only)" \
+		$merge >expect &&
+	git log -3 --pretty="tformat:>%C(always,red)%s%C(always,reset)%(trailers:only)" \
+		--remerge-diff $merge >out &&
+	grep "^>" out >actual &&
+	test_cmp expect actual &&
+	test_decode_color <actual >decoded &&
+	grep "^><RED>merge<RESET>$" decoded
+'
+
 # pretty-formats note wide char limitations, and add tests
 test_expect_failure 'wide and decomposed characters column counting' '
 
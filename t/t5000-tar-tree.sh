@@ -397,6 +397,33 @@ test_expect_success GZIP 'extract tgz file' '
 	test_cmp_bin b.tar j.tar
 '
 
+test_expect_success 'tar.gzipThreads=1 uses a single stream' '
+	git -c tar.gzipThreads=1 archive --format=tgz HEAD >j-single.tgz &&
+	test_cmp_bin j.tgz j-single.tgz
+'
+
+test_expect_success 'tgz output does not depend on tar.gzipThreads' '
+	git -c tar.gzipThreads=2 archive --format=tgz HEAD >j-t2.tgz &&
+	git -c tar.gzipThreads=5 archive --format=tgz HEAD >j-t5.tgz &&
+	git -c tar.gzipThreads=0 archive --format=tgz HEAD >j-t0.tgz &&
+	test_cmp_bin j-t2.tgz j-t5.tgz &&
+	test_cmp_bin j-t2.tgz j-t0.tgz
+'
+
+test_expect_success GZIP 'extract tgz file compressed by threads' '
+	gzip -d -c <j-t2.tgz >j-t2.tar &&
+	test_cmp_bin b.tar j-t2.tar &&
+	git -c tar.gzipThreads=3 archive --format=tgz -9 HEAD >j-t3.tgz &&
+	gzip -d -c <j-t3.tgz >j-t3.tar &&
+	test_cmp_bin b.tar j-t3.tar
+'
+
+test_expect_success 'negative tar.gzipThreads is rejected' '
+	test_must_fail git -c tar.gzipThreads=-1 archive --format=tgz HEAD \
+		>/dev/null 2>err &&
+	test_grep "invalid number of threads" err
+'
+
 test_expect_success 'remote tar.gz is allowed by default' '
 	git archive --remote=. --format=tar.gz HEAD >remote.tar.gz &&
 	test_cmp_bin j.tgz remote.tar.gz
@@ -718,6 +718,80 @@ test_expect_success 'write generation data chunk when commit-graph chain is repl
 	)
 '
 
+check_reachability_queries () {
+	for c in $(git rev-list --all)
+	do
+		graph_git_two_modes "for-each-ref --contains $c" &&
+		graph_git_two_modes "for-each-ref --no-contains $c" &&
+		graph_git_two_modes "for-each-ref --merged $c" &&
+		graph_git_two_modes "merge-base --all $c side" || return 1
+	done
+}
+
+test_expect_success 'reachability labels are kept across split layers' '
+	git init reach-chain &&
+	(
+		cd reach-chain &&
+		git config core.commitGraph true &&
+
+		test_commit_bulk 8 &&
+		git commit-graph write --reachable --split --reachability-index &&
+
+		git checkout -b side &&
+		test_commit side-1 &&
+		git checkout - &&
+		test_commit main-1 &&
+		git commit-graph write --reachable --split=no-merge &&
+
+		git merge -m merge-1 side &&
+		git checkout side &&
+		test_commit side-2 &&
+		git checkout - &&
+		git commit-graph write --reachable --split=no-merge &&
+
+		test_line_count = 3 $graphdir/commit-graph-chain &&
+		test-tool read-graph >output &&
+		grep "^chunks: .* reachability" output &&
+		git commit-graph verify &&
+		check_reachability_queries &&
+
+		# merge the two upper layers, but keep the base
+		git merge -m merge-2 side &&
+		test_commit main-2 &&
+		git commit-graph write --reachable --split --size-multiple=1 &&
+		test_line_count = 2 $graphdir/commit-graph-chain &&
+		test-tool read-graph >output &&
+		grep "^chunks: .* reachability" output &&
+		git commit-graph verify &&
+		check_reachability_queries
+	)
+'
+
+test_expect_success 'no reachability labels on top of a layer without them' '
+	git init reach-base &&
+	(
+		cd reach-base &&
+		test_commit one &&
+		git commit-graph write --reachable --split &&
+		test_commit two &&
+		git commit-graph write --reachable --split=no-merge \
+			--reachability-index 2>err &&
+		test_grep "base commit-graph layers have none" err &&
+		test-tool read-graph >output &&
+		! grep reachability output &&
+
+		git commit-graph write --reachable --split=replace \
+			--reachability-index &&
+		test-tool read-graph >output &&
+		grep "^chunks: .* reachability" output &&
+
+		git commit-graph write --reachable --split=replace \
+			--no-reachability-index &&
+		test-tool read-graph >output &&
+		! grep reachability output
+	)
+'
+
 test_expect_success 'temporary graph layer is discarded upon failure' '
 	git init layer-discard &&
 	(
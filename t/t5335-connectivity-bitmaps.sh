@@ -0,0 +1,100 @@
+#!/bin/sh
+
+test_description='connectivity check using reachability bitmaps'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+connectivity_result () {
+	test_trace2_data connectivity bitmap/result "$1"
+}
+
+test_expect_success 'setup' '
+	git init server &&
+	test_commit -C server --no-tag base &&
+	git clone --no-local server client &&
+	git -C client repack -adb &&
+	test_commit -C server --no-tag one &&
+	test_commit -C server --no-tag two
+'
+
+test_expect_success 'fetch is checked in-process with bitmaps' '
+	GIT_TRACE2_EVENT="$(pwd)/trace-bitmap.txt" \
+		git -C client fetch origin &&
+	connectivity_result connected <trace-bitmap.txt &&
+	test_subcommand_flex ! git rev-list --objects --stdin <trace-bitmap.txt &&
+	git -C client rev-parse origin/main >actual &&
+	git -C server rev-parse main >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'transfer.bitmapConnectivity=false uses rev-list' '
+	test_commit -C server --no-tag three &&
+	GIT_TRACE2_EVENT="$(pwd)/trace-disabled.txt" \
+		git -C client -c transfer.bitmapConnectivity=false fetch origin &&
+	! grep "\"category\":\"connectivity\"" trace-disabled.txt &&
+	test_subcommand_flex git rev-list --objects --stdin <trace-disabled.txt
+'
+
+test_expect_success 'fetch without bitmaps uses rev-list' '
+	git clone --no-local server no-bitmaps &&
+	test_commit -C server --no-tag four &&
+	GIT_TRACE2_EVENT="$(pwd)/trace-no-bitmaps.txt" \
+		git -C no-bitmaps fetch origin &&
+	! grep "\"category\":\"connectivity\"" trace-no-bitmaps.txt &&
+	test_subcommand_flex git rev-list --objects --stdin <trace-no-bitmaps.txt
+'
+
+test_expect_success 'push to a bitmapped repository is checked in-process' '
+	git -C server repack -adb &&
+	git -C client fetch origin &&
+	git -C client checkout -b topic origin/main &&
+	test_commit -C client --no-tag pushed &&
+	GIT_TRACE2_EVENT="$(pwd)/trace-push.txt" \
+		git -C client push origin topic &&
+	connectivity_result connected <trace-push.txt &&
+	git -C server rev-parse topic >actual &&
+	git -C client rev-parse topic >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'push with a missing object falls back to rev-list' '
+	git init corrupt &&
+	test_commit -C corrupt --no-tag greetings &&
+	git -C corrupt fetch ../server main &&
+	git -C corrupt rebase --quiet FETCH_HEAD &&
+
+	# Store "bye" under the name of the blob of greetings.t, so that
+	# the pushed pack lacks that blob.
+	S=$(git -C corrupt rev-parse HEAD:greetings.t | sed -e "s|^..|&/|") &&
+	X=$(echo bye | git -C corrupt hash-object -w --stdin |
+	    sed -e "s|^..|&/|") &&
+	mv -f corrupt/.git/objects/$X corrupt/.git/objects/$S &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace-missing.txt" \
+		test_must_fail git -C corrupt push --porcelain \
+			../server HEAD:refs/heads/corrupt >actual &&
+	grep "missing necessary objects" actual &&
+	connectivity_result fallback <trace-missing.txt &&
+	test_must_fail git -C server rev-parse --verify refs/heads/corrupt
+'
+
+test_expect_success 'partial clone does not use bitmaps' '
+	git clone --no-local server partial &&
+	git -C partial repack -adb &&
+	git -C partial config remote.origin.promisor true &&
+	git -C partial config remote.origin.partialCloneFilter blob:none &&
+	git -C client checkout -b partial-topic origin/main &&
+	test_commit -C client --no-tag partial-push &&
+	GIT_TRACE2_EVENT="$(pwd)/trace-partial.txt" \
+		git -C client push ../partial partial-topic &&
+	! grep "\"category\":\"connectivity\"" trace-partial.txt &&
+	test_subcommand_flex ! git fetch <trace-partial.txt &&
+	git -C partial rev-parse partial-topic >actual &&
+	git -C client rev-parse partial-topic >expect &&
+	test_cmp expect actual
+'
+
+test_done
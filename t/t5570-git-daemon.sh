@@ -32,6 +32,15 @@ test_expect_success 'daemon rejects invalid --max-connections values' '
 	test_grep "fatal: invalid max-connections ${SQ}$arg${SQ}, expecting an integer" err
 '
 
+test_expect_success 'daemon rejects invalid --max-queued-connections values' '
+	for arg in "3a" "-3"
+	do
+		test_must_fail git daemon --max-queued-connections="$arg" 2>err &&
+		test_grep "fatal: invalid max-queued-connections ${SQ}$arg${SQ}, expecting a non-negative integer" err ||
+		return 1
+	done
+'
+
 start_git_daemon
 
 check_verbose_connect () {
@@ -232,4 +241,56 @@ test_expect_success FAKENC 'hostname interpolation works after LF-stripping' '
 	test_cmp expect actual
 '
 
+stop_git_daemon
+write_script block-hook <<EOF
+test -f "$PWD/blocked" && exit 0
+>"$PWD/blocked"
+i=0
+while ! test -f "$PWD/release" && test \$i -lt 60
+do
+	sleep 1
+	i=\$((\$i + 1))
+done
+EOF
+GIT_TRACE2_EVENT="$PWD/daemon-trace.event" &&
+export GIT_TRACE2_EVENT &&
+start_git_daemon --max-connections=1 --max-queued-connections=1 \
+	--access-hook="\"$PWD/block-hook\""
+sane_unset GIT_TRACE2_EVENT
+
+wait_for () {
+	for i in $(test_seq 60)
+	do
+		if eval "$1"
+		then
+			return 0
+		fi
+		sleep 1
+	done
+	return 1
+}
+
+test_expect_success 'connections beyond --max-connections are queued' '
+	repo="$GIT_DAEMON_DOCUMENT_ROOT_PATH/queued.git" &&
+	git init --bare "$repo" &&
+	git push "$repo" HEAD &&
+	>"$repo"/git-daemon-export-ok &&
+	{
+		git ls-remote "$GIT_DAEMON_URL/queued.git" >first &
+	} &&
+	first_pid=$! &&
+	test_when_finished ">release" &&
+	wait_for "test -f blocked" &&
+	{
+		git ls-remote "$GIT_DAEMON_URL/queued.git" >second &
+	} &&
+	second_pid=$! &&
+	wait_for "grep \"queue_depth\" daemon-trace.event >/dev/null" &&
+	>release &&
+	wait $first_pid &&
+	wait $second_pid &&
+	test_cmp first second &&
+	grep "\"queue_wait_ms\"" daemon-trace.event
+'
+
 test_done
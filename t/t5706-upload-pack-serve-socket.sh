@@ -0,0 +1,141 @@
+#!/bin/sh
+
+test_description='upload-pack serving protocol v2 requests over a socket'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+test -z "$NO_UNIX_SOCKETS" || {
+	skip_all='skipping upload-pack socket tests, unix sockets not available'
+	test_done
+}
+
+# Start a server for the repository "$1", listening on "$1/serve.sock".
+# Its trace2 events go to "$1.trace".
+start_server () {
+	rm -f "$1.trace" &&
+	GIT_TRACE2_EVENT="$(pwd)/$1.trace" \
+	git -C "$1" upload-pack --listen="$(pwd)/$1/serve.sock" . \
+		2>"$1.server.err" &
+	server_pid=$! &&
+	test_when_finished "kill $server_pid && { wait $server_pid || :; }" &&
+	for i in $(test_seq 1 50)
+	do
+		test -S "$1/serve.sock" && return 0
+		sleep 0.1
+	done &&
+	false
+}
+
+# Whether the server for "$1" served a request.
+server_served () {
+	grep "\"label\":\"socket/connection\"" "$1.trace"
+}
+
+test_expect_success 'setup' '
+	git init --bare server.git &&
+	git init --bare other.git &&
+	test_commit one &&
+	git push server.git main &&
+	git push other.git main:other &&
+	git push server.git main:refs/namespaces/ns/refs/heads/in-ns &&
+	git push server.git main:hidden
+'
+
+test_expect_success '--listen is incompatible with --stateless-rpc' '
+	test_must_fail git upload-pack --listen=sock --stateless-rpc . 2>err &&
+	test_grep "cannot be used together" err
+'
+
+test_expect_success 'requests are served by the listening process' '
+	start_server server.git &&
+	test_config_global uploadpack.serveSocket \
+		"$(pwd)/server.git/serve.sock" &&
+	git -c protocol.version=2 ls-remote server.git >actual &&
+	server_served server.git &&
+	git -c protocol.version=0 ls-remote server.git >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'requests for another repository are not served' '
+	start_server other.git &&
+	test_config_global uploadpack.serveSocket \
+		"$(pwd)/other.git/serve.sock" &&
+	git -c protocol.version=2 ls-remote server.git >actual &&
+	! server_served other.git &&
+	grep "socket/rejected" other.git.trace &&
+	git -c protocol.version=0 ls-remote server.git >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'the namespace of the request is used' '
+	start_server server.git &&
+	test_config_global uploadpack.serveSocket serve.sock &&
+	git -c protocol.version=2 ls-remote \
+		--upload-pack="git --namespace=ns upload-pack" \
+		server.git >actual &&
+	server_served server.git &&
+	git -c protocol.version=0 ls-remote \
+		--upload-pack="git --namespace=ns upload-pack" \
+		server.git >expect &&
+	test_cmp expect actual &&
+	grep refs/heads/in-ns actual &&
+	! grep refs/heads/main actual
+'
+
+test_expect_success 'the -c settings of the request are used' '
+	start_server server.git &&
+	test_config_global uploadpack.serveSocket serve.sock &&
+	git -c protocol.version=2 ls-remote \
+		--upload-pack="git -c uploadpack.hideRefs=refs/heads/hidden upload-pack" \
+		server.git >actual &&
+	server_served server.git &&
+	grep refs/heads/main actual &&
+	! grep refs/heads/hidden actual &&
+
+	# and only for that request
+	git -c protocol.version=2 ls-remote server.git >actual &&
+	grep refs/heads/hidden actual
+'
+
+test_expect_success 'server notices new objects and refs' '
+	start_server other.git &&
+	test_config_global uploadpack.serveSocket serve.sock &&
+	git -c protocol.version=2 clone --no-local -b other other.git clone &&
+	test_commit two &&
+	git push other.git main:other &&
+	git -C other.git repack -ad &&
+	git -C clone -c protocol.version=2 fetch origin &&
+	server_served other.git &&
+	git -C clone rev-parse origin/other >actual &&
+	git rev-parse main >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'falls back to serving locally without a server' '
+	test_config_global uploadpack.serveSocket missing.sock &&
+	git -c protocol.version=2 ls-remote server.git >actual &&
+	git ls-remote server.git >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'socket is ignored in repository config' '
+	start_server server.git &&
+	test_config -C server.git uploadpack.serveSocket serve.sock &&
+	git -c protocol.version=2 ls-remote server.git >actual &&
+	! server_served server.git &&
+	git ls-remote server.git >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'protocol v0 is not forwarded' '
+	start_server server.git &&
+	test_config_global uploadpack.serveSocket serve.sock &&
+	git -c protocol.version=0 ls-remote server.git >actual &&
+	! server_served server.git &&
+	grep refs/heads/main actual
+'
+
+test_done
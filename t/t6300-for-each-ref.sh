@@ -2152,4 +2152,15 @@ test_expect_success GPG 'show lack of signature with custom format' '
 	test_cmp expect actual
 '
 
+test_expect_success 'nested atoms around escapes' '
+	cat >expect <<-\EOF &&
+	[%main%] |main
+	  none   |testtag
+	EOF
+	git for-each-ref \
+		--format="%(align:middle,9)%(if)%(upstream)%(then)[%%%(upstream:lstrip=-1)%25]%(else)none%(end)%(end)|%(refname:lstrip=2)" \
+		refs/heads/main refs/tags/testtag >actual &&
+	test_cmp expect actual
+'
+
 test_done
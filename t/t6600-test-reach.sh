@@ -58,6 +58,22 @@ test_expect_success 'setup' '
 	git -c commitGraph.generationVersion=1 commit-graph write --reachable &&
 	mv .git/objects/info/commit-graph commit-graph-no-gdat &&
 	chmod u+w commit-graph-no-gdat &&
+	git commit-graph write --reachable --reachability-index &&
+	mv .git/objects/info/commit-graph commit-graph-reach &&
+	chmod u+w commit-graph-reach &&
+	git show-ref -s commit-5-5 |
+		git commit-graph write --stdin-commits --reachability-index &&
+	mv .git/objects/info/commit-graph commit-graph-reach-half &&
+	chmod u+w commit-graph-reach-half &&
+	git repack -adb &&
+	bitmap_full=$(ls .git/objects/pack/pack-*.bitmap) &&
+	mv "$bitmap_full" bitmap-full &&
+	git clone --no-local --no-tags --single-branch --branch=commit-5-5 \
+		. half &&
+	git -C half repack -adb &&
+	cp half/.git/objects/pack/pack-* .git/objects/pack/ &&
+	bitmap_half=$(ls .git/objects/pack/pack-*.bitmap) &&
+	mv "$bitmap_half" bitmap-half &&
 	git config core.commitGraph true
 '
 
@@ -73,6 +89,26 @@ run_all_modes () {
 	test_cmp expect actual &&
 	cp commit-graph-no-gdat .git/objects/info/commit-graph &&
 	"$@" <input >actual &&
+	test_cmp expect actual &&
+	cp commit-graph-reach .git/objects/info/commit-graph &&
+	"$@" <input >actual &&
+	test_cmp expect actual &&
+	cp commit-graph-reach-half .git/objects/info/commit-graph &&
+	"$@" <input >actual &&
+	test_cmp expect actual
+}
+
+# Like run_all_modes, but also with a bitmap index that covers all of
+# the history, and with one that covers only what commit-5-5 can reach.
+run_bitmap_modes () {
+	run_all_modes "$@" &&
+	test_when_finished rm -f "$bitmap_full" "$bitmap_half" &&
+	cp bitmap-full "$bitmap_full" &&
+	"$@" <input >actual &&
+	test_cmp expect actual &&
+	rm "$bitmap_full" &&
+	cp bitmap-half "$bitmap_half" &&
+	"$@" <input >actual &&
 	test_cmp expect actual
 }
 
@@ -456,7 +492,7 @@ test_expect_success 'for-each-ref ahead-behind:linear' '
 	refs/heads/commit-1-5 0 4
 	refs/heads/commit-1-8 0 1
 	EOF
-	run_all_modes git for-each-ref \
+	run_bitmap_modes git for-each-ref \
 		--format="%(refname) %(ahead-behind:commit-1-9)" --stdin
 '
 
@@ -473,7 +509,7 @@ test_expect_success 'for-each-ref ahead-behind:all' '
 	refs/heads/commit-4-2 0 17
 	refs/heads/commit-4-4 0 9
 	EOF
-	run_all_modes git for-each-ref \
+	run_bitmap_modes git for-each-ref \
 		--format="%(refname) %(ahead-behind:commit-5-5)" --stdin
 '
 
@@ -490,7 +526,7 @@ test_expect_success 'for-each-ref ahead-behind:some' '
 	refs/heads/commit-5-3 0 39
 	refs/heads/commit-9-9 27 0
 	EOF
-	run_all_modes git for-each-ref \
+	run_bitmap_modes git for-each-ref \
 		--format="%(refname) %(ahead-behind:commit-9-6)" --stdin
 '
 
@@ -509,7 +545,7 @@ test_expect_success 'for-each-ref ahead-behind:some, multibase' '
 	refs/heads/commit-7-8 14 12 8 6
 	refs/heads/commit-9-9 27 0 27 0
 	EOF
-	run_all_modes git for-each-ref \
+	run_bitmap_modes git for-each-ref \
 		--format="%(refname) %(ahead-behind:commit-9-6) %(ahead-behind:commit-6-9)" \
 		--stdin
 '
@@ -525,10 +561,32 @@ test_expect_success 'for-each-ref ahead-behind:none' '
 	refs/heads/commit-7-5 7 4
 	refs/heads/commit-9-9 49 0
 	EOF
-	run_all_modes git for-each-ref \
+	run_bitmap_modes git for-each-ref \
 		--format="%(refname) %(ahead-behind:commit-8-4)" --stdin
 '
 
+test_expect_success 'for-each-ref ahead-behind far from bitmaps' '
+	test_when_finished "rm -f \"\$bitmap_half\"; git branch -D far" &&
+	cp bitmap-half "$bitmap_half" &&
+	git branch far commit-9-9 &&
+	test_commit_bulk --ref=refs/heads/far 300 &&
+	cat >input <<-\EOF &&
+	refs/heads/commit-4-8
+	refs/heads/commit-9-9
+	refs/heads/far
+	EOF
+	cat >expect <<-\EOF &&
+	refs/heads/commit-4-8 16 16
+	refs/heads/commit-9-9 49 0
+	refs/heads/far 349 0
+	EOF
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git for-each-ref --format="%(refname) %(ahead-behind:commit-8-4)" \
+		--stdin <input >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"ahead_behind/left\",\"value\":\"1\"" trace.txt
+'
+
 test_expect_success 'for-each-ref merged:linear' '
 	cat >input <<-\EOF &&
 	refs/heads/commit-1-1
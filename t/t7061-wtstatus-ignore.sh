@@ -313,4 +313,39 @@ test_expect_success 'status ignores submodule in excluded directory' '
 	test_cmp expected actual
 '
 
+test_expect_success 'untracked and ignored files are the same with threads' '
+	git init threads &&
+	(
+		cd threads &&
+		for i in 1 2 3 4 5 6
+		do
+			mkdir -p tracked$i/sub untracked$i/deep/er empty$i/dir &&
+			: >tracked$i/sub/file &&
+			: >tracked$i/sub/new &&
+			: >tracked$i/sub/new.o &&
+			: >tracked$i/sub/keep.o &&
+			: >untracked$i/deep/er/file &&
+			: >untracked$i/deep/er/file.o || return 1
+		done &&
+		echo "*.o" >.gitignore &&
+		echo "!keep.o" >tracked2/.gitignore &&
+		echo "sub/" >tracked3/.gitignore &&
+		git init tracked4/nested &&
+		git add -f .gitignore tracked*/.gitignore tracked*/sub/file &&
+		for args in "status --porcelain" "status --porcelain -uall" \
+			"status --porcelain --ignored" \
+			"status --porcelain --ignored=matching -uall" \
+			"status --porcelain -- tracked2 untracked3" \
+			"ls-files -o -i --exclude-standard" "clean -ndX" "clean -nd"
+		do
+			git -c core.untrackedThreads=1 $args >../expect &&
+			GIT_TRACE2_PERF="$(pwd)/../trace" \
+				git -c core.untrackedThreads=4 $args >../actual &&
+			test_cmp ../expect ../actual &&
+			grep "threads:4" ../trace &&
+			rm ../trace || return 1
+		done
+	)
+'
+
 test_done
@@ -986,6 +986,52 @@ test_expect_success '"status" after file replacement should be clean with UC=fal
 	status_is_clean
 '
 
+test_expect_success 'threads fill the untracked cache like a single one' '
+	git init threads &&
+	(
+		cd threads &&
+		git config core.untrackedCache true &&
+		for i in 1 2 3 4 5
+		do
+			mkdir -p tracked$i/sub untracked$i/deep empty$i &&
+			: >tracked$i/sub/file &&
+			: >tracked$i/sub/new &&
+			: >tracked$i/sub/new.o &&
+			: >untracked$i/deep/file || return 1
+		done &&
+		echo "*.o" >.gitignore &&
+		echo "new" >tracked2/.gitignore &&
+		git add .gitignore tracked*/.gitignore tracked*/sub/file &&
+		avoid_racy &&
+
+		git -c core.untrackedThreads=1 status --porcelain >../expect &&
+		test-tool dump-untracked-cache >../expect.uc &&
+		git -c core.untrackedCache=false update-index --no-untracked-cache &&
+		git update-index --untracked-cache &&
+		GIT_TRACE2_PERF="$TRASH_DIRECTORY/trace.output" \
+			git -c core.untrackedThreads=4 status --porcelain >../actual &&
+		test_cmp ../expect ../actual &&
+		grep "threads:4" "$TRASH_DIRECTORY/trace.output" &&
+		test-tool dump-untracked-cache >../actual.uc &&
+		test_cmp ../expect.uc ../actual.uc &&
+
+		: >untracked3/deep/more &&
+		: >tracked4/sub/more &&
+		avoid_racy &&
+		git -c core.untrackedThreads=1 status --porcelain >../expect &&
+		test-tool dump-untracked-cache >../expect.uc &&
+		rm untracked3/deep/more tracked4/sub/more &&
+		git -c core.untrackedThreads=4 status --porcelain &&
+		: >untracked3/deep/more &&
+		: >tracked4/sub/more &&
+		avoid_racy &&
+		git -c core.untrackedThreads=4 status --porcelain >../actual &&
+		test_cmp ../expect ../actual &&
+		test-tool dump-untracked-cache >../actual.uc &&
+		test_cmp ../expect.uc ../actual.uc
+	)
+'
+
 test_expect_success 'empty repo (no index) and core.untrackedCache' '
 	git init emptyrepo &&
 	git -C emptyrepo -c core.untrackedCache=true write-tree
@@ -1175,6 +1175,24 @@ test_expect_success 'grep -Fi' '
 	test_cmp expected actual
 '
 
+test_expect_success 'grep -F with several patterns' '
+	test_write_lines "one a*b" two "a*b three" "four ab" "five [x]" >fixed &&
+	cat >expected <<-\EOF &&
+	fixed:1:one a*b
+	fixed:3:a*b three
+	fixed:5:five [x]
+	EOF
+	git grep --no-index -n -F -e "[x]" -e "a*b" -e absent fixed >actual &&
+	test_cmp expected actual &&
+	cat >expected <<-\EOF &&
+	fixed:1:one a*b
+	fixed:2:two
+	fixed:4:four ab
+	EOF
+	git grep --no-index -n -e o -e ab fixed >actual &&
+	test_cmp expected actual
+'
+
 test_expect_success 'outside of git repository' '
 	rm -fr non &&
 	mkdir -p non/git/sub &&
@@ -0,0 +1,145 @@
+#!/bin/sh
+
+test_description='grep with the trigram index of the grep-trigrams task'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	mkdir dir &&
+	for i in 1 2 3 4 5 6 7 8
+	do
+		printf "line one of file $i\nthe quick brown fox\n" >file$i &&
+		printf "nested $i\n" >dir/nested$i || return 1
+	done &&
+	echo "needle in a haystack" >>file3 &&
+	echo "another needle" >>dir/nested5 &&
+	echo "Needle with a capital" >>file6 &&
+	printf "binary needle\0" >binary &&
+	git add . &&
+	git commit -m initial &&
+	git tag initial &&
+	echo "a needle added later" >>file7 &&
+	git add file7 &&
+	git commit -m second &&
+	git maintenance run --task=grep-trigrams &&
+	test_path_is_file .git/objects/info/grep-trigrams
+'
+
+# Compare the output of "git grep" with and without the index, and make
+# sure that the index was used, or not, as the first argument says.
+test_grep_trigrams () {
+	used=$1 &&
+	shift &&
+	test_might_fail git -c grep.useTrigramIndex=false grep "$@" >expect &&
+	test_when_finished "rm -f trace.event" &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		test_might_fail git grep "$@" >actual &&
+	test_cmp expect actual &&
+	if test "$used" = used
+	then
+		grep "trigram/skipped" trace.event
+	else
+		! grep "trigram/skipped" trace.event
+	fi
+}
+
+for args in \
+	"needle HEAD" \
+	"-w needle HEAD" \
+	"-l needle HEAD" \
+	"-c needle HEAD" \
+	"-F -e needle -e brown HEAD" \
+	"-e needle --or -e brown HEAD" \
+	"needle initial" \
+	"needle HEAD initial" \
+	"--cached needle" \
+	"needle HEAD -- dir" \
+	"nothing-matches HEAD" \
+	"-a needle HEAD"
+do
+	test_expect_success "grep $args uses the index" "
+		test_grep_trigrams used $args
+	"
+done
+
+for args in \
+	"-i needle HEAD" \
+	"-v needle HEAD" \
+	"-L needle HEAD" \
+	"nee.le HEAD" \
+	"-e needle --and -e in HEAD" \
+	"--all-match -e needle -e in HEAD" \
+	"-e needle -e ab HEAD" \
+	"needle"
+do
+	test_expect_success "grep $args does not use the index" "
+		test_grep_trigrams unused $args
+	"
+done
+
+test_expect_success 'grep.useTrigramIndex=false ignores the index' '
+	test_when_finished "rm -f trace.event" &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		git -c grep.useTrigramIndex=false grep needle HEAD &&
+	! grep "trigram/skipped" trace.event
+'
+
+test_expect_success 'blobs that are not indexed are still searched' '
+	echo "a fresh needle" >file8 &&
+	git commit -a -m third &&
+	git grep needle HEAD >actual &&
+	grep "^HEAD:file8:a fresh needle" actual
+'
+
+test_expect_success 'maintenance.grep-trigrams.refs selects the trees' '
+	git config maintenance.grep-trigrams.refs initial &&
+	test_when_finished "git config unset maintenance.grep-trigrams.refs" &&
+	git maintenance run --task=grep-trigrams &&
+	test_grep_trigrams used needle initial &&
+	test_grep_trigrams used needle HEAD
+'
+
+test_expect_success 'a corrupt index is ignored' '
+	test_when_finished "git maintenance run --task=grep-trigrams" &&
+	echo garbage >.git/objects/info/grep-trigrams &&
+	git grep needle HEAD >actual 2>err &&
+	test_grep "ignoring invalid grep trigram index" err &&
+	git -c grep.useTrigramIndex=false grep needle HEAD >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'a truncated index is ignored' '
+	test_when_finished "git maintenance run --task=grep-trigrams" &&
+	head -c 100 .git/objects/info/grep-trigrams >truncated &&
+	mv truncated .git/objects/info/grep-trigrams &&
+	git grep needle HEAD >actual 2>err &&
+	test_grep "ignoring invalid grep trigram index" err &&
+	git -c grep.useTrigramIndex=false grep needle HEAD >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'an index with a bad checksum is ignored' '
+	test_when_finished "git maintenance run --task=grep-trigrams" &&
+	git -c grep.useTrigramIndex=false grep needle HEAD >expect &&
+	index=.git/objects/info/grep-trigrams &&
+	size=$(test_file_size $index) &&
+	for offset in $(test_seq $((size - $(test_oid rawsz) - 8)) \
+				 $((size - $(test_oid rawsz) - 1)))
+	do
+		cp $index index.bak &&
+		printf "\377" |
+		dd of=$index bs=1 seek=$offset conv=notrunc 2>/dev/null &&
+		git grep needle HEAD >actual 2>err &&
+		test_grep "ignoring invalid grep trigram index" err &&
+		test_cmp expect actual &&
+		mv index.bak $index || return 1
+	done
+'
+
+test_expect_success 'maintenance run --auto does not write the index' '
+	rm .git/objects/info/grep-trigrams &&
+	git maintenance run --auto --task=grep-trigrams &&
+	test_path_is_missing .git/objects/info/grep-trigrams
+'
+
+test_done
@@ -316,4 +316,31 @@ test_expect_success 'blame does not coalesce non-adjacent result lines' '
 	test_cmp expect actual
 '
 
+test_expect_success 'blame -C -C picks the same copies with any number of threads' '
+	git checkout --orphan copies &&
+	git rm -rfq . &&
+	for i in $(test_seq 100)
+	do
+		test_write_lines "common line number $i" "the same line in every file" \
+			"the same line in every file" "own line in file $i" >copy$i || return 1
+	done &&
+	git add . &&
+	git commit -m "many files" &&
+	for i in $(test_seq 100)
+	do
+		cat copy$i || return 1
+	done >all &&
+	git add all &&
+	git commit -m "all in one" &&
+	git -c blame.threads=1 blame -C -C -C --porcelain all >expect &&
+	for threads in 2 4 7
+	do
+		git -c blame.threads=$threads blame -C -C -C --porcelain all >actual &&
+		test_cmp expect actual || return 1
+	done &&
+	git -c blame.threads=4 blame -M --porcelain copy1 >actual &&
+	git -c blame.threads=1 blame -M --porcelain copy1 >expect &&
+	test_cmp expect actual
+'
+
 test_done
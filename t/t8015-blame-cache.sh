@@ -0,0 +1,125 @@
+#!/bin/sh
+
+test_description='git blame with blame.cache'
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+TEST_CREATE_REPO_NO_TEMPLATE=1
+. ./test-lib.sh
+
+if ! test_have_prereq PERL_TEST_HELPERS
+then
+	skip_all='skipping blame cache tests; Perl not available'
+	test_done
+fi
+
+# Running the annotate tests with the cache enabled blames each commit
+# after the ones before it have been blamed and cached.
+PROG='git -c blame.cache=true blame -c'
+. "$TEST_DIRECTORY"/annotate-tests.sh
+
+test_expect_success 'setup history to cache' '
+	test_write_lines 1 2 3 4 5 6 7 8 9 >cached &&
+	git add cached &&
+	git commit -m "cached: add" &&
+	git mv cached renamed &&
+	test_write_lines 1 2 three 4 5 6 7 8 9 >renamed &&
+	git add renamed &&
+	git commit -m "cached: rename" &&
+	test_write_lines 1 2 three 4 5 6 seven 8 9 10 >renamed &&
+	git commit -a -m "cached: edit" &&
+	git tag cached-base &&
+	test_write_lines 0 1 2 three 4 5 6 seven 8 nine 10 >renamed &&
+	git commit -a -m "cached: edit again"
+'
+
+test_expect_success 'blame reuses the result cached for an ancestor' '
+	rm -rf .git/blame-cache &&
+	git -c blame.cache=true blame cached-base -- renamed >/dev/null &&
+	test_path_is_dir .git/blame-cache &&
+	git blame --porcelain HEAD -- renamed >expect &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git -c blame.cache=true blame --porcelain HEAD -- renamed >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"cache/hits\",\"value\":\"1\"" trace.txt &&
+
+	git blame --root -L 3,8 --porcelain HEAD -- renamed >expect &&
+	git -c blame.cache=true blame --root -L 3,8 --porcelain HEAD -- renamed >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'broken cache entries are ignored' '
+	for f in .git/blame-cache/*
+	do
+		echo garbage >"$f" || return 1
+	done &&
+	git blame HEAD -- renamed >expect &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git -c blame.cache=true blame HEAD -- renamed >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"cache/hits\",\"value\":\"0\"" trace.txt
+'
+
+test_expect_success 'truncated and garbled cache entries are ignored' '
+	rm -rf .git/blame-cache &&
+	git -c blame.cache=true blame HEAD -- renamed >expect &&
+	for f in .git/blame-cache/*
+	do
+		head -n 1 "$f" >head &&
+		sed -n 2p "$f" >entry &&
+		{
+			cat head &&
+			cut -d " " -f 1-3 entry
+		} >"$f.truncated" &&
+		{
+			cat head &&
+			tr " " "\t" <entry
+		} >"$f.tabs" &&
+		{
+			cat head &&
+			sed "s/^[0-9]* [0-9]* [0-9]* [-b] [0-9a-f]*/0 1 0 - x/" entry
+		} >"$f.oid" || return 1
+	done &&
+	for kind in truncated tabs oid
+	do
+		for f in .git/blame-cache/*.$kind
+		do
+			cp "$f" "${f%.$kind}" || return 1
+		done &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+			git -c blame.cache=true blame HEAD -- renamed >actual &&
+		test_cmp expect actual &&
+		grep "\"key\":\"cache/hits\",\"value\":\"0\"" trace.txt || return 1
+	done
+'
+
+test_expect_success 'gc expires unused cache entries' '
+	rm -rf .git/blame-cache &&
+	git -c blame.cache=true blame cached-base -- renamed >/dev/null &&
+	git -c blame.cache=true blame HEAD -- renamed >/dev/null &&
+	ls .git/blame-cache >entries &&
+	test_line_count = 2 entries &&
+	test-tool chmtime =-3000000 .git/blame-cache/* &&
+	git -c blame.cache=true blame cached-base -- renamed >/dev/null &&
+	git gc --quiet &&
+	ls .git/blame-cache >entries &&
+	test_line_count = 1 entries &&
+	test-tool chmtime =-3000000 .git/blame-cache/* &&
+	git -c gc.blameCacheExpire=never gc --quiet &&
+	ls .git/blame-cache >entries &&
+	test_line_count = 1 entries &&
+	git -c gc.blameCacheExpire=now gc --quiet &&
+	test_path_is_missing .git/blame-cache
+'
+
+test_expect_success 'cache is not used for moves, copies, ignored revisions or ranges' '
+	rm -rf .git/blame-cache &&
+	git -c blame.cache=true blame -M HEAD -- renamed >/dev/null &&
+	git -c blame.cache=true blame -C HEAD -- renamed >/dev/null &&
+	git -c blame.cache=true blame --ignore-rev cached-base HEAD -- renamed >/dev/null &&
+	git -c blame.cache=true blame cached-base..HEAD -- renamed >/dev/null &&
+	git -c blame.cache=true blame --reverse cached-base..HEAD -- renamed >/dev/null &&
+	test_path_is_missing .git/blame-cache
+'
+
+test_done
@@ -1,5 +1,7 @@
 #include "unit-test.h"
+#include "hash-batch.h"
 #include "hex.h"
+#include "object-file.h"
 #include "strbuf.h"
 
 static void check_hash_data(const void *data, size_t data_length,
@@ -107,3 +109,41 @@ void test_hash__zero_tree_literal(void)
 		"4b825dc642cb6eb9a060e54bf8d69288fbee4904",
 		"6ef19b41225c5369f1c104d45d8d85efa9b057b53b14b4b9b939dd74decc5321");
 }
+
+void test_hash__batch(void)
+{
+	unsigned char data[256];
+
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = i * 7;
+
+	for (size_t i = 1; i < ARRAY_SIZE(hash_algos); i++) {
+		const struct git_hash_algo *algop = &hash_algos[i];
+		struct hash_batch *batch = hash_batch_new(algop, 1);
+		unsigned char hashes[200][GIT_MAX_RAWSZ];
+		struct object_id oids[200];
+
+		/* lengths around the block and padding boundaries */
+		for (size_t len = 0; len < ARRAY_SIZE(hashes); len++) {
+			hash_batch_add(batch, data + len % 7, len, hashes[len]);
+			hash_batch_add_object(batch, data, len, OBJ_BLOB, &oids[len]);
+		}
+		hash_batch_flush(batch);
+
+		for (size_t len = 0; len < ARRAY_SIZE(hashes); len++) {
+			struct git_hash_ctx ctx;
+			unsigned char hash[GIT_MAX_RAWSZ];
+			struct object_id oid;
+
+			algop->init_fn(&ctx);
+			git_hash_update(&ctx, data + len % 7, len);
+			git_hash_final(hash, &ctx);
+			cl_assert_equal_s(hash_to_hex_algop(hashes[len], algop),
+					  hash_to_hex_algop(hash, algop));
+
+			hash_object_file(algop, data, len, OBJ_BLOB, &oid);
+			cl_assert_equal_s(oid_to_hex(&oids[len]), oid_to_hex(&oid));
+		}
+		hash_batch_free(batch);
+	}
+}
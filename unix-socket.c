@@ -139,3 +139,130 @@ int unix_stream_listen(const char *path,
 	errno = saved_errno;
 	return -1;
 }
+
+int unix_stream_send_fds(int sock, const int *fds, int nr_fds,
+			 const void *buf, size_t len)
+{
+	struct msghdr msg = { 0 };
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char *control;
+	size_t control_len = CMSG_SPACE(sizeof(int) * nr_fds);
+	ssize_t ret;
+
+	if (!len) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	control = xcalloc(1, control_len);
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = control_len;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nr_fds);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nr_fds);
+
+	do {
+		ret = sendmsg(sock, &msg, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	free(control);
+	if (ret < 0)
+		return -1;
+	if (ret != len) {
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+int unix_stream_recv_fds(int sock, int *fds, int nr_fds,
+			 void *buf, size_t len)
+{
+	struct msghdr msg = { 0 };
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char *control;
+	size_t control_len = CMSG_SPACE(sizeof(int) * nr_fds);
+	ssize_t ret;
+	int received = 0;
+
+	control = xcalloc(1, control_len);
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = control_len;
+
+	do {
+		ret = recvmsg(sock, &msg, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0)
+		goto fail;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		int nr;
+
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		nr = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		if (received + nr > nr_fds) {
+			int *extra = xcalloc(nr, sizeof(int));
+			int i;
+
+			memcpy(extra, CMSG_DATA(cmsg), sizeof(int) * nr);
+			for (i = 0; i < nr; i++)
+				close(extra[i]);
+			free(extra);
+			continue;
+		}
+		memcpy(fds + received, CMSG_DATA(cmsg), sizeof(int) * nr);
+		received += nr;
+	}
+
+	if (received != nr_fds || (msg.msg_flags & MSG_CTRUNC)) {
+		while (received > 0)
+			close(fds[--received]);
+		errno = EPROTO;
+		goto fail;
+	}
+
+	free(control);
+	return ret;
+
+fail:
+	free(control);
+	return -1;
+}
+
+int unix_stream_peer_is_same_user(int sock)
+{
+#if defined(SO_PEERCRED)
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+		return 0;
+	return cred.uid == geteuid();
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || \
+      defined(__NetBSD__)
+	uid_t uid;
+	gid_t gid;
+
+	if (getpeereid(sock, &uid, &gid) < 0)
+		return 0;
+	return uid == geteuid();
+#else
+	return 0;
+#endif
+}
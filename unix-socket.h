@@ -12,4 +12,28 @@ int unix_stream_connect(const char *path, int disallow_chdir);
 int unix_stream_listen(const char *path,
 		       const struct unix_stream_listen_opts *opts);
 
+/*
+ * Send "nr_fds" file descriptors over the connected socket "sock",
+ * together with "len" (which must be non-zero) bytes of "buf".
+ * Returns 0 on success, -1 on error.
+ */
+int unix_stream_send_fds(int sock, const int *fds, int nr_fds,
+			 const void *buf, size_t len);
+
+/*
+ * Receive exactly "nr_fds" file descriptors sent by
+ * unix_stream_send_fds(), and up to "len" bytes of data into "buf".
+ * Returns the number of bytes read, or -1 on error (in which case no
+ * descriptors are left open).
+ */
+int unix_stream_recv_fds(int sock, int *fds, int nr_fds,
+			 void *buf, size_t len);
+
+/*
+ * Return 1 if the process at the other end of the connected socket
+ * "sock" runs as the same user as we do, and 0 if it does not or if the
+ * platform cannot tell.
+ */
+int unix_stream_peer_is_same_user(int sock);
+
 #endif /* UNIX_SOCKET_H */
@@ -428,7 +428,7 @@ static int check_updates(struct unpack_trees_options *o,
 	int errs = 0;
 	struct progress *progress;
 	struct checkout state = CHECKOUT_INIT;
-	int i, pc_workers, pc_threshold;
+	int i, pc_workers, pc_threshold, queued_up_to = 0;
 
 	trace_performance_enter();
 	state.super_prefix = o->super_prefix;
@@ -487,6 +487,9 @@ static int check_updates(struct unpack_trees_options *o,
 	for (i = 0; i < index->cache_nr; i++) {
 		struct cache_entry *ce = index->cache[i];
 
+		if (i >= queued_up_to)
+			queued_up_to = queue_checkout_filters(&state, i,
+							      must_checkout);
 		if (must_checkout(ce)) {
 			size_t last_pc_queue_size = pc_queue_size();
 